@@ -0,0 +1,20 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/descriptor_matcher/descriptor_matcher.cpp" "/root/repo/build/lib_descriptor_matcher/CMakeFiles/lib_descriptor_matcher.dir/descriptor_matcher.cpp.o" "gcc" "/root/repo/build/lib_descriptor_matcher/CMakeFiles/lib_descriptor_matcher.dir/descriptor_matcher.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/build/lib_feature_tracker_profiler/CMakeFiles/lib_feature_tracker_profiler.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/lib_descriptor_matcher.dir/descriptor_matcher.cpp.o"
+  "CMakeFiles/lib_descriptor_matcher.dir/descriptor_matcher.cpp.o.d"
+  "liblib_descriptor_matcher.a"
+  "liblib_descriptor_matcher.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/lib_descriptor_matcher.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,3 @@
+file(REMOVE_RECURSE
+  "liblib_descriptor_matcher.a"
+)
@@ -0,0 +1,23 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/direct_method_tracker/direct_method_tracker.cpp" "/root/repo/build/lib_direct_method_tracker/CMakeFiles/lib_direct_method_tracker.dir/direct_method_tracker.cpp.o" "gcc" "/root/repo/build/lib_direct_method_tracker/CMakeFiles/lib_direct_method_tracker.dir/direct_method_tracker.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/build/lib_feature_tracker_thread_pool/CMakeFiles/lib_feature_tracker_thread_pool.dir/DependInfo.cmake"
+  "/root/repo/build/lib_feature_tracker_gradient_pyramid/CMakeFiles/lib_feature_tracker_gradient_pyramid.dir/DependInfo.cmake"
+  "/root/repo/build/lib_feature_tracker_patch_pattern/CMakeFiles/lib_feature_tracker_patch_pattern.dir/DependInfo.cmake"
+  "/root/repo/build/lib_feature_tracker_profiler/CMakeFiles/lib_feature_tracker_profiler.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
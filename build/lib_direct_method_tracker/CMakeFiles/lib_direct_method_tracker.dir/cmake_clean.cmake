@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/lib_direct_method_tracker.dir/direct_method_tracker.cpp.o"
+  "CMakeFiles/lib_direct_method_tracker.dir/direct_method_tracker.cpp.o.d"
+  "liblib_direct_method_tracker.a"
+  "liblib_direct_method_tracker.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/lib_direct_method_tracker.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
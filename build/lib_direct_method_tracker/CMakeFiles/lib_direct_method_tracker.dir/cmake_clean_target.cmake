@@ -0,0 +1,3 @@
+file(REMOVE_RECURSE
+  "liblib_direct_method_tracker.a"
+)
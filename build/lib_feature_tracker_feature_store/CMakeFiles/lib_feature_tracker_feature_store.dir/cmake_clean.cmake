@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/lib_feature_tracker_feature_store.dir/feature_store.cpp.o"
+  "CMakeFiles/lib_feature_tracker_feature_store.dir/feature_store.cpp.o.d"
+  "liblib_feature_tracker_feature_store.a"
+  "liblib_feature_tracker_feature_store.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/lib_feature_tracker_feature_store.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,3 @@
+file(REMOVE_RECURSE
+  "liblib_feature_tracker_feature_store.a"
+)
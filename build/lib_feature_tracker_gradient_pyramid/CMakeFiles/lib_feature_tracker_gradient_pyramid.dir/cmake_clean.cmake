@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/lib_feature_tracker_gradient_pyramid.dir/gradient_pyramid.cpp.o"
+  "CMakeFiles/lib_feature_tracker_gradient_pyramid.dir/gradient_pyramid.cpp.o.d"
+  "liblib_feature_tracker_gradient_pyramid.a"
+  "liblib_feature_tracker_gradient_pyramid.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/lib_feature_tracker_gradient_pyramid.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
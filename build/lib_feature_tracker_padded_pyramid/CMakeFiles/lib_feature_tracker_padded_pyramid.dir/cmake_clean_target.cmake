@@ -0,0 +1,3 @@
+file(REMOVE_RECURSE
+  "liblib_feature_tracker_padded_pyramid.a"
+)
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/lib_feature_tracker_patch_pattern.dir/patch_pattern.cpp.o"
+  "CMakeFiles/lib_feature_tracker_patch_pattern.dir/patch_pattern.cpp.o.d"
+  "liblib_feature_tracker_patch_pattern.a"
+  "liblib_feature_tracker_patch_pattern.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/lib_feature_tracker_patch_pattern.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/lib_feature_tracker_profiler.dir/profiler.cpp.o"
+  "CMakeFiles/lib_feature_tracker_profiler.dir/profiler.cpp.o.d"
+  "liblib_feature_tracker_profiler.a"
+  "liblib_feature_tracker_profiler.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/lib_feature_tracker_profiler.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
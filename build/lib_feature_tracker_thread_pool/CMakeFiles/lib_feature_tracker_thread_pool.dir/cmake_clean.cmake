@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/lib_feature_tracker_thread_pool.dir/thread_pool.cpp.o"
+  "CMakeFiles/lib_feature_tracker_thread_pool.dir/thread_pool.cpp.o.d"
+  "liblib_feature_tracker_thread_pool.a"
+  "liblib_feature_tracker_thread_pool.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/lib_feature_tracker_thread_pool.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,39 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/optical_flow_tracker/affine_klt/optical_flow_affine_klt.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/affine_klt/optical_flow_affine_klt.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/affine_klt/optical_flow_affine_klt.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/affine_klt/optical_flow_affine_klt_fast.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/affine_klt/optical_flow_affine_klt_fast.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/affine_klt/optical_flow_affine_klt_fast.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/affine_klt/optical_flow_affine_klt_pattern.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/affine_klt/optical_flow_affine_klt_pattern.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/affine_klt/optical_flow_affine_klt_pattern.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/basic_klt/optical_flow_basic_klt.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/basic_klt/optical_flow_basic_klt_cached.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_cached.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_cached.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/basic_klt/optical_flow_basic_klt_fast.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_fast.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_fast.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/basic_klt/optical_flow_basic_klt_fixed.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_fixed.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_fixed.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/basic_klt/optical_flow_basic_klt_fixed_point.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_fixed_point.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_fixed_point.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/basic_klt/optical_flow_basic_klt_pattern.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_pattern.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_pattern.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/lssd_klt/optical_flow_lssd_klt.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/lssd_klt/optical_flow_lssd_klt.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/lssd_klt/optical_flow_lssd_klt.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/lssd_klt/optical_flow_lssd_klt_fast.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/lssd_klt/optical_flow_lssd_klt_fast.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/lssd_klt/optical_flow_lssd_klt_fast.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/lssd_klt/optical_flow_lssd_klt_pattern.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/lssd_klt/optical_flow_lssd_klt_pattern.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/lssd_klt/optical_flow_lssd_klt_pattern.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/optical_flow.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/optical_flow.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/optical_flow.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/optical_flow_async_tracker.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/optical_flow_async_tracker.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/optical_flow_async_tracker.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/optical_flow_sequence_tracker.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/optical_flow_sequence_tracker.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker.dir/optical_flow_sequence_tracker.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/build/lib_feature_tracker_gradient_pyramid/CMakeFiles/lib_feature_tracker_gradient_pyramid.dir/DependInfo.cmake"
+  "/root/repo/build/lib_feature_tracker_padded_pyramid/CMakeFiles/lib_feature_tracker_padded_pyramid.dir/DependInfo.cmake"
+  "/root/repo/build/lib_feature_tracker_thread_pool/CMakeFiles/lib_feature_tracker_thread_pool.dir/DependInfo.cmake"
+  "/root/repo/build/lib_feature_tracker_patch_pattern/CMakeFiles/lib_feature_tracker_patch_pattern.dir/DependInfo.cmake"
+  "/root/repo/build/lib_feature_tracker_feature_store/CMakeFiles/lib_feature_tracker_feature_store.dir/DependInfo.cmake"
+  "/root/repo/build/lib_feature_tracker_profiler/CMakeFiles/lib_feature_tracker_profiler.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
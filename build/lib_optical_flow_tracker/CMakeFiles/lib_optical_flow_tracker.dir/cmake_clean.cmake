@@ -0,0 +1,39 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/lib_optical_flow_tracker.dir/affine_klt/optical_flow_affine_klt.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker.dir/affine_klt/optical_flow_affine_klt.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker.dir/affine_klt/optical_flow_affine_klt_fast.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker.dir/affine_klt/optical_flow_affine_klt_fast.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker.dir/affine_klt/optical_flow_affine_klt_pattern.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker.dir/affine_klt/optical_flow_affine_klt_pattern.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_cached.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_cached.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_fast.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_fast.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_fixed.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_fixed.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_fixed_point.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_fixed_point.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_pattern.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker.dir/basic_klt/optical_flow_basic_klt_pattern.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker.dir/lssd_klt/optical_flow_lssd_klt.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker.dir/lssd_klt/optical_flow_lssd_klt.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker.dir/lssd_klt/optical_flow_lssd_klt_fast.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker.dir/lssd_klt/optical_flow_lssd_klt_fast.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker.dir/lssd_klt/optical_flow_lssd_klt_pattern.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker.dir/lssd_klt/optical_flow_lssd_klt_pattern.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker.dir/optical_flow.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker.dir/optical_flow.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker.dir/optical_flow_async_tracker.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker.dir/optical_flow_async_tracker.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker.dir/optical_flow_sequence_tracker.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker.dir/optical_flow_sequence_tracker.cpp.o.d"
+  "liblib_optical_flow_tracker.a"
+  "liblib_optical_flow_tracker.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/lib_optical_flow_tracker.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,3 @@
+file(REMOVE_RECURSE
+  "liblib_optical_flow_tracker.a"
+)
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/lib_optical_flow_tracker_sse_1.dir/affine_klt/optical_flow_affine_klt_sse.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker_sse_1.dir/affine_klt/optical_flow_affine_klt_sse.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker_sse_1.dir/basic_klt/optical_flow_basic_klt_sse.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker_sse_1.dir/basic_klt/optical_flow_basic_klt_sse.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker_sse_1.dir/lssd_klt/optical_flow_lssd_klt_sse.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker_sse_1.dir/lssd_klt/optical_flow_lssd_klt_sse.cpp.o.d"
+  "CMakeFiles/lib_optical_flow_tracker_sse_1.dir/optical_flow_sse.cpp.o"
+  "CMakeFiles/lib_optical_flow_tracker_sse_1.dir/optical_flow_sse.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/lib_optical_flow_tracker_sse_1.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
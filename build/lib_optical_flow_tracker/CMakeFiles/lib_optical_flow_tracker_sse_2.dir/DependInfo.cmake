@@ -0,0 +1,22 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/optical_flow_tracker/affine_klt/optical_flow_affine_klt_sse.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker_sse_2.dir/affine_klt/optical_flow_affine_klt_sse.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker_sse_2.dir/affine_klt/optical_flow_affine_klt_sse.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/basic_klt/optical_flow_basic_klt_sse.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker_sse_2.dir/basic_klt/optical_flow_basic_klt_sse.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker_sse_2.dir/basic_klt/optical_flow_basic_klt_sse.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/lssd_klt/optical_flow_lssd_klt_sse.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker_sse_2.dir/lssd_klt/optical_flow_lssd_klt_sse.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker_sse_2.dir/lssd_klt/optical_flow_lssd_klt_sse.cpp.o.d"
+  "/root/repo/src/optical_flow_tracker/optical_flow_sse.cpp" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker_sse_2.dir/optical_flow_sse.cpp.o" "gcc" "/root/repo/build/lib_optical_flow_tracker/CMakeFiles/lib_optical_flow_tracker_sse_2.dir/optical_flow_sse.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -5,6 +5,7 @@
 #include "slam_basic_math.h"
 #include "slam_operations.h"
 #include "feature_tracker.h"
+#include "profiler.h"
 
 namespace FEATURE_TRACKER {
 
@@ -62,6 +63,7 @@ private:
 
 private:
     DescriptorMatcherOptions options_;
+    std::vector<int32_t> index_pairs_in_cur_;
 
 };
 
@@ -71,6 +73,7 @@ bool DescriptorMatcher<DescriptorType>::ForceMatch(const std::vector<DescriptorT
                                                    const std::vector<DescriptorType> &descriptors_cur,
                                                    std::vector<int32_t> &index_pairs_in_cur) {
     RETURN_FALSE_IF(descriptors_cur.empty());
+    PROFILE_ZONE(kMatchDescriptors);
 
     if (descriptors_ref.size() != index_pairs_in_cur.size()) {
         index_pairs_in_cur.resize(descriptors_ref.size(), -1);
@@ -79,6 +82,7 @@ bool DescriptorMatcher<DescriptorType>::ForceMatch(const std::vector<DescriptorT
     // For each descriptor in ref, find best pair in cur.
     const int32_t max_i = descriptors_ref.size();
     const int32_t max_j = descriptors_cur.size();
+    PROFILE_COUNT(kDescriptorDistance, static_cast<uint64_t>(max_i) * max_j);
     for (int32_t i = 0; i < max_i; ++i) {
         float min_distance = options_.kMaxValidDescriptorDistance;
         for (int32_t j = 0; j < max_j; ++j) {
@@ -99,9 +103,10 @@ bool DescriptorMatcher<DescriptorType>::ForceMatch(const std::vector<DescriptorT
                                                    const std::vector<Vec2> &pixel_uv_cur,
                                                    std::vector<Vec2> &matched_pixel_uv_cur,
                                                    std::vector<uint8_t> &status) {
-    std::vector<int32_t> index_pairs_in_cur;
-    RETURN_FALSE_IF_FALSE(ForceMatch(descriptors_ref, descriptors_cur, index_pairs_in_cur));
-	return FillMatchedPixelByPairIndices(index_pairs_in_cur, pixel_uv_cur, matched_pixel_uv_cur, status);
+    // Reuse buffer of index pairs, so that matching does not allocate heap once it is large enough.
+    index_pairs_in_cur_.assign(descriptors_ref.size(), -1);
+    RETURN_FALSE_IF_FALSE(ForceMatch(descriptors_ref, descriptors_cur, index_pairs_in_cur_));
+    return FillMatchedPixelByPairIndices(index_pairs_in_cur_, pixel_uv_cur, matched_pixel_uv_cur, status);
 }
 
 template <typename DescriptorType>
@@ -113,6 +118,7 @@ bool DescriptorMatcher<DescriptorType>::NearbyMatch(const std::vector<Descriptor
     RETURN_FALSE_IF(descriptors_cur.empty());
     RETURN_FALSE_IF(descriptors_ref.size() != pixel_uv_pred_in_cur.size());
     RETURN_FALSE_IF(descriptors_cur.size() != pixel_uv_cur.size());
+    PROFILE_ZONE(kMatchDescriptors);
 
     if (descriptors_ref.size() != index_pairs_in_cur.size()) {
         index_pairs_in_cur.resize(descriptors_ref.size(), -1);
@@ -130,6 +136,7 @@ bool DescriptorMatcher<DescriptorType>::NearbyMatch(const std::vector<Descriptor
             }
 
             const float distance = ComputeDistance(descriptors_ref[i], descriptors_cur[j]);
+            PROFILE_COUNT(kDescriptorDistance, 1);
             if (distance < min_distance && distance < options_.kMaxValidDescriptorDistance) {
                 min_distance = distance;
                 index_pairs_in_cur[i] = j;
@@ -149,9 +156,10 @@ bool DescriptorMatcher<DescriptorType>::NearbyMatch(const std::vector<Descriptor
                                                     const std::vector<Vec2> &pixel_uv_cur,
                                                     std::vector<Vec2> &matched_pixel_uv_cur,
                                                     std::vector<uint8_t> &status) {
-    std::vector<int32_t> index_pairs_in_cur;
-    RETURN_FALSE_IF_FALSE(NearbyMatch(descriptors_ref, descriptors_cur, pixel_uv_pred_in_cur, pixel_uv_cur, index_pairs_in_cur));
-	return FillMatchedPixelByPairIndices(index_pairs_in_cur, pixel_uv_cur, matched_pixel_uv_cur, status);
+    // Reuse buffer of index pairs, so that matching does not allocate heap once it is large enough.
+    index_pairs_in_cur_.assign(descriptors_ref.size(), -1);
+    RETURN_FALSE_IF_FALSE(NearbyMatch(descriptors_ref, descriptors_cur, pixel_uv_pred_in_cur, pixel_uv_cur, index_pairs_in_cur_));
+    return FillMatchedPixelByPairIndices(index_pairs_in_cur_, pixel_uv_cur, matched_pixel_uv_cur, status);
 }
 
 template <typename DescriptorType>
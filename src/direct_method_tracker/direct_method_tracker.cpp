@@ -2,6 +2,9 @@
 #include "camera_basic.h"
 #include "slam_operations.h"
 #include "slam_log_reporter.h"
+#include "profiler.h"
+
+#include <algorithm>
 
 namespace FEATURE_TRACKER {
 
@@ -51,6 +54,8 @@ bool DirectMethod::TrackFeatures(const ImagePyramid &ref_pyramid,
                                       std::vector<uint8_t> &status) {
     RETURN_FALSE_IF(ref_pixel_uv.empty());
     RETURN_FALSE_IF(cur_pyramid.level() != ref_pyramid.level());
+    PROFILE_ZONE(kTrackFeatures);
+    PROFILE_COUNT(kFeaturesToTrack, ref_pixel_uv.size() < options().kMaxTrackPointsNumber ? ref_pixel_uv.size() : options().kMaxTrackPointsNumber);
 
     // If sizeof ref_pixel_uv is not equal to cur_pixel_uv, view it as no prediction.
     if (ref_pixel_uv.size() != cur_pixel_uv.size()) {
@@ -66,6 +71,18 @@ bool DirectMethod::TrackFeatures(const ImagePyramid &ref_pyramid,
     }
     std::array<float, 4> scaled_K = { K[0] / scale, K[1] / scale, K[2] / scale, K[3] / scale };
 
+    // Prepare sampling points of patch. Invalid parameters of sparse pattern fall back to full patch.
+    if (!patch_pattern_.CreatePatchPattern(options_.kPatchPattern, options_.kPatchRowHalfSize, options_.kPatchColHalfSize,
+        options_.kPatchPatternStride, options_.kPatchPatternPoints)) {
+        patch_pattern_.CreatePatchPattern(PatchPatternType::kFull, options_.kPatchRowHalfSize, options_.kPatchColHalfSize);
+    }
+
+    // Prepare thread pool.
+    const uint32_t num_threads = std::max(options_.kNumThreads, static_cast<uint32_t>(1));
+    if (thread_pool_ == nullptr || thread_pool_->num_threads() != num_threads) {
+        thread_pool_ = std::make_unique<ThreadPool>(num_threads);
+    }
+
     // Track per level.
     for (int32_t level_idx = ref_pyramid.level() - 1; level_idx > -1; --level_idx) {
         const GrayImage &ref_image = ref_pyramid.GetImageConst(level_idx);
@@ -148,16 +165,28 @@ bool DirectMethod::TrackAllFeaturesDirect(const GrayImage &ref_image,
     // Construct camera model with K.
     SENSOR_MODEL::CameraBasic camera(K[0], K[1], K[2], K[3]);
 
+    // Sample gradient of current image from gradient pyramid if it is given.
+    const GradientImage *cur_gradient_image = cur_gradient_pyramid_ == nullptr ? nullptr : cur_gradient_pyramid_->FindGradientImage(cur_image);
+
     // Iterate to estimate q_rc and p_rc.
     for (uint32_t iter = 0; iter < options_.kMaxIteration; ++iter) {
         // Prepare for constructing incremental function.
         Mat6 H = Mat6::Zero();
         Vec6 b = Vec6::Zero();
 
-        // Use all features to construct incremental function.
+        // Use all features to construct incremental function. Each feature has its own H and b.
         const uint32_t max_feature_id = ref_pixel_uv.size() < options().kMaxTrackPointsNumber ? ref_pixel_uv.size() : options().kMaxTrackPointsNumber;
-        for (uint32_t i = 0; i < max_feature_id; ++i) {
-            CONTINUE_IF(p_c_in_ref[i].z() < kZerofloat);
+        H_of_features_.resize(max_feature_id);
+        b_of_features_.resize(max_feature_id);
+        thread_pool_->ParallelFor(max_feature_id, [&] (uint32_t i, uint32_t worker_id) {
+            PROFILE_ZONE(kComputeBias);
+            Mat6 &H_i = H_of_features_[i];
+            Vec6 &b_i = b_of_features_[i];
+            H_i.setZero();
+            b_i.setZero();
+            if (p_c_in_ref[i].z() < kZerofloat) {
+                return;
+            }
 
             const float p_r_x = p_c_in_ref[i].x();
             const float p_r_y = p_c_in_ref[i].y();
@@ -169,7 +198,9 @@ bool DirectMethod::TrackAllFeaturesDirect(const GrayImage &ref_image,
 
             // Project points to current frame.
             const Vec3 p_c_in_cur = q_rc.inverse() * (p_c_in_ref[i] - p_rc);
-            CONTINUE_IF(p_c_in_cur.z() < kZerofloat);
+            if (p_c_in_cur.z() < kZerofloat) {
+                return;
+            }
 
             const Vec2 cur_norm_xy = (p_c_in_cur / p_c_in_cur.z()).head<2>();
             camera.LiftFromNormalizedPlaneToImagePlane(cur_norm_xy, cur_pixel_uv[i]);
@@ -189,36 +220,53 @@ bool DirectMethod::TrackAllFeaturesDirect(const GrayImage &ref_image,
                                  fy * p_r_x * p_r_y * p_r_z2_inv,
                                  fy * p_r_x * p_r_z_inv;
 
-            // Compute image gradient with all pixel in the patch, create H * v = b
+            // Compute image gradient with all points of pattern in the patch, create H * v = b
             std::array<float, 6> temp_value;
-            for (int32_t drow = - options().kPatchRowHalfSize; drow <= options().kPatchRowHalfSize; ++drow) {
-                for (int32_t dcol = - options().kPatchColHalfSize; dcol <= options().kPatchColHalfSize; ++dcol) {
-                    const float row_i = static_cast<float>(drow) + ref_pixel_uv[i].y();
-                    const float col_i = static_cast<float>(dcol) + ref_pixel_uv[i].x();
-                    const float row_j = static_cast<float>(drow) + cur_pixel_uv[i].y();
-                    const float col_j = static_cast<float>(dcol) + cur_pixel_uv[i].x();
-                    // Compute pixel gradient
-                    if (cur_image.GetPixelValue(row_j, col_j - 1.0f, &temp_value[0]) &&
-                        cur_image.GetPixelValue(row_j, col_j + 1.0f, &temp_value[1]) &&
-                        cur_image.GetPixelValue(row_j - 1.0f, col_j, &temp_value[2]) &&
-                        cur_image.GetPixelValue(row_j + 1.0f, col_j, &temp_value[3]) &&
-                        ref_image.GetPixelValue(row_i, col_i, &temp_value[4]) &&
-                        cur_image.GetPixelValue(row_j, col_j, &temp_value[5])) {
-
-                        const Vec2 jacobian_image_pixel = Vec2(temp_value[1] - temp_value[0], temp_value[3] - temp_value[2]) * 0.5f;
-                        const float residual = temp_value[5] - temp_value[4];
-
-                        // Construct full jacobian. Then use it to construct incremental function.
-                        const Vec6 jacobian = (jacobian_image_pixel.transpose() * jacobian_pixel_xi).transpose();
-                        H += jacobian * jacobian.transpose();
-                        b += residual * jacobian;
-                    }
+            for (const PatchPatternPoint &point : patch_pattern_.points()) {
+                const float row_i = static_cast<float>(point.drow) + ref_pixel_uv[i].y();
+                const float col_i = static_cast<float>(point.dcol) + ref_pixel_uv[i].x();
+                const float row_j = static_cast<float>(point.drow) + cur_pixel_uv[i].y();
+                const float col_j = static_cast<float>(point.dcol) + cur_pixel_uv[i].x();
+                // Compute pixel gradient
+                float grad_x = 0.0f;
+                float grad_y = 0.0f;
+                bool is_gradient_valid = false;
+                if (cur_gradient_image != nullptr) {
+                    is_gradient_valid = cur_gradient_image->GetGradient(row_j, col_j, grad_x, grad_y);
+                } else if (cur_image.GetPixelValue(row_j, col_j - 1.0f, &temp_value[0]) &&
+                           cur_image.GetPixelValue(row_j, col_j + 1.0f, &temp_value[1]) &&
+                           cur_image.GetPixelValue(row_j - 1.0f, col_j, &temp_value[2]) &&
+                           cur_image.GetPixelValue(row_j + 1.0f, col_j, &temp_value[3])) {
+                    grad_x = temp_value[1] - temp_value[0];
+                    grad_y = temp_value[3] - temp_value[2];
+                    is_gradient_valid = true;
+                }
+
+                if (is_gradient_valid &&
+                    ref_image.GetPixelValue(row_i, col_i, &temp_value[4]) &&
+                    cur_image.GetPixelValue(row_j, col_j, &temp_value[5])) {
+
+                    const Vec2 jacobian_image_pixel = Vec2(grad_x, grad_y) * 0.5f;
+                    const float residual = temp_value[5] - temp_value[4];
+
+                    // Construct full jacobian. Then use it to construct incremental function.
+                    const Vec6 jacobian = (jacobian_image_pixel.transpose() * jacobian_pixel_xi).transpose();
+                    H_i += jacobian * jacobian.transpose();
+                    b_i += residual * jacobian;
                 }
             }
+        }, options_.kThreadSchedule, options_.kThreadChunkSize);
+        for (uint32_t i = 0; i < max_feature_id; ++i) {
+            H += H_of_features_[i];
+            b += b_of_features_[i];
         }
 
         // Solve incremental function.
-        Vec6 dx = H.ldlt().solve(b);
+        Vec6 dx = Vec6::Zero();
+        {
+            PROFILE_ZONE(kSolve);
+            dx = H.ldlt().solve(b);
+        }
         BREAK_IF(Eigen::isnan(dx.array()).any());
 
         // Update current frame pose.
@@ -6,6 +6,9 @@
 #include "datatype_image_pyramid.h"
 #include "slam_basic_math.h"
 #include "feature_tracker.h"
+#include "thread_pool.h"
+#include "gradient_pyramid.h"
+#include "patch_pattern.h"
 
 #include "memory"
 
@@ -25,6 +28,12 @@ struct DirectMethodOptions {
     float kMaxConvergeStep = 1e-6f;
     float kMaxConvergeResidual = 2.0f;
     DirectMethodMethod kMethod = kDirect;
+    PatchPatternType kPatchPattern = PatchPatternType::kFull;
+    int32_t kPatchPatternStride = 3;    // Spacing of points in diamond and checkerboard pattern.
+    std::vector<PatchPatternPoint> kPatchPatternPoints;    // Offsets of points in custom pattern.
+    uint32_t kNumThreads = 1;
+    ThreadPoolSchedule kThreadSchedule = ThreadPoolSchedule::kWorkStealing;
+    uint32_t kThreadChunkSize = 8;
 };
 
 class DirectMethod {
@@ -58,9 +67,12 @@ public:
 
     // Reference for member variables.
     DirectMethodOptions &options() { return options_; }
+    const GradientPyramid *&cur_gradient_pyramid() { return cur_gradient_pyramid_; }
 
     // Const reference for member variables.
     const DirectMethodOptions &options() const { return options_; }
+    const GradientPyramid *cur_gradient_pyramid() const { return cur_gradient_pyramid_; }
+    const PatchPattern &patch_pattern() const { return patch_pattern_; }
 
 private:
     virtual bool TrackSingleLevel(const GrayImage &ref_image,
@@ -111,6 +123,19 @@ private:
     // Current frame pose in reference frame.
     Quat q_rc_ = Quat::Identity();
     Vec3 p_rc_ = Vec3::Zero();
+
+    // Incremental function of each feature. They are summed in order, so result does not depend on threads.
+    std::vector<Mat6> H_of_features_ = {};
+    std::vector<Vec6> b_of_features_ = {};
+
+    // Gradient pyramid of current image given by user. It is not owned by tracker.
+    const GradientPyramid *cur_gradient_pyramid_ = nullptr;
+
+    // Sampling points of patch, created from options.
+    PatchPattern patch_pattern_;
+
+    // Thread pool for constructing incremental function in parallel.
+    std::unique_ptr<ThreadPool> thread_pool_ = nullptr;
 };
 
 }
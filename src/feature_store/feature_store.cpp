@@ -0,0 +1,89 @@
+#include "feature_store.h"
+#include "slam_operations.h"
+
+namespace FEATURE_TRACKER {
+
+void FeatureStore::Reserve(uint32_t capacity) {
+    u_.reserve(capacity);
+    v_.reserve(capacity);
+    status_.reserve(capacity);
+    id_.reserve(capacity);
+    age_.reserve(capacity);
+}
+
+void FeatureStore::Clear() {
+    u_.clear();
+    v_.clear();
+    status_.clear();
+    id_.clear();
+    age_.clear();
+}
+
+void FeatureStore::Append(const std::vector<Vec2> &pixel_uv) {
+    const uint32_t num_features = static_cast<uint32_t>(pixel_uv.size());
+    const uint32_t offset = size();
+    u_.resize(offset + num_features);
+    v_.resize(offset + num_features);
+    for (uint32_t i = 0; i < num_features; ++i) {
+        u_[offset + i] = pixel_uv[i].x();
+        v_[offset + i] = pixel_uv[i].y();
+    }
+
+    status_.resize(offset + num_features, static_cast<uint8_t>(TrackStatus::kNotTracked));
+    age_.resize(offset + num_features, 0);
+    id_.resize(offset + num_features);
+    for (uint32_t i = offset; i < offset + num_features; ++i) {
+        id_[i] = next_id_++;
+    }
+}
+
+void FeatureStore::Append(const float *u, const float *v, uint32_t num_features) {
+    const uint32_t offset = size();
+    u_.insert(u_.end(), u, u + num_features);
+    v_.insert(v_.end(), v, v + num_features);
+
+    status_.resize(offset + num_features, static_cast<uint8_t>(TrackStatus::kNotTracked));
+    age_.resize(offset + num_features, 0);
+    id_.resize(offset + num_features);
+    for (uint32_t i = offset; i < offset + num_features; ++i) {
+        id_[i] = next_id_++;
+    }
+}
+
+bool FeatureStore::Remove(uint32_t index) {
+    RETURN_FALSE_IF(index >= size());
+    const uint32_t last = size() - 1;
+    if (index != last) {
+        u_[index] = u_[last];
+        v_[index] = v_[last];
+        status_[index] = status_[last];
+        id_[index] = id_[last];
+        age_[index] = age_[last];
+    }
+
+    u_.pop_back();
+    v_.pop_back();
+    status_.pop_back();
+    id_.pop_back();
+    age_.pop_back();
+    return true;
+}
+
+uint32_t FeatureStore::RemoveLostFeatures() {
+    // Features not tracked yet, such as new appended ones or skipped by budget, are kept. Features moved from the back
+    // have not been checked, so do not step forward after removing.
+    uint32_t num_removed = 0;
+    uint32_t index = 0;
+    while (index < size()) {
+        if (status_[index] > static_cast<uint8_t>(TrackStatus::kTracked)) {
+            Remove(index);
+            ++num_removed;
+        } else {
+            ++index;
+        }
+    }
+
+    return num_removed;
+}
+
+}
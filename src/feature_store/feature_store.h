@@ -0,0 +1,93 @@
+#ifndef _FEATURE_TRACKER_FEATURE_STORE_H_
+#define _FEATURE_TRACKER_FEATURE_STORE_H_
+
+#include "basic_type.h"
+#include "feature_tracker.h"
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace FEATURE_TRACKER {
+
+/* Aligned Allocator Declaration. */
+// Allocate memory aligned to kAlignment bytes, so that arrays can be loaded into vector lanes directly.
+template <typename T, std::size_t kAlignment = 32>
+struct AlignedAllocator {
+    using value_type = T;
+    template <typename U> struct rebind { using other = AlignedAllocator<U, kAlignment>; };
+
+    AlignedAllocator() = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, kAlignment> &) {}
+
+    T *allocate(std::size_t size) {
+        return static_cast<T *>(::operator new(size * sizeof(T), std::align_val_t(kAlignment)));
+    }
+    void deallocate(T *ptr, std::size_t) {
+        ::operator delete(ptr, std::align_val_t(kAlignment));
+    }
+
+    template <typename U> bool operator==(const AlignedAllocator<U, kAlignment> &) const { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U, kAlignment> &) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+/* Class Feature Store Declaration. */
+// Structure of arrays of tracked features. Each feature has pixel position u/v in the latest frame, track status,
+// a unique id and its age, which is the number of frames it has been tracked. Order of features is not stable,
+// because lost features are removed by swapping them with the last one.
+class FeatureStore {
+
+public:
+    FeatureStore() = default;
+    virtual ~FeatureStore() = default;
+
+    // Reserve memory for features, so that no reallocation happens until this number of features is reached.
+    void Reserve(uint32_t capacity);
+    void Clear();
+
+    // Append new detected features. They get new ids, zero age and kNotTracked status.
+    void Append(const std::vector<Vec2> &pixel_uv);
+    void Append(const float *u, const float *v, uint32_t num_features);
+
+    // Remove one feature by moving the last one into its slot, so the last feature changes its index.
+    // Return false if index is out of range.
+    bool Remove(uint32_t index);
+    // Remove all features which failed to be tracked, whose status is after kTracked, and return number of removed
+    // features. Features with kNotTracked status are kept, because they are new appended or skipped by budget.
+    uint32_t RemoveLostFeatures();
+
+    uint32_t size() const { return static_cast<uint32_t>(u_.size()); }
+    bool empty() const { return u_.empty(); }
+    Vec2 pixel_uv(uint32_t index) const { return Vec2(u_[index], v_[index]); }
+
+    // Reference for member variables.
+    AlignedVector<float> &u() { return u_; }
+    AlignedVector<float> &v() { return v_; }
+    AlignedVector<uint8_t> &status() { return status_; }
+    AlignedVector<uint32_t> &id() { return id_; }
+    AlignedVector<uint32_t> &age() { return age_; }
+
+    // Const reference for member variables.
+    const AlignedVector<float> &u() const { return u_; }
+    const AlignedVector<float> &v() const { return v_; }
+    const AlignedVector<uint8_t> &status() const { return status_; }
+    const AlignedVector<uint32_t> &id() const { return id_; }
+    const AlignedVector<uint32_t> &age() const { return age_; }
+    const uint32_t &next_id() const { return next_id_; }
+
+private:
+    AlignedVector<float> u_;
+    AlignedVector<float> v_;
+    AlignedVector<uint8_t> status_;
+    AlignedVector<uint32_t> id_;
+    AlignedVector<uint32_t> age_;
+    uint32_t next_id_ = 0;
+
+};
+
+}
+
+#endif // end of _FEATURE_TRACKER_FEATURE_STORE_H_
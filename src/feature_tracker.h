@@ -11,6 +11,7 @@ enum class TrackStatus : uint8_t {
     kLargeResidual = 2,
     kOutside = 3,
     kNumericError = 4,
+    kInconsistent = 5,    // Tracked forward, but tracking it backward does not return to reference.
 };
 
 }
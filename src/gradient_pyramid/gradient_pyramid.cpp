@@ -0,0 +1,156 @@
+#include "gradient_pyramid.h"
+#include "slam_operations.h"
+#include "profiler.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace FEATURE_TRACKER {
+
+void GradientImage::CreateGradientImage(const GrayImage &image, ThreadPool *thread_pool) {
+    source_data_ = image.data();
+    rows_ = image.rows();
+    cols_ = image.cols();
+    dx_.resize(rows_ * cols_);
+    dy_.resize(rows_ * cols_);
+
+    if (thread_pool == nullptr) {
+        for (int32_t row = 0; row < rows_; ++row) {
+            ComputeGradientInRow(source_data_, row);
+        }
+    } else {
+        thread_pool->ParallelFor(rows_, [&] (uint32_t row, uint32_t worker_id) {
+            ComputeGradientInRow(source_data_, row);
+        });
+    }
+}
+
+void GradientImage::ComputeGradientInRow(const uint8_t *image_data, int32_t row) {
+    int16_t *dx_row = dx_.data() + row * cols_;
+    int16_t *dy_row = dy_.data() + row * cols_;
+
+    // Gradient of pixels on border is zero.
+    if (row == 0 || row == rows_ - 1 || cols_ < 3) {
+        std::fill_n(dx_row, cols_, 0);
+        std::fill_n(dy_row, cols_, 0);
+        return;
+    }
+    dx_row[0] = dy_row[0] = 0;
+    dx_row[cols_ - 1] = dy_row[cols_ - 1] = 0;
+
+    const uint8_t *center = image_data + row * cols_;
+    const uint8_t *top = center - cols_;
+    const uint8_t *bottom = center + cols_;
+    int32_t col = 1;
+
+#if defined(__SSE2__)
+    // Process 8 pixels at once. Pixels are widened into int16 before subtraction.
+    const __m128i zero = _mm_setzero_si128();
+    for (; col + 8 < cols_; col += 8) {
+        const __m128i left = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(center + col - 1)), zero);
+        const __m128i right = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(center + col + 1)), zero);
+        const __m128i up = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(top + col)), zero);
+        const __m128i down = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(bottom + col)), zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dx_row + col), _mm_sub_epi16(right, left));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dy_row + col), _mm_sub_epi16(down, up));
+    }
+#endif
+
+    for (; col < cols_ - 1; ++col) {
+        dx_row[col] = static_cast<int16_t>(center[col + 1]) - static_cast<int16_t>(center[col - 1]);
+        dy_row[col] = static_cast<int16_t>(bottom[col]) - static_cast<int16_t>(top[col]);
+    }
+}
+
+bool GradientImage::GetGradient(float row, float col, float &dx, float &dy) const {
+    const float int_pixel_row = std::floor(row);
+    const float int_pixel_col = std::floor(col);
+    const int32_t top = static_cast<int32_t>(int_pixel_row);
+    const int32_t left = static_cast<int32_t>(int_pixel_col);
+    if (top < 1 || top + 1 > rows_ - 2 || left < 1 || left + 1 > cols_ - 2) {
+        return false;
+    }
+
+    // Compute the weight for linear interpolar.
+    const float dec_pixel_row = row - int_pixel_row;
+    const float dec_pixel_col = col - int_pixel_col;
+    const float w_top_left = (1.0f - dec_pixel_row) * (1.0f - dec_pixel_col);
+    const float w_top_right = (1.0f - dec_pixel_row) * dec_pixel_col;
+    const float w_bottom_left = dec_pixel_row * (1.0f - dec_pixel_col);
+    const float w_bottom_right = dec_pixel_row * dec_pixel_col;
+
+    const int32_t index = top * cols_ + left;
+    dx = w_top_left * static_cast<float>(dx_[index]) + w_top_right * static_cast<float>(dx_[index + 1]) +
+         w_bottom_left * static_cast<float>(dx_[index + cols_]) + w_bottom_right * static_cast<float>(dx_[index + cols_ + 1]);
+    dy = w_top_left * static_cast<float>(dy_[index]) + w_top_right * static_cast<float>(dy_[index + 1]) +
+         w_bottom_left * static_cast<float>(dy_[index + cols_]) + w_bottom_right * static_cast<float>(dy_[index + cols_ + 1]);
+    return true;
+}
+
+bool GradientImage::GetGradientPatch(const Vec2 &pixel_uv, int32_t patch_rows, int32_t patch_cols, float *all_dx, float *all_dy) const {
+    const float int_pixel_row = std::floor(pixel_uv.y());
+    const float int_pixel_col = std::floor(pixel_uv.x());
+    const int32_t min_pixel_row = static_cast<int32_t>(int_pixel_row) - patch_rows / 2;
+    const int32_t min_pixel_col = static_cast<int32_t>(int_pixel_col) - patch_cols / 2;
+    const int32_t max_pixel_row = min_pixel_row + patch_rows;
+    const int32_t max_pixel_col = min_pixel_col + patch_cols;
+    if (min_pixel_row < 1 || max_pixel_row > rows_ - 2 || min_pixel_col < 1 || max_pixel_col > cols_ - 2) {
+        return false;
+    }
+
+    // Compute the weight for linear interpolar.
+    const float dec_pixel_row = pixel_uv.y() - int_pixel_row;
+    const float dec_pixel_col = pixel_uv.x() - int_pixel_col;
+    const float w_top_left = (1.0f - dec_pixel_row) * (1.0f - dec_pixel_col);
+    const float w_top_right = (1.0f - dec_pixel_row) * dec_pixel_col;
+    const float w_bottom_left = dec_pixel_row * (1.0f - dec_pixel_col);
+    const float w_bottom_right = dec_pixel_row * dec_pixel_col;
+
+    for (int32_t row = 0; row < patch_rows; ++row) {
+        const int32_t index = (row + min_pixel_row) * cols_ + min_pixel_col;
+        const int16_t *dx_top = dx_.data() + index;
+        const int16_t *dx_bottom = dx_top + cols_;
+        const int16_t *dy_top = dy_.data() + index;
+        const int16_t *dy_bottom = dy_top + cols_;
+        float *dx_row = all_dx + row * patch_cols;
+        float *dy_row = all_dy + row * patch_cols;
+        for (int32_t col = 0; col < patch_cols; ++col) {
+            dx_row[col] = w_top_left * static_cast<float>(dx_top[col]) + w_top_right * static_cast<float>(dx_top[col + 1]) +
+                          w_bottom_left * static_cast<float>(dx_bottom[col]) + w_bottom_right * static_cast<float>(dx_bottom[col + 1]);
+            dy_row[col] = w_top_left * static_cast<float>(dy_top[col]) + w_top_right * static_cast<float>(dy_top[col + 1]) +
+                          w_bottom_left * static_cast<float>(dy_bottom[col]) + w_bottom_right * static_cast<float>(dy_bottom[col + 1]);
+        }
+    }
+
+    return true;
+}
+
+bool GradientPyramid::CreateGradientPyramid(const ImagePyramid &image_pyramid, ThreadPool *thread_pool) {
+    RETURN_FALSE_IF(image_pyramid.level() == 0);
+    PROFILE_ZONE(kBuildPyramid);
+
+    level_ = image_pyramid.level();
+    if (images_.size() < level_) {
+        images_.resize(level_);
+    }
+    for (uint32_t level_idx = 0; level_idx < level_; ++level_idx) {
+        images_[level_idx].CreateGradientImage(image_pyramid.GetImageConst(level_idx), thread_pool);
+    }
+
+    return true;
+}
+
+const GradientImage *GradientPyramid::FindGradientImage(const GrayImage &image) const {
+    for (uint32_t level_idx = 0; level_idx < level_; ++level_idx) {
+        if (images_[level_idx].IsCreatedFrom(image)) {
+            return &images_[level_idx];
+        }
+    }
+    return nullptr;
+}
+
+}
@@ -0,0 +1,81 @@
+#ifndef _FEATURE_TRACKER_GRADIENT_PYRAMID_H_
+#define _FEATURE_TRACKER_GRADIENT_PYRAMID_H_
+
+#include "basic_type.h"
+#include "datatype_image.h"
+#include "datatype_image_pyramid.h"
+#include "thread_pool.h"
+
+#include <vector>
+
+namespace FEATURE_TRACKER {
+
+/* Class Gradient Image Declaration. */
+// Central difference I(x + 1) - I(x - 1) and I(y + 1) - I(y - 1) of one image, stored in int16.
+// Gradient of pixels on border of image is zero.
+class GradientImage {
+
+public:
+    GradientImage() = default;
+    virtual ~GradientImage() = default;
+
+    // Compute gradient of image. Rows are split across workers of thread pool if it is given.
+    void CreateGradientImage(const GrayImage &image, ThreadPool *thread_pool = nullptr);
+
+    // Bilinear interpolate gradient at sub-pixel position. Return false if interpolation touches border of image.
+    bool GetGradient(float row, float col, float &dx, float &dy) const;
+
+    // Bilinear interpolate gradient of a patch whose center is pixel_uv, with the same sampling position as patch
+    // extracted for tracking. Return false if any pixel of this patch touches border of image.
+    bool GetGradientPatch(const Vec2 &pixel_uv, int32_t patch_rows, int32_t patch_cols, float *all_dx, float *all_dy) const;
+
+    // Check if this gradient image is computed from the given image.
+    bool IsCreatedFrom(const GrayImage &image) const {
+        return source_data_ == image.data() && rows_ == image.rows() && cols_ == image.cols();
+    }
+
+    // Const reference for member variables.
+    const int32_t &rows() const { return rows_; }
+    const int32_t &cols() const { return cols_; }
+    const std::vector<int16_t> &dx() const { return dx_; }
+    const std::vector<int16_t> &dy() const { return dy_; }
+
+private:
+    void ComputeGradientInRow(const uint8_t *image_data, int32_t row);
+
+private:
+    const uint8_t *source_data_ = nullptr;
+    int32_t rows_ = 0;
+    int32_t cols_ = 0;
+    std::vector<int16_t> dx_;
+    std::vector<int16_t> dy_;
+
+};
+
+/* Class Gradient Pyramid Declaration. */
+// Gradient of each level of an image pyramid. It is built once per frame, and can be shared by all trackers that
+// work on this pyramid. Buffers are kept between frames, so swapping two gradient pyramids together with their image
+// pyramids lets gradient of current frame be reused as reference in next frame without recomputation.
+class GradientPyramid {
+
+public:
+    GradientPyramid() = default;
+    virtual ~GradientPyramid() = default;
+
+    bool CreateGradientPyramid(const ImagePyramid &image_pyramid, ThreadPool *thread_pool = nullptr);
+
+    // Find the level which is computed from the given image. Return nullptr if there is no such level.
+    const GradientImage *FindGradientImage(const GrayImage &image) const;
+
+    uint32_t level() const { return level_; }
+    const GradientImage &GetGradientImage(uint32_t level) const { return images_[level]; }
+
+private:
+    uint32_t level_ = 0;
+    std::vector<GradientImage> images_;
+
+};
+
+}
+
+#endif // end of _FEATURE_TRACKER_GRADIENT_PYRAMID_H_
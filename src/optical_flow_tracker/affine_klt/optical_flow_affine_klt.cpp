@@ -3,99 +3,120 @@
 
 namespace FEATURE_TRACKER {
 
-bool OpticalFlowAffineKlt::TrackMultipleLevel(const ImagePyramid &ref_pyramid,
-                                              const ImagePyramid &cur_pyramid,
-                                              const std::vector<Vec2> &ref_pixel_uv,
-                                              std::vector<Vec2> &cur_pixel_uv,
-                                              std::vector<uint8_t> &status) {
-    const uint32_t max_feature_id = ref_pixel_uv.size() < options().kMaxTrackPointsNumber ?
-                                    ref_pixel_uv.size() : options().kMaxTrackPointsNumber;
-    const float scale = static_cast<float>(1 << (ref_pyramid.level() - 1));
-
-    // Track each pixel per level.
-    for (uint32_t feature_id = 0; feature_id < max_feature_id; ++feature_id) {
-        // Do not repeatly track features that has been tracking failed.
-        CONTINUE_IF(status[feature_id] > static_cast<uint8_t>(TrackStatus::kTracked));
-
-        // Recorder scaled ref_pixel_uv and cur_pixel_uv.
-        Vec2 scaled_ref_pixel_uv = ref_pixel_uv[feature_id] / scale;
-        Vec2 scaled_cur_pixel_uv = cur_pixel_uv[feature_id] / scale;
-
-        // Define affine transform matrix.
-        Mat2 affine = Mat2::Identity();
-
-        for (int32_t level_idx = ref_pyramid.level() - 1; level_idx > -1; --level_idx) {
-            const GrayImage &ref_image = ref_pyramid.GetImageConst(level_idx);
-            const GrayImage &cur_image = cur_pyramid.GetImageConst(level_idx);
-
-            // Track this feature in one pyramid level.
-            switch (options().kMethod) {
-                case OpticalFlowMethod::kInverse:
-                case OpticalFlowMethod::kDirect:
-                    TrackOneFeature(ref_image, cur_image, scaled_ref_pixel_uv, scaled_cur_pixel_uv, affine, status[feature_id]);
-                    break;
-                case OpticalFlowMethod::kFast:
-                default:
-                    TrackOneFeatureFast(ref_image, cur_image, scaled_ref_pixel_uv, scaled_cur_pixel_uv, affine, status[feature_id]);
-                    break;
-            }
+void OpticalFlowAffineKlt::TrackOneFeatureInMultipleLevel(const ImagePyramid &ref_pyramid,
+                                                          const ImagePyramid &cur_pyramid,
+                                                          const Vec2 &ref_pixel_uv,
+                                                          Vec2 &cur_pixel_uv,
+                                                          uint8_t &status,
+                                                          const FeatureTrackingContext &context,
+                                                          TrackingScratch &scratch) const {
+    // Do not repeatly track features that has been tracking failed.
+    if (status > static_cast<uint8_t>(TrackStatus::kTracked)) {
+        return;
+    }
 
-            // If feature is tracked in final level, recovery its scale.
-            if (!level_idx) {
-                cur_pixel_uv[feature_id] = scaled_cur_pixel_uv;
-                break;
-            }
+    // Recorder scaled ref_pixel_uv and cur_pixel_uv in the start level of this feature.
+    const float scale = static_cast<float>(1 << context.start_level);
+    Vec2 scaled_ref_pixel_uv = ref_pixel_uv / scale;
+    Vec2 scaled_cur_pixel_uv = cur_pixel_uv / scale;
 
-            // Adjust result on different pyramid level.
-            scaled_ref_pixel_uv *= 2.0f;
-            scaled_cur_pixel_uv *= 2.0f;
+    // Define affine transform matrix. Use local affine transform predicted by homography if given.
+    Mat2 affine = context.has_predict_affine ? context.predict_affine : Mat2::Identity();
+
+    for (int32_t level_idx = context.start_level; level_idx > -1; --level_idx) {
+        const GrayImage &ref_image = ref_pyramid.GetImageConst(level_idx);
+        const GrayImage &cur_image = cur_pyramid.GetImageConst(level_idx);
+
+        // Track this feature in one pyramid level.
+        TrackOneFeatureInOneLevel(ref_image, cur_image, scaled_ref_pixel_uv, scaled_cur_pixel_uv, affine, status, scratch);
+        if (context.record_telemetry) {
+            RecordTelemetry(context.feature_id, level_idx, status, scratch);
         }
 
-        // If feature is outside, mark it.
-        const auto &feature = cur_pixel_uv[feature_id];
-        if (feature.x() < 0 || feature.x() > cur_pyramid.GetImageConst(0).cols() - 1||
-            feature.y() < 0 || feature.y() > cur_pyramid.GetImageConst(0).rows() - 1) {
-            status[feature_id] = static_cast<uint8_t>(TrackStatus::kOutside);
+        // If feature is tracked in final level, recovery its scale.
+        if (!level_idx) {
+            cur_pixel_uv = scaled_cur_pixel_uv;
+            break;
         }
+
+        // Adjust result on different pyramid level.
+        scaled_ref_pixel_uv *= 2.0f;
+        scaled_cur_pixel_uv *= 2.0f;
     }
 
-    return true;
+    // If feature is outside, mark it.
+    CheckFeatureOutside(cur_pyramid.GetImageConst(0), cur_pixel_uv, status);
 }
 
-bool OpticalFlowAffineKlt::TrackSingleLevel(const GrayImage &ref_image,
-                                            const GrayImage &cur_image,
-                                            const std::vector<Vec2> &ref_pixel_uv,
-                                            std::vector<Vec2> &cur_pixel_uv,
-                                            std::vector<uint8_t> &status) {
-    // Track per feature.
-    const uint32_t max_feature_id = ref_pixel_uv.size() < options().kMaxTrackPointsNumber ? ref_pixel_uv.size() : options().kMaxTrackPointsNumber;
-    for (uint32_t feature_id = 0; feature_id < max_feature_id; ++feature_id) {
-        // Do not repeatly track features that has been tracking failed.
-        CONTINUE_IF(status[feature_id] > static_cast<uint8_t>(TrackStatus::kTracked));
-
-        // Define affine transform matrix.
-        Mat2 affine = predict_affine_;
-
-        switch (options().kMethod) {
-            case OpticalFlowMethod::kInverse:
-            case OpticalFlowMethod::kDirect:
-                TrackOneFeature(ref_image, cur_image, ref_pixel_uv[feature_id], cur_pixel_uv[feature_id], affine, status[feature_id]);
-                break;
-            case OpticalFlowMethod::kFast:
-            default:
-                TrackOneFeatureFast(ref_image, cur_image, ref_pixel_uv[feature_id], cur_pixel_uv[feature_id], affine, status[feature_id]);
-                break;
-        }
+void OpticalFlowAffineKlt::PrepareLevelMajorStates(uint32_t num_features) {
+    affine_of_features_.resize(num_features);
+}
 
-        // If feature is outside, mark it.
-        const auto &feature = cur_pixel_uv[feature_id];
-        if (feature.x() < 0 || feature.x() > cur_image.cols() - 1||
-            feature.y() < 0 || feature.y() > cur_image.rows() - 1) {
-            status[feature_id] = static_cast<uint8_t>(TrackStatus::kOutside);
-        }
+void OpticalFlowAffineKlt::InitializeLevelMajorState(uint32_t feature_id, const Vec2 &scaled_ref_pixel_uv, const Vec2 &scaled_cur_pixel_uv) {
+    // Use local affine transform predicted by homography if given.
+    affine_of_features_[feature_id].setIdentity();
+    GetPredictAffine(feature_id, affine_of_features_[feature_id]);
+}
+
+void OpticalFlowAffineKlt::TrackOneFeatureInLevelMajor(const GrayImage &ref_image,
+                                                       const GrayImage &cur_image,
+                                                       uint32_t feature_id,
+                                                       int32_t level_idx,
+                                                       const Vec2 &scaled_ref_pixel_uv,
+                                                       Vec2 &scaled_cur_pixel_uv,
+                                                       uint8_t &status,
+                                                       TrackingScratch &scratch) {
+    TrackOneFeatureInOneLevel(ref_image, cur_image, scaled_ref_pixel_uv, scaled_cur_pixel_uv, affine_of_features_[feature_id], status, scratch);
+}
+
+void OpticalFlowAffineKlt::TrackOneFeatureInSingleLevel(const GrayImage &ref_image,
+                                                        const GrayImage &cur_image,
+                                                        const Vec2 &ref_pixel_uv,
+                                                        Vec2 &cur_pixel_uv,
+                                                        uint8_t &status,
+                                                        const FeatureTrackingContext &context,
+                                                        TrackingScratch &scratch) const {
+    // Do not repeatly track features that has been tracking failed.
+    if (status > static_cast<uint8_t>(TrackStatus::kTracked)) {
+        return;
+    }
+
+    // Define affine transform matrix. Use local affine transform predicted by homography if given. Prediction maps
+    // current frame to reference frame in backward pass.
+    Mat2 affine = context.has_predict_affine ? context.predict_affine :
+        (is_backward_pass() ? Mat2(predict_affine_.inverse()) : predict_affine_);
+
+    TrackOneFeatureInOneLevel(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, affine, status, scratch);
+    if (context.record_telemetry) {
+        RecordTelemetry(context.feature_id, 0, status, scratch);
     }
 
-    return true;
+    // If feature is outside, mark it.
+    CheckFeatureOutside(cur_image, cur_pixel_uv, status);
+}
+
+void OpticalFlowAffineKlt::TrackOneFeatureInOneLevel(const GrayImage &ref_image,
+                                                     const GrayImage &cur_image,
+                                                     const Vec2 &ref_pixel_uv,
+                                                     Vec2 &cur_pixel_uv,
+                                                     Mat2 &affine,
+                                                     uint8_t &status,
+                                                     TrackingScratch &scratch) const {
+    switch (options().kMethod) {
+        case OpticalFlowMethod::kInverse:
+        case OpticalFlowMethod::kDirect:
+            TrackOneFeature(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, affine, status, scratch);
+            break;
+        case OpticalFlowMethod::kSse:
+            DispatchSimd([&] (auto simd_level) {
+                TrackOneFeatureSse<decltype(simd_level)::value>(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, affine, status, scratch);
+            });
+            break;
+        case OpticalFlowMethod::kFast:
+        default:
+            TrackOneFeatureFast(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, affine, status, scratch);
+            break;
+    }
 }
 
 void OpticalFlowAffineKlt::TrackOneFeature(const GrayImage &ref_image,
@@ -103,16 +124,20 @@ void OpticalFlowAffineKlt::TrackOneFeature(const GrayImage &ref_image,
                                            const Vec2 &ref_pixel_uv,
                                            Vec2 &cur_pixel_uv,
                                            Mat2 &affine,
-                                           uint8_t &status) {
+                                           uint8_t &status,
+                                           TrackingScratch &scratch) const {
     Mat6 hessian = Mat6::Zero();
     Vec6 bias = Vec6::Zero();
 
-    for (uint32_t iter = 0; iter < options().kMaxIteration; ++iter) {
+    for (uint32_t iter = 0; iter < max_iteration(); ++iter) {
+        RecordIteration(scratch);
+
         // Construct incremental function. Statis average residual and count valid pixel.
-        BREAK_IF(ConstructIncrementalFunction(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, affine, hessian, bias) == 0);
+        BREAK_IF(ConstructIncrementalFunction(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, affine, hessian, bias, scratch.convergence) == 0);
+        RecordHessian(scratch, hessian);
 
         // Solve hessian * z = bias.
-        const Vec6 z = hessian.ldlt().solve(bias);
+        const Vec6 z = SolveIncrementalFunction(hessian, bias);
         const Vec2 v = z.head<2>() * cur_pixel_uv.x() + z.segment<2>(2) * cur_pixel_uv.y() + z.tail<2>();
 
         if (std::isnan(v(0)) || std::isnan(v(1))) {
@@ -147,11 +172,14 @@ int32_t OpticalFlowAffineKlt::ConstructIncrementalFunction(const GrayImage &ref_
                                                            const Vec2 &cur_pixel_uv,
                                                            const Mat2 &affine,
                                                            Mat6 &hessian,
-                                                           Vec6 &bias) {
+                                                           Vec6 &bias,
+                                                           ConvergenceRecord &convergence) const {
+    PROFILE_ZONE(kComputeBias);
     hessian.setZero();
     bias.setZero();
     std::array<float, 6> temp_value;
     int32_t num_of_valid_pixel = 0;
+    float squared_residual = 0.0f;
 
     if (options().kMethod == OpticalFlowMethod::kDirect) {
         // For direct optical flow, use current image to compute gradient.
@@ -213,6 +241,7 @@ int32_t OpticalFlowAffineKlt::ConstructIncrementalFunction(const GrayImage &ref_
                     bias(3) -= dt * y * dy;
                     bias(4) -= dt * dx;
                     bias(5) -= dt * dy;
+                    squared_residual += dt * dt;
 
                     ++num_of_valid_pixel;
                 }
@@ -278,6 +307,7 @@ int32_t OpticalFlowAffineKlt::ConstructIncrementalFunction(const GrayImage &ref_
                     bias(3) -= dt * y * dy;
                     bias(4) -= dt * dx;
                     bias(5) -= dt * dy;
+                    squared_residual += dt * dt;
 
                     ++num_of_valid_pixel;
                 }
@@ -292,6 +322,7 @@ int32_t OpticalFlowAffineKlt::ConstructIncrementalFunction(const GrayImage &ref_
             }
         }
     }
+    RecordResidual(convergence, squared_residual, num_of_valid_pixel);
 
     return num_of_valid_pixel;
 }
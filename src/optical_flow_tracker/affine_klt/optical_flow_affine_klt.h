@@ -19,16 +19,41 @@ public:
     const Mat2 &predict_affine() const { return predict_affine_; }
 
 private:
-    virtual bool TrackMultipleLevel(const ImagePyramid &ref_pyramid,
-                                    const ImagePyramid &cur_pyramid,
-                                    const std::vector<Vec2> &ref_pixel_uv,
-                                    std::vector<Vec2> &cur_pixel_uv,
-                                    std::vector<uint8_t> &status) override;
-    virtual bool TrackSingleLevel(const GrayImage &ref_image,
-                                  const GrayImage &cur_image,
-                                  const std::vector<Vec2> &ref_pixel_uv,
-                                  std::vector<Vec2> &cur_pixel_uv,
-                                  std::vector<uint8_t> &status) override;
+    virtual void TrackOneFeatureInMultipleLevel(const ImagePyramid &ref_pyramid,
+                                                const ImagePyramid &cur_pyramid,
+                                                const Vec2 &ref_pixel_uv,
+                                                Vec2 &cur_pixel_uv,
+                                                uint8_t &status,
+                                                const FeatureTrackingContext &context,
+                                                TrackingScratch &scratch) const override;
+    virtual void TrackOneFeatureInSingleLevel(const GrayImage &ref_image,
+                                              const GrayImage &cur_image,
+                                              const Vec2 &ref_pixel_uv,
+                                              Vec2 &cur_pixel_uv,
+                                              uint8_t &status,
+                                              const FeatureTrackingContext &context,
+                                              TrackingScratch &scratch) const override;
+    // Affine matrix and translation are fitted for each feature.
+    virtual uint32_t NumberOfFeatureParameters() const override { return 6; }
+    virtual void PrepareLevelMajorStates(uint32_t num_features) override;
+    virtual void InitializeLevelMajorState(uint32_t feature_id, const Vec2 &scaled_ref_pixel_uv, const Vec2 &scaled_cur_pixel_uv) override;
+    virtual void TrackOneFeatureInLevelMajor(const GrayImage &ref_image,
+                                             const GrayImage &cur_image,
+                                             uint32_t feature_id,
+                                             int32_t level_idx,
+                                             const Vec2 &scaled_ref_pixel_uv,
+                                             Vec2 &scaled_cur_pixel_uv,
+                                             uint8_t &status,
+                                             TrackingScratch &scratch) override;
+
+    // Track one feature in one pyramid level with selected method.
+    void TrackOneFeatureInOneLevel(const GrayImage &ref_image,
+                                   const GrayImage &cur_image,
+                                   const Vec2 &ref_pixel_uv,
+                                   Vec2 &cur_pixel_uv,
+                                   Mat2 &affine,
+                                   uint8_t &status,
+                                   TrackingScratch &scratch) const;
 
     // Support for inverse and direct method.
     void TrackOneFeature(const GrayImage &ref_image,
@@ -36,14 +61,16 @@ private:
                          const Vec2 &ref_pixel_uv,
                          Vec2 &cur_pixel_uv,
                          Mat2 &affine,
-                         uint8_t &status);
+                         uint8_t &status,
+                         TrackingScratch &scratch) const;
     int32_t ConstructIncrementalFunction(const GrayImage &ref_image,
                                          const GrayImage &cur_image,
                                          const Vec2 &ref_pixel_uv,
                                          const Vec2 &cur_pixel_uv,
                                          const Mat2 &affine,
                                          Mat6 &hessian,
-                                         Vec6 &bias);
+                                         Vec6 &bias,
+                                         ConvergenceRecord &convergence) const;
 
     // Support for fast method.
     void TrackOneFeatureFast(const GrayImage &ref_image,
@@ -51,27 +78,71 @@ private:
                              const Vec2 &ref_pixel_uv,
                              Vec2 &cur_pixel_uv,
                              Mat2 &affine,
-                             uint8_t &status);
+                             uint8_t &status,
+                             TrackingScratch &scratch) const;
     void PrecomputeJacobianAndHessian(const std::vector<float> &ex_ref_patch,
-                                      const std::vector<bool> &ex_ref_patch_pixel_valid,
+                                      const std::vector<uint8_t> &ex_ref_patch_pixel_valid,
                                       int32_t ex_ref_patch_rows,
                                       int32_t ex_ref_patch_cols,
                                       const Vec2 &cur_pixel_uv,
                                       std::vector<float> &all_dx_in_ref_patch,
                                       std::vector<float> &all_dy_in_ref_patch,
-                                      Mat6 &hessian);
+                                      Mat6 &hessian) const;
+    void PrecomputeHessian(const std::vector<float> &all_dx_in_ref_patch,
+                           const std::vector<float> &all_dy_in_ref_patch,
+                           const Vec2 &cur_pixel_uv,
+                           Mat6 &hessian) const;
     int32_t ComputeBias(const GrayImage &cur_image,
                         const Vec2 &cur_pixel_uv,
                         const std::vector<float> &ex_ref_patch,
-                        const std::vector<bool> &ex_ref_patch_pixel_valid,
+                        const std::vector<uint8_t> &ex_ref_patch_pixel_valid,
                         int32_t ex_ref_patch_rows,
                         int32_t ex_ref_patch_cols,
                         const std::vector<float> &all_dx_in_ref_patch,
                         const std::vector<float> &all_dy_in_ref_patch,
                         const Mat2 &affine,
-                        Vec6 &bias);
+                        Vec6 &bias,
+                        ConvergenceRecord &convergence) const;
+
+    // Support for fast method with sparse patch pattern.
+    void TrackOneFeatureFastPattern(const GrayImage &ref_image,
+                                    const GrayImage &cur_image,
+                                    const Vec2 &ref_pixel_uv,
+                                    Vec2 &cur_pixel_uv,
+                                    Mat2 &affine,
+                                    uint8_t &status,
+                                    TrackingScratch &scratch) const;
+    void PrecomputeHessianPattern(const std::vector<float> &all_dx_in_ref_pattern,
+                                  const std::vector<float> &all_dy_in_ref_pattern,
+                                  const Vec2 &cur_pixel_uv,
+                                  Mat6 &hessian) const;
+    int32_t ComputeBiasPattern(const GrayImage &cur_image,
+                               const Vec2 &cur_pixel_uv,
+                               const Mat2 &affine,
+                               TrackingScratch &scratch,
+                               Vec6 &bias) const;
 
     // Support for Sse method.
+    template <SimdLevel kSimdLevel>
+    void TrackOneFeatureSse(const GrayImage &ref_image,
+                            const GrayImage &cur_image,
+                            const Vec2 &ref_pixel_uv,
+                            Vec2 &cur_pixel_uv,
+                            Mat2 &affine,
+                            uint8_t &status,
+                            TrackingScratch &scratch) const;
+    template <SimdLevel kSimdLevel>
+    void PrecomputeJacobianAndHessianSse(const float *ex_ref_patch,
+                                         const float *ex_ref_patch_pixel_valid,
+                                         const Vec2 &cur_pixel_uv,
+                                         Mat6 &hessian,
+                                         TrackingScratch &scratch) const;
+    template <SimdLevel kSimdLevel>
+    int32_t ComputeBiasSse(const GrayImage &cur_image,
+                           const Vec2 &cur_pixel_uv,
+                           const Mat2 &affine,
+                           Vec6 &bias,
+                           TrackingScratch &scratch) const;
 
     // Support for Neon method.
 
@@ -79,6 +150,9 @@ private:
     // Support for prediction.
     Mat2 predict_affine_ = Mat2::Identity();
 
+    // Affine transform matrix of each feature kept between levels in level-major traversal.
+    std::vector<Mat2> affine_of_features_;
+
 };
 
 }
@@ -0,0 +1,136 @@
+#include "optical_flow_affine_klt.h"
+#include "slam_operations.h"
+#include "slam_log_reporter.h"
+
+namespace FEATURE_TRACKER {
+
+void OpticalFlowAffineKlt::TrackOneFeatureFastPattern(const GrayImage &ref_image,
+                                                      const GrayImage &cur_image,
+                                                      const Vec2 &ref_pixel_uv,
+                                                      Vec2 &cur_pixel_uv,
+                                                      Mat2 &affine,
+                                                      uint8_t &status,
+                                                      TrackingScratch &scratch) const {
+    // Sample pixel value and gradient at pattern points in reference image.
+    const uint32_t valid_point_num = ExtractPatternInReferenceImage(ref_image, ref_pixel_uv, scratch.ref_pattern, scratch.ref_pattern_valid,
+        scratch.all_dx_in_ref_pattern, scratch.all_dy_in_ref_pattern);
+
+    // If this feature has no valid point in pattern, it can not be tracked.
+    if (valid_point_num == 0) {
+        status = static_cast<uint8_t>(TrackStatus::kOutside);
+        return;
+    }
+
+    // Precompute hessian matrix.
+    Mat6 hessian = Mat6::Zero();
+    PrecomputeHessianPattern(scratch.all_dx_in_ref_pattern, scratch.all_dy_in_ref_pattern, cur_pixel_uv, hessian);
+    RecordHessian(scratch, hessian);
+
+    // Compute incremental by iteration.
+    Vec6 bias = Vec6::Zero();
+    float last_squared_step = INFINITY;
+    uint32_t large_step_cnt = 0;
+    status = static_cast<uint8_t>(TrackStatus::kLargeResidual);
+
+    for (uint32_t iter = 0; iter < max_iteration(); ++iter) {
+        RecordIteration(scratch);
+
+        // Compute bias.
+        BREAK_IF(ComputeBiasPattern(cur_image, cur_pixel_uv, affine, scratch, bias) == 0);
+
+        // Solve incremental function.
+        const Vec6 z = SolveIncrementalFunction(hessian, bias);
+        if (Eigen::isnan(z.array()).any()) {
+            status = static_cast<uint8_t>(TrackStatus::kNumericError);
+            break;
+        }
+
+        // Update cur_pixel_uv.
+        const Vec2 v = z.head<2>() * cur_pixel_uv.x() + z.segment<2>(2) * cur_pixel_uv.y() + z.tail<2>();
+        cur_pixel_uv += v;
+
+        // Update affine transform matrix.
+        affine.col(0) += z.head<2>();
+        affine.col(1) += z.segment<2>(2);
+
+        // Check if this step is converged.
+        const float squared_step = v.squaredNorm();
+        if (squared_step < last_squared_step) {
+            last_squared_step = squared_step;
+            large_step_cnt = 0;
+        } else {
+            ++large_step_cnt;
+            BREAK_IF(large_step_cnt >= options().kMaxToleranceLargeStep);
+        }
+        if (squared_step < options().kMaxConvergeStep) {
+            status = static_cast<uint8_t>(TrackStatus::kTracked);
+            break;
+        }
+    }
+}
+
+void OpticalFlowAffineKlt::PrecomputeHessianPattern(const std::vector<float> &all_dx_in_ref_pattern,
+                                                    const std::vector<float> &all_dy_in_ref_pattern,
+                                                    const Vec2 &cur_pixel_uv,
+                                                    Mat6 &hessian) const {
+    PROFILE_ZONE(kPrecomputeJacobian);
+    hessian.setZero();
+
+    // Invalid points have zero gradient, so they contribute nothing.
+    const std::vector<PatchPatternPoint> &points = patch_pattern().points();
+    for (uint32_t i = 0; i < points.size(); ++i) {
+        const float dx = all_dx_in_ref_pattern[i];
+        const float dy = all_dy_in_ref_pattern[i];
+        const float x = static_cast<float>(points[i].dcol) + cur_pixel_uv.x();
+        const float y = static_cast<float>(points[i].drow) + cur_pixel_uv.y();
+
+        // Jacobian of this point is [x * dx, x * dy, y * dx, y * dy, dx, dy].
+        Vec6 jacobian;
+        jacobian << x * dx, x * dy, y * dx, y * dy, dx, dy;
+        hessian += jacobian * jacobian.transpose();
+    }
+}
+
+int32_t OpticalFlowAffineKlt::ComputeBiasPattern(const GrayImage &cur_image,
+                                                 const Vec2 &cur_pixel_uv,
+                                                 const Mat2 &affine,
+                                                 TrackingScratch &scratch,
+                                                 Vec6 &bias) const {
+    PROFILE_ZONE(kComputeBias);
+    int32_t valid_point_cnt = 0;
+    float squared_residual = 0.0f;
+    float cur_pixel_value = 0.0f;
+    bias.setZero();
+
+    const std::vector<PatchPatternPoint> &points = patch_pattern().points();
+    for (uint32_t i = 0; i < points.size(); ++i) {
+        // If the point is not valid in reference pattern, ignore it.
+        CONTINUE_IF(!scratch.ref_pattern_valid[i]);
+
+        // Check if the point is valid in current image.
+        const Vec2 affined_dcol_drow = affine * Vec2(points[i].dcol, points[i].drow);
+        const float row_in_cur_image = affined_dcol_drow.y() + cur_pixel_uv.y();
+        const float col_in_cur_image = affined_dcol_drow.x() + cur_pixel_uv.x();
+        CONTINUE_IF(!cur_image.GetPixelValue(row_in_cur_image, col_in_cur_image, &cur_pixel_value));
+
+        // Compute bias.
+        const float dt = cur_pixel_value - scratch.ref_pattern[i];
+        const float dx = scratch.all_dx_in_ref_pattern[i];
+        const float dy = scratch.all_dy_in_ref_pattern[i];
+        bias(0) -= dt * col_in_cur_image * dx;
+        bias(1) -= dt * col_in_cur_image * dy;
+        bias(2) -= dt * row_in_cur_image * dx;
+        bias(3) -= dt * row_in_cur_image * dy;
+        bias(4) -= dt * dx;
+        bias(5) -= dt * dy;
+        squared_residual += dt * dt;
+
+        // Statis valid point number.
+        ++valid_point_cnt;
+    }
+    RecordResidual(scratch.convergence, squared_residual, valid_point_cnt);
+
+    return valid_point_cnt;
+}
+
+}
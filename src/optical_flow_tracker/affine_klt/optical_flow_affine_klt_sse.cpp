@@ -0,0 +1,258 @@
+#include "optical_flow_affine_klt.h"
+#include "slam_operations.h"
+#include "slam_log_reporter.h"
+#include "optical_flow_simd.h"
+
+namespace FEATURE_TRACKER {
+
+OPTICAL_FLOW_SIMD_BEGIN
+
+template <SimdLevel kSimdLevel>
+void OpticalFlowAffineKlt::TrackOneFeatureSse(const GrayImage &ref_image,
+                                              const GrayImage &cur_image,
+                                              const Vec2 &ref_pixel_uv,
+                                              Vec2 &cur_pixel_uv,
+                                              Mat2 &affine,
+                                              uint8_t &status,
+                                              TrackingScratch &scratch) const {
+    // Confirm extended patch size. Extract it from reference image.
+    const uint32_t valid_pixel_num = ExtractExtendPatchInReferenceImageSse<kSimdLevel>(ref_image, ref_pixel_uv, ex_ref_patch_rows(), ex_ref_patch_cols(),
+        ex_patch_stride_sse(), scratch.ex_ref_patch_sse.data(), scratch.ex_ref_patch_pixel_valid_sse.data());
+
+    // If this feature has no valid pixel in patch, it can not be tracked.
+    if (valid_pixel_num == 0) {
+        status = static_cast<uint8_t>(TrackStatus::kOutside);
+        return;
+    }
+
+    // Precompute dx, dy, hessian matrix.
+    Mat6 hessian = Mat6::Zero();
+    PrecomputeJacobianAndHessianSse<kSimdLevel>(scratch.ex_ref_patch_sse.data(), scratch.ex_ref_patch_pixel_valid_sse.data(), cur_pixel_uv, hessian, scratch);
+    RecordHessian(scratch, hessian);
+
+    // Compute incremental by iteration.
+    Vec6 bias = Vec6::Zero();
+    float last_squared_step = INFINITY;
+    uint32_t large_step_cnt = 0;
+    status = static_cast<uint8_t>(TrackStatus::kLargeResidual);
+
+    for (uint32_t iter = 0; iter < max_iteration(); ++iter) {
+        RecordIteration(scratch);
+
+        // Compute bias.
+        BREAK_IF(ComputeBiasSse<kSimdLevel>(cur_image, cur_pixel_uv, affine, bias, scratch) == 0);
+
+        // Solve incremental function.
+        const Vec6 z = SolveIncrementalFunction(hessian, bias);
+        if (Eigen::isnan(z.array()).any()) {
+            status = static_cast<uint8_t>(TrackStatus::kNumericError);
+            break;
+        }
+
+        // Update cur_pixel_uv.
+        const Vec2 v = z.head<2>() * cur_pixel_uv.x() + z.segment<2>(2) * cur_pixel_uv.y() + z.tail<2>();
+        cur_pixel_uv += v;
+
+        // Update affine transform matrix.
+        affine.col(0) += z.head<2>();
+        affine.col(1) += z.segment<2>(2);
+
+        // Check if this step is converged.
+        const float squared_step = v.squaredNorm();
+        if (squared_step < last_squared_step) {
+            last_squared_step = squared_step;
+            large_step_cnt = 0;
+        } else {
+            ++large_step_cnt;
+            BREAK_IF(large_step_cnt >= options().kMaxToleranceLargeStep);
+        }
+        if (squared_step < options().kMaxConvergeStep) {
+            status = static_cast<uint8_t>(TrackStatus::kTracked);
+            break;
+        }
+    }
+}
+
+template <SimdLevel kSimdLevel>
+void OpticalFlowAffineKlt::PrecomputeJacobianAndHessianSse(const float *ex_ref_patch,
+                                                           const float *ex_ref_patch_pixel_valid,
+                                                           const Vec2 &cur_pixel_uv,
+                                                           Mat6 &hessian,
+                                                           TrackingScratch &scratch) const {
+    using Float8 = SimdFloat8<kSimdLevel>;
+    PROFILE_ZONE(kPrecomputeJacobian);
+    const int32_t stride = patch_stride_sse();
+    const int32_t ex_stride = ex_patch_stride_sse();
+
+    // Only upper triangle of hessian is accumulated in vector lanes, it will be reduced once per patch.
+    std::array<Float8, 21> hessian_upper;
+    hessian_upper.fill(Float8::Zero());
+
+    for (int32_t row = 0; row < patch_rows(); ++row) {
+        const int32_t ex_row_offset = (row + 1) * ex_stride + 1;
+        const Float8 y = Float8::Set(static_cast<float>(row - options().kPatchRowHalfSize) + cur_pixel_uv.y());
+
+        for (int32_t col = 0; col < stride; col += Float8::kSize) {
+            const int32_t ex_index = ex_row_offset + col;
+            const int32_t index = row * stride + col;
+
+            // Gradient is valid only if all four neighbours are valid.
+            const Float8 valid = Float8::Load(ex_ref_patch_pixel_valid + ex_index - 1) *
+                                 Float8::Load(ex_ref_patch_pixel_valid + ex_index + 1) *
+                                 Float8::Load(ex_ref_patch_pixel_valid + ex_index - ex_stride) *
+                                 Float8::Load(ex_ref_patch_pixel_valid + ex_index + ex_stride) *
+                                 Float8::Load(patch_col_valid_sse().data() + col);
+
+            // Compute dx and dy for jacobian.
+            const Float8 dx = (Float8::Load(ex_ref_patch + ex_index + 1) - Float8::Load(ex_ref_patch + ex_index - 1)) * valid;
+            const Float8 dy = (Float8::Load(ex_ref_patch + ex_index + ex_stride) - Float8::Load(ex_ref_patch + ex_index - ex_stride)) * valid;
+            dx.Store(scratch.all_dx_in_ref_patch_sse.data() + index);
+            dy.Store(scratch.all_dy_in_ref_patch_sse.data() + index);
+
+            // Keep pixel value and validity of the center for computing bias.
+            Float8::Load(ex_ref_patch + ex_index).Store(scratch.ref_patch_sse.data() + index);
+            (Float8::Load(ex_ref_patch_pixel_valid + ex_index) * Float8::Load(patch_col_valid_sse().data() + col)).Store(scratch.ref_patch_pixel_valid_sse.data() + index);
+
+            // Jacobian is [x * dx, x * dy, y * dx, y * dy, dx, dy].
+            const Float8 x = Float8::Sequence(static_cast<float>(col - options().kPatchColHalfSize) + cur_pixel_uv.x());
+            const std::array<Float8, 6> jacobian = {x * dx, x * dy, y * dx, y * dy, dx, dy};
+
+            // Compute hessian matrix.
+            int32_t k = 0;
+            for (int32_t i = 0; i < 6; ++i) {
+                for (int32_t j = i; j < 6; ++j) {
+                    hessian_upper[k] = Float8::MulAdd(jacobian[i], jacobian[j], hessian_upper[k]);
+                    ++k;
+                }
+            }
+        }
+    }
+
+    int32_t k = 0;
+    for (int32_t i = 0; i < 6; ++i) {
+        for (int32_t j = i; j < 6; ++j) {
+            hessian(i, j) = hessian_upper[k].Sum();
+            hessian(j, i) = hessian(i, j);
+            ++k;
+        }
+    }
+
+    // Keep the same normal equations as fast method, so that both methods are interchangeable.
+    hessian(3, 4) = hessian(2, 3);
+    hessian(4, 3) = hessian(3, 4);
+}
+
+template <SimdLevel kSimdLevel>
+int32_t OpticalFlowAffineKlt::ComputeBiasSse(const GrayImage &cur_image,
+                                             const Vec2 &cur_pixel_uv,
+                                             const Mat2 &affine,
+                                             Vec6 &bias,
+                                             TrackingScratch &scratch) const {
+    using Float8 = SimdFloat8<kSimdLevel>;
+    PROFILE_ZONE(kComputeBias);
+    const int32_t stride = patch_stride_sse();
+    const float min_dcol = static_cast<float>(- options().kPatchColHalfSize);
+    const float max_dcol = static_cast<float>(stride - 1 - options().kPatchColHalfSize);
+    const float min_drow = static_cast<float>(- options().kPatchRowHalfSize);
+    const float max_drow = static_cast<float>(options().kPatchRowHalfSize);
+
+    // Compute bounding box of affined patch, including padded lanes.
+    float min_col = INFINITY;
+    float max_col = - INFINITY;
+    float min_row = INFINITY;
+    float max_row = - INFINITY;
+    for (const float &dcol : {min_dcol, max_dcol}) {
+        for (const float &drow : {min_drow, max_drow}) {
+            const Vec2 corner = affine * Vec2(dcol, drow) + cur_pixel_uv;
+            min_col = std::min(min_col, corner.x());
+            max_col = std::max(max_col, corner.x());
+            min_row = std::min(min_row, corner.y());
+            max_row = std::max(max_row, corner.y());
+        }
+    }
+
+    std::array<Float8, 6> bias_lanes;
+    bias_lanes.fill(Float8::Zero());
+    Float8 valid_cnt = Float8::Zero();
+    Float8 squared_residual = Float8::Zero();
+    const Float8 a00 = Float8::Set(affine(0, 0));
+    const Float8 a10 = Float8::Set(affine(1, 0));
+
+    // Vector lanes gather 4 pixels from top and bottom rows of each position, with one pixel of margin for rounding.
+    // If they can not be read, only valid pixels in each row are sampled into scratch.
+    const PaddedImageView image_view = GetImageView(cur_image);
+    const bool is_readable = image_view.IsInside(min_row - 1.0f, min_col - 1.0f, max_row + 2.0f, max_col + 4.0f);
+    bool is_partly_outside = false;
+    for (int32_t row = 0; row < patch_rows(); ++row) {
+        const float drow = static_cast<float>(row - options().kPatchRowHalfSize);
+        const auto position = [&] (int32_t col) -> Vec2 {
+            return affine * Vec2(static_cast<float>(col - options().kPatchColHalfSize), drow) + cur_pixel_uv;
+        };
+        int32_t valid_begin = 0;
+        int32_t valid_end = 0;
+        image_view.GetValidRangeInLine(patch_cols(), position, valid_begin, valid_end);
+        is_partly_outside |= valid_begin != 0 || valid_end != patch_cols();
+        float *cur_patch_row = scratch.cur_patch_sse.data() + row * stride;
+        float *cur_valid_row = scratch.cur_patch_pixel_valid_sse.data() + row * stride;
+        std::fill_n(cur_valid_row, stride, 0.0f);
+        std::fill(cur_valid_row + valid_begin, cur_valid_row + valid_end, 1.0f);
+        if (!is_readable) {
+            std::fill_n(cur_patch_row, stride, 0.0f);
+            for (int32_t col = valid_begin; col < valid_end; ++col) {
+                const Vec2 uv = position(col);
+                cur_patch_row[col] = image_view.GetPixelValueNoCheck(uv.y(), uv.x());
+            }
+        }
+
+        for (int32_t col = 0; col < stride; col += Float8::kSize) {
+            const int32_t index = row * stride + col;
+            const float dcol = static_cast<float>(col - options().kPatchColHalfSize);
+
+            // Compute position of pixels in current image, and sample them.
+            const Float8 dcols = Float8::Sequence(0.0f);
+            const Float8 x = Float8::MulAdd(a00, dcols, Float8::Set(affine(0, 0) * dcol + affine(0, 1) * drow + cur_pixel_uv.x()));
+            const Float8 y = Float8::MulAdd(a10, dcols, Float8::Set(affine(1, 0) * dcol + affine(1, 1) * drow + cur_pixel_uv.y()));
+            const Float8 cur_value = is_readable ? Float8::SampleBilinear(image_view.GetPixelPtr(0, 0), image_view.stride(), x, y) :
+                                                   Float8::Load(cur_patch_row + col);
+
+            // Compute residual.
+            const Float8 valid = Float8::Load(scratch.ref_patch_pixel_valid_sse.data() + index) * Float8::Load(cur_valid_row + col);
+            const Float8 dt = (cur_value - Float8::Load(scratch.ref_patch_sse.data() + index)) * valid;
+
+            // Compute bias.
+            const Float8 dx_dt = Float8::Load(scratch.all_dx_in_ref_patch_sse.data() + index) * dt;
+            const Float8 dy_dt = Float8::Load(scratch.all_dy_in_ref_patch_sse.data() + index) * dt;
+            bias_lanes[0] = Float8::MulAdd(x, dx_dt, bias_lanes[0]);
+            bias_lanes[1] = Float8::MulAdd(x, dy_dt, bias_lanes[1]);
+            bias_lanes[2] = Float8::MulAdd(y, dx_dt, bias_lanes[2]);
+            bias_lanes[3] = Float8::MulAdd(y, dy_dt, bias_lanes[3]);
+            bias_lanes[4] = bias_lanes[4] + dx_dt;
+            bias_lanes[5] = bias_lanes[5] + dy_dt;
+            valid_cnt = valid_cnt + valid;
+            squared_residual = Float8::MulAdd(dt, dt, squared_residual);
+        }
+    }
+    if (is_partly_outside) {
+        PROFILE_COUNT(kPaddedBorderFastPath, is_readable ? 1 : 0);
+        PROFILE_COUNT(kOutsideImageFallback, is_readable ? 0 : 1);
+    }
+
+    for (int32_t i = 0; i < 6; ++i) {
+        bias(i) = - bias_lanes[i].Sum();
+    }
+    RecordResidual(scratch.convergence, squared_residual.Sum(), static_cast<uint32_t>(valid_cnt.Sum()));
+    return static_cast<int32_t>(valid_cnt.Sum());
+}
+
+// Kernels for the simd level which this file is compiled with.
+template void OpticalFlowAffineKlt::TrackOneFeatureSse<kCompiledSimdLevel>(const GrayImage &ref_image,
+                                                                           const GrayImage &cur_image,
+                                                                           const Vec2 &ref_pixel_uv,
+                                                                           Vec2 &cur_pixel_uv,
+                                                                           Mat2 &affine,
+                                                                           uint8_t &status,
+                                                                           TrackingScratch &scratch) const;
+
+OPTICAL_FLOW_SIMD_END
+
+}
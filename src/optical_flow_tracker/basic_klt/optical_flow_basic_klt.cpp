@@ -4,109 +4,127 @@
 
 namespace FEATURE_TRACKER {
 
-bool OpticalFlowBasicKlt::TrackMultipleLevel(const ImagePyramid &ref_pyramid,
-                                             const ImagePyramid &cur_pyramid,
-                                             const std::vector<Vec2> &ref_pixel_uv,
-                                             std::vector<Vec2> &cur_pixel_uv,
-                                             std::vector<uint8_t> &status) {
-    const uint32_t max_feature_id = ref_pixel_uv.size() < options().kMaxTrackPointsNumber ?
-                                    ref_pixel_uv.size() : options().kMaxTrackPointsNumber;
-    const float scale = static_cast<float>(1 << (ref_pyramid.level() - 1));
-
-    // Track each pixel per level.
-    for (uint32_t feature_id = 0; feature_id < max_feature_id; ++feature_id) {
-        // Do not repeatly track features that has been tracking failed.
-        CONTINUE_IF(status[feature_id] > static_cast<uint8_t>(TrackStatus::kTracked));
-
-        // Recorder scaled ref_pixel_uv and cur_pixel_uv.
-        Vec2 scaled_ref_pixel_uv = ref_pixel_uv[feature_id] / scale;
-        Vec2 scaled_cur_pixel_uv = cur_pixel_uv[feature_id] / scale;
-
-        for (int32_t level_idx = ref_pyramid.level() - 1; level_idx > -1; --level_idx) {
-            const GrayImage &ref_image = ref_pyramid.GetImageConst(level_idx);
-            const GrayImage &cur_image = cur_pyramid.GetImageConst(level_idx);
-
-            // Track this feature in one pyramid level.
-            switch (options().kMethod) {
-                case OpticalFlowMethod::kInverse:
-                case OpticalFlowMethod::kDirect:
-                    TrackOneFeature(ref_image, cur_image, scaled_ref_pixel_uv, scaled_cur_pixel_uv, status[feature_id]);
-                    break;
-                case OpticalFlowMethod::kFast:
-                default:
-                    TrackOneFeatureFast(ref_image, cur_image, scaled_ref_pixel_uv, scaled_cur_pixel_uv, status[feature_id]);
-                    break;
-            }
-
-            // If feature is tracked in final level, recovery its scale.
-            if (!level_idx) {
-                cur_pixel_uv[feature_id] = scaled_cur_pixel_uv;
-                break;
-            }
+void OpticalFlowBasicKlt::TrackOneFeatureInMultipleLevel(const ImagePyramid &ref_pyramid,
+                                                         const ImagePyramid &cur_pyramid,
+                                                         const Vec2 &ref_pixel_uv,
+                                                         Vec2 &cur_pixel_uv,
+                                                         uint8_t &status,
+                                                         const FeatureTrackingContext &context,
+                                                         TrackingScratch &scratch) const {
+    // Do not repeatly track features that has been tracking failed.
+    if (status > static_cast<uint8_t>(TrackStatus::kTracked)) {
+        return;
+    }
 
-            // Adjust result on different pyramid level.
-            scaled_ref_pixel_uv *= 2.0f;
-            scaled_cur_pixel_uv *= 2.0f;
+    // Recorder scaled ref_pixel_uv and cur_pixel_uv in the start level of this feature.
+    const float scale = static_cast<float>(1 << context.start_level);
+    Vec2 scaled_ref_pixel_uv = ref_pixel_uv / scale;
+    Vec2 scaled_cur_pixel_uv = cur_pixel_uv / scale;
+
+    for (int32_t level_idx = context.start_level; level_idx > -1; --level_idx) {
+        const GrayImage &ref_image = ref_pyramid.GetImageConst(level_idx);
+        const GrayImage &cur_image = cur_pyramid.GetImageConst(level_idx);
+
+        // Track this feature in one pyramid level.
+        RefPatchCache *ref_patch_cache = context.ref_patch_cache == nullptr ? nullptr :
+            context.ref_patch_cache + level_idx * context.ref_patch_cache_stride;
+        TrackOneFeatureInOneLevel(ref_image, cur_image, scaled_ref_pixel_uv, scaled_cur_pixel_uv, status, ref_patch_cache, scratch);
+        if (context.record_telemetry) {
+            RecordTelemetry(context.feature_id, level_idx, status, scratch);
         }
 
-        // If feature is outside, mark it.
-        const auto &feature = cur_pixel_uv[feature_id];
-        if (feature.x() < 0 || feature.x() > cur_pyramid.GetImageConst(0).cols() - 1||
-            feature.y() < 0 || feature.y() > cur_pyramid.GetImageConst(0).rows() - 1) {
-            status[feature_id] = static_cast<uint8_t>(TrackStatus::kOutside);
+        // If feature is tracked in final level, recovery its scale.
+        if (!level_idx) {
+            cur_pixel_uv = scaled_cur_pixel_uv;
+            break;
         }
+
+        // Adjust result on different pyramid level.
+        scaled_ref_pixel_uv *= 2.0f;
+        scaled_cur_pixel_uv *= 2.0f;
     }
 
-    return true;
+    // If feature is outside, mark it.
+    CheckFeatureOutside(cur_pyramid.GetImageConst(0), cur_pixel_uv, status);
 }
 
-bool OpticalFlowBasicKlt::TrackSingleLevel(const GrayImage &ref_image,
-                                           const GrayImage &cur_image,
-                                           const std::vector<Vec2> &ref_pixel_uv,
-                                           std::vector<Vec2> &cur_pixel_uv,
-                                           std::vector<uint8_t> &status) {
-    // Track per feature.
-    const uint32_t max_feature_id = ref_pixel_uv.size() < options().kMaxTrackPointsNumber ?
-                                    ref_pixel_uv.size() : options().kMaxTrackPointsNumber;
-    for (uint32_t feature_id = 0; feature_id < max_feature_id; ++feature_id) {
-        // Do not repeatly track features that has been tracking failed.
-        CONTINUE_IF(status[feature_id] > static_cast<uint8_t>(TrackStatus::kTracked));
-
-        switch (options().kMethod) {
-            case OpticalFlowMethod::kInverse:
-            case OpticalFlowMethod::kDirect:
-                TrackOneFeature(ref_image, cur_image, ref_pixel_uv[feature_id], cur_pixel_uv[feature_id], status[feature_id]);
-                break;
-            case OpticalFlowMethod::kFast:
-            default:
-                TrackOneFeatureFast(ref_image, cur_image, ref_pixel_uv[feature_id], cur_pixel_uv[feature_id], status[feature_id]);
-                break;
-        }
+void OpticalFlowBasicKlt::TrackOneFeatureInLevelMajor(const GrayImage &ref_image,
+                                                      const GrayImage &cur_image,
+                                                      uint32_t feature_id,
+                                                      int32_t level_idx,
+                                                      const Vec2 &scaled_ref_pixel_uv,
+                                                      Vec2 &scaled_cur_pixel_uv,
+                                                      uint8_t &status,
+                                                      TrackingScratch &scratch) {
+    TrackOneFeatureInOneLevel(ref_image, cur_image, scaled_ref_pixel_uv, scaled_cur_pixel_uv, status,
+        GetRefPatchCache(level_idx, feature_id), scratch);
+}
 
-        // If feature is outside, mark it.
-        const auto &feature = cur_pixel_uv[feature_id];
-        if (feature.x() < 0 || feature.x() > cur_image.cols() - 1||
-            feature.y() < 0 || feature.y() > cur_image.rows() - 1) {
-            status[feature_id] = static_cast<uint8_t>(TrackStatus::kOutside);
-        }
+void OpticalFlowBasicKlt::TrackOneFeatureInSingleLevel(const GrayImage &ref_image,
+                                                       const GrayImage &cur_image,
+                                                       const Vec2 &ref_pixel_uv,
+                                                       Vec2 &cur_pixel_uv,
+                                                       uint8_t &status,
+                                                       const FeatureTrackingContext &context,
+                                                       TrackingScratch &scratch) const {
+    // Do not repeatly track features that has been tracking failed.
+    if (status > static_cast<uint8_t>(TrackStatus::kTracked)) {
+        return;
     }
 
-    return true;
+    TrackOneFeatureInOneLevel(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status, nullptr, scratch);
+    if (context.record_telemetry) {
+        RecordTelemetry(context.feature_id, 0, status, scratch);
+    }
+
+    // If feature is outside, mark it.
+    CheckFeatureOutside(cur_image, cur_pixel_uv, status);
+}
+
+void OpticalFlowBasicKlt::TrackOneFeatureInOneLevel(const GrayImage &ref_image,
+                                                    const GrayImage &cur_image,
+                                                    const Vec2 &ref_pixel_uv,
+                                                    Vec2 &cur_pixel_uv,
+                                                    uint8_t &status,
+                                                    RefPatchCache *ref_patch_cache,
+                                                    TrackingScratch &scratch) const {
+    switch (options().kMethod) {
+        case OpticalFlowMethod::kInverse:
+        case OpticalFlowMethod::kDirect:
+            TrackOneFeature(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status, scratch);
+            break;
+        case OpticalFlowMethod::kSse:
+            DispatchSimd([&] (auto simd_level) {
+                TrackOneFeatureSse<decltype(simd_level)::value>(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status, scratch);
+            });
+            break;
+        case OpticalFlowMethod::kFixedPoint:
+            TrackOneFeatureFixedPoint(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status, scratch);
+            break;
+        case OpticalFlowMethod::kFast:
+        default:
+            TrackOneFeatureFast(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status, ref_patch_cache, scratch);
+            break;
+    }
 }
 
 void OpticalFlowBasicKlt::TrackOneFeature(const GrayImage &ref_image,
                                           const GrayImage &cur_image,
                                           const Vec2 &ref_pixel_uv,
                                           Vec2 &cur_pixel_uv,
-                                          uint8_t &status) {
-    for (uint32_t iter = 0; iter < options().kMaxIteration; ++iter) {
+                                          uint8_t &status,
+                                          TrackingScratch &scratch) const {
+    for (uint32_t iter = 0; iter < max_iteration(); ++iter) {
+        RecordIteration(scratch);
+
         // Compute each pixel in the patch, create hessian * v = bias
         Mat2 hessian = Mat2::Zero();
         Vec2 bias = Vec2::Zero();
-        BREAK_IF(ConstructIncrementalFunction(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, hessian, bias) == 0);
+        BREAK_IF(ConstructIncrementalFunction(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, hessian, bias, scratch.convergence) == 0);
+        RecordHessian(scratch, hessian);
 
         // Solve hessian * v = bias.
-        Vec2 v = hessian.ldlt().solve(bias);
+        Vec2 v = SolveIncrementalFunction(hessian, bias);
         if (Eigen::isnan(v.array()).any()) {
             status = static_cast<uint8_t>(TrackStatus::kNumericError);
             break;
@@ -133,9 +151,12 @@ int32_t OpticalFlowBasicKlt::ConstructIncrementalFunction(const GrayImage &ref_i
                                                           const Vec2 &ref_pixel_uv,
                                                           const Vec2 &cur_pixel_uv,
                                                           Mat2 &hessian,
-                                                          Vec2 &bias) {
+                                                          Vec2 &bias,
+                                                          ConvergenceRecord &convergence) const {
+    PROFILE_ZONE(kComputeBias);
     std::array<float, 6> temp_value = {};
     int32_t num_of_valid_pixel = 0;
+    float squared_residual = 0.0f;
 
     if (options().kMethod == OpticalFlowMethod::kInverse) {
         // For inverse optical flow, use reference image to compute gradient.
@@ -162,6 +183,7 @@ int32_t OpticalFlowBasicKlt::ConstructIncrementalFunction(const GrayImage &ref_i
 
                     bias(0) -= fx * ft;
                     bias(1) -= fy * ft;
+                    squared_residual += ft * ft;
 
                     ++num_of_valid_pixel;
                 }
@@ -192,6 +214,7 @@ int32_t OpticalFlowBasicKlt::ConstructIncrementalFunction(const GrayImage &ref_i
 
                     bias(0) -= fx * ft;
                     bias(1) -= fy * ft;
+                    squared_residual += ft * ft;
 
                     ++num_of_valid_pixel;
                 }
@@ -199,6 +222,7 @@ int32_t OpticalFlowBasicKlt::ConstructIncrementalFunction(const GrayImage &ref_i
         }
     }
     hessian(1, 0) = hessian(0, 1);
+    RecordResidual(convergence, squared_residual, num_of_valid_pixel);
 
     return num_of_valid_pixel;
 }
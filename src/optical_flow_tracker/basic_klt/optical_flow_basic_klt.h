@@ -2,6 +2,8 @@
 #define _OPTICAL_FLOW_BASIC_KLT_H_
 
 #include "optical_flow.h"
+#include "optical_flow_fixed_patch.h"
+#include "slam_operations.h"
 #include <vector>
 
 namespace FEATURE_TRACKER {
@@ -13,54 +15,205 @@ public:
     virtual ~OpticalFlowBasicKlt() = default;
 
 private:
-    virtual bool TrackMultipleLevel(const ImagePyramid &ref_pyramid,
-                                    const ImagePyramid &cur_pyramid,
-                                    const std::vector<Vec2> &ref_pixel_uv,
-                                    std::vector<Vec2> &cur_pixel_uv,
-                                    std::vector<uint8_t> &status) override;
-    virtual bool TrackSingleLevel(const GrayImage &ref_image,
-                                  const GrayImage &cur_image,
-                                  const std::vector<Vec2> &ref_pixel_uv,
-                                  std::vector<Vec2> &cur_pixel_uv,
-                                  std::vector<uint8_t> &status) override;
+    virtual void TrackOneFeatureInMultipleLevel(const ImagePyramid &ref_pyramid,
+                                                const ImagePyramid &cur_pyramid,
+                                                const Vec2 &ref_pixel_uv,
+                                                Vec2 &cur_pixel_uv,
+                                                uint8_t &status,
+                                                const FeatureTrackingContext &context,
+                                                TrackingScratch &scratch) const override;
+    virtual void TrackOneFeatureInSingleLevel(const GrayImage &ref_image,
+                                              const GrayImage &cur_image,
+                                              const Vec2 &ref_pixel_uv,
+                                              Vec2 &cur_pixel_uv,
+                                              uint8_t &status,
+                                              const FeatureTrackingContext &context,
+                                              TrackingScratch &scratch) const override;
+    virtual bool IsMethodSupported(OpticalFlowMethod method) const override { return true; }
+    virtual void TrackOneFeatureInLevelMajor(const GrayImage &ref_image,
+                                             const GrayImage &cur_image,
+                                             uint32_t feature_id,
+                                             int32_t level_idx,
+                                             const Vec2 &scaled_ref_pixel_uv,
+                                             Vec2 &scaled_cur_pixel_uv,
+                                             uint8_t &status,
+                                             TrackingScratch &scratch) override;
+
+    // Track one feature in one pyramid level with selected method. Reference patch cache is only used by fast method.
+    void TrackOneFeatureInOneLevel(const GrayImage &ref_image,
+                                   const GrayImage &cur_image,
+                                   const Vec2 &ref_pixel_uv,
+                                   Vec2 &cur_pixel_uv,
+                                   uint8_t &status,
+                                   RefPatchCache *ref_patch_cache,
+                                   TrackingScratch &scratch) const;
+
+    // Iterate incremental of cur_pixel_uv with hessian precomputed in reference patch, which is shared by all kernels
+    // of fast method. Bias functor computes bias at cur_pixel_uv, and returns number of valid pixels.
+    template <typename HessianType, typename ComputeBiasFunc>
+    void TrackOneFeatureWithHessian(const HessianType &hessian,
+                                    Vec2 &cur_pixel_uv,
+                                    uint8_t &status,
+                                    TrackingScratch &scratch,
+                                    const ComputeBiasFunc &compute_bias) const {
+        status = static_cast<uint8_t>(TrackStatus::kLargeResidual);
+        float last_squared_step = INFINITY;
+        uint32_t large_step_cnt = 0;
+        Vec2 bias = Vec2::Zero();
+        for (uint32_t iter = 0; iter < max_iteration(); ++iter) {
+            RecordIteration(scratch);
+
+            // Compute bias.
+            BREAK_IF(compute_bias(cur_pixel_uv, bias) == 0);
+
+            // Solve incremental function.
+            const Vec2 v = SolveIncrementalFunction(hessian, bias);
+            if (Eigen::isnan(v.array()).any()) {
+                status = static_cast<uint8_t>(TrackStatus::kNumericError);
+                break;
+            }
+
+            // Update cur_pixel_uv.
+            cur_pixel_uv += v;
+
+            // Check if this step is converged.
+            const float squared_step = v.squaredNorm();
+            if (squared_step < last_squared_step) {
+                last_squared_step = squared_step;
+                large_step_cnt = 0;
+            } else {
+                ++large_step_cnt;
+                BREAK_IF(large_step_cnt >= options().kMaxToleranceLargeStep);
+            }
+            if (squared_step < options().kMaxConvergeStep) {
+                status = static_cast<uint8_t>(TrackStatus::kTracked);
+                break;
+            }
+        }
+    }
 
     // Support for inverse and direct method.
     void TrackOneFeature(const GrayImage &ref_image,
                          const GrayImage &cur_image,
                          const Vec2 &ref_pixel_uv,
                          Vec2 &cur_pixel_uv,
-                         uint8_t &status);
+                         uint8_t &status,
+                         TrackingScratch &scratch) const;
     int32_t ConstructIncrementalFunction(const GrayImage &ref_image,
                                          const GrayImage &cur_image,
                                          const Vec2 &ref_pixel_uv,
                                          const Vec2 &cur_pixel_uv,
                                          Mat2 &H,
-                                         Vec2 &b);
+                                         Vec2 &b,
+                                         ConvergenceRecord &convergence) const;
 
     // Support for fast method.
     void TrackOneFeatureFast(const GrayImage &ref_image,
                              const GrayImage &cur_image,
                              const Vec2 &ref_pixel_uv,
                              Vec2 &cur_pixel_uv,
-                             uint8_t &status);
+                             uint8_t &status,
+                             RefPatchCache *ref_patch_cache,
+                             TrackingScratch &scratch) const;
     void PrecomputeJacobianAndHessian(const std::vector<float> &ex_ref_patch,
-                                      const std::vector<bool> &ex_ref_patch_pixel_valid,
+                                      const std::vector<uint8_t> &ex_ref_patch_pixel_valid,
                                       int32_t ex_ref_patch_rows,
                                       int32_t ex_ref_patch_cols,
                                       std::vector<float> &all_dx_in_ref_patch,
                                       std::vector<float> &all_dy_in_ref_patch,
-                                      Mat2 &hessian);
+                                      Mat2 &hessian) const;
+    void PrecomputeHessian(const std::vector<float> &all_dx_in_ref_patch,
+                           const std::vector<float> &all_dy_in_ref_patch,
+                           Mat2 &hessian) const;
     int32_t ComputeBias(const GrayImage &cur_image,
                         const Vec2 &cur_pixel_uv,
                         const std::vector<float> &ex_ref_patch,
-                        const std::vector<bool> &ex_ref_patch_pixel_valid,
+                        const std::vector<uint8_t> &ex_ref_patch_pixel_valid,
                         int32_t ex_ref_patch_rows,
                         int32_t ex_ref_patch_cols,
                         const std::vector<float> &all_dx_in_ref_patch,
                         const std::vector<float> &all_dy_in_ref_patch,
-                        Vec2 &bias);
+                        Vec2 &bias,
+                        ConvergenceRecord &convergence) const;
+
+    // Support for fast method with compile-time patch size. Return false if patch size is not specialized.
+    bool TrackOneFeatureFastFixedPatch(const GrayImage &ref_image,
+                                       const GrayImage &cur_image,
+                                       const Vec2 &ref_pixel_uv,
+                                       Vec2 &cur_pixel_uv,
+                                       uint8_t &status,
+                                       RefPatchCache *ref_patch_cache,
+                                       TrackingScratch &scratch) const;
+    template <int32_t kHalfSize>
+    void TrackOneFeatureFixed(const GrayImage &ref_image,
+                              const GrayImage &cur_image,
+                              const Vec2 &ref_pixel_uv,
+                              Vec2 &cur_pixel_uv,
+                              uint8_t &status,
+                              RefPatchCache *ref_patch_cache,
+                              TrackingScratch &scratch) const;
+    template <int32_t kHalfSize>
+    Mat2 PrecomputeJacobianAndHessianFixed(FixedPatch<kHalfSize> &patch) const;
+    template <int32_t kHalfSize>
+    int32_t ComputeBiasFixed(const GrayImage &cur_image,
+                             const Vec2 &cur_pixel_uv,
+                             const FixedPatch<kHalfSize> &patch,
+                             Vec2 &bias,
+                             ConvergenceRecord &convergence) const;
+
+    // Support for fast method with cached reference patch.
+    void TrackOneFeatureFastCached(const GrayImage &ref_image,
+                                   const GrayImage &cur_image,
+                                   const Vec2 &ref_pixel_uv,
+                                   Vec2 &cur_pixel_uv,
+                                   uint8_t &status,
+                                   RefPatchCache &ref_patch_cache,
+                                   TrackingScratch &scratch) const;
+
+    // Support for fast method with sparse patch pattern.
+    void TrackOneFeatureFastPattern(const GrayImage &ref_image,
+                                    const GrayImage &cur_image,
+                                    const Vec2 &ref_pixel_uv,
+                                    Vec2 &cur_pixel_uv,
+                                    uint8_t &status,
+                                    TrackingScratch &scratch) const;
+    int32_t ComputeBiasPattern(const GrayImage &cur_image,
+                               const Vec2 &cur_pixel_uv,
+                               TrackingScratch &scratch,
+                               Vec2 &bias) const;
 
     // Support for Sse method.
+    template <SimdLevel kSimdLevel>
+    void TrackOneFeatureSse(const GrayImage &ref_image,
+                            const GrayImage &cur_image,
+                            const Vec2 &ref_pixel_uv,
+                            Vec2 &cur_pixel_uv,
+                            uint8_t &status,
+                            TrackingScratch &scratch) const;
+    template <SimdLevel kSimdLevel>
+    void PrecomputeJacobianAndHessianSse(const float *ex_ref_patch,
+                                         const float *ex_ref_patch_pixel_valid,
+                                         Mat2 &hessian,
+                                         TrackingScratch &scratch) const;
+    template <SimdLevel kSimdLevel>
+    int32_t ComputeBiasSse(const GrayImage &cur_image,
+                           const Vec2 &cur_pixel_uv,
+                           Vec2 &bias,
+                           TrackingScratch &scratch) const;
+
+    // Support for fixed-point method.
+    void TrackOneFeatureFixedPoint(const GrayImage &ref_image,
+                                   const GrayImage &cur_image,
+                                   const Vec2 &ref_pixel_uv,
+                                   Vec2 &cur_pixel_uv,
+                                   uint8_t &status,
+                                   TrackingScratch &scratch) const;
+    void PrecomputeJacobianAndHessianFixedPoint(Mat2 &hessian,
+                                                TrackingScratch &scratch) const;
+    int32_t ComputeBiasFixedPoint(const GrayImage &cur_image,
+                                  const Vec2 &cur_pixel_uv,
+                                  Vec2 &bias,
+                                  TrackingScratch &scratch) const;
 
     // Support for Neon method.
 
@@ -0,0 +1,48 @@
+#include "optical_flow_basic_klt.h"
+#include "slam_log_reporter.h"
+#include "slam_operations.h"
+
+namespace FEATURE_TRACKER {
+
+void OpticalFlowBasicKlt::TrackOneFeatureFastCached(const GrayImage &ref_image,
+                                                    const GrayImage &cur_image,
+                                                    const Vec2 &ref_pixel_uv,
+                                                    Vec2 &cur_pixel_uv,
+                                                    uint8_t &status,
+                                                    RefPatchCache &ref_patch_cache,
+                                                    TrackingScratch &scratch) const {
+    // Extract reference patch and precompute dx, dy, hessian matrix only once for each reference frame.
+    if (!ref_patch_cache.is_valid || ref_patch_cache.ref_pixel_uv != ref_pixel_uv) {
+        ref_patch_cache.valid_pixel_num = ExtractExtendPatchInReferenceImage(ref_image, ref_pixel_uv, ex_ref_patch_rows(), ex_ref_patch_cols(),
+            ref_patch_cache.ex_ref_patch, ref_patch_cache.ex_ref_patch_pixel_valid);
+
+        if (ref_patch_cache.valid_pixel_num > 0) {
+            Mat2 hessian = Mat2::Zero();
+            if (SampleGradientInReferencePatch(ref_image, ref_pixel_uv, ref_patch_cache.all_dx_in_ref_patch, ref_patch_cache.all_dy_in_ref_patch)) {
+                PrecomputeHessian(ref_patch_cache.all_dx_in_ref_patch, ref_patch_cache.all_dy_in_ref_patch, hessian);
+            } else {
+                PrecomputeJacobianAndHessian(ref_patch_cache.ex_ref_patch, ref_patch_cache.ex_ref_patch_pixel_valid, ex_ref_patch_rows(), ex_ref_patch_cols(),
+                    ref_patch_cache.all_dx_in_ref_patch, ref_patch_cache.all_dy_in_ref_patch, hessian);
+            }
+            ref_patch_cache.hessian_ldlt.compute(hessian);
+        }
+
+        ref_patch_cache.ref_pixel_uv = ref_pixel_uv;
+        ref_patch_cache.is_valid = true;
+    }
+
+    // If this feature has no valid pixel in patch, it can not be tracked.
+    if (ref_patch_cache.valid_pixel_num == 0) {
+        status = static_cast<uint8_t>(TrackStatus::kOutside);
+        return;
+    }
+    RecordHessian(scratch, ref_patch_cache.hessian_ldlt);
+
+    // Compute incremental by iteration.
+    TrackOneFeatureWithHessian(ref_patch_cache.hessian_ldlt, cur_pixel_uv, status, scratch, [&] (const Vec2 &pixel_uv, Vec2 &bias) {
+        return ComputeBias(cur_image, pixel_uv, ref_patch_cache.ex_ref_patch, ref_patch_cache.ex_ref_patch_pixel_valid,
+            ex_ref_patch_rows(), ex_ref_patch_cols(), ref_patch_cache.all_dx_in_ref_patch, ref_patch_cache.all_dy_in_ref_patch, bias, scratch.convergence);
+    });
+}
+
+}
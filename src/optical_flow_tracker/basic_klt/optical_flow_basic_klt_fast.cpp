@@ -8,11 +8,28 @@ void OpticalFlowBasicKlt::TrackOneFeatureFast(const GrayImage &ref_image,
                                               const GrayImage &cur_image,
                                               const Vec2 &ref_pixel_uv,
                                               Vec2 &cur_pixel_uv,
-                                              uint8_t &status) {
+                                              uint8_t &status,
+                                              RefPatchCache *ref_patch_cache,
+                                              TrackingScratch &scratch) const {
+    // Sample only points of sparse pattern if it is selected.
+    if (!patch_pattern().IsFull()) {
+        TrackOneFeatureFastPattern(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status, scratch);
+        return;
+    }
+
+    // Use kernel with compile-time patch size if it is specialized.
+    if (options().kUseFixedPatchKernel && TrackOneFeatureFastFixedPatch(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status, ref_patch_cache, scratch)) {
+        return;
+    }
+
+    // Reuse reference patch of reference frame if cache is enabled.
+    if (ref_patch_cache != nullptr) {
+        TrackOneFeatureFastCached(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status, *ref_patch_cache, scratch);
+        return;
+    }
+
     // Confirm extended patch size. Extract it from reference image.
-    ex_ref_patch().clear();
-    ex_ref_patch_pixel_valid().clear();
-    const uint32_t valid_pixel_num = ExtractExtendPatchInReferenceImage(ref_image, ref_pixel_uv, ex_ref_patch_rows(), ex_ref_patch_cols(), ex_ref_patch(), ex_ref_patch_pixel_valid());
+    const uint32_t valid_pixel_num = ExtractExtendPatchInReferenceImage(ref_image, ref_pixel_uv, ex_ref_patch_rows(), ex_ref_patch_cols(), scratch.ex_ref_patch, scratch.ex_ref_patch_pixel_valid);
 
     // If this feature has no valid pixel in patch, it can not be tracked.
     if (valid_pixel_num == 0) {
@@ -21,60 +38,38 @@ void OpticalFlowBasicKlt::TrackOneFeatureFast(const GrayImage &ref_image,
     }
 
     // Precompute dx, dy, hessian matrix.
-    all_dx_in_ref_patch().clear();
-    all_dy_in_ref_patch().clear();
     Mat2 hessian = Mat2::Zero();
-    PrecomputeJacobianAndHessian(ex_ref_patch(), ex_ref_patch_pixel_valid(), ex_ref_patch_rows(), ex_ref_patch_cols(), all_dx_in_ref_patch(), all_dy_in_ref_patch(), hessian);
+    if (SampleGradientInReferencePatch(ref_image, ref_pixel_uv, scratch.all_dx_in_ref_patch, scratch.all_dy_in_ref_patch)) {
+        PrecomputeHessian(scratch.all_dx_in_ref_patch, scratch.all_dy_in_ref_patch, hessian);
+    } else {
+        PrecomputeJacobianAndHessian(scratch.ex_ref_patch, scratch.ex_ref_patch_pixel_valid, ex_ref_patch_rows(), ex_ref_patch_cols(), scratch.all_dx_in_ref_patch, scratch.all_dy_in_ref_patch, hessian);
+    }
+    RecordHessian(scratch, hessian);
 
     // Compute incremental by iteration.
-    status = static_cast<uint8_t>(TrackStatus::kLargeResidual);
-    float last_squared_step = INFINITY;
-    uint32_t large_step_cnt = 0;
-    Vec2 bias = Vec2::Zero();
-    for (uint32_t iter = 0; iter < options().kMaxIteration; ++iter) {
-        // Compute bias.
-        BREAK_IF(ComputeBias(cur_image, cur_pixel_uv, ex_ref_patch(), ex_ref_patch_pixel_valid(),
-            ex_ref_patch_rows(), ex_ref_patch_cols(), all_dx_in_ref_patch(), all_dy_in_ref_patch(), bias) == 0);
-
-        // Solve incremental function.
-        const Vec2 v = hessian.ldlt().solve(bias);
-        if (Eigen::isnan(v.array()).any()) {
-            status = static_cast<uint8_t>(TrackStatus::kNumericError);
-            break;
-        }
-
-        // Update cur_pixel_uv.
-        cur_pixel_uv += v;
-
-        // Check if this step is converged.
-        const float squared_step = v.squaredNorm();
-        if (squared_step < last_squared_step) {
-            last_squared_step = squared_step;
-            large_step_cnt = 0;
-        } else {
-            ++large_step_cnt;
-            BREAK_IF(large_step_cnt >= options().kMaxToleranceLargeStep);
-        }
-        if (squared_step < options().kMaxConvergeStep) {
-            status = static_cast<uint8_t>(TrackStatus::kTracked);
-            break;
-        }
-    }
+    TrackOneFeatureWithHessian(hessian, cur_pixel_uv, status, scratch, [&] (const Vec2 &pixel_uv, Vec2 &bias) {
+        return ComputeBias(cur_image, pixel_uv, scratch.ex_ref_patch, scratch.ex_ref_patch_pixel_valid,
+            ex_ref_patch_rows(), ex_ref_patch_cols(), scratch.all_dx_in_ref_patch, scratch.all_dy_in_ref_patch, bias, scratch.convergence);
+    });
 }
 
 void OpticalFlowBasicKlt::PrecomputeJacobianAndHessian(const std::vector<float> &ex_ref_patch,
-                                                       const std::vector<bool> &ex_ref_patch_pixel_valid,
+                                                       const std::vector<uint8_t> &ex_ref_patch_pixel_valid,
                                                        int32_t ex_ref_patch_rows,
                                                        int32_t ex_ref_patch_cols,
                                                        std::vector<float> &all_dx_in_ref_patch,
                                                        std::vector<float> &all_dy_in_ref_patch,
-                                                       Mat2 &hessian) {
+                                                       Mat2 &hessian) const {
+    PROFILE_ZONE(kPrecomputeJacobian);
     const int32_t patch_rows = ex_ref_patch_rows - 2;
     const int32_t patch_cols = ex_ref_patch_cols - 2;
+    all_dx_in_ref_patch.resize(patch_rows * patch_cols);
+    all_dy_in_ref_patch.resize(patch_rows * patch_cols);
     hessian.setZero();
 
     for (int32_t row = 0; row < patch_rows; ++row) {
         for (int32_t col = 0; col < patch_cols; ++col) {
+            const int32_t index = row * patch_cols + col;
             const int32_t ex_index = (row + 1) * ex_ref_patch_cols + col + 1;
             const int32_t ex_index_left = ex_index - 1;
             const int32_t ex_index_right = ex_index + 1;
@@ -86,16 +81,16 @@ void OpticalFlowBasicKlt::PrecomputeJacobianAndHessian(const std::vector<float>
                 // Compute dx and dy for jacobian.
                 const float dx = ex_ref_patch[ex_index_right] - ex_ref_patch[ex_index_left];
                 const float dy = ex_ref_patch[ex_index_bottom] - ex_ref_patch[ex_index_top];
-                all_dx_in_ref_patch.emplace_back(dx);
-                all_dy_in_ref_patch.emplace_back(dy);
+                all_dx_in_ref_patch[index] = dx;
+                all_dy_in_ref_patch[index] = dy;
 
                 // Compute hessian matrix.
                 hessian(0, 0) += dx * dx;
                 hessian(0, 1) += dx * dy;
                 hessian(1, 1) += dy * dy;
             } else {
-                all_dx_in_ref_patch.emplace_back(0.0f);
-                all_dy_in_ref_patch.emplace_back(0.0f);
+                all_dx_in_ref_patch[index] = 0.0f;
+                all_dy_in_ref_patch[index] = 0.0f;
             }
         }
     }
@@ -103,15 +98,32 @@ void OpticalFlowBasicKlt::PrecomputeJacobianAndHessian(const std::vector<float>
     hessian(1, 0) = hessian(0, 1);
 }
 
+void OpticalFlowBasicKlt::PrecomputeHessian(const std::vector<float> &all_dx_in_ref_patch,
+                                            const std::vector<float> &all_dy_in_ref_patch,
+                                            Mat2 &hessian) const {
+    PROFILE_ZONE(kPrecomputeJacobian);
+    hessian.setZero();
+    for (uint32_t i = 0; i < all_dx_in_ref_patch.size(); ++i) {
+        const float dx = all_dx_in_ref_patch[i];
+        const float dy = all_dy_in_ref_patch[i];
+        hessian(0, 0) += dx * dx;
+        hessian(0, 1) += dx * dy;
+        hessian(1, 1) += dy * dy;
+    }
+    hessian(1, 0) = hessian(0, 1);
+}
+
 int32_t OpticalFlowBasicKlt::ComputeBias(const GrayImage &cur_image,
                                          const Vec2 &cur_pixel_uv,
                                          const std::vector<float> &ex_ref_patch,
-                                         const std::vector<bool> &ex_ref_patch_pixel_valid,
+                                         const std::vector<uint8_t> &ex_ref_patch_pixel_valid,
                                          int32_t ex_ref_patch_rows,
                                          int32_t ex_ref_patch_cols,
                                          const std::vector<float> &all_dx_in_ref_patch,
                                          const std::vector<float> &all_dy_in_ref_patch,
-                                         Vec2 &bias) {
+                                         Vec2 &bias,
+                                         ConvergenceRecord &convergence) const {
+    PROFILE_ZONE(kComputeBias);
     const int32_t patch_rows = ex_ref_patch_rows - 2;
     const int32_t patch_cols = ex_ref_patch_cols - 2;
     bias.setZero();
@@ -132,76 +144,49 @@ int32_t OpticalFlowBasicKlt::ComputeBias(const GrayImage &cur_image,
     const int32_t max_cur_pixel_row = min_cur_pixel_row + patch_rows;
     const int32_t max_cur_pixel_col = min_cur_pixel_col + patch_cols;
 
-    uint32_t valid_pixel_cnt = 0;
+    // Only valid pixels in each row of current patch are sampled.
+    const PaddedImageView image_view = GetImageView(cur_image);
     if (min_cur_pixel_row < 0 || max_cur_pixel_row > cur_image.rows() - 2 ||
         min_cur_pixel_col < 0 || max_cur_pixel_col > cur_image.cols() - 2) {
-        // If this patch is partly outside of reference image.
-        for (int32_t row = min_cur_pixel_row; row < max_cur_pixel_row; ++row) {
-            const int32_t row_in_ex_patch = row - min_cur_pixel_row + 1;
-            const int32_t row_in_patch = row - min_cur_pixel_row;
-
-            for (int32_t col = min_cur_pixel_col; col < max_cur_pixel_col; ++col) {
-                CONTINUE_IF(row < 0 || row > cur_image.rows() - 2 || col < 0 || col > cur_image.cols() - 2);
-
-                const int32_t col_in_ex_patch = col + 1 - min_cur_pixel_col;
-                const int32_t index_in_ex_patch = row_in_ex_patch * ex_ref_patch_cols + col_in_ex_patch;
-
-                // If this pixel is invalid in ref or cur image, discard it.
-                CONTINUE_IF(!ex_ref_patch_pixel_valid[index_in_ex_patch]);
-
-                // Compute pixel valud residual.
-                const float ref_pixel_value = ex_ref_patch[index_in_ex_patch];
-                const float cur_pixel_value = w_top_left * static_cast<float>(cur_image.GetPixelValueNoCheck(row, col)) +
-                                              w_top_right * static_cast<float>(cur_image.GetPixelValueNoCheck(row, col + 1)) +
-                                              w_bottom_left * static_cast<float>(cur_image.GetPixelValueNoCheck(row + 1, col)) +
-                                              w_bottom_right * static_cast<float>(cur_image.GetPixelValueNoCheck(row + 1, col + 1));
-                const float dt = cur_pixel_value - ref_pixel_value;
-
-                // Update bias.
-                const int32_t &col_in_patch = col - min_cur_pixel_col;
-                const int32_t index_in_patch = row_in_patch * patch_cols + col_in_patch;
-
-                bias(0) -= all_dx_in_ref_patch[index_in_patch] * dt;
-                bias(1) -= all_dy_in_ref_patch[index_in_patch] * dt;
-
-                // Static valid pixel number.
-                ++valid_pixel_cnt;
-            }
-        }
+        PROFILE_COUNT(kOutsideImageFallback, 1);
+    }
 
-    } else {
-        // If this patch is totally inside of reference image.
-        for (int32_t row = min_cur_pixel_row; row < max_cur_pixel_row; ++row) {
-            const int32_t row_in_ex_patch = row - min_cur_pixel_row + 1;
-            const int32_t row_in_patch = row - min_cur_pixel_row;
-
-            for (int32_t col = min_cur_pixel_col; col < max_cur_pixel_col; ++col) {
-                const int32_t col_in_ex_patch = col + 1 - min_cur_pixel_col;
-                const int32_t index_in_ex_patch = row_in_ex_patch * ex_ref_patch_cols + col_in_ex_patch;
-
-                // If this pixel is invalid in ref or cur image, discard it.
-                CONTINUE_IF(!ex_ref_patch_pixel_valid[index_in_ex_patch]);
-
-                // Compute pixel valud residual.
-                const float ref_pixel_value = ex_ref_patch[index_in_ex_patch];
-                const float cur_pixel_value = w_top_left * static_cast<float>(cur_image.GetPixelValueNoCheck(row, col)) +
-                                              w_top_right * static_cast<float>(cur_image.GetPixelValueNoCheck(row, col + 1)) +
-                                              w_bottom_left * static_cast<float>(cur_image.GetPixelValueNoCheck(row + 1, col)) +
-                                              w_bottom_right * static_cast<float>(cur_image.GetPixelValueNoCheck(row + 1, col + 1));
-                const float dt = cur_pixel_value - ref_pixel_value;
-
-                // Update bias.
-                const int32_t &col_in_patch = col - min_cur_pixel_col;
-                const int32_t index_in_patch = row_in_patch * patch_cols + col_in_patch;
-
-                bias(0) -= all_dx_in_ref_patch[index_in_patch] * dt;
-                bias(1) -= all_dy_in_ref_patch[index_in_patch] * dt;
-
-                // Static valid pixel number.
-                ++valid_pixel_cnt;
-            }
+    uint32_t valid_pixel_cnt = 0;
+    float squared_residual = 0.0f;
+    for (int32_t row_in_patch = 0; row_in_patch < patch_rows; ++row_in_patch) {
+        int32_t valid_begin = 0;
+        int32_t valid_end = 0;
+        image_view.GetValidRangeInRow(row_in_patch + min_cur_pixel_row, min_cur_pixel_col, patch_cols, valid_begin, valid_end);
+        CONTINUE_IF(valid_begin == valid_end);
+        const int32_t row_in_ex_patch = row_in_patch + 1;
+        const uint8_t *top = image_view.GetPixelPtr(row_in_patch + min_cur_pixel_row, min_cur_pixel_col);
+        const uint8_t *bottom = top + image_view.stride();
+
+        for (int32_t col_in_patch = valid_begin; col_in_patch < valid_end; ++col_in_patch) {
+            const int32_t index_in_ex_patch = row_in_ex_patch * ex_ref_patch_cols + col_in_patch + 1;
+
+            // If this pixel is invalid in ref image, discard it.
+            CONTINUE_IF(!ex_ref_patch_pixel_valid[index_in_ex_patch]);
+
+            // Compute pixel valud residual.
+            const float ref_pixel_value = ex_ref_patch[index_in_ex_patch];
+            const float cur_pixel_value = w_top_left * static_cast<float>(top[col_in_patch]) +
+                                          w_top_right * static_cast<float>(top[col_in_patch + 1]) +
+                                          w_bottom_left * static_cast<float>(bottom[col_in_patch]) +
+                                          w_bottom_right * static_cast<float>(bottom[col_in_patch + 1]);
+            const float dt = cur_pixel_value - ref_pixel_value;
+
+            // Update bias.
+            const int32_t index_in_patch = row_in_patch * patch_cols + col_in_patch;
+            bias(0) -= all_dx_in_ref_patch[index_in_patch] * dt;
+            bias(1) -= all_dy_in_ref_patch[index_in_patch] * dt;
+            squared_residual += dt * dt;
+
+            // Static valid pixel number.
+            ++valid_pixel_cnt;
         }
     }
+    RecordResidual(convergence, squared_residual, valid_pixel_cnt);
 
     return valid_pixel_cnt;
 }
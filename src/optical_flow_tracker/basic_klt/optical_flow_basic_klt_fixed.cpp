@@ -0,0 +1,204 @@
+#include "optical_flow_basic_klt.h"
+#include "optical_flow_fixed_patch.h"
+#include "slam_log_reporter.h"
+#include "slam_operations.h"
+
+namespace FEATURE_TRACKER {
+
+bool OpticalFlowBasicKlt::TrackOneFeatureFastFixedPatch(const GrayImage &ref_image,
+                                                        const GrayImage &cur_image,
+                                                        const Vec2 &ref_pixel_uv,
+                                                        Vec2 &cur_pixel_uv,
+                                                        uint8_t &status,
+                                                        RefPatchCache *ref_patch_cache,
+                                                        TrackingScratch &scratch) const {
+    // Only square patch with common size is specialized.
+    RETURN_FALSE_IF(options().kPatchRowHalfSize != options().kPatchColHalfSize);
+    switch (options().kPatchRowHalfSize) {
+        case 3:
+            TrackOneFeatureFixed<3>(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status, ref_patch_cache, scratch);
+            return true;
+        case 4:
+            TrackOneFeatureFixed<4>(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status, ref_patch_cache, scratch);
+            return true;
+        case 5:
+            TrackOneFeatureFixed<5>(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status, ref_patch_cache, scratch);
+            return true;
+        case 6:
+            TrackOneFeatureFixed<6>(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status, ref_patch_cache, scratch);
+            return true;
+        case 7:
+            TrackOneFeatureFixed<7>(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status, ref_patch_cache, scratch);
+            return true;
+        default:
+            return false;
+    }
+}
+
+template <int32_t kHalfSize>
+void OpticalFlowBasicKlt::TrackOneFeatureFixed(const GrayImage &ref_image,
+                                               const GrayImage &cur_image,
+                                               const Vec2 &ref_pixel_uv,
+                                               Vec2 &cur_pixel_uv,
+                                               uint8_t &status,
+                                               RefPatchCache *ref_patch_cache,
+                                               TrackingScratch &scratch) const {
+    using Patch = FixedPatch<kHalfSize>;
+
+    // Reference patch lives in cache if it is enabled, otherwise on stack.
+    Patch local_patch;
+    if (ref_patch_cache != nullptr && !std::holds_alternative<Patch>(ref_patch_cache->fixed_patch)) {
+        ref_patch_cache->fixed_patch.template emplace<Patch>();
+        ref_patch_cache->is_valid = false;
+    }
+    Patch &patch = ref_patch_cache != nullptr ? std::get<Patch>(ref_patch_cache->fixed_patch) : local_patch;
+
+    uint32_t valid_pixel_num = 0;
+    Eigen::LDLT<Mat2> hessian_ldlt;
+    if (ref_patch_cache != nullptr && ref_patch_cache->is_valid && ref_patch_cache->ref_pixel_uv == ref_pixel_uv) {
+        // Reference patch and hessian matrix of this feature has been cached.
+        valid_pixel_num = ref_patch_cache->valid_pixel_num;
+        hessian_ldlt = ref_patch_cache->hessian_ldlt;
+    } else {
+        // Extract extended patch from reference image.
+        valid_pixel_num = patch.ExtractExtendPatchInReferenceImage(GetImageView(ref_image), ref_pixel_uv);
+        if (valid_pixel_num > 0) {
+            hessian_ldlt.compute(PrecomputeJacobianAndHessianFixed<kHalfSize>(patch));
+        }
+
+        if (ref_patch_cache != nullptr) {
+            ref_patch_cache->ref_pixel_uv = ref_pixel_uv;
+            ref_patch_cache->valid_pixel_num = valid_pixel_num;
+            ref_patch_cache->hessian_ldlt = hessian_ldlt;
+            ref_patch_cache->is_valid = true;
+        }
+    }
+
+    // If this feature has no valid pixel in patch, it can not be tracked.
+    if (valid_pixel_num == 0) {
+        status = static_cast<uint8_t>(TrackStatus::kOutside);
+        return;
+    }
+    RecordHessian(scratch, hessian_ldlt);
+
+    // Compute incremental by iteration.
+    TrackOneFeatureWithHessian(hessian_ldlt, cur_pixel_uv, status, scratch, [&] (const Vec2 &pixel_uv, Vec2 &bias) {
+        return ComputeBiasFixed<kHalfSize>(cur_image, pixel_uv, patch, bias, scratch.convergence);
+    });
+}
+
+template <int32_t kHalfSize>
+Mat2 OpticalFlowBasicKlt::PrecomputeJacobianAndHessianFixed(FixedPatch<kHalfSize> &patch) const {
+    PROFILE_ZONE(kPrecomputeJacobian);
+    using Patch = FixedPatch<kHalfSize>;
+
+    // Precompute dx, dy, hessian matrix. Each column keeps its own partial sum, so that loops can be vectorized.
+    patch.PrecomputeJacobian();
+    std::array<float, Patch::kSize> hessian_00 = {};
+    std::array<float, Patch::kSize> hessian_01 = {};
+    std::array<float, Patch::kSize> hessian_11 = {};
+    for (int32_t row = 0; row < Patch::kSize; ++row) {
+        const float *dx = patch.all_dx_in_ref_patch.data() + row * Patch::kSize;
+        const float *dy = patch.all_dy_in_ref_patch.data() + row * Patch::kSize;
+        for (int32_t col = 0; col < Patch::kSize; ++col) {
+            hessian_00[col] += dx[col] * dx[col];
+            hessian_01[col] += dx[col] * dy[col];
+            hessian_11[col] += dy[col] * dy[col];
+        }
+    }
+    Mat2 hessian = Mat2::Zero();
+    for (int32_t col = 0; col < Patch::kSize; ++col) {
+        hessian(0, 0) += hessian_00[col];
+        hessian(0, 1) += hessian_01[col];
+        hessian(1, 1) += hessian_11[col];
+    }
+    hessian(1, 0) = hessian(0, 1);
+    return hessian;
+}
+
+template <int32_t kHalfSize>
+int32_t OpticalFlowBasicKlt::ComputeBiasFixed(const GrayImage &cur_image,
+                                              const Vec2 &cur_pixel_uv,
+                                              const FixedPatch<kHalfSize> &patch,
+                                              Vec2 &bias,
+                                              ConvergenceRecord &convergence) const {
+    PROFILE_ZONE(kComputeBias);
+    using Patch = FixedPatch<kHalfSize>;
+
+    // Compute the weight for linear interpolar.
+    const float int_pixel_row = std::floor(cur_pixel_uv.y());
+    const float int_pixel_col = std::floor(cur_pixel_uv.x());
+    const float dec_pixel_row = cur_pixel_uv.y() - int_pixel_row;
+    const float dec_pixel_col = cur_pixel_uv.x() - int_pixel_col;
+    const float w_top_left = (1.0f - dec_pixel_row) * (1.0f - dec_pixel_col);
+    const float w_top_right = (1.0f - dec_pixel_row) * dec_pixel_col;
+    const float w_bottom_left = dec_pixel_row * (1.0f - dec_pixel_col);
+    const float w_bottom_right = dec_pixel_row * dec_pixel_col;
+
+    // Extract patch from current image, and compute bias.
+    const int32_t min_cur_pixel_row = static_cast<int32_t>(int_pixel_row) - Patch::kSize / 2;
+    const int32_t min_cur_pixel_col = static_cast<int32_t>(int_pixel_col) - Patch::kSize / 2;
+    const int32_t max_cur_pixel_row = min_cur_pixel_row + Patch::kSize;
+    const int32_t max_cur_pixel_col = min_cur_pixel_col + Patch::kSize;
+    // Whole rows are sampled if they can be read from view of current image, otherwise only valid pixels in each row.
+    const PaddedImageView image_view = GetImageView(cur_image);
+    const bool is_readable = image_view.IsInside(min_cur_pixel_row, min_cur_pixel_col, max_cur_pixel_row, max_cur_pixel_col);
+    if (min_cur_pixel_row < 0 || max_cur_pixel_row > cur_image.rows() - 2 ||
+        min_cur_pixel_col < 0 || max_cur_pixel_col > cur_image.cols() - 2) {
+        PROFILE_COUNT(kPaddedBorderFastPath, is_readable ? 1 : 0);
+        PROFILE_COUNT(kOutsideImageFallback, is_readable ? 0 : 1);
+    }
+
+    std::array<float, Patch::kSize> bias_0 = {};
+    std::array<float, Patch::kSize> bias_1 = {};
+    std::array<float, Patch::kSize> cur_values = {};
+    std::array<float, Patch::kSize> squared_residual = {};
+    uint32_t valid_pixel_cnt = 0;
+    for (int32_t row = 0; row < Patch::kSize; ++row) {
+        const int32_t row_in_image = row + min_cur_pixel_row;
+        int32_t valid_begin = 0;
+        int32_t valid_end = 0;
+        image_view.GetValidRangeInRow(row_in_image, min_cur_pixel_col, Patch::kSize, valid_begin, valid_end);
+        const uint32_t valid_mask = patch.ref_patch_valid_mask(row) & image_view.GetValidMaskInRow(row_in_image, min_cur_pixel_col, Patch::kSize);
+
+        const int32_t read_begin = is_readable ? 0 : valid_begin;
+        const int32_t read_end = is_readable ? Patch::kSize : valid_end;
+        if (read_begin < read_end) {
+            const uint8_t *top = image_view.GetPixelPtr(row_in_image, min_cur_pixel_col);
+            const uint8_t *bottom = top + image_view.stride();
+            for (int32_t col = read_begin; col < read_end; ++col) {
+                cur_values[col] = w_top_left * static_cast<float>(top[col]) +
+                                  w_top_right * static_cast<float>(top[col + 1]) +
+                                  w_bottom_left * static_cast<float>(bottom[col]) +
+                                  w_bottom_right * static_cast<float>(bottom[col + 1]);
+            }
+        }
+        std::fill(cur_values.begin(), cur_values.begin() + read_begin, 0.0f);
+        std::fill(cur_values.begin() + read_end, cur_values.end(), 0.0f);
+
+        // Residual of invalid pixel is zero, so it contributes nothing.
+        const float *ref_values = patch.ex_ref_patch.data() + (row + 1) * Patch::kExSize + 1;
+        const float *dx = patch.all_dx_in_ref_patch.data() + row * Patch::kSize;
+        const float *dy = patch.all_dy_in_ref_patch.data() + row * Patch::kSize;
+        for (int32_t col = 0; col < Patch::kSize; ++col) {
+            const float valid = static_cast<float>((valid_mask >> col) & 1u);
+            const float dt = (cur_values[col] - ref_values[col]) * valid;
+            bias_0[col] -= dx[col] * dt;
+            bias_1[col] -= dy[col] * dt;
+            squared_residual[col] += dt * dt;
+        }
+        valid_pixel_cnt += static_cast<uint32_t>(__builtin_popcount(valid_mask));
+    }
+
+    bias.setZero();
+    float sum_squared_residual = 0.0f;
+    for (int32_t col = 0; col < Patch::kSize; ++col) {
+        bias(0) += bias_0[col];
+        bias(1) += bias_1[col];
+        sum_squared_residual += squared_residual[col];
+    }
+    RecordResidual(convergence, sum_squared_residual, valid_pixel_cnt);
+    return valid_pixel_cnt;
+}
+
+}
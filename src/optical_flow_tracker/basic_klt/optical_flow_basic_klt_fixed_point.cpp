@@ -0,0 +1,253 @@
+#include "optical_flow_basic_klt.h"
+#include "optical_flow_fixed_point.h"
+#include "slam_log_reporter.h"
+#include "slam_operations.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace FEATURE_TRACKER {
+
+#if defined(__SSE2__)
+namespace {
+    // Sum four int32 lanes. Each lane holds a partial sum which fits in int32, but the total may not.
+    inline int64_t HorizontalSumInt32(const __m128i &value) {
+        alignas(16) int32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes), value);
+        return static_cast<int64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    // Load 8 uint8 and widen them into int16.
+    inline __m128i LoadUint8AsInt16(const uint8_t *ptr) {
+        return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(ptr)), _mm_setzero_si128());
+    }
+}
+#endif
+
+void OpticalFlowBasicKlt::TrackOneFeatureFixedPoint(const GrayImage &ref_image,
+                                                    const GrayImage &cur_image,
+                                                    const Vec2 &ref_pixel_uv,
+                                                    Vec2 &cur_pixel_uv,
+                                                    uint8_t &status,
+                                                    TrackingScratch &scratch) const {
+    // Row of patch is too long to be accumulated in int32, use float method instead.
+    if (patch_cols() > kFixedPointMaxRowSize) {
+        TrackOneFeatureFast(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status, nullptr, scratch);
+        return;
+    }
+
+    // Confirm extended patch size. Extract it from reference image.
+    const uint32_t valid_pixel_num = ExtractExtendPatchInReferenceImageFixedPoint(ref_image, ref_pixel_uv, ex_ref_patch_rows(), ex_ref_patch_cols(),
+        scratch.ex_ref_patch_fixed_point.data(), scratch.ex_ref_patch_pixel_valid_fixed_point.data());
+
+    // If this feature has no valid pixel in patch, it can not be tracked.
+    if (valid_pixel_num == 0) {
+        status = static_cast<uint8_t>(TrackStatus::kOutside);
+        return;
+    }
+
+    // Precompute dx, dy, hessian matrix.
+    Mat2 hessian = Mat2::Zero();
+    PrecomputeJacobianAndHessianFixedPoint(hessian, scratch);
+    RecordHessian(scratch, hessian);
+
+    // Compute incremental by iteration.
+    TrackOneFeatureWithHessian(hessian, cur_pixel_uv, status, scratch, [&] (const Vec2 &pixel_uv, Vec2 &bias) {
+        return ComputeBiasFixedPoint(cur_image, pixel_uv, bias, scratch);
+    });
+}
+
+void OpticalFlowBasicKlt::PrecomputeJacobianAndHessianFixedPoint(Mat2 &hessian,
+                                                                 TrackingScratch &scratch) const {
+    PROFILE_ZONE(kPrecomputeJacobian);
+    const int32_t ex_cols = ex_ref_patch_cols();
+    const int16_t *ex_ref_patch = scratch.ex_ref_patch_fixed_point.data();
+    const uint8_t *ex_ref_patch_pixel_valid = scratch.ex_ref_patch_pixel_valid_fixed_point.data();
+    constexpr int32_t kShift = kFixedPointPixelBits - kFixedPointGradientBits;
+
+    int64_t hessian_00 = 0;
+    int64_t hessian_01 = 0;
+    int64_t hessian_11 = 0;
+    for (int32_t row = 0; row < patch_rows(); ++row) {
+        const int32_t ex_row_offset = (row + 1) * ex_cols + 1;
+        int16_t *dx_row = scratch.all_dx_in_ref_patch_fixed_point.data() + row * patch_cols();
+        int16_t *dy_row = scratch.all_dy_in_ref_patch_fixed_point.data() + row * patch_cols();
+
+        int32_t row_hessian_00 = 0;
+        int32_t row_hessian_01 = 0;
+        int32_t row_hessian_11 = 0;
+        int32_t col = 0;
+
+#if defined(__SSE2__)
+        // Process 8 pixels at once. Validity of four neighbours is turned into mask of int16 lanes, and products of
+        // gradients are summed in pairs by madd, so every lane of row sum stays in int32 as the scalar one does.
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(1 << (kShift - 1));
+        __m128i sum_00 = zero;
+        __m128i sum_01 = zero;
+        __m128i sum_11 = zero;
+        for (; col + 8 <= patch_cols(); col += 8) {
+            const int32_t ex_index = ex_row_offset + col;
+            const __m128i valid = _mm_and_si128(
+                _mm_and_si128(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(ex_ref_patch_pixel_valid + ex_index - 1)),
+                              _mm_loadl_epi64(reinterpret_cast<const __m128i *>(ex_ref_patch_pixel_valid + ex_index + 1))),
+                _mm_and_si128(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(ex_ref_patch_pixel_valid + ex_index - ex_cols)),
+                              _mm_loadl_epi64(reinterpret_cast<const __m128i *>(ex_ref_patch_pixel_valid + ex_index + ex_cols))));
+            const __m128i mask = _mm_sub_epi16(zero, _mm_unpacklo_epi8(valid, zero));
+            const __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ex_ref_patch + ex_index - 1));
+            const __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ex_ref_patch + ex_index + 1));
+            const __m128i up = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ex_ref_patch + ex_index - ex_cols));
+            const __m128i down = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ex_ref_patch + ex_index + ex_cols));
+            const __m128i dx = _mm_and_si128(_mm_srai_epi16(_mm_add_epi16(_mm_sub_epi16(right, left), round), kShift), mask);
+            const __m128i dy = _mm_and_si128(_mm_srai_epi16(_mm_add_epi16(_mm_sub_epi16(down, up), round), kShift), mask);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dx_row + col), dx);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dy_row + col), dy);
+
+            // Compute hessian matrix.
+            sum_00 = _mm_add_epi32(sum_00, _mm_madd_epi16(dx, dx));
+            sum_01 = _mm_add_epi32(sum_01, _mm_madd_epi16(dx, dy));
+            sum_11 = _mm_add_epi32(sum_11, _mm_madd_epi16(dy, dy));
+        }
+        row_hessian_00 = static_cast<int32_t>(HorizontalSumInt32(sum_00));
+        row_hessian_01 = static_cast<int32_t>(HorizontalSumInt32(sum_01));
+        row_hessian_11 = static_cast<int32_t>(HorizontalSumInt32(sum_11));
+#endif
+
+        for (; col < patch_cols(); ++col) {
+            const int32_t ex_index = ex_row_offset + col;
+
+            // Gradient is valid only if all four neighbours are valid. Convert it from Q5 into Q3 with rounding.
+            const int32_t valid = ex_ref_patch_pixel_valid[ex_index - 1] & ex_ref_patch_pixel_valid[ex_index + 1] &
+                                  ex_ref_patch_pixel_valid[ex_index - ex_cols] & ex_ref_patch_pixel_valid[ex_index + ex_cols];
+            const int32_t dx = ((ex_ref_patch[ex_index + 1] - ex_ref_patch[ex_index - 1] + (1 << (kShift - 1))) >> kShift) * valid;
+            const int32_t dy = ((ex_ref_patch[ex_index + ex_cols] - ex_ref_patch[ex_index - ex_cols] + (1 << (kShift - 1))) >> kShift) * valid;
+            dx_row[col] = static_cast<int16_t>(dx);
+            dy_row[col] = static_cast<int16_t>(dy);
+
+            // Compute hessian matrix.
+            row_hessian_00 += dx * dx;
+            row_hessian_01 += dx * dy;
+            row_hessian_11 += dy * dy;
+        }
+
+        hessian_00 += row_hessian_00;
+        hessian_01 += row_hessian_01;
+        hessian_11 += row_hessian_11;
+    }
+
+    hessian(0, 0) = static_cast<float>(hessian_00) * kFixedPointHessianScale;
+    hessian(0, 1) = static_cast<float>(hessian_01) * kFixedPointHessianScale;
+    hessian(1, 0) = hessian(0, 1);
+    hessian(1, 1) = static_cast<float>(hessian_11) * kFixedPointHessianScale;
+}
+
+int32_t OpticalFlowBasicKlt::ComputeBiasFixedPoint(const GrayImage &cur_image,
+                                                   const Vec2 &cur_pixel_uv,
+                                                   Vec2 &bias,
+                                                   TrackingScratch &scratch) const {
+    PROFILE_ZONE(kComputeBias);
+    const int32_t ex_cols = ex_ref_patch_cols();
+    const int16_t *ex_ref_patch = scratch.ex_ref_patch_fixed_point.data();
+    const uint8_t *ex_ref_patch_pixel_valid = scratch.ex_ref_patch_pixel_valid_fixed_point.data();
+
+    // Compute the weight for linear interpolar.
+    const std::array<int32_t, 4> weights = ComputeFixedPointBilinearWeights(cur_pixel_uv);
+
+    // Extract patch from current image, and compute bias.
+    const int32_t min_cur_pixel_row = static_cast<int32_t>(std::floor(cur_pixel_uv.y())) - patch_rows() / 2;
+    const int32_t min_cur_pixel_col = static_cast<int32_t>(std::floor(cur_pixel_uv.x())) - patch_cols() / 2;
+    const int32_t max_cur_pixel_row = min_cur_pixel_row + patch_rows();
+    const int32_t max_cur_pixel_col = min_cur_pixel_col + patch_cols();
+    // Only valid pixels in each row of current patch are sampled.
+    const PaddedImageView image_view = GetImageView(cur_image);
+    if (min_cur_pixel_row < 0 || max_cur_pixel_row > cur_image.rows() - 2 ||
+        min_cur_pixel_col < 0 || max_cur_pixel_col > cur_image.cols() - 2) {
+        PROFILE_COUNT(kOutsideImageFallback, 1);
+    }
+
+    int64_t bias_0 = 0;
+    int64_t bias_1 = 0;
+    int64_t squared_residual = 0;
+    int32_t valid_pixel_cnt = 0;
+    for (int32_t row = 0; row < patch_rows(); ++row) {
+        const int32_t row_in_image = row + min_cur_pixel_row;
+        int32_t valid_begin = 0;
+        int32_t valid_end = 0;
+        image_view.GetValidRangeInRow(row_in_image, min_cur_pixel_col, patch_cols(), valid_begin, valid_end);
+        CONTINUE_IF(valid_begin == valid_end);
+        const int16_t *ref_row = ex_ref_patch + (row + 1) * ex_cols + 1;
+        const uint8_t *ref_valid_row = ex_ref_patch_pixel_valid + (row + 1) * ex_cols + 1;
+        const int16_t *dx_row = scratch.all_dx_in_ref_patch_fixed_point.data() + row * patch_cols();
+        const int16_t *dy_row = scratch.all_dy_in_ref_patch_fixed_point.data() + row * patch_cols();
+        const uint8_t *top = image_view.GetPixelPtr(row_in_image, min_cur_pixel_col);
+        const uint8_t *bottom = top + image_view.stride();
+
+        int32_t row_bias_0 = 0;
+        int32_t row_bias_1 = 0;
+        int32_t col = valid_begin;
+
+#if defined(__SSE2__)
+        // Process 8 pixels at once. Q14 weights fit in int16, so interpolation is madd of interleaved left and right
+        // pixels with paired weights, which gives the same result as scalar one. Squared residual of a whole row may
+        // exceed int32, but each lane sums at most 16 of them, so lanes are summed into int64 per row.
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi32(1 << (kFixedPointWeightBits - kFixedPointPixelBits - 1));
+        const __m128i top_weights = _mm_set_epi16(weights[1], weights[0], weights[1], weights[0],
+                                                  weights[1], weights[0], weights[1], weights[0]);
+        const __m128i bottom_weights = _mm_set_epi16(weights[3], weights[2], weights[3], weights[2],
+                                                     weights[3], weights[2], weights[3], weights[2]);
+        __m128i sum_bias_0 = zero;
+        __m128i sum_bias_1 = zero;
+        __m128i sum_squared_residual = zero;
+        __m128i sum_valid = zero;
+        for (; col + 8 <= valid_end; col += 8) {
+            const __m128i top_left = LoadUint8AsInt16(top + col);
+            const __m128i top_right = LoadUint8AsInt16(top + col + 1);
+            const __m128i bottom_left = LoadUint8AsInt16(bottom + col);
+            const __m128i bottom_right = LoadUint8AsInt16(bottom + col + 1);
+            const __m128i interp_low = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(
+                _mm_madd_epi16(_mm_unpacklo_epi16(top_left, top_right), top_weights),
+                _mm_madd_epi16(_mm_unpacklo_epi16(bottom_left, bottom_right), bottom_weights)), round),
+                kFixedPointWeightBits - kFixedPointPixelBits);
+            const __m128i interp_high = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(
+                _mm_madd_epi16(_mm_unpackhi_epi16(top_left, top_right), top_weights),
+                _mm_madd_epi16(_mm_unpackhi_epi16(bottom_left, bottom_right), bottom_weights)), round),
+                kFixedPointWeightBits - kFixedPointPixelBits);
+            const __m128i valid = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(ref_valid_row + col));
+            const __m128i mask = _mm_sub_epi16(zero, _mm_unpacklo_epi8(valid, zero));
+            const __m128i ref = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ref_row + col));
+            const __m128i dt = _mm_and_si128(_mm_sub_epi16(_mm_packs_epi32(interp_low, interp_high), ref), mask);
+            const __m128i dx = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dx_row + col));
+            const __m128i dy = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dy_row + col));
+            sum_bias_0 = _mm_sub_epi32(sum_bias_0, _mm_madd_epi16(dx, dt));
+            sum_bias_1 = _mm_sub_epi32(sum_bias_1, _mm_madd_epi16(dy, dt));
+            sum_squared_residual = _mm_add_epi32(sum_squared_residual, _mm_madd_epi16(dt, dt));
+            sum_valid = _mm_add_epi64(sum_valid, _mm_sad_epu8(valid, zero));
+        }
+        row_bias_0 = static_cast<int32_t>(HorizontalSumInt32(sum_bias_0));
+        row_bias_1 = static_cast<int32_t>(HorizontalSumInt32(sum_bias_1));
+        squared_residual += HorizontalSumInt32(sum_squared_residual);
+        valid_pixel_cnt += _mm_cvtsi128_si32(sum_valid);
+#endif
+
+        for (; col < valid_end; ++col) {
+            const int32_t valid = ref_valid_row[col];
+            const int32_t dt = (InterpolateFixedPoint(weights, top[col], top[col + 1], bottom[col], bottom[col + 1]) - ref_row[col]) * valid;
+            row_bias_0 -= dx_row[col] * dt;
+            row_bias_1 -= dy_row[col] * dt;
+            squared_residual += dt * dt;
+            valid_pixel_cnt += valid;
+        }
+
+        bias_0 += row_bias_0;
+        bias_1 += row_bias_1;
+    }
+
+    bias(0) = static_cast<float>(bias_0) * kFixedPointBiasScale;
+    bias(1) = static_cast<float>(bias_1) * kFixedPointBiasScale;
+    RecordResidual(scratch.convergence, static_cast<float>(squared_residual) / static_cast<float>(1 << (kFixedPointPixelBits * 2)), valid_pixel_cnt);
+    return valid_pixel_cnt;
+}
+
+}
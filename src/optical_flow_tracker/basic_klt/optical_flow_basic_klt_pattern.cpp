@@ -0,0 +1,66 @@
+#include "optical_flow_basic_klt.h"
+#include "slam_log_reporter.h"
+#include "slam_operations.h"
+
+namespace FEATURE_TRACKER {
+
+void OpticalFlowBasicKlt::TrackOneFeatureFastPattern(const GrayImage &ref_image,
+                                                     const GrayImage &cur_image,
+                                                     const Vec2 &ref_pixel_uv,
+                                                     Vec2 &cur_pixel_uv,
+                                                     uint8_t &status,
+                                                     TrackingScratch &scratch) const {
+    // Sample pixel value and gradient at pattern points in reference image.
+    const uint32_t valid_point_num = ExtractPatternInReferenceImage(ref_image, ref_pixel_uv, scratch.ref_pattern, scratch.ref_pattern_valid,
+        scratch.all_dx_in_ref_pattern, scratch.all_dy_in_ref_pattern);
+
+    // If this feature has no valid point in pattern, it can not be tracked.
+    if (valid_point_num == 0) {
+        status = static_cast<uint8_t>(TrackStatus::kOutside);
+        return;
+    }
+
+    // Precompute hessian matrix. Invalid points have zero gradient, so they contribute nothing.
+    Mat2 hessian = Mat2::Zero();
+    PrecomputeHessian(scratch.all_dx_in_ref_pattern, scratch.all_dy_in_ref_pattern, hessian);
+    RecordHessian(scratch, hessian);
+
+    // Compute incremental by iteration.
+    TrackOneFeatureWithHessian(hessian, cur_pixel_uv, status, scratch, [&] (const Vec2 &pixel_uv, Vec2 &bias) {
+        return ComputeBiasPattern(cur_image, pixel_uv, scratch, bias);
+    });
+}
+
+int32_t OpticalFlowBasicKlt::ComputeBiasPattern(const GrayImage &cur_image,
+                                                const Vec2 &cur_pixel_uv,
+                                                TrackingScratch &scratch,
+                                                Vec2 &bias) const {
+    PROFILE_ZONE(kComputeBias);
+    bias.setZero();
+    uint32_t valid_point_cnt = 0;
+    float squared_residual = 0.0f;
+    float cur_pixel_value = 0.0f;
+
+    const std::vector<PatchPatternPoint> &points = patch_pattern().points();
+    for (uint32_t i = 0; i < points.size(); ++i) {
+        // If this point is invalid in ref or cur image, discard it.
+        CONTINUE_IF(!scratch.ref_pattern_valid[i]);
+        const float row = static_cast<float>(points[i].drow) + cur_pixel_uv.y();
+        const float col = static_cast<float>(points[i].dcol) + cur_pixel_uv.x();
+        CONTINUE_IF(!cur_image.GetPixelValue(row, col, &cur_pixel_value));
+
+        // Update bias.
+        const float dt = cur_pixel_value - scratch.ref_pattern[i];
+        bias(0) -= scratch.all_dx_in_ref_pattern[i] * dt;
+        bias(1) -= scratch.all_dy_in_ref_pattern[i] * dt;
+        squared_residual += dt * dt;
+
+        // Static valid point number.
+        ++valid_point_cnt;
+    }
+    RecordResidual(scratch.convergence, squared_residual, valid_point_cnt);
+
+    return valid_point_cnt;
+}
+
+}
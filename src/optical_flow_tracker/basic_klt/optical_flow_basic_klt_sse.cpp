@@ -0,0 +1,187 @@
+#include "optical_flow_basic_klt.h"
+#include "slam_log_reporter.h"
+#include "slam_operations.h"
+#include "optical_flow_simd.h"
+
+namespace FEATURE_TRACKER {
+
+OPTICAL_FLOW_SIMD_BEGIN
+
+template <SimdLevel kSimdLevel>
+void OpticalFlowBasicKlt::TrackOneFeatureSse(const GrayImage &ref_image,
+                                             const GrayImage &cur_image,
+                                             const Vec2 &ref_pixel_uv,
+                                             Vec2 &cur_pixel_uv,
+                                             uint8_t &status,
+                                             TrackingScratch &scratch) const {
+    // Confirm extended patch size. Extract it from reference image.
+    const uint32_t valid_pixel_num = ExtractExtendPatchInReferenceImageSse<kSimdLevel>(ref_image, ref_pixel_uv, ex_ref_patch_rows(), ex_ref_patch_cols(),
+        ex_patch_stride_sse(), scratch.ex_ref_patch_sse.data(), scratch.ex_ref_patch_pixel_valid_sse.data());
+
+    // If this feature has no valid pixel in patch, it can not be tracked.
+    if (valid_pixel_num == 0) {
+        status = static_cast<uint8_t>(TrackStatus::kOutside);
+        return;
+    }
+
+    // Precompute dx, dy, hessian matrix.
+    Mat2 hessian = Mat2::Zero();
+    PrecomputeJacobianAndHessianSse<kSimdLevel>(scratch.ex_ref_patch_sse.data(), scratch.ex_ref_patch_pixel_valid_sse.data(), hessian, scratch);
+    RecordHessian(scratch, hessian);
+
+    // Compute incremental by iteration.
+    TrackOneFeatureWithHessian(hessian, cur_pixel_uv, status, scratch, [&] (const Vec2 &pixel_uv, Vec2 &bias) {
+        return ComputeBiasSse<kSimdLevel>(cur_image, pixel_uv, bias, scratch);
+    });
+}
+
+template <SimdLevel kSimdLevel>
+void OpticalFlowBasicKlt::PrecomputeJacobianAndHessianSse(const float *ex_ref_patch,
+                                                          const float *ex_ref_patch_pixel_valid,
+                                                          Mat2 &hessian,
+                                                          TrackingScratch &scratch) const {
+    using Float8 = SimdFloat8<kSimdLevel>;
+    PROFILE_ZONE(kPrecomputeJacobian);
+    const int32_t stride = patch_stride_sse();
+    const int32_t ex_stride = ex_patch_stride_sse();
+    Float8 hessian_00 = Float8::Zero();
+    Float8 hessian_01 = Float8::Zero();
+    Float8 hessian_11 = Float8::Zero();
+
+    for (int32_t row = 0; row < patch_rows(); ++row) {
+        const int32_t ex_row_offset = (row + 1) * ex_stride + 1;
+        for (int32_t col = 0; col < stride; col += Float8::kSize) {
+            const int32_t ex_index = ex_row_offset + col;
+            const int32_t index = row * stride + col;
+
+            // Gradient is valid only if all four neighbours are valid.
+            const Float8 valid = Float8::Load(ex_ref_patch_pixel_valid + ex_index - 1) *
+                                 Float8::Load(ex_ref_patch_pixel_valid + ex_index + 1) *
+                                 Float8::Load(ex_ref_patch_pixel_valid + ex_index - ex_stride) *
+                                 Float8::Load(ex_ref_patch_pixel_valid + ex_index + ex_stride) *
+                                 Float8::Load(patch_col_valid_sse().data() + col);
+
+            // Compute dx and dy for jacobian.
+            const Float8 dx = (Float8::Load(ex_ref_patch + ex_index + 1) - Float8::Load(ex_ref_patch + ex_index - 1)) * valid;
+            const Float8 dy = (Float8::Load(ex_ref_patch + ex_index + ex_stride) - Float8::Load(ex_ref_patch + ex_index - ex_stride)) * valid;
+            dx.Store(scratch.all_dx_in_ref_patch_sse.data() + index);
+            dy.Store(scratch.all_dy_in_ref_patch_sse.data() + index);
+
+            // Keep pixel value and validity of the center for computing bias.
+            Float8::Load(ex_ref_patch + ex_index).Store(scratch.ref_patch_sse.data() + index);
+            (Float8::Load(ex_ref_patch_pixel_valid + ex_index) * Float8::Load(patch_col_valid_sse().data() + col)).Store(scratch.ref_patch_pixel_valid_sse.data() + index);
+
+            // Compute hessian matrix.
+            hessian_00 = Float8::MulAdd(dx, dx, hessian_00);
+            hessian_01 = Float8::MulAdd(dx, dy, hessian_01);
+            hessian_11 = Float8::MulAdd(dy, dy, hessian_11);
+        }
+    }
+
+    hessian(0, 0) = hessian_00.Sum();
+    hessian(0, 1) = hessian_01.Sum();
+    hessian(1, 0) = hessian(0, 1);
+    hessian(1, 1) = hessian_11.Sum();
+}
+
+template <SimdLevel kSimdLevel>
+int32_t OpticalFlowBasicKlt::ComputeBiasSse(const GrayImage &cur_image,
+                                            const Vec2 &cur_pixel_uv,
+                                            Vec2 &bias,
+                                            TrackingScratch &scratch) const {
+    using Float8 = SimdFloat8<kSimdLevel>;
+    PROFILE_ZONE(kComputeBias);
+    const int32_t stride = patch_stride_sse();
+
+    // Compute the weight for linear interpolar.
+    const float int_pixel_row = std::floor(cur_pixel_uv.y());
+    const float int_pixel_col = std::floor(cur_pixel_uv.x());
+    const float dec_pixel_row = cur_pixel_uv.y() - int_pixel_row;
+    const float dec_pixel_col = cur_pixel_uv.x() - int_pixel_col;
+    const float w_top_left = (1.0f - dec_pixel_row) * (1.0f - dec_pixel_col);
+    const float w_top_right = (1.0f - dec_pixel_row) * dec_pixel_col;
+    const float w_bottom_left = dec_pixel_row * (1.0f - dec_pixel_col);
+    const float w_bottom_right = dec_pixel_row * dec_pixel_col;
+
+    // Extract patch from current image, and compute bias.
+    const int32_t min_cur_pixel_row = static_cast<int32_t>(int_pixel_row) - patch_rows() / 2;
+    const int32_t min_cur_pixel_col = static_cast<int32_t>(int_pixel_col) - patch_cols() / 2;
+    const int32_t max_cur_pixel_row = min_cur_pixel_row + patch_rows();
+    const int32_t max_cur_pixel_col = min_cur_pixel_col + patch_cols();
+
+    Float8 bias_0 = Float8::Zero();
+    Float8 bias_1 = Float8::Zero();
+    Float8 valid_cnt = Float8::Zero();
+    Float8 squared_residual = Float8::Zero();
+
+    // Vector lanes read the whole padded row and one more column on its right side. If they can not be read, only
+    // valid pixels in each row are sampled into scratch.
+    const PaddedImageView image_view = GetImageView(cur_image);
+    const bool is_readable = image_view.IsInside(min_cur_pixel_row, min_cur_pixel_col, max_cur_pixel_row, min_cur_pixel_col + stride);
+    if (min_cur_pixel_row < 0 || max_cur_pixel_row > cur_image.rows() - 2 ||
+        min_cur_pixel_col < 0 || max_cur_pixel_col > cur_image.cols() - 2) {
+        PROFILE_COUNT(kPaddedBorderFastPath, is_readable ? 1 : 0);
+        PROFILE_COUNT(kOutsideImageFallback, is_readable ? 0 : 1);
+    }
+
+    const Float8 w_tl = Float8::Set(w_top_left);
+    const Float8 w_tr = Float8::Set(w_top_right);
+    const Float8 w_bl = Float8::Set(w_bottom_left);
+    const Float8 w_br = Float8::Set(w_bottom_right);
+    for (int32_t row = 0; row < patch_rows(); ++row) {
+        int32_t valid_begin = 0;
+        int32_t valid_end = 0;
+        image_view.GetValidRangeInRow(row + min_cur_pixel_row, min_cur_pixel_col, patch_cols(), valid_begin, valid_end);
+        float *cur_patch_row = scratch.cur_patch_sse.data() + row * stride;
+        float *cur_valid_row = scratch.cur_patch_pixel_valid_sse.data() + row * stride;
+        std::fill_n(cur_valid_row, stride, 0.0f);
+        std::fill(cur_valid_row + valid_begin, cur_valid_row + valid_end, 1.0f);
+
+        if (!is_readable) {
+            std::fill_n(cur_patch_row, stride, 0.0f);
+            if (valid_begin < valid_end) {
+                const uint8_t *top = image_view.GetPixelPtr(row + min_cur_pixel_row, min_cur_pixel_col);
+                const uint8_t *bottom = top + image_view.stride();
+                for (int32_t col = valid_begin; col < valid_end; ++col) {
+                    cur_patch_row[col] = w_top_left * static_cast<float>(top[col]) + w_top_right * static_cast<float>(top[col + 1]) +
+                                         w_bottom_left * static_cast<float>(bottom[col]) + w_bottom_right * static_cast<float>(bottom[col + 1]);
+                }
+            }
+        }
+
+        const uint8_t *top = is_readable ? image_view.GetPixelPtr(row + min_cur_pixel_row, min_cur_pixel_col) : nullptr;
+        const uint8_t *bottom = is_readable ? top + image_view.stride() : nullptr;
+
+        for (int32_t col = 0; col < stride; col += Float8::kSize) {
+            const int32_t index = row * stride + col;
+            const Float8 cur_value = !is_readable ? Float8::Load(cur_patch_row + col) :
+                                     Float8::MulAdd(w_tl, Float8::LoadUint8(top + col),
+                                     Float8::MulAdd(w_tr, Float8::LoadUint8(top + col + 1),
+                                     Float8::MulAdd(w_bl, Float8::LoadUint8(bottom + col),
+                                     w_br * Float8::LoadUint8(bottom + col + 1))));
+            const Float8 valid = Float8::Load(scratch.ref_patch_pixel_valid_sse.data() + index) * Float8::Load(cur_valid_row + col);
+            const Float8 dt = (cur_value - Float8::Load(scratch.ref_patch_sse.data() + index)) * valid;
+            bias_0 = Float8::MulAdd(Float8::Load(scratch.all_dx_in_ref_patch_sse.data() + index), dt, bias_0);
+            bias_1 = Float8::MulAdd(Float8::Load(scratch.all_dy_in_ref_patch_sse.data() + index), dt, bias_1);
+            valid_cnt = valid_cnt + valid;
+            squared_residual = Float8::MulAdd(dt, dt, squared_residual);
+        }
+    }
+
+    bias(0) = - bias_0.Sum();
+    bias(1) = - bias_1.Sum();
+    RecordResidual(scratch.convergence, squared_residual.Sum(), static_cast<uint32_t>(valid_cnt.Sum()));
+    return static_cast<int32_t>(valid_cnt.Sum());
+}
+
+// Kernels for the simd level which this file is compiled with.
+template void OpticalFlowBasicKlt::TrackOneFeatureSse<kCompiledSimdLevel>(const GrayImage &ref_image,
+                                                                          const GrayImage &cur_image,
+                                                                          const Vec2 &ref_pixel_uv,
+                                                                          Vec2 &cur_pixel_uv,
+                                                                          uint8_t &status,
+                                                                          TrackingScratch &scratch) const;
+
+OPTICAL_FLOW_SIMD_END
+
+}
@@ -4,102 +4,137 @@
 
 namespace FEATURE_TRACKER {
 
-bool OpticalFlowLssdKlt::TrackMultipleLevel(const ImagePyramid &ref_pyramid,
-                                            const ImagePyramid &cur_pyramid,
-                                            const std::vector<Vec2> &ref_pixel_uv,
-                                            std::vector<Vec2> &cur_pixel_uv,
-                                            std::vector<uint8_t> &status) {
-    const uint32_t max_feature_id = ref_pixel_uv.size() < options().kMaxTrackPointsNumber ?
-                                    ref_pixel_uv.size() : options().kMaxTrackPointsNumber;
-    const float scale = static_cast<float>(1 << (ref_pyramid.level() - 1));
-
-    // Track each pixel per level.
-    for (uint32_t feature_id = 0; feature_id < max_feature_id; ++feature_id) {
-        // Do not repeatly track features that has been tracking failed.
-        CONTINUE_IF(status[feature_id] > static_cast<uint8_t>(TrackStatus::kTracked));
-
-        // Recorder scaled ref_pixel_uv and cur_pixel_uv.
-        Vec2 scaled_ref_pixel_uv = ref_pixel_uv[feature_id] / scale;
-        const Vec2 scaled_cur_pixel_uv = cur_pixel_uv[feature_id] / scale;
-
-        // Define se2 transform.
-        Mat2 R_cr = predict_R_cr_;
-        Vec2 t_cr = scaled_cur_pixel_uv - predict_R_cr_ * scaled_ref_pixel_uv;
-
-        for (int32_t level_idx = ref_pyramid.level() - 1; level_idx > -1; --level_idx) {
-            const GrayImage &ref_image = ref_pyramid.GetImageConst(level_idx);
-            const GrayImage &cur_image = cur_pyramid.GetImageConst(level_idx);
-
-            // Track this feature in one pyramid level.
-            switch (options().kMethod) {
-                case OpticalFlowMethod::kInverse:
-                case OpticalFlowMethod::kDirect:
-                    TrackOneFeature(ref_image, cur_image, scaled_ref_pixel_uv, R_cr, t_cr, status[feature_id]);
-                    break;
-                case OpticalFlowMethod::kFast:
-                default:
-                    TrackOneFeatureFast(ref_image, cur_image, scaled_ref_pixel_uv, R_cr, t_cr, status[feature_id]);
-                    break;
-            }
-
-            // If feature is tracked in final level, recovery its scale.
-            if (!level_idx) {
-                cur_pixel_uv[feature_id] = R_cr * ref_pixel_uv[feature_id] + t_cr;
-                break;
-            }
+void OpticalFlowLssdKlt::TrackOneFeatureInMultipleLevel(const ImagePyramid &ref_pyramid,
+                                                        const ImagePyramid &cur_pyramid,
+                                                        const Vec2 &ref_pixel_uv,
+                                                        Vec2 &cur_pixel_uv,
+                                                        uint8_t &status,
+                                                        const FeatureTrackingContext &context,
+                                                        TrackingScratch &scratch) const {
+    // Do not repeatly track features that has been tracking failed.
+    if (status > static_cast<uint8_t>(TrackStatus::kTracked)) {
+        return;
+    }
 
-            // Adjust result on different pyramid level.
-            scaled_ref_pixel_uv *= 2.0f;
-            t_cr *= 2.0f;
+    // Recorder scaled ref_pixel_uv and cur_pixel_uv in the start level of this feature.
+    const float scale = static_cast<float>(1 << context.start_level);
+    Vec2 scaled_ref_pixel_uv = ref_pixel_uv / scale;
+    const Vec2 scaled_cur_pixel_uv = cur_pixel_uv / scale;
+
+    // Define se2 transform. Use local rotation predicted by homography if given. Prediction maps current frame to
+    // reference frame in backward pass.
+    Mat2 R_cr = context.has_predict_affine ? ClosestRotation(context.predict_affine) :
+        (is_backward_pass() ? Mat2(predict_R_cr_.inverse()) : predict_R_cr_);
+    Vec2 t_cr = scaled_cur_pixel_uv - R_cr * scaled_ref_pixel_uv;
+
+    for (int32_t level_idx = context.start_level; level_idx > -1; --level_idx) {
+        const GrayImage &ref_image = ref_pyramid.GetImageConst(level_idx);
+        const GrayImage &cur_image = cur_pyramid.GetImageConst(level_idx);
+
+        // Track this feature in one pyramid level.
+        TrackOneFeatureInOneLevel(ref_image, cur_image, scaled_ref_pixel_uv, R_cr, t_cr, status, scratch);
+        if (context.record_telemetry) {
+            RecordTelemetry(context.feature_id, level_idx, status, scratch);
         }
 
-        // If feature is outside, mark it.
-        const auto &feature = cur_pixel_uv[feature_id];
-        if (feature.x() < 0 || feature.x() > cur_pyramid.GetImageConst(0).cols() - 1||
-            feature.y() < 0 || feature.y() > cur_pyramid.GetImageConst(0).rows() - 1) {
-            status[feature_id] = static_cast<uint8_t>(TrackStatus::kOutside);
+        // If feature is tracked in final level, recovery its scale.
+        if (!level_idx) {
+            cur_pixel_uv = R_cr * ref_pixel_uv + t_cr;
+            break;
         }
+
+        // Adjust result on different pyramid level.
+        scaled_ref_pixel_uv *= 2.0f;
+        t_cr *= 2.0f;
     }
 
-    return true;
+    // If feature is outside, mark it.
+    CheckFeatureOutside(cur_pyramid.GetImageConst(0), cur_pixel_uv, status);
 }
 
-bool OpticalFlowLssdKlt::TrackSingleLevel(const GrayImage &ref_image,
-                                          const GrayImage &cur_image,
-                                          const std::vector<Vec2> &ref_pixel_uv,
-                                          std::vector<Vec2> &cur_pixel_uv,
-                                          std::vector<uint8_t> &status) {
-    // Track per feature.
-    const uint32_t max_feature_id = ref_pixel_uv.size() < options().kMaxTrackPointsNumber ?
-                                    ref_pixel_uv.size() : options().kMaxTrackPointsNumber;
-    for (uint32_t feature_id = 0; feature_id < max_feature_id; ++feature_id) {
-        // Do not repeatly track features that has been tracking failed.
-        CONTINUE_IF(status[feature_id] > static_cast<uint8_t>(TrackStatus::kTracked));
-
-        // Define se2 transform.
-        Mat2 R_cr = predict_R_cr_;
-        Vec2 t_cr = cur_pixel_uv[feature_id] - predict_R_cr_ * ref_pixel_uv[feature_id];
-
-        switch (options().kMethod) {
-            case OpticalFlowMethod::kInverse:
-            case OpticalFlowMethod::kDirect:
-                TrackOneFeature(ref_image, cur_image, ref_pixel_uv[feature_id], R_cr, t_cr, status[feature_id]);
-                break;
-            case OpticalFlowMethod::kFast:
-            default:
-                TrackOneFeatureFast(ref_image, cur_image, ref_pixel_uv[feature_id], R_cr, t_cr, status[feature_id]);
-                break;
-        }
+void OpticalFlowLssdKlt::PrepareLevelMajorStates(uint32_t num_features) {
+    R_cr_of_features_.resize(num_features);
+    t_cr_of_features_.resize(num_features);
+}
 
-        // If feature is outside, mark it.
-        const auto &feature = cur_pixel_uv[feature_id];
-        if (feature.x() < 0 || feature.x() > cur_image.cols() - 1||
-            feature.y() < 0 || feature.y() > cur_image.rows() - 1) {
-            status[feature_id] = static_cast<uint8_t>(TrackStatus::kOutside);
-        }
+void OpticalFlowLssdKlt::InitializeLevelMajorState(uint32_t feature_id, const Vec2 &scaled_ref_pixel_uv, const Vec2 &scaled_cur_pixel_uv) {
+    // Define se2 transform. Use local rotation predicted by homography if given. Prediction maps current frame to
+    // reference frame in backward pass.
+    Mat2 &R_cr = R_cr_of_features_[feature_id];
+    R_cr = is_backward_pass() ? Mat2(predict_R_cr_.inverse()) : predict_R_cr_;
+    GetPredictRotation(feature_id, R_cr);
+    t_cr_of_features_[feature_id] = scaled_cur_pixel_uv - R_cr * scaled_ref_pixel_uv;
+}
+
+void OpticalFlowLssdKlt::TrackOneFeatureInLevelMajor(const GrayImage &ref_image,
+                                                     const GrayImage &cur_image,
+                                                     uint32_t feature_id,
+                                                     int32_t level_idx,
+                                                     const Vec2 &scaled_ref_pixel_uv,
+                                                     Vec2 &scaled_cur_pixel_uv,
+                                                     uint8_t &status,
+                                                     TrackingScratch &scratch) {
+    Mat2 &R_cr = R_cr_of_features_[feature_id];
+    Vec2 &t_cr = t_cr_of_features_[feature_id];
+    TrackOneFeatureInOneLevel(ref_image, cur_image, scaled_ref_pixel_uv, R_cr, t_cr, status, scratch);
+
+    // Se2 transform is kept between levels, and result in this level is recovered from it.
+    scaled_cur_pixel_uv = R_cr * scaled_ref_pixel_uv + t_cr;
+    if (level_idx) {
+        t_cr *= 2.0f;
+    }
+}
+
+void OpticalFlowLssdKlt::TrackOneFeatureInSingleLevel(const GrayImage &ref_image,
+                                                      const GrayImage &cur_image,
+                                                      const Vec2 &ref_pixel_uv,
+                                                      Vec2 &cur_pixel_uv,
+                                                      uint8_t &status,
+                                                      const FeatureTrackingContext &context,
+                                                      TrackingScratch &scratch) const {
+    // Do not repeatly track features that has been tracking failed.
+    if (status > static_cast<uint8_t>(TrackStatus::kTracked)) {
+        return;
+    }
+
+    // Define se2 transform. Use local rotation predicted by homography if given. Prediction maps current frame to
+    // reference frame in backward pass.
+    Mat2 R_cr = context.has_predict_affine ? ClosestRotation(context.predict_affine) :
+        (is_backward_pass() ? Mat2(predict_R_cr_.inverse()) : predict_R_cr_);
+    Vec2 t_cr = cur_pixel_uv - R_cr * ref_pixel_uv;
+
+    TrackOneFeatureInOneLevel(ref_image, cur_image, ref_pixel_uv, R_cr, t_cr, status, scratch);
+    cur_pixel_uv = R_cr * ref_pixel_uv + t_cr;
+    if (context.record_telemetry) {
+        RecordTelemetry(context.feature_id, 0, status, scratch);
     }
 
-    return true;
+    // If feature is outside, mark it.
+    CheckFeatureOutside(cur_image, cur_pixel_uv, status);
+}
+
+void OpticalFlowLssdKlt::TrackOneFeatureInOneLevel(const GrayImage &ref_image,
+                                                   const GrayImage &cur_image,
+                                                   const Vec2 &ref_pixel_uv,
+                                                   Mat2 &R_cr,
+                                                   Vec2 &t_cr,
+                                                   uint8_t &status,
+                                                   TrackingScratch &scratch) const {
+    switch (options().kMethod) {
+        case OpticalFlowMethod::kInverse:
+        case OpticalFlowMethod::kDirect:
+            TrackOneFeature(ref_image, cur_image, ref_pixel_uv, R_cr, t_cr, status, scratch);
+            break;
+        case OpticalFlowMethod::kSse:
+            DispatchSimd([&] (auto simd_level) {
+                TrackOneFeatureSse<decltype(simd_level)::value>(ref_image, cur_image, ref_pixel_uv, R_cr, t_cr, status, scratch);
+            });
+            break;
+        case OpticalFlowMethod::kFast:
+        default:
+            TrackOneFeatureFast(ref_image, cur_image, ref_pixel_uv, R_cr, t_cr, status, scratch);
+            break;
+    }
 }
 
 void OpticalFlowLssdKlt::TrackOneFeature(const GrayImage &ref_image,
@@ -107,17 +142,21 @@ void OpticalFlowLssdKlt::TrackOneFeature(const GrayImage &ref_image,
                                          const Vec2 &ref_pixel_uv,
                                          Mat2 &R_cr,
                                          Vec2 &t_cr,
-                                         uint8_t &status) {
+                                         uint8_t &status,
+                                         TrackingScratch &scratch) const {
     Mat2 delta_R;
 
-    for (uint32_t iter = 0; iter < options().kMaxIteration; ++iter) {
+    for (uint32_t iter = 0; iter < max_iteration(); ++iter) {
+        RecordIteration(scratch);
+
         // Compute each pixel in the patch, create hessian * v = bias
         Mat3 hessian = Mat3::Zero();
         Vec3 bias = Vec3::Zero();
-        BREAK_IF(ConstructIncrementalFunction(ref_image, cur_image, ref_pixel_uv, R_cr, t_cr, hessian, bias) == 0);
+        BREAK_IF(ConstructIncrementalFunction(ref_image, cur_image, ref_pixel_uv, R_cr, t_cr, hessian, bias, scratch.convergence) == 0);
+        RecordHessian(scratch, hessian);
 
         // Solve hessian * v = bias.
-        const Vec3 v = hessian.ldlt().solve(bias);
+        const Vec3 v = SolveIncrementalFunction(hessian, bias);
         if (Eigen::isnan(v.array()).any()) {
             status = static_cast<uint8_t>(TrackStatus::kNumericError);
             break;
@@ -143,9 +182,12 @@ int32_t OpticalFlowLssdKlt::ConstructIncrementalFunction(const GrayImage &ref_im
                                                          const Mat2 &R_cr,
                                                          const Vec2 &t_cr,
                                                          Mat3 &hessian,
-                                                         Vec3 &bias) {
+                                                         Vec3 &bias,
+                                                         ConvergenceRecord &convergence) const {
+    PROFILE_ZONE(kComputeBias);
     std::array<float, 6> temp_value = {};
     int32_t num_of_valid_pixel = 0;
+    float squared_residual = 0.0f;
 
     // Compute average pixel value in reference patch and current patch.
     float ref_average_value = 0.0f;
@@ -237,6 +279,7 @@ int32_t OpticalFlowLssdKlt::ConstructIncrementalFunction(const GrayImage &ref_im
 
                     hessian += jacobian.transpose() * jacobian;
                     bias -= jacobian.transpose() * residual;
+                    squared_residual += residual(0) * residual(0);
                 }
             }
         }
@@ -265,10 +308,12 @@ int32_t OpticalFlowLssdKlt::ConstructIncrementalFunction(const GrayImage &ref_im
 
                     hessian += jacobian.transpose() * jacobian;
                     bias -= jacobian.transpose() * residual;
+                    squared_residual += residual(0) * residual(0);
                 }
             }
         }
     }
+    RecordResidual(convergence, squared_residual, num_of_valid_pixel);
 
     return num_of_valid_pixel;
 }
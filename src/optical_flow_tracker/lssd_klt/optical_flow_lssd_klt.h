@@ -21,16 +21,41 @@ public:
     const bool &consider_patch_luminance() const { return consider_patch_luminance_; }
 
 private:
-    virtual bool TrackMultipleLevel(const ImagePyramid &ref_pyramid,
-                                    const ImagePyramid &cur_pyramid,
-                                    const std::vector<Vec2> &ref_pixel_uv,
-                                    std::vector<Vec2> &cur_pixel_uv,
-                                    std::vector<uint8_t> &status) override;
-    virtual bool TrackSingleLevel(const GrayImage &ref_image,
-                                  const GrayImage &cur_image,
-                                  const std::vector<Vec2> &ref_pixel_uv,
-                                  std::vector<Vec2> &cur_pixel_uv,
-                                  std::vector<uint8_t> &status) override;
+    virtual void TrackOneFeatureInMultipleLevel(const ImagePyramid &ref_pyramid,
+                                                const ImagePyramid &cur_pyramid,
+                                                const Vec2 &ref_pixel_uv,
+                                                Vec2 &cur_pixel_uv,
+                                                uint8_t &status,
+                                                const FeatureTrackingContext &context,
+                                                TrackingScratch &scratch) const override;
+    virtual void TrackOneFeatureInSingleLevel(const GrayImage &ref_image,
+                                              const GrayImage &cur_image,
+                                              const Vec2 &ref_pixel_uv,
+                                              Vec2 &cur_pixel_uv,
+                                              uint8_t &status,
+                                              const FeatureTrackingContext &context,
+                                              TrackingScratch &scratch) const override;
+    // Rotation angle and translation are fitted for each feature.
+    virtual uint32_t NumberOfFeatureParameters() const override { return 3; }
+    virtual void PrepareLevelMajorStates(uint32_t num_features) override;
+    virtual void InitializeLevelMajorState(uint32_t feature_id, const Vec2 &scaled_ref_pixel_uv, const Vec2 &scaled_cur_pixel_uv) override;
+    virtual void TrackOneFeatureInLevelMajor(const GrayImage &ref_image,
+                                             const GrayImage &cur_image,
+                                             uint32_t feature_id,
+                                             int32_t level_idx,
+                                             const Vec2 &scaled_ref_pixel_uv,
+                                             Vec2 &scaled_cur_pixel_uv,
+                                             uint8_t &status,
+                                             TrackingScratch &scratch) override;
+
+    // Track one feature in one pyramid level with selected method.
+    void TrackOneFeatureInOneLevel(const GrayImage &ref_image,
+                                   const GrayImage &cur_image,
+                                   const Vec2 &ref_pixel_uv,
+                                   Mat2 &R_cr,
+                                   Vec2 &t_cr,
+                                   uint8_t &status,
+                                   TrackingScratch &scratch) const;
 
     // Support for inverse/direct method.
     void TrackOneFeature(const GrayImage &ref_image,
@@ -38,14 +63,16 @@ private:
                          const Vec2 &ref_pixel_uv,
                          Mat2 &R_cr,
                          Vec2 &t_cr,
-                         uint8_t &status);
+                         uint8_t &status,
+                         TrackingScratch &scratch) const;
     int32_t ConstructIncrementalFunction(const GrayImage &ref_image,
                                          const GrayImage &cur_image,
                                          const Vec2 &ref_pixel_uv,
                                          const Mat2 &R_cr,
                                          const Vec2 &t_cr,
                                          Mat3 &hessian,
-                                         Vec3 &bias);
+                                         Vec3 &bias,
+                                         ConvergenceRecord &convergence) const;
 
     // Support for fast method.
     void TrackOneFeatureFast(const GrayImage &ref_image,
@@ -53,13 +80,14 @@ private:
                              const Vec2 &ref_pixel_uv,
                              Mat2 &R_cr,
                              Vec2 &t_cr,
-                             uint8_t &status);
+                             uint8_t &status,
+                             TrackingScratch &scratch) const;
     void PrecomputeJacobian(const std::vector<float> &ex_ref_patch,
-                            const std::vector<bool> &ex_ref_patch_pixel_valid,
+                            const std::vector<uint8_t> &ex_ref_patch_pixel_valid,
                             int32_t ex_ref_patch_rows,
                             int32_t ex_ref_patch_cols,
                             std::vector<float> &all_dx_in_ref_patch,
-                            std::vector<float> &all_dy_in_ref_patch);
+                            std::vector<float> &all_dy_in_ref_patch) const;
     uint32_t ExtractPatchInCurrentImage(const GrayImage &cur_image,
                                         const Vec2 &ref_pixel_uv,
                                         const Mat2 &R_cr,
@@ -67,23 +95,69 @@ private:
                                         int32_t cur_patch_rows,
                                         int32_t cur_patch_cols,
                                         std::vector<float> &cur_patch,
-                                        std::vector<bool> &cur_patch_pixel_valid);
+                                        std::vector<uint8_t> &cur_patch_pixel_valid) const;
     int32_t ComputeHessianAndBias(const GrayImage &cur_image,
                                   const Vec2 &ref_pixel_uv,
                                   const Mat2 &R_cr,
                                   const Vec2 &t_cr,
                                   const std::vector<float> &ex_ref_patch,
-                                  const std::vector<bool> &ex_ref_patch_pixel_valid,
+                                  const std::vector<uint8_t> &ex_ref_patch_pixel_valid,
                                   int32_t ex_ref_patch_rows,
                                   int32_t ex_ref_patch_cols,
                                   const std::vector<float> &all_dx_in_ref_patch,
                                   const std::vector<float> &all_dy_in_ref_patch,
                                   const std::vector<float> &cur_patch,
-                                  const std::vector<bool> &cur_patch_pixel_valid,
+                                  const std::vector<uint8_t> &cur_patch_pixel_valid,
                                   Mat3 &hessian,
-                                  Vec3 &bias);
+                                  Vec3 &bias,
+                                  ConvergenceRecord &convergence) const;
+
+    // Support for fast method with sparse patch pattern.
+    void TrackOneFeatureFastPattern(const GrayImage &ref_image,
+                                    const GrayImage &cur_image,
+                                    const Vec2 &ref_pixel_uv,
+                                    Mat2 &R_cr,
+                                    Vec2 &t_cr,
+                                    uint8_t &status,
+                                    TrackingScratch &scratch) const;
+    uint32_t ExtractPatternInCurrentImage(const GrayImage &cur_image,
+                                          const Vec2 &ref_pixel_uv,
+                                          const Mat2 &R_cr,
+                                          const Vec2 &t_cr,
+                                          std::vector<float> &cur_pattern,
+                                          std::vector<uint8_t> &cur_pattern_valid) const;
+    int32_t ComputeHessianAndBiasPattern(const Vec2 &ref_pixel_uv,
+                                         const Mat2 &R_cr,
+                                         TrackingScratch &scratch,
+                                         Mat3 &hessian,
+                                         Vec3 &bias) const;
 
     // Support for Sse method.
+    template <SimdLevel kSimdLevel>
+    void TrackOneFeatureSse(const GrayImage &ref_image,
+                            const GrayImage &cur_image,
+                            const Vec2 &ref_pixel_uv,
+                            Mat2 &R_cr,
+                            Vec2 &t_cr,
+                            uint8_t &status,
+                            TrackingScratch &scratch) const;
+    template <SimdLevel kSimdLevel>
+    void PrecomputeJacobianSse(const float *ex_ref_patch,
+                               const float *ex_ref_patch_pixel_valid,
+                               TrackingScratch &scratch) const;
+    template <SimdLevel kSimdLevel>
+    uint32_t ExtractPatchInCurrentImageSse(const GrayImage &cur_image,
+                                           const Vec2 &ref_pixel_uv,
+                                           const Mat2 &R_cr,
+                                           const Vec2 &t_cr,
+                                           TrackingScratch &scratch) const;
+    template <SimdLevel kSimdLevel>
+    int32_t ComputeHessianAndBiasSse(const Vec2 &ref_pixel_uv,
+                                     const Mat2 &R_cr,
+                                     float cur_patch_scale,
+                                     Mat3 &hessian,
+                                     Vec3 &bias,
+                                     TrackingScratch &scratch) const;
 
     // Support for Neon method.
 
@@ -92,6 +166,10 @@ private:
     Mat2 predict_R_cr_ = Mat2::Identity();
     bool consider_patch_luminance_ = false;
 
+    // Se2 transform of each feature kept between levels in level-major traversal.
+    std::vector<Mat2> R_cr_of_features_;
+    std::vector<Vec2> t_cr_of_features_;
+
 };
 
 }
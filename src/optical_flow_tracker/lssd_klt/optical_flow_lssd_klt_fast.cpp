@@ -9,11 +9,16 @@ void OpticalFlowLssdKlt::TrackOneFeatureFast(const GrayImage &ref_image,
                                              const Vec2 &ref_pixel_uv,
                                              Mat2 &R_cr,
                                              Vec2 &t_cr,
-                                             uint8_t &status) {
+                                             uint8_t &status,
+                                             TrackingScratch &scratch) const {
+    // Sample only points of sparse pattern if it is selected.
+    if (!patch_pattern().IsFull()) {
+        TrackOneFeatureFastPattern(ref_image, cur_image, ref_pixel_uv, R_cr, t_cr, status, scratch);
+        return;
+    }
+
     // Confirm extended patch size. Extract it from reference image.
-    ex_ref_patch().clear();
-    ex_ref_patch_pixel_valid().clear();
-    const uint32_t valid_pixel_num = ExtractExtendPatchInReferenceImage(ref_image, ref_pixel_uv, ex_ref_patch_rows(), ex_ref_patch_cols(), ex_ref_patch(), ex_ref_patch_pixel_valid());
+    const uint32_t valid_pixel_num = ExtractExtendPatchInReferenceImage(ref_image, ref_pixel_uv, ex_ref_patch_rows(), ex_ref_patch_cols(), scratch.ex_ref_patch, scratch.ex_ref_patch_pixel_valid);
 
     // If this feature has no valid pixel in patch, it can not be tracked.
     if (valid_pixel_num == 0) {
@@ -22,28 +27,37 @@ void OpticalFlowLssdKlt::TrackOneFeatureFast(const GrayImage &ref_image,
     }
 
     // Compute the image gradient of reference image.
-    all_dx_in_ref_patch().clear();
-    all_dy_in_ref_patch().clear();
-    PrecomputeJacobian(ex_ref_patch(), ex_ref_patch_pixel_valid(), ex_ref_patch_rows(), ex_ref_patch_cols(), all_dx_in_ref_patch(), all_dy_in_ref_patch());
+    if (!SampleGradientInReferencePatch(ref_image, ref_pixel_uv, scratch.all_dx_in_ref_patch, scratch.all_dy_in_ref_patch)) {
+        PrecomputeJacobian(scratch.ex_ref_patch, scratch.ex_ref_patch_pixel_valid, ex_ref_patch_rows(), ex_ref_patch_cols(), scratch.all_dx_in_ref_patch, scratch.all_dy_in_ref_patch);
+    }
 
-    // Compute the average value for reference patch.
+    // Compute the average value for reference patch. Only the patch inside of extended patch is averaged, so that
+    // it covers the same region with current patch.
     if (consider_patch_luminance_) {
         float ref_average_value = 0.0f;
+        uint32_t ref_valid_pixel_num = 0;
         for (int32_t row = 1; row < ex_ref_patch_rows() - 1; ++row) {
-            for (int32_t col = 1; col < ex_ref_patch_cols() - 1;++col) {
-                ref_average_value += ex_ref_patch()[row * ex_ref_patch_cols() + col];
+            for (int32_t col = 1; col < ex_ref_patch_cols() - 1; ++col) {
+                const int32_t ex_index = row * ex_ref_patch_cols() + col;
+                CONTINUE_IF(!scratch.ex_ref_patch_pixel_valid[ex_index]);
+                ref_average_value += scratch.ex_ref_patch[ex_index];
+                ++ref_valid_pixel_num;
             }
         }
-        ref_average_value /= static_cast<float>(valid_pixel_num);
+        if (ref_valid_pixel_num == 0) {
+            status = static_cast<uint8_t>(TrackStatus::kOutside);
+            return;
+        }
+        ref_average_value /= static_cast<float>(ref_valid_pixel_num);
 
         // Scale dx, dy and pixel value in reference patch.
-        for (auto &dx : all_dx_in_ref_patch()) {
+        for (auto &dx : scratch.all_dx_in_ref_patch) {
             dx /= ref_average_value;
         }
-        for (auto &dy : all_dy_in_ref_patch()) {
+        for (auto &dy : scratch.all_dy_in_ref_patch) {
             dy /= ref_average_value;
         }
-        for (auto &value : ex_ref_patch()) {
+        for (auto &value : scratch.ex_ref_patch) {
             value /= ref_average_value;
         }
     }
@@ -56,25 +70,23 @@ void OpticalFlowLssdKlt::TrackOneFeatureFast(const GrayImage &ref_image,
 
     Vec3 bias = Vec3::Zero();
     Mat3 hessian = Mat3::Zero();
-    for (uint32_t iter = 0; iter < options().kMaxIteration; ++iter) {
+    for (uint32_t iter = 0; iter < max_iteration(); ++iter) {
+        RecordIteration(scratch);
+
         // Extract patch in current image, and compute average value.
-        cur_patch().clear();
-        cur_patch_pixel_valid().clear();
-        const uint32_t valid_pixel_num = ExtractPatchInCurrentImage(cur_image, ref_pixel_uv, R_cr, t_cr, patch_rows(), patch_cols(), cur_patch(), cur_patch_pixel_valid());
+        const uint32_t valid_pixel_num = ExtractPatchInCurrentImage(cur_image, ref_pixel_uv, R_cr, t_cr, patch_rows(), patch_cols(), scratch.cur_patch, scratch.cur_patch_pixel_valid);
         BREAK_IF(valid_pixel_num == 0);
 
-        // Compute the average value for reference patch.
+        // Compute the average value for current patch. Invalid pixels are zero, so they are not summed.
         if (consider_patch_luminance_) {
             float cur_average_value = 0.0f;
-            for (int32_t row = 1; row < patch_rows() - 1; ++row) {
-                for (int32_t col = 1; col < patch_cols() - 1;++col) {
-                    cur_average_value += cur_patch()[row * patch_cols() + col];
-                }
+            for (const float &value : scratch.cur_patch) {
+                cur_average_value += value;
             }
             cur_average_value /= static_cast<float>(valid_pixel_num);
 
             // Scale pixel value in current patch.
-            for (auto &value : cur_patch()) {
+            for (auto &value : scratch.cur_patch) {
                 value /= cur_average_value;
             }
         }
@@ -82,11 +94,12 @@ void OpticalFlowLssdKlt::TrackOneFeatureFast(const GrayImage &ref_image,
         // Compute hessian and bias.
         hessian.setZero();
         bias.setZero();
-        BREAK_IF(ComputeHessianAndBias(cur_image, ref_pixel_uv, R_cr, t_cr, ex_ref_patch(), ex_ref_patch_pixel_valid(), ex_ref_patch_rows(), ex_ref_patch_cols(),
-            all_dx_in_ref_patch(), all_dy_in_ref_patch(), cur_patch(), cur_patch_pixel_valid(), hessian, bias) == 0);
+        BREAK_IF(ComputeHessianAndBias(cur_image, ref_pixel_uv, R_cr, t_cr, scratch.ex_ref_patch, scratch.ex_ref_patch_pixel_valid, ex_ref_patch_rows(), ex_ref_patch_cols(),
+            scratch.all_dx_in_ref_patch, scratch.all_dy_in_ref_patch, scratch.cur_patch, scratch.cur_patch_pixel_valid, hessian, bias, scratch.convergence) == 0);
+        RecordHessian(scratch, hessian);
 
         // Solve incremental function.
-        const Vec3 v = hessian.ldlt().solve(bias);
+        const Vec3 v = SolveIncrementalFunction(hessian, bias);
         if (Eigen::isnan(v.array()).any()) {
             status = static_cast<uint8_t>(TrackStatus::kNumericError);
             break;
@@ -115,16 +128,20 @@ void OpticalFlowLssdKlt::TrackOneFeatureFast(const GrayImage &ref_image,
 }
 
 void OpticalFlowLssdKlt::PrecomputeJacobian(const std::vector<float> &ex_ref_patch,
-                                            const std::vector<bool> &ex_ref_patch_pixel_valid,
+                                            const std::vector<uint8_t> &ex_ref_patch_pixel_valid,
                                             int32_t ex_ref_patch_rows,
                                             int32_t ex_ref_patch_cols,
                                             std::vector<float> &all_dx_in_ref_patch,
-                                            std::vector<float> &all_dy_in_ref_patch) {
+                                            std::vector<float> &all_dy_in_ref_patch) const {
+    PROFILE_ZONE(kPrecomputeJacobian);
     const int32_t patch_rows = ex_ref_patch_rows - 2;
     const int32_t patch_cols = ex_ref_patch_cols - 2;
+    all_dx_in_ref_patch.resize(patch_rows * patch_cols);
+    all_dy_in_ref_patch.resize(patch_rows * patch_cols);
 
     for (int32_t row = 0; row < patch_rows; ++row) {
         for (int32_t col = 0; col < patch_cols; ++col) {
+            const int32_t index = row * patch_cols + col;
             const int32_t ex_index = (row + 1) * ex_ref_patch_cols + col + 1;
             const int32_t ex_index_left = ex_index - 1;
             const int32_t ex_index_right = ex_index + 1;
@@ -136,11 +153,11 @@ void OpticalFlowLssdKlt::PrecomputeJacobian(const std::vector<float> &ex_ref_pat
                 // Compute dx and dy for jacobian.
                 const float dx = ex_ref_patch[ex_index_right] - ex_ref_patch[ex_index_left];
                 const float dy = ex_ref_patch[ex_index_bottom] - ex_ref_patch[ex_index_top];
-                all_dx_in_ref_patch.emplace_back(dx);
-                all_dy_in_ref_patch.emplace_back(dy);
+                all_dx_in_ref_patch[index] = dx;
+                all_dy_in_ref_patch[index] = dy;
             } else {
-                all_dx_in_ref_patch.emplace_back(0.0f);
-                all_dy_in_ref_patch.emplace_back(0.0f);
+                all_dx_in_ref_patch[index] = 0.0f;
+                all_dy_in_ref_patch[index] = 0.0f;
             }
         }
     }
@@ -153,55 +170,40 @@ uint32_t OpticalFlowLssdKlt::ExtractPatchInCurrentImage(const GrayImage &cur_ima
                                                         int32_t cur_patch_rows,
                                                         int32_t cur_patch_cols,
                                                         std::vector<float> &cur_patch,
-                                                        std::vector<bool> &cur_patch_pixel_valid) {
-    // Check if this patch inside of current image.
-    const Vec2 cur_pixel_uv = R_cr * ref_pixel_uv + t_cr;
-    const int32_t min_cur_pixel_row = static_cast<int32_t>(cur_pixel_uv.y()) - cur_patch_rows;
-    const int32_t min_cur_pixel_col = static_cast<int32_t>(cur_pixel_uv.x()) - cur_patch_cols;
-    const int32_t max_cur_pixel_row = min_cur_pixel_row + cur_patch_rows * 2;
-    const int32_t max_cur_pixel_col = min_cur_pixel_col + cur_patch_cols * 2;
-
-    float temp_value = 0.0f;
-    if (min_cur_pixel_row < 0 || max_cur_pixel_row > cur_image.rows() - 2 ||
-        min_cur_pixel_col < 0 || max_cur_pixel_col > cur_image.cols() - 2) {
-        // If this patch is partly outside of current image.
-        uint32_t valid_pixel_cnt = 0;
-        for (int32_t drow = - options().kPatchRowHalfSize; drow <= options().kPatchRowHalfSize; ++drow) {
-            for (int32_t dcol = - options().kPatchColHalfSize; dcol <= options().kPatchColHalfSize; ++dcol) {
-                const float row_i = static_cast<float>(drow) + ref_pixel_uv.y();
-                const float col_i = static_cast<float>(dcol) + ref_pixel_uv.x();
-                const Vec2 cur_patch_pixel_uv = R_cr * Vec2(col_i, row_i) + t_cr;
-                const float row_j = cur_patch_pixel_uv.y();
-                const float col_j = cur_patch_pixel_uv.x();
-
-                if (cur_image.GetPixelValue(row_j, col_j, &temp_value)) {
-                    cur_patch.emplace_back(temp_value);
-                    cur_patch_pixel_valid.emplace_back(true);
-                    ++valid_pixel_cnt;
-                } else {
-                    cur_patch.emplace_back(0.0f);
-                    cur_patch_pixel_valid.emplace_back(false);
-                }
-            }
-        }
+                                                        std::vector<uint8_t> &cur_patch_pixel_valid) const {
+    cur_patch.resize(patch_size());
+    cur_patch_pixel_valid.resize(patch_size());
 
-        return valid_pixel_cnt;
-    } else {
-        // If this patch is totally inside of current image.
-        for (int32_t drow = - options().kPatchRowHalfSize; drow <= options().kPatchRowHalfSize; ++drow) {
-            for (int32_t dcol = - options().kPatchColHalfSize; dcol <= options().kPatchColHalfSize; ++dcol) {
-                const float row_i = static_cast<float>(drow) + ref_pixel_uv.y();
-                const float col_i = static_cast<float>(dcol) + ref_pixel_uv.x();
-                const Vec2 cur_patch_pixel_uv = R_cr * Vec2(col_i, row_i) + t_cr;
-                const float row_j = cur_patch_pixel_uv.y();
-                const float col_j = cur_patch_pixel_uv.x();
-
-                cur_patch.emplace_back(cur_image.GetPixelValueNoCheck(row_j, col_j));
-                cur_patch_pixel_valid.emplace_back(true);
-            }
+    // Only valid pixels in each row of transformed patch are sampled.
+    const PaddedImageView image_view = GetImageView(cur_image);
+    uint32_t valid_pixel_cnt = 0;
+    bool is_partly_outside = false;
+    for (int32_t row = 0; row < cur_patch_rows; ++row) {
+        const float row_i = static_cast<float>(row - options().kPatchRowHalfSize) + ref_pixel_uv.y();
+        const auto position = [&] (int32_t col) -> Vec2 {
+            const float col_i = static_cast<float>(col - options().kPatchColHalfSize) + ref_pixel_uv.x();
+            return R_cr * Vec2(col_i, row_i) + t_cr;
+        };
+        int32_t valid_begin = 0;
+        int32_t valid_end = 0;
+        image_view.GetValidRangeInLine(cur_patch_cols, position, valid_begin, valid_end);
+        is_partly_outside |= valid_begin != 0 || valid_end != cur_patch_cols;
+
+        float *patch_row = cur_patch.data() + row * cur_patch_cols;
+        uint8_t *valid_row = cur_patch_pixel_valid.data() + row * cur_patch_cols;
+        for (int32_t col = valid_begin; col < valid_end; ++col) {
+            const Vec2 cur_patch_pixel_uv = position(col);
+            patch_row[col] = image_view.GetPixelValueNoCheck(cur_patch_pixel_uv.y(), cur_patch_pixel_uv.x());
         }
-        return cur_patch.size();
+        std::fill(patch_row, patch_row + valid_begin, 0.0f);
+        std::fill(patch_row + valid_end, patch_row + cur_patch_cols, 0.0f);
+        std::fill(valid_row, valid_row + cur_patch_cols, 0);
+        std::fill(valid_row + valid_begin, valid_row + valid_end, 1);
+        valid_pixel_cnt += valid_end - valid_begin;
     }
+    PROFILE_COUNT(kOutsideImageFallback, is_partly_outside ? 1 : 0);
+
+    return valid_pixel_cnt;
 }
 
 int32_t OpticalFlowLssdKlt::ComputeHessianAndBias(const GrayImage &cur_image,
@@ -209,16 +211,19 @@ int32_t OpticalFlowLssdKlt::ComputeHessianAndBias(const GrayImage &cur_image,
                                                   const Mat2 &R_cr,
                                                   const Vec2 &t_cr,
                                                   const std::vector<float> &ex_ref_patch,
-                                                  const std::vector<bool> &ex_ref_patch_pixel_valid,
+                                                  const std::vector<uint8_t> &ex_ref_patch_pixel_valid,
                                                   int32_t ex_ref_patch_rows,
                                                   int32_t ex_ref_patch_cols,
                                                   const std::vector<float> &all_dx_in_ref_patch,
                                                   const std::vector<float> &all_dy_in_ref_patch,
                                                   const std::vector<float> &cur_patch,
-                                                  const std::vector<bool> &cur_patch_pixel_valid,
+                                                  const std::vector<uint8_t> &cur_patch_pixel_valid,
                                                   Mat3 &hessian,
-                                                  Vec3 &bias) {
+                                                  Vec3 &bias,
+                                                  ConvergenceRecord &convergence) const {
+    PROFILE_ZONE(kComputeBias);
     int32_t num_of_valid_pixel = 0;
+    float squared_residual = 0.0f;
     Mat1x3 jacobian = Mat1x3::Zero();
 
     // For inverse optical flow, use reference image to compute gradient.
@@ -240,11 +245,13 @@ int32_t OpticalFlowLssdKlt::ComputeHessianAndBias(const GrayImage &cur_image,
 
                 hessian += jacobian.transpose() * jacobian;
                 bias -= jacobian.transpose() * residual;
+                squared_residual += residual * residual;
 
                 ++num_of_valid_pixel;
             }
         }
     }
+    RecordResidual(convergence, squared_residual, num_of_valid_pixel);
 
     return num_of_valid_pixel;
 }
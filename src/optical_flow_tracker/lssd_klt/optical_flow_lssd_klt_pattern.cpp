@@ -0,0 +1,168 @@
+#include "optical_flow_lssd_klt.h"
+#include "slam_log_reporter.h"
+#include "slam_operations.h"
+
+namespace FEATURE_TRACKER {
+
+void OpticalFlowLssdKlt::TrackOneFeatureFastPattern(const GrayImage &ref_image,
+                                                    const GrayImage &cur_image,
+                                                    const Vec2 &ref_pixel_uv,
+                                                    Mat2 &R_cr,
+                                                    Vec2 &t_cr,
+                                                    uint8_t &status,
+                                                    TrackingScratch &scratch) const {
+    // Sample pixel value and gradient at pattern points in reference image.
+    const uint32_t valid_point_num = ExtractPatternInReferenceImage(ref_image, ref_pixel_uv, scratch.ref_pattern, scratch.ref_pattern_valid,
+        scratch.all_dx_in_ref_pattern, scratch.all_dy_in_ref_pattern);
+
+    // If this feature has no valid point in pattern, it can not be tracked.
+    if (valid_point_num == 0) {
+        status = static_cast<uint8_t>(TrackStatus::kOutside);
+        return;
+    }
+
+    // Compute the average value for reference pattern. Invalid points are zero.
+    if (consider_patch_luminance_) {
+        float ref_average_value = 0.0f;
+        for (const float &value : scratch.ref_pattern) {
+            ref_average_value += value;
+        }
+        ref_average_value /= static_cast<float>(valid_point_num);
+
+        // Scale dx, dy and pixel value in reference pattern.
+        for (uint32_t i = 0; i < scratch.ref_pattern.size(); ++i) {
+            scratch.all_dx_in_ref_pattern[i] /= ref_average_value;
+            scratch.all_dy_in_ref_pattern[i] /= ref_average_value;
+            scratch.ref_pattern[i] /= ref_average_value;
+        }
+    }
+
+    // Compute incremental by iteration.
+    status = static_cast<uint8_t>(TrackStatus::kLargeResidual);
+    float last_squared_step = INFINITY;
+    uint32_t large_step_cnt = 0;
+    Mat2 delta_R = Mat2::Identity();
+
+    Vec3 bias = Vec3::Zero();
+    Mat3 hessian = Mat3::Zero();
+    for (uint32_t iter = 0; iter < max_iteration(); ++iter) {
+        RecordIteration(scratch);
+
+        // Extract pattern in current image, and compute average value.
+        const uint32_t valid_point_num = ExtractPatternInCurrentImage(cur_image, ref_pixel_uv, R_cr, t_cr, scratch.cur_pattern, scratch.cur_pattern_valid);
+        BREAK_IF(valid_point_num == 0);
+
+        if (consider_patch_luminance_) {
+            float cur_average_value = 0.0f;
+            for (const float &value : scratch.cur_pattern) {
+                cur_average_value += value;
+            }
+            cur_average_value /= static_cast<float>(valid_point_num);
+
+            // Scale pixel value in current pattern.
+            for (auto &value : scratch.cur_pattern) {
+                value /= cur_average_value;
+            }
+        }
+
+        // Compute hessian and bias.
+        hessian.setZero();
+        bias.setZero();
+        BREAK_IF(ComputeHessianAndBiasPattern(ref_pixel_uv, R_cr, scratch, hessian, bias) == 0);
+        RecordHessian(scratch, hessian);
+
+        // Solve incremental function.
+        const Vec3 v = SolveIncrementalFunction(hessian, bias);
+        if (Eigen::isnan(v.array()).any()) {
+            status = static_cast<uint8_t>(TrackStatus::kNumericError);
+            break;
+        }
+
+        // Update rotation and translation.
+        delta_R << 1, -v.x(), v.x(), 1;
+        R_cr *= delta_R;
+        R_cr /= R_cr.col(0).norm();
+        t_cr += v.tail<2>();
+
+        // Check if this step is converged.
+        const float squared_step = v.squaredNorm();
+        if (squared_step < last_squared_step) {
+            last_squared_step = squared_step;
+            large_step_cnt = 0;
+        } else {
+            ++large_step_cnt;
+            BREAK_IF(large_step_cnt >= options().kMaxToleranceLargeStep);
+        }
+        if (squared_step < options().kMaxConvergeStep) {
+            status = static_cast<uint8_t>(TrackStatus::kTracked);
+            break;
+        }
+    }
+}
+
+uint32_t OpticalFlowLssdKlt::ExtractPatternInCurrentImage(const GrayImage &cur_image,
+                                                          const Vec2 &ref_pixel_uv,
+                                                          const Mat2 &R_cr,
+                                                          const Vec2 &t_cr,
+                                                          std::vector<float> &cur_pattern,
+                                                          std::vector<uint8_t> &cur_pattern_valid) const {
+    const uint32_t num_points = patch_pattern().size();
+    cur_pattern.resize(num_points);
+    cur_pattern_valid.resize(num_points);
+
+    uint32_t valid_point_cnt = 0;
+    float value = 0.0f;
+    for (uint32_t i = 0; i < num_points; ++i) {
+        const PatchPatternPoint &point = patch_pattern().points()[i];
+        const float row_i = static_cast<float>(point.drow) + ref_pixel_uv.y();
+        const float col_i = static_cast<float>(point.dcol) + ref_pixel_uv.x();
+        const Vec2 cur_pattern_pixel_uv = R_cr * Vec2(col_i, row_i) + t_cr;
+
+        if (cur_image.GetPixelValue(cur_pattern_pixel_uv.y(), cur_pattern_pixel_uv.x(), &value)) {
+            cur_pattern[i] = value;
+            cur_pattern_valid[i] = 1;
+            ++valid_point_cnt;
+        } else {
+            cur_pattern[i] = 0.0f;
+            cur_pattern_valid[i] = 0;
+        }
+    }
+
+    return valid_point_cnt;
+}
+
+int32_t OpticalFlowLssdKlt::ComputeHessianAndBiasPattern(const Vec2 &ref_pixel_uv,
+                                                         const Mat2 &R_cr,
+                                                         TrackingScratch &scratch,
+                                                         Mat3 &hessian,
+                                                         Vec3 &bias) const {
+    PROFILE_ZONE(kComputeBias);
+    int32_t num_of_valid_point = 0;
+    float squared_residual = 0.0f;
+    Mat1x3 jacobian = Mat1x3::Zero();
+
+    // For inverse optical flow, use reference image to compute gradient.
+    const std::vector<PatchPatternPoint> &points = patch_pattern().points();
+    for (uint32_t i = 0; i < points.size(); ++i) {
+        // If the point is both valid in ref and cur pattern.
+        CONTINUE_IF(!scratch.ref_pattern_valid[i] || !scratch.cur_pattern_valid[i]);
+
+        const float row_i = static_cast<float>(points[i].drow) + ref_pixel_uv.y();
+        const float col_i = static_cast<float>(points[i].dcol) + ref_pixel_uv.x();
+        const float dx = scratch.all_dx_in_ref_pattern[i];
+        const float dy = scratch.all_dy_in_ref_pattern[i];
+        jacobian << Vec2(dx, dy).dot(R_cr * Vec2(-row_i, col_i)), dx, dy;
+        const float residual = scratch.cur_pattern[i] - scratch.ref_pattern[i];
+
+        hessian += jacobian.transpose() * jacobian;
+        bias -= jacobian.transpose() * residual;
+        squared_residual += residual * residual;
+
+        ++num_of_valid_point;
+    }
+    RecordResidual(scratch.convergence, squared_residual, num_of_valid_point);
+
+    return num_of_valid_point;
+}
+
+}
@@ -0,0 +1,315 @@
+#include "optical_flow_lssd_klt.h"
+#include "slam_log_reporter.h"
+#include "slam_operations.h"
+#include "optical_flow_simd.h"
+
+namespace FEATURE_TRACKER {
+
+OPTICAL_FLOW_SIMD_BEGIN
+
+template <SimdLevel kSimdLevel>
+void OpticalFlowLssdKlt::TrackOneFeatureSse(const GrayImage &ref_image,
+                                            const GrayImage &cur_image,
+                                            const Vec2 &ref_pixel_uv,
+                                            Mat2 &R_cr,
+                                            Vec2 &t_cr,
+                                            uint8_t &status,
+                                            TrackingScratch &scratch) const {
+    using Float8 = SimdFloat8<kSimdLevel>;
+    // Confirm extended patch size. Extract it from reference image.
+    const uint32_t valid_pixel_num = ExtractExtendPatchInReferenceImageSse<kSimdLevel>(ref_image, ref_pixel_uv, ex_ref_patch_rows(), ex_ref_patch_cols(),
+        ex_patch_stride_sse(), scratch.ex_ref_patch_sse.data(), scratch.ex_ref_patch_pixel_valid_sse.data());
+
+    // If this feature has no valid pixel in patch, it can not be tracked.
+    if (valid_pixel_num == 0) {
+        status = static_cast<uint8_t>(TrackStatus::kOutside);
+        return;
+    }
+
+    // Compute the image gradient of reference image.
+    PrecomputeJacobianSse<kSimdLevel>(scratch.ex_ref_patch_sse.data(), scratch.ex_ref_patch_pixel_valid_sse.data(), scratch);
+
+    // Compute the average value for reference patch. It covers the same region with current patch.
+    const int32_t stride = patch_stride_sse();
+    if (consider_patch_luminance_) {
+        Float8 ref_sum = Float8::Zero();
+        Float8 ref_valid_cnt = Float8::Zero();
+        for (int32_t index = 0; index < patch_rows() * stride; index += Float8::kSize) {
+            const Float8 valid = Float8::Load(scratch.ref_patch_pixel_valid_sse.data() + index);
+            ref_sum = Float8::MulAdd(Float8::Load(scratch.ref_patch_sse.data() + index), valid, ref_sum);
+            ref_valid_cnt = ref_valid_cnt + valid;
+        }
+        if (ref_valid_cnt.Sum() == 0.0f) {
+            status = static_cast<uint8_t>(TrackStatus::kOutside);
+            return;
+        }
+        const Float8 ref_scale = Float8::Set(ref_valid_cnt.Sum() / ref_sum.Sum());
+
+        // Scale dx, dy and pixel value in reference patch.
+        for (int32_t index = 0; index < patch_rows() * stride; index += Float8::kSize) {
+            (Float8::Load(scratch.all_dx_in_ref_patch_sse.data() + index) * ref_scale).Store(scratch.all_dx_in_ref_patch_sse.data() + index);
+            (Float8::Load(scratch.all_dy_in_ref_patch_sse.data() + index) * ref_scale).Store(scratch.all_dy_in_ref_patch_sse.data() + index);
+            (Float8::Load(scratch.ref_patch_sse.data() + index) * ref_scale).Store(scratch.ref_patch_sse.data() + index);
+        }
+    }
+
+    // Compute incremental by iteration.
+    status = static_cast<uint8_t>(TrackStatus::kLargeResidual);
+    float last_squared_step = INFINITY;
+    uint32_t large_step_cnt = 0;
+    Mat2 delta_R = Mat2::Identity();
+
+    Vec3 bias = Vec3::Zero();
+    Mat3 hessian = Mat3::Zero();
+    for (uint32_t iter = 0; iter < max_iteration(); ++iter) {
+        RecordIteration(scratch);
+
+        // Extract patch in current image.
+        const uint32_t valid_pixel_num = ExtractPatchInCurrentImageSse<kSimdLevel>(cur_image, ref_pixel_uv, R_cr, t_cr, scratch);
+        BREAK_IF(valid_pixel_num == 0);
+
+        // Compute the average value for current patch. Invalid pixels are zero, so they are not summed.
+        float cur_patch_scale = 1.0f;
+        if (consider_patch_luminance_) {
+            float cur_average_value = 0.0f;
+            for (int32_t row = 0; row < patch_rows(); ++row) {
+                for (int32_t col = 0; col < patch_cols(); ++col) {
+                    cur_average_value += scratch.cur_patch_sse[row * stride + col];
+                }
+            }
+            cur_average_value /= static_cast<float>(valid_pixel_num);
+            cur_patch_scale = 1.0f / cur_average_value;
+        }
+
+        // Compute hessian and bias.
+        BREAK_IF(ComputeHessianAndBiasSse<kSimdLevel>(ref_pixel_uv, R_cr, cur_patch_scale, hessian, bias, scratch) == 0);
+        RecordHessian(scratch, hessian);
+
+        // Solve incremental function.
+        const Vec3 v = SolveIncrementalFunction(hessian, bias);
+        if (Eigen::isnan(v.array()).any()) {
+            status = static_cast<uint8_t>(TrackStatus::kNumericError);
+            break;
+        }
+
+        // Update rotation and translation.
+        delta_R << 1, -v.x(), v.x(), 1;
+        R_cr *= delta_R;
+        R_cr /= R_cr.col(0).norm();
+        t_cr += v.tail<2>();
+
+        // Check if this step is converged.
+        const float squared_step = v.squaredNorm();
+        if (squared_step < last_squared_step) {
+            last_squared_step = squared_step;
+            large_step_cnt = 0;
+        } else {
+            ++large_step_cnt;
+            BREAK_IF(large_step_cnt >= options().kMaxToleranceLargeStep);
+        }
+        if (squared_step < options().kMaxConvergeStep) {
+            status = static_cast<uint8_t>(TrackStatus::kTracked);
+            break;
+        }
+    }
+}
+
+template <SimdLevel kSimdLevel>
+void OpticalFlowLssdKlt::PrecomputeJacobianSse(const float *ex_ref_patch,
+                                               const float *ex_ref_patch_pixel_valid,
+                                               TrackingScratch &scratch) const {
+    using Float8 = SimdFloat8<kSimdLevel>;
+    PROFILE_ZONE(kPrecomputeJacobian);
+    const int32_t stride = patch_stride_sse();
+    const int32_t ex_stride = ex_patch_stride_sse();
+
+    for (int32_t row = 0; row < patch_rows(); ++row) {
+        const int32_t ex_row_offset = (row + 1) * ex_stride + 1;
+        for (int32_t col = 0; col < stride; col += Float8::kSize) {
+            const int32_t ex_index = ex_row_offset + col;
+            const int32_t index = row * stride + col;
+
+            // Gradient is valid only if all four neighbours are valid.
+            const Float8 valid = Float8::Load(ex_ref_patch_pixel_valid + ex_index - 1) *
+                                 Float8::Load(ex_ref_patch_pixel_valid + ex_index + 1) *
+                                 Float8::Load(ex_ref_patch_pixel_valid + ex_index - ex_stride) *
+                                 Float8::Load(ex_ref_patch_pixel_valid + ex_index + ex_stride) *
+                                 Float8::Load(patch_col_valid_sse().data() + col);
+
+            // Compute dx and dy for jacobian.
+            const Float8 dx = (Float8::Load(ex_ref_patch + ex_index + 1) - Float8::Load(ex_ref_patch + ex_index - 1)) * valid;
+            const Float8 dy = (Float8::Load(ex_ref_patch + ex_index + ex_stride) - Float8::Load(ex_ref_patch + ex_index - ex_stride)) * valid;
+            dx.Store(scratch.all_dx_in_ref_patch_sse.data() + index);
+            dy.Store(scratch.all_dy_in_ref_patch_sse.data() + index);
+
+            // Keep pixel value and validity of the center for computing residual.
+            Float8::Load(ex_ref_patch + ex_index).Store(scratch.ref_patch_sse.data() + index);
+            (Float8::Load(ex_ref_patch_pixel_valid + ex_index) * Float8::Load(patch_col_valid_sse().data() + col)).Store(scratch.ref_patch_pixel_valid_sse.data() + index);
+        }
+    }
+}
+
+template <SimdLevel kSimdLevel>
+uint32_t OpticalFlowLssdKlt::ExtractPatchInCurrentImageSse(const GrayImage &cur_image,
+                                                           const Vec2 &ref_pixel_uv,
+                                                           const Mat2 &R_cr,
+                                                           const Vec2 &t_cr,
+                                                           TrackingScratch &scratch) const {
+    using Float8 = SimdFloat8<kSimdLevel>;
+    const int32_t stride = patch_stride_sse();
+
+    // Compute bounding box of rotated patch, including padded lanes.
+    float min_col = INFINITY;
+    float max_col = - INFINITY;
+    float min_row = INFINITY;
+    float max_row = - INFINITY;
+    for (const int32_t &dcol : {- options().kPatchColHalfSize, stride - 1 - options().kPatchColHalfSize}) {
+        for (const int32_t &drow : {- options().kPatchRowHalfSize, options().kPatchRowHalfSize}) {
+            const Vec2 corner = R_cr * (ref_pixel_uv + Vec2(dcol, drow)) + t_cr;
+            min_col = std::min(min_col, corner.x());
+            max_col = std::max(max_col, corner.x());
+            min_row = std::min(min_row, corner.y());
+            max_row = std::max(max_row, corner.y());
+        }
+    }
+
+    // Vector lanes gather 4 pixels from top and bottom rows of each position, with one pixel of margin for rounding.
+    // If they can not be read, only valid pixels in each row are sampled. Invalid pixels are zero either way.
+    const PaddedImageView image_view = GetImageView(cur_image);
+    const bool is_readable = image_view.IsInside(min_row - 1.0f, min_col - 1.0f, max_row + 2.0f, max_col + 4.0f);
+    const Float8 r00 = Float8::Set(R_cr(0, 0));
+    const Float8 r10 = Float8::Set(R_cr(1, 0));
+    const Float8 dcols = Float8::Sequence(0.0f);
+    uint32_t valid_pixel_cnt = 0;
+    bool is_partly_outside = false;
+    for (int32_t row = 0; row < patch_rows(); ++row) {
+        const float row_i = static_cast<float>(row - options().kPatchRowHalfSize) + ref_pixel_uv.y();
+        const auto position = [&] (int32_t col) -> Vec2 {
+            const float col_i = static_cast<float>(col - options().kPatchColHalfSize) + ref_pixel_uv.x();
+            return R_cr * Vec2(col_i, row_i) + t_cr;
+        };
+        int32_t valid_begin = 0;
+        int32_t valid_end = 0;
+        image_view.GetValidRangeInLine(patch_cols(), position, valid_begin, valid_end);
+        is_partly_outside |= valid_begin != 0 || valid_end != patch_cols();
+
+        float *cur_patch_row = scratch.cur_patch_sse.data() + row * stride;
+        float *cur_valid_row = scratch.cur_patch_pixel_valid_sse.data() + row * stride;
+        if (is_readable) {
+            // Step along rotated columns incrementally.
+            for (int32_t col = 0; col < stride; col += Float8::kSize) {
+                const Vec2 first_pixel_uv = position(col);
+                const Float8 x = Float8::MulAdd(r00, dcols, Float8::Set(first_pixel_uv.x()));
+                const Float8 y = Float8::MulAdd(r10, dcols, Float8::Set(first_pixel_uv.y()));
+                Float8::SampleBilinear(image_view.GetPixelPtr(0, 0), image_view.stride(), x, y).Store(cur_patch_row + col);
+            }
+        } else {
+            for (int32_t col = valid_begin; col < valid_end; ++col) {
+                const Vec2 cur_patch_pixel_uv = position(col);
+                cur_patch_row[col] = image_view.GetPixelValueNoCheck(cur_patch_pixel_uv.y(), cur_patch_pixel_uv.x());
+            }
+        }
+        std::fill(cur_patch_row, cur_patch_row + valid_begin, 0.0f);
+        std::fill(cur_patch_row + valid_end, cur_patch_row + stride, 0.0f);
+        std::fill_n(cur_valid_row, stride, 0.0f);
+        std::fill(cur_valid_row + valid_begin, cur_valid_row + valid_end, 1.0f);
+        valid_pixel_cnt += valid_end - valid_begin;
+    }
+    if (is_partly_outside) {
+        PROFILE_COUNT(kPaddedBorderFastPath, is_readable ? 1 : 0);
+        PROFILE_COUNT(kOutsideImageFallback, is_readable ? 0 : 1);
+    }
+
+    return valid_pixel_cnt;
+}
+
+template <SimdLevel kSimdLevel>
+int32_t OpticalFlowLssdKlt::ComputeHessianAndBiasSse(const Vec2 &ref_pixel_uv,
+                                                     const Mat2 &R_cr,
+                                                     float cur_patch_scale,
+                                                     Mat3 &hessian,
+                                                     Vec3 &bias,
+                                                     TrackingScratch &scratch) const {
+    using Float8 = SimdFloat8<kSimdLevel>;
+    PROFILE_ZONE(kComputeBias);
+    const int32_t stride = patch_stride_sse();
+    const Float8 scale = Float8::Set(cur_patch_scale);
+    const Float8 r00 = Float8::Set(R_cr(0, 0));
+    const Float8 r01 = Float8::Set(R_cr(0, 1));
+    const Float8 r10 = Float8::Set(R_cr(1, 0));
+    const Float8 r11 = Float8::Set(R_cr(1, 1));
+
+    // Upper triangle of hessian and bias are accumulated in vector lanes, they will be reduced once per patch.
+    Float8 hessian_00 = Float8::Zero();
+    Float8 hessian_01 = Float8::Zero();
+    Float8 hessian_02 = Float8::Zero();
+    Float8 hessian_11 = Float8::Zero();
+    Float8 hessian_12 = Float8::Zero();
+    Float8 hessian_22 = Float8::Zero();
+    Float8 bias_0 = Float8::Zero();
+    Float8 bias_1 = Float8::Zero();
+    Float8 bias_2 = Float8::Zero();
+    Float8 valid_cnt = Float8::Zero();
+    Float8 squared_residual = Float8::Zero();
+
+    for (int32_t row = 0; row < patch_rows(); ++row) {
+        const Float8 neg_row_i = Float8::Set(- static_cast<float>(row - options().kPatchRowHalfSize) - ref_pixel_uv.y());
+        for (int32_t col = 0; col < stride; col += Float8::kSize) {
+            const int32_t index = row * stride + col;
+            const Float8 col_i = Float8::Sequence(static_cast<float>(col - options().kPatchColHalfSize) + ref_pixel_uv.x());
+
+            // If the pixel is both valid in reference patch and current patch.
+            const Float8 valid = Float8::Load(scratch.ref_patch_pixel_valid_sse.data() + index) *
+                                 Float8::Load(scratch.cur_patch_pixel_valid_sse.data() + index);
+            const Float8 dx = Float8::Load(scratch.all_dx_in_ref_patch_sse.data() + index) * valid;
+            const Float8 dy = Float8::Load(scratch.all_dy_in_ref_patch_sse.data() + index) * valid;
+            const Float8 residual = (Float8::Load(scratch.cur_patch_sse.data() + index) * scale - Float8::Load(scratch.ref_patch_sse.data() + index)) * valid;
+
+            // Jacobian is [(dx, dy) * R_cr * (-row_i, col_i), dx, dy].
+            const Float8 rotated_x = Float8::MulAdd(r00, neg_row_i, r01 * col_i);
+            const Float8 rotated_y = Float8::MulAdd(r10, neg_row_i, r11 * col_i);
+            const Float8 d_theta = Float8::MulAdd(dx, rotated_x, dy * rotated_y);
+
+            hessian_00 = Float8::MulAdd(d_theta, d_theta, hessian_00);
+            hessian_01 = Float8::MulAdd(d_theta, dx, hessian_01);
+            hessian_02 = Float8::MulAdd(d_theta, dy, hessian_02);
+            hessian_11 = Float8::MulAdd(dx, dx, hessian_11);
+            hessian_12 = Float8::MulAdd(dx, dy, hessian_12);
+            hessian_22 = Float8::MulAdd(dy, dy, hessian_22);
+            bias_0 = Float8::MulAdd(d_theta, residual, bias_0);
+            bias_1 = Float8::MulAdd(dx, residual, bias_1);
+            bias_2 = Float8::MulAdd(dy, residual, bias_2);
+            valid_cnt = valid_cnt + valid;
+            squared_residual = Float8::MulAdd(residual, residual, squared_residual);
+        }
+    }
+
+    hessian(0, 0) = hessian_00.Sum();
+    hessian(0, 1) = hessian_01.Sum();
+    hessian(0, 2) = hessian_02.Sum();
+    hessian(1, 1) = hessian_11.Sum();
+    hessian(1, 2) = hessian_12.Sum();
+    hessian(2, 2) = hessian_22.Sum();
+    hessian(1, 0) = hessian(0, 1);
+    hessian(2, 0) = hessian(0, 2);
+    hessian(2, 1) = hessian(1, 2);
+    bias(0) = - bias_0.Sum();
+    bias(1) = - bias_1.Sum();
+    bias(2) = - bias_2.Sum();
+    RecordResidual(scratch.convergence, squared_residual.Sum(), static_cast<uint32_t>(valid_cnt.Sum()));
+
+    return static_cast<int32_t>(valid_cnt.Sum());
+}
+
+// Kernels for the simd level which this file is compiled with.
+template void OpticalFlowLssdKlt::TrackOneFeatureSse<kCompiledSimdLevel>(const GrayImage &ref_image,
+                                                                         const GrayImage &cur_image,
+                                                                         const Vec2 &ref_pixel_uv,
+                                                                         Mat2 &R_cr,
+                                                                         Vec2 &t_cr,
+                                                                         uint8_t &status,
+                                                                         TrackingScratch &scratch) const;
+
+OPTICAL_FLOW_SIMD_END
+
+}
@@ -1,5 +1,11 @@
 #include "optical_flow.h"
+#include "optical_flow_simd.h"
+#include "optical_flow_fixed_point.h"
 #include "slam_operations.h"
+#include "slam_log_reporter.h"
+
+#include <algorithm>
+#include <cmath>
 
 namespace FEATURE_TRACKER {
 
@@ -10,6 +16,8 @@ bool OpticalFlow::TrackFeatures(const ImagePyramid &ref_pyramid,
                                 std::vector<uint8_t> &status) {
     RETURN_FALSE_IF(ref_pixel_uv.empty());
     RETURN_FALSE_IF(cur_pyramid.level() != ref_pyramid.level());
+    start_time_ = GetTimeBudgetClock();
+    PROFILE_ZONE(kTrackFeatures);
 
     // If sizeof ref_pixel_uv is not equal to cur_pixel_uv, view it as no prediction.
     if (ref_pixel_uv.size() != cur_pixel_uv.size()) {
@@ -21,11 +29,37 @@ bool OpticalFlow::TrackFeatures(const ImagePyramid &ref_pyramid,
         status.resize(ref_pixel_uv.size(), static_cast<uint8_t>(TrackStatus::kNotTracked));
     }
 
+    // Seed features with prediction by homography.
+    PredictFeatures(ref_pixel_uv, cur_pixel_uv);
+
     // Prepare for tracking.
-    PrepareForTracking();
+    const uint32_t max_feature_id = ref_pixel_uv.size() < options_.kMaxTrackPointsNumber ? ref_pixel_uv.size() : options_.kMaxTrackPointsNumber;
+    PROFILE_COUNT(kFeaturesToTrack, max_feature_id);
+    RETURN_FALSE_IF_FALSE(PrepareForTracking());
+    PrepareRefPatchCache(ref_pyramid, max_feature_id);
+    PrepareTimeBudget(max_feature_id);
 
     // Track features in multiple level.
-    return TrackMultipleLevel(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+    PrepareTelemetry(max_feature_id);
+    SelectStartLevels(ref_pixel_uv, cur_pixel_uv, status, ref_pyramid.level());
+    RETURN_FALSE_IF_FALSE(TrackMultipleLevel(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status));
+    RecordTimeBudget(status.data());
+
+    // Track features back to reference frame, starting from their reference position. Features which failed in
+    // forward pass keep their status, so they are skipped in backward pass.
+    if (options_.kCheckForwardBackward) {
+        backward_pixel_uv_ = ref_pixel_uv;
+        backward_status_ = status;
+        is_backward_pass_ = true;
+        SelectStartLevels(cur_pixel_uv, backward_pixel_uv_, backward_status_, ref_pyramid.level());
+        const bool res = TrackMultipleLevel(cur_pyramid, ref_pyramid, cur_pixel_uv, backward_pixel_uv_, backward_status_);
+        is_backward_pass_ = false;
+        RETURN_FALSE_IF_FALSE(res);
+        CheckForwardBackward(ref_pixel_uv, status);
+        RecordTimeBudget(status.data());
+    }
+
+    return true;
 }
 
 bool OpticalFlow::TrackFeatures(const GrayImage &ref_image,
@@ -34,6 +68,8 @@ bool OpticalFlow::TrackFeatures(const GrayImage &ref_image,
                                 std::vector<Vec2> &cur_pixel_uv,
                                 std::vector<uint8_t> &status) {
     RETURN_FALSE_IF(ref_pixel_uv.empty());
+    start_time_ = GetTimeBudgetClock();
+    PROFILE_ZONE(kTrackFeatures);
 
     // If sizeof ref_pixel_uv is not equal to cur_pixel_uv, view it as no prediction.
     if (ref_pixel_uv.size() != cur_pixel_uv.size()) {
@@ -45,11 +81,280 @@ bool OpticalFlow::TrackFeatures(const GrayImage &ref_image,
         status.resize(ref_pixel_uv.size(), static_cast<uint8_t>(TrackStatus::kNotTracked));
     }
 
+    // Seed features with prediction by homography.
+    PredictFeatures(ref_pixel_uv, cur_pixel_uv);
+
     // Prepare for tracking.
-    PrepareForTracking();
+    const uint32_t max_feature_id = ref_pixel_uv.size() < options_.kMaxTrackPointsNumber ? ref_pixel_uv.size() : options_.kMaxTrackPointsNumber;
+    PROFILE_COUNT(kFeaturesToTrack, max_feature_id);
+    RETURN_FALSE_IF_FALSE(PrepareForTracking());
+    PrepareTimeBudget(max_feature_id);
 
-    // Track features in multiple level.
-    return TrackSingleLevel(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status);
+    // Track features in single level.
+    PrepareTelemetry(max_feature_id);
+    RETURN_FALSE_IF_FALSE(TrackSingleLevel(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status));
+    RecordTimeBudget(status.data());
+
+    // Track features back to reference image.
+    if (options_.kCheckForwardBackward) {
+        backward_pixel_uv_ = ref_pixel_uv;
+        backward_status_ = status;
+        is_backward_pass_ = true;
+        const bool res = TrackSingleLevel(cur_image, ref_image, cur_pixel_uv, backward_pixel_uv_, backward_status_);
+        is_backward_pass_ = false;
+        RETURN_FALSE_IF_FALSE(res);
+        CheckForwardBackward(ref_pixel_uv, status);
+        RecordTimeBudget(status.data());
+    }
+
+    return true;
+}
+
+bool OpticalFlow::TrackFeatures(const ImagePyramid &ref_pyramid,
+                                const ImagePyramid &cur_pyramid,
+                                FeatureStore &features) {
+    RETURN_FALSE_IF(features.empty());
+    RETURN_FALSE_IF(cur_pyramid.level() != ref_pyramid.level());
+    RETURN_FALSE_IF(options_.kCheckForwardBackward);
+    start_time_ = GetTimeBudgetClock();
+    PROFILE_ZONE(kTrackFeatures);
+
+    // Prepare for tracking.
+    const uint32_t num_features = features.size();
+    const int32_t top_level = ref_pyramid.level() - 1;
+    PROFILE_COUNT(kFeaturesToTrack, num_features);
+    RETURN_FALSE_IF_FALSE(PrepareForTracking());
+    PrepareRefPatchCache(ref_pyramid, num_features, features.id().data());
+    PrepareTimeBudget(num_features);
+    PrepareTelemetry(num_features);
+    start_level_of_features_.assign(num_features, -1);
+
+    // Track features in multiple level. Each feature is read from store and written back in place.
+    TrackEachFeature(num_features, [&] (uint32_t feature_id, TrackingScratch &scratch) {
+        uint8_t &status = features.status()[feature_id];
+        if (status > static_cast<uint8_t>(TrackStatus::kTracked)) {
+            return;
+        }
+
+        const Vec2 ref_pixel_uv(features.u()[feature_id], features.v()[feature_id]);
+        Vec2 cur_pixel_uv = ref_pixel_uv;
+        FeatureTrackingContext context;
+        context.feature_id = feature_id;
+        context.has_predict_affine = PredictFeature(ref_pixel_uv, cur_pixel_uv, context.predict_affine);
+        context.start_level = SelectStartLevel(ref_pixel_uv, cur_pixel_uv, top_level);
+        context.ref_patch_cache = GetRefPatchCache(0, feature_id);
+        context.ref_patch_cache_stride = ref_patch_cache_num_features_;
+        context.record_telemetry = true;
+        start_level_of_features_[feature_id] = context.start_level;
+
+        TrackOneFeatureInMultipleLevel(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status, context, scratch);
+        if (status == static_cast<uint8_t>(TrackStatus::kTracked)) {
+            features.u()[feature_id] = cur_pixel_uv.x();
+            features.v()[feature_id] = cur_pixel_uv.y();
+            ++features.age()[feature_id];
+        }
+    });
+    RecordTimeBudget(features.status().data());
+
+    // Count levels of features which are started.
+    if (static_cast<int32_t>(level_hit_counts_.size()) <= top_level) {
+        level_hit_counts_.resize(top_level + 1, 0);
+    }
+    for (uint32_t feature_id = 0; feature_id < num_features; ++feature_id) {
+        for (int32_t level_idx = 0; level_idx <= start_level_of_features_[feature_id]; ++level_idx) {
+            ++level_hit_counts_[level_idx];
+        }
+    }
+
+    return true;
+}
+
+bool OpticalFlow::TrackFeatures(const GrayImage &ref_image,
+                                const GrayImage &cur_image,
+                                FeatureStore &features) {
+    RETURN_FALSE_IF(features.empty());
+    RETURN_FALSE_IF(options_.kCheckForwardBackward);
+    start_time_ = GetTimeBudgetClock();
+    PROFILE_ZONE(kTrackFeatures);
+
+    // Prepare for tracking.
+    const uint32_t num_features = features.size();
+    PROFILE_COUNT(kFeaturesToTrack, num_features);
+    RETURN_FALSE_IF_FALSE(PrepareForTracking());
+    PrepareTimeBudget(num_features);
+    PrepareTelemetry(num_features);
+
+    // Track features in single level. Each feature is read from store and written back in place.
+    TrackEachFeature(num_features, [&] (uint32_t feature_id, TrackingScratch &scratch) {
+        uint8_t &status = features.status()[feature_id];
+        const Vec2 ref_pixel_uv(features.u()[feature_id], features.v()[feature_id]);
+        Vec2 cur_pixel_uv = ref_pixel_uv;
+        FeatureTrackingContext context;
+        context.feature_id = feature_id;
+        context.has_predict_affine = PredictFeature(ref_pixel_uv, cur_pixel_uv, context.predict_affine);
+        context.record_telemetry = true;
+
+        TrackOneFeatureInSingleLevel(ref_image, cur_image, ref_pixel_uv, cur_pixel_uv, status, context, scratch);
+        if (status == static_cast<uint8_t>(TrackStatus::kTracked)) {
+            features.u()[feature_id] = cur_pixel_uv.x();
+            features.v()[feature_id] = cur_pixel_uv.y();
+            ++features.age()[feature_id];
+        }
+    });
+    RecordTimeBudget(features.status().data());
+
+    return true;
+}
+
+bool OpticalFlow::TrackFeatures(const ImagePyramid &ref_pyramid,
+                                const ImagePyramid &cur_pyramid,
+                                const std::vector<Vec2> &ref_pixel_uv,
+                                std::vector<Vec2> &cur_pixel_uv,
+                                std::vector<uint8_t> &status,
+                                uint32_t begin_id,
+                                uint32_t end_id,
+                                TrackingScratch &scratch) const {
+    RETURN_FALSE_IF(ref_pixel_uv.empty());
+    RETURN_FALSE_IF(cur_pyramid.level() != ref_pyramid.level() || ref_pyramid.level() == 0);
+    // Outputs are shared by concurrent jobs, so they cannot be resized here.
+    RETURN_FALSE_IF(cur_pixel_uv.size() != ref_pixel_uv.size() || status.size() != ref_pixel_uv.size());
+    // Patch layout should be prepared for current options.
+    RETURN_FALSE_IF(patch_rows_ != (options_.kPatchRowHalfSize << 1) + 1 || patch_cols_ != (options_.kPatchColHalfSize << 1) + 1);
+    // Options which need state of tracker across features cannot be honored.
+    RETURN_FALSE_IF(options_.kCheckForwardBackward || options_.kUseAdaptivePyramidLevel);
+    RETURN_FALSE_IF(options_.kTimeBudgetInMillisecond > 0.0f || use_predict_homography_);
+    RETURN_FALSE_IF(!IsMethodSupported(options_.kMethod));
+
+    PrepareScratch(scratch);
+    end_id = std::min(end_id, static_cast<uint32_t>(ref_pixel_uv.size()));
+    FeatureTrackingContext context;
+    context.start_level = ref_pyramid.level() - 1;
+    for (uint32_t feature_id = begin_id; feature_id < end_id; ++feature_id) {
+        context.feature_id = feature_id;
+        TrackOneFeatureInMultipleLevel(ref_pyramid, cur_pyramid, ref_pixel_uv[feature_id], cur_pixel_uv[feature_id],
+            status[feature_id], context, scratch);
+    }
+
+    return true;
+}
+
+void OpticalFlow::PrepareForReentrantTracking() {
+    PreparePatchLayout();
+    // Max iteration is not shrunk by time budget of stateful tracking any more.
+    use_time_budget_ = false;
+    max_iteration_.store(options_.kMaxIteration, std::memory_order_relaxed);
+}
+
+bool OpticalFlow::TrackMultipleLevelFeatureMajor(const ImagePyramid &ref_pyramid,
+                                                 const ImagePyramid &cur_pyramid,
+                                                 const std::vector<Vec2> &ref_pixel_uv,
+                                                 std::vector<Vec2> &cur_pixel_uv,
+                                                 std::vector<uint8_t> &status) {
+    const uint32_t max_feature_id = ref_pixel_uv.size() < options_.kMaxTrackPointsNumber ? ref_pixel_uv.size() : options_.kMaxTrackPointsNumber;
+    TrackEachFeature(max_feature_id, [&] (uint32_t feature_id, TrackingScratch &scratch) {
+        TrackOneFeatureInMultipleLevel(ref_pyramid, cur_pyramid, ref_pixel_uv[feature_id], cur_pixel_uv[feature_id],
+            status[feature_id], GetFeatureTrackingContext(feature_id), scratch);
+    });
+    return true;
+}
+
+bool OpticalFlow::TrackMultipleLevelLevelMajor(const ImagePyramid &ref_pyramid,
+                                               const ImagePyramid &cur_pyramid,
+                                               const std::vector<Vec2> &ref_pixel_uv,
+                                               std::vector<Vec2> &cur_pixel_uv,
+                                               std::vector<uint8_t> &status) {
+    const uint32_t max_feature_id = ref_pixel_uv.size() < options_.kMaxTrackPointsNumber ? ref_pixel_uv.size() : options_.kMaxTrackPointsNumber;
+    SelectFeaturesToTrack(status, max_feature_id);
+
+    // Scale cur_pixel_uv to the start level of each feature. It holds the scaled result between levels.
+    PrepareLevelMajorStates(max_feature_id);
+    for (uint32_t feature_id = 0; feature_id < max_feature_id; ++feature_id) {
+        CONTINUE_IF(!features_to_track_[feature_id]);
+        const float scale = static_cast<float>(1 << start_level_of_features_[feature_id]);
+        cur_pixel_uv[feature_id] /= scale;
+        InitializeLevelMajorState(feature_id, ref_pixel_uv[feature_id] / scale, cur_pixel_uv[feature_id]);
+    }
+
+    // Track all features per level. Scaling by power of 2 is exact, so result is the same as feature-major.
+    for (int32_t level_idx = ref_pyramid.level() - 1; level_idx > -1; --level_idx) {
+        const GrayImage &ref_image = ref_pyramid.GetImageConst(level_idx);
+        const GrayImage &cur_image = cur_pyramid.GetImageConst(level_idx);
+        const float level_scale = static_cast<float>(1 << level_idx);
+
+        TrackEachFeature(max_feature_id, [&] (uint32_t feature_id, TrackingScratch &scratch) {
+            if (!features_to_track_[feature_id] || start_level_of_features_[feature_id] < level_idx) {
+                return;
+            }
+
+            // Track this feature in one pyramid level.
+            const Vec2 scaled_ref_pixel_uv = ref_pixel_uv[feature_id] / level_scale;
+            TrackOneFeatureInLevelMajor(ref_image, cur_image, feature_id, level_idx, scaled_ref_pixel_uv, cur_pixel_uv[feature_id],
+                status[feature_id], scratch);
+            RecordTelemetry(feature_id, level_idx, status[feature_id], scratch);
+
+            // Adjust result on different pyramid level.
+            if (level_idx) {
+                cur_pixel_uv[feature_id] *= 2.0f;
+            }
+        });
+    }
+
+    // If feature is outside, mark it.
+    for (uint32_t feature_id = 0; feature_id < max_feature_id; ++feature_id) {
+        CONTINUE_IF(!features_to_track_[feature_id]);
+        CheckFeatureOutside(cur_pyramid.GetImageConst(0), cur_pixel_uv[feature_id], status[feature_id]);
+    }
+
+    return true;
+}
+
+bool OpticalFlow::TrackMultipleLevel(const ImagePyramid &ref_pyramid,
+                                     const ImagePyramid &cur_pyramid,
+                                     const std::vector<Vec2> &ref_pixel_uv,
+                                     std::vector<Vec2> &cur_pixel_uv,
+                                     std::vector<uint8_t> &status) {
+    switch (pyramid_traversal()) {
+        case PyramidTraversal::kLevelMajor:
+            return TrackMultipleLevelLevelMajor(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+        case PyramidTraversal::kFeatureMajor:
+        default:
+            return TrackMultipleLevelFeatureMajor(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+    }
+}
+
+bool OpticalFlow::TrackSingleLevel(const GrayImage &ref_image,
+                                   const GrayImage &cur_image,
+                                   const std::vector<Vec2> &ref_pixel_uv,
+                                   std::vector<Vec2> &cur_pixel_uv,
+                                   std::vector<uint8_t> &status) {
+    const uint32_t max_feature_id = ref_pixel_uv.size() < options_.kMaxTrackPointsNumber ? ref_pixel_uv.size() : options_.kMaxTrackPointsNumber;
+    TrackEachFeature(max_feature_id, [&] (uint32_t feature_id, TrackingScratch &scratch) {
+        FeatureTrackingContext context;
+        context.feature_id = feature_id;
+        context.has_predict_affine = GetPredictAffine(feature_id, context.predict_affine);
+        context.record_telemetry = true;
+        TrackOneFeatureInSingleLevel(ref_image, cur_image, ref_pixel_uv[feature_id], cur_pixel_uv[feature_id],
+            status[feature_id], context, scratch);
+    });
+    return true;
+}
+
+FeatureTrackingContext OpticalFlow::GetFeatureTrackingContext(uint32_t feature_id) {
+    FeatureTrackingContext context;
+    context.feature_id = feature_id;
+    context.start_level = start_level_of_features_[feature_id];
+    context.has_predict_affine = GetPredictAffine(feature_id, context.predict_affine);
+    context.ref_patch_cache = GetRefPatchCache(0, feature_id);
+    context.ref_patch_cache_stride = ref_patch_cache_num_features_;
+    context.record_telemetry = true;
+    return context;
+}
+
+void OpticalFlow::CheckFeatureOutside(const GrayImage &cur_image, const Vec2 &cur_pixel_uv, uint8_t &status) {
+    if (cur_pixel_uv.x() < 0 || cur_pixel_uv.x() > cur_image.cols() - 1 ||
+        cur_pixel_uv.y() < 0 || cur_pixel_uv.y() > cur_image.rows() - 1) {
+        status = static_cast<uint8_t>(TrackStatus::kOutside);
+    }
 }
 
 uint32_t OpticalFlow::ExtractExtendPatchInReferenceImage(const GrayImage &ref_image,
@@ -57,7 +362,11 @@ uint32_t OpticalFlow::ExtractExtendPatchInReferenceImage(const GrayImage &ref_im
                                                          int32_t ex_ref_patch_rows,
                                                          int32_t ex_ref_patch_cols,
                                                          std::vector<float> &ex_ref_patch,
-                                                         std::vector<bool> &ex_ref_patch_pixel_valid) {
+                                                         std::vector<uint8_t> &ex_ref_patch_pixel_valid) const {
+    PROFILE_ZONE(kExtractRefPatch);
+    // Buffers are sized by PrepareScratch(), then resizing is a no-op. Only cache of reference patch grows here.
+    ex_ref_patch.resize(ex_ref_patch_rows * ex_ref_patch_cols);
+    ex_ref_patch_pixel_valid.resize(ex_ref_patch_rows * ex_ref_patch_cols);
     // Compute the weight for linear interpolar.
     const float int_pixel_row = std::floor(ref_pixel_uv.y());
     const float int_pixel_col = std::floor(ref_pixel_uv.x());
@@ -74,44 +383,204 @@ uint32_t OpticalFlow::ExtractExtendPatchInReferenceImage(const GrayImage &ref_im
     const int32_t max_ref_pixel_row = min_ref_pixel_row + ex_ref_patch_rows;
     const int32_t max_ref_pixel_col = min_ref_pixel_col + ex_ref_patch_cols;
 
+    // Whole rows are sampled if they can be read, otherwise only valid pixels in each row.
+    const PaddedImageView image_view = GetImageView(ref_image);
+    const bool is_readable = image_view.IsInside(min_ref_pixel_row, min_ref_pixel_col, max_ref_pixel_row, max_ref_pixel_col);
     if (min_ref_pixel_row < 0 || max_ref_pixel_row > ref_image.rows() - 2 ||
         min_ref_pixel_col < 0 || max_ref_pixel_col > ref_image.cols() - 2) {
-        // If this patch is partly outside of reference image.
-        uint32_t valid_pixel_cnt = 0;
-        for (int32_t row = min_ref_pixel_row; row < max_ref_pixel_row; ++row) {
-            for (int32_t col = min_ref_pixel_col; col < max_ref_pixel_col; ++col) {
-                if (row < 0 || row > ref_image.rows() - 2 || col < 0 || col > ref_image.cols() - 2) {
-                    ex_ref_patch_pixel_valid.emplace_back(false);
-                    ex_ref_patch.emplace_back(0.0f);
-                } else {
-                    ex_ref_patch_pixel_valid.emplace_back(true);
-                    ex_ref_patch.emplace_back(w_top_left * static_cast<float>(ref_image.GetPixelValueNoCheck(row, col)) +
-                                              w_top_right * static_cast<float>(ref_image.GetPixelValueNoCheck(row, col + 1)) +
-                                              w_bottom_left * static_cast<float>(ref_image.GetPixelValueNoCheck(row + 1, col)) +
-                                              w_bottom_right * static_cast<float>(ref_image.GetPixelValueNoCheck(row + 1, col + 1)));
-                    ++valid_pixel_cnt;
-                }
+        PROFILE_COUNT(kPaddedBorderFastPath, is_readable ? 1 : 0);
+        PROFILE_COUNT(kOutsideImageFallback, is_readable ? 0 : 1);
+    }
+
+    uint32_t valid_pixel_cnt = 0;
+    for (int32_t row = 0; row < ex_ref_patch_rows; ++row) {
+        int32_t valid_begin = 0;
+        int32_t valid_end = 0;
+        image_view.GetValidRangeInRow(row + min_ref_pixel_row, min_ref_pixel_col, ex_ref_patch_cols, valid_begin, valid_end);
+        const int32_t read_begin = is_readable ? 0 : valid_begin;
+        const int32_t read_end = is_readable ? ex_ref_patch_cols : valid_end;
+        float *patch_row = ex_ref_patch.data() + row * ex_ref_patch_cols;
+        uint8_t *valid_row = ex_ref_patch_pixel_valid.data() + row * ex_ref_patch_cols;
+        if (read_begin < read_end) {
+            const uint8_t *top = image_view.GetPixelPtr(row + min_ref_pixel_row, min_ref_pixel_col);
+            const uint8_t *bottom = top + image_view.stride();
+            for (int32_t col = read_begin; col < read_end; ++col) {
+                patch_row[col] = w_top_left * static_cast<float>(top[col]) + w_top_right * static_cast<float>(top[col + 1]) +
+                                 w_bottom_left * static_cast<float>(bottom[col]) + w_bottom_right * static_cast<float>(bottom[col + 1]);
             }
         }
+        std::fill(patch_row, patch_row + valid_begin, 0.0f);
+        std::fill(patch_row + valid_end, patch_row + ex_ref_patch_cols, 0.0f);
+        std::fill(valid_row, valid_row + ex_ref_patch_cols, 0);
+        std::fill(valid_row + valid_begin, valid_row + valid_end, 1);
+        valid_pixel_cnt += valid_end - valid_begin;
+    }
 
-        return valid_pixel_cnt;
-    } else {
-        // If this patch is totally inside of reference image.
-        for (int32_t row = min_ref_pixel_row; row < max_ref_pixel_row; ++row) {
-            for (int32_t col = min_ref_pixel_col; col < max_ref_pixel_col; ++col) {
-                ex_ref_patch_pixel_valid.emplace_back(true);
-                ex_ref_patch.emplace_back(w_top_left * static_cast<float>(ref_image.GetPixelValueNoCheck(row, col)) +
-                                          w_top_right * static_cast<float>(ref_image.GetPixelValueNoCheck(row, col + 1)) +
-                                          w_bottom_left * static_cast<float>(ref_image.GetPixelValueNoCheck(row + 1, col)) +
-                                          w_bottom_right * static_cast<float>(ref_image.GetPixelValueNoCheck(row + 1, col + 1)));
+    return valid_pixel_cnt;
+}
+
+uint32_t OpticalFlow::ExtractExtendPatchInReferenceImageFixedPoint(const GrayImage &ref_image,
+                                                                   const Vec2 &ref_pixel_uv,
+                                                                   int32_t ex_ref_patch_rows,
+                                                                   int32_t ex_ref_patch_cols,
+                                                                   int16_t *ex_ref_patch,
+                                                                   uint8_t *ex_ref_patch_pixel_valid) const {
+    PROFILE_ZONE(kExtractRefPatch);
+    // Compute the weight for linear interpolar.
+    const std::array<int32_t, 4> weights = ComputeFixedPointBilinearWeights(ref_pixel_uv);
+
+    // Extract patch from reference image.
+    const int32_t min_ref_pixel_row = static_cast<int32_t>(std::floor(ref_pixel_uv.y())) - ex_ref_patch_rows / 2;
+    const int32_t min_ref_pixel_col = static_cast<int32_t>(std::floor(ref_pixel_uv.x())) - ex_ref_patch_cols / 2;
+    const int32_t max_ref_pixel_row = min_ref_pixel_row + ex_ref_patch_rows;
+    const int32_t max_ref_pixel_col = min_ref_pixel_col + ex_ref_patch_cols;
+
+    // Whole rows are sampled if they can be read, otherwise only valid pixels in each row.
+    const PaddedImageView image_view = GetImageView(ref_image);
+    const bool is_readable = image_view.IsInside(min_ref_pixel_row, min_ref_pixel_col, max_ref_pixel_row, max_ref_pixel_col);
+    if (min_ref_pixel_row < 0 || max_ref_pixel_row > ref_image.rows() - 2 ||
+        min_ref_pixel_col < 0 || max_ref_pixel_col > ref_image.cols() - 2) {
+        PROFILE_COUNT(kPaddedBorderFastPath, is_readable ? 1 : 0);
+        PROFILE_COUNT(kOutsideImageFallback, is_readable ? 0 : 1);
+    }
+
+    uint32_t valid_pixel_cnt = 0;
+    for (int32_t row = 0; row < ex_ref_patch_rows; ++row) {
+        int32_t valid_begin = 0;
+        int32_t valid_end = 0;
+        image_view.GetValidRangeInRow(row + min_ref_pixel_row, min_ref_pixel_col, ex_ref_patch_cols, valid_begin, valid_end);
+        const int32_t read_begin = is_readable ? 0 : valid_begin;
+        const int32_t read_end = is_readable ? ex_ref_patch_cols : valid_end;
+        int16_t *patch_row = ex_ref_patch + row * ex_ref_patch_cols;
+        uint8_t *valid_row = ex_ref_patch_pixel_valid + row * ex_ref_patch_cols;
+        if (read_begin < read_end) {
+            const uint8_t *top = image_view.GetPixelPtr(row + min_ref_pixel_row, min_ref_pixel_col);
+            const uint8_t *bottom = top + image_view.stride();
+            for (int32_t col = read_begin; col < read_end; ++col) {
+                patch_row[col] = InterpolateFixedPoint(weights, top[col], top[col + 1], bottom[col], bottom[col + 1]);
             }
         }
+        std::fill(patch_row, patch_row + valid_begin, 0);
+        std::fill(patch_row + valid_end, patch_row + ex_ref_patch_cols, 0);
+        std::fill(valid_row, valid_row + ex_ref_patch_cols, 0);
+        std::fill(valid_row + valid_begin, valid_row + valid_end, 1);
+        valid_pixel_cnt += valid_end - valid_begin;
+    }
+
+    return valid_pixel_cnt;
+}
+
+bool OpticalFlow::SampleGradientInReferencePatch(const GrayImage &ref_image,
+                                                 const Vec2 &ref_pixel_uv,
+                                                 std::vector<float> &all_dx_in_ref_patch,
+                                                 std::vector<float> &all_dy_in_ref_patch) const {
+    RETURN_FALSE_IF(ref_gradient_pyramid_ == nullptr);
+    const GradientImage *gradient_image = ref_gradient_pyramid_->FindGradientImage(ref_image);
+    RETURN_FALSE_IF(gradient_image == nullptr);
+
+    all_dx_in_ref_patch.resize(patch_size_);
+    all_dy_in_ref_patch.resize(patch_size_);
+    return gradient_image->GetGradientPatch(ref_pixel_uv, patch_rows_, patch_cols_, all_dx_in_ref_patch.data(), all_dy_in_ref_patch.data());
+}
+
+uint32_t OpticalFlow::ExtractPatternInReferenceImage(const GrayImage &ref_image,
+                                                     const Vec2 &ref_pixel_uv,
+                                                     std::vector<float> &ref_pattern,
+                                                     std::vector<uint8_t> &ref_pattern_valid,
+                                                     std::vector<float> &all_dx_in_ref_pattern,
+                                                     std::vector<float> &all_dy_in_ref_pattern) const {
+    PROFILE_ZONE(kPrecomputeJacobian);
+    const uint32_t num_points = patch_pattern_.size();
+    ref_pattern.resize(num_points);
+    ref_pattern_valid.resize(num_points);
+    all_dx_in_ref_pattern.resize(num_points);
+    all_dy_in_ref_pattern.resize(num_points);
+
+    uint32_t valid_point_cnt = 0;
+    float value = 0.0f;
+    std::array<float, 4> neighbours = {};
+    for (uint32_t i = 0; i < num_points; ++i) {
+        const PatchPatternPoint &point = patch_pattern_.points()[i];
+        const float row = static_cast<float>(point.drow) + ref_pixel_uv.y();
+        const float col = static_cast<float>(point.dcol) + ref_pixel_uv.x();
+
+        // Gradient is central difference with the same scale as extended patch.
+        if (ref_image.GetPixelValue(row, col, &value) &&
+            ref_image.GetPixelValue(row, col - 1.0f, &neighbours[0]) &&
+            ref_image.GetPixelValue(row, col + 1.0f, &neighbours[1]) &&
+            ref_image.GetPixelValue(row - 1.0f, col, &neighbours[2]) &&
+            ref_image.GetPixelValue(row + 1.0f, col, &neighbours[3])) {
+            ref_pattern[i] = value;
+            ref_pattern_valid[i] = 1;
+            all_dx_in_ref_pattern[i] = neighbours[1] - neighbours[0];
+            all_dy_in_ref_pattern[i] = neighbours[3] - neighbours[2];
+            ++valid_point_cnt;
+        } else {
+            ref_pattern[i] = 0.0f;
+            ref_pattern_valid[i] = 0;
+            all_dx_in_ref_pattern[i] = 0.0f;
+            all_dy_in_ref_pattern[i] = 0.0f;
+        }
+    }
+
+    return valid_point_cnt;
+}
 
-        return ex_ref_patch.size();
+const PaddedImage *OpticalFlow::FindPaddedImage(const GrayImage &image) const {
+    const PaddedImage *padded_image = nullptr;
+    if (ref_padded_pyramid_ != nullptr) {
+        padded_image = ref_padded_pyramid_->FindPaddedImage(image);
+    }
+    if (padded_image == nullptr && cur_padded_pyramid_ != nullptr) {
+        padded_image = cur_padded_pyramid_->FindPaddedImage(image);
     }
+    return padded_image;
 }
 
 bool OpticalFlow::PrepareForTracking() {
+    if (!IsMethodSupported(options_.kMethod)) {
+        ReportError("[OpticalFlow] Method " << static_cast<int32_t>(options_.kMethod) << " is not supported by this tracker.");
+        return false;
+    }
+    PreparePatchLayout();
+
+    // Prepare thread pool and one group of scratch buffers for each worker.
+    const uint32_t num_threads = std::max(options_.kNumThreads, static_cast<uint32_t>(1));
+    if (num_threads > 1 && (thread_pool_ == nullptr || thread_pool_->num_threads() != num_threads)) {
+        thread_pool_ = std::make_unique<ThreadPool>(num_threads);
+    } else if (num_threads == 1) {
+        thread_pool_.reset();
+    }
+    scratches_.resize(num_threads);
+    for (auto &scratch : scratches_) {
+        PrepareScratch(scratch);
+    }
+
+    // Per-feature buffers are sized by max number of features, so that they are not reallocated when number of
+    // features grows between frames. Reserving is a no-op after the first frame.
+    const uint32_t max_num_features = options_.kMaxTrackPointsNumber;
+    predict_affine_of_features_.reserve(max_num_features);
+    track_order_.reserve(max_num_features);
+    features_out_of_budget_.reserve(max_num_features);
+    start_level_of_features_.reserve(max_num_features);
+    backward_pixel_uv_.reserve(max_num_features);
+    backward_status_.reserve(max_num_features);
+    features_to_track_.reserve(max_num_features);
+
+    return true;
+}
+
+SimdLevel OpticalFlow::DetectSimdLevel() {
+#if defined(OPTICAL_FLOW_SIMD_X86)
+    static const SimdLevel simd_level = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? SimdLevel::kAvx2 :
+        (__builtin_cpu_supports("sse4.1") ? SimdLevel::kSse4 : SimdLevel::kScalar);
+    return simd_level;
+#else
+    return SimdLevel::kScalar;
+#endif
+}
+
+void OpticalFlow::PreparePatchLayout() {
     patch_rows_ = (options_.kPatchRowHalfSize << 1) + 1;
     patch_cols_ = (options_.kPatchColHalfSize << 1) + 1;
     patch_size_ = patch_rows_ * patch_cols_;
@@ -120,17 +589,374 @@ bool OpticalFlow::PrepareForTracking() {
     ex_patch_cols_ = patch_cols_ + 2;
     ex_patch_size_ = ex_patch_rows_ * ex_patch_cols_;
 
-    ex_ref_patch_.reserve(ex_patch_size_);
-    ex_ref_patch_pixel_valid_.reserve(ex_patch_size_);
-    cur_patch_.reserve(patch_size_);
-    cur_patch_pixel_valid_.reserve(patch_size_);
+    // Prepare padded layout for sse method.
+    patch_stride_sse_ = Float8Layout::AlignedSize(patch_cols_);
+    ex_patch_stride_sse_ = patch_stride_sse_ + Float8Layout::kSize;
+    simd_level_ = std::min(options_.kMaxSimdLevel, DetectSimdLevel());
+    patch_col_valid_sse_.resize(patch_stride_sse_);
+    for (int32_t col = 0; col < patch_stride_sse_; ++col) {
+        patch_col_valid_sse_[col] = col < patch_cols_ ? 1.0f : 0.0f;
+    }
+
+    // Prepare sampling points of patch. Invalid parameters of sparse pattern fall back to full patch, and so does pattern
+    // with too few points to fit parameters of feature.
+    if (!patch_pattern_.CreatePatchPattern(options_.kPatchPattern, options_.kPatchRowHalfSize, options_.kPatchColHalfSize,
+        options_.kPatchPatternStride, options_.kPatchPatternPoints) ||
+        patch_pattern_.size() < kMinPatternPointsPerParameter * NumberOfFeatureParameters()) {
+        patch_pattern_.CreatePatchPattern(PatchPatternType::kFull, options_.kPatchRowHalfSize, options_.kPatchColHalfSize);
+    }
+}
+
+void OpticalFlow::PrepareScratch(TrackingScratch &scratch) const {
+    scratch.ex_ref_patch.resize(ex_patch_size_);
+    scratch.ex_ref_patch_pixel_valid.resize(ex_patch_size_);
+    scratch.cur_patch.resize(patch_size_);
+    scratch.cur_patch_pixel_valid.resize(patch_size_);
+
+    scratch.all_dx_in_ref_patch.resize(patch_size_);
+    scratch.all_dy_in_ref_patch.resize(patch_size_);
+    scratch.all_dx_in_cur_patch.resize(patch_size_);
+    scratch.all_dy_in_cur_patch.resize(patch_size_);
+
+    scratch.ex_ref_patch_sse.resize(ex_patch_rows_ * ex_patch_stride_sse_);
+    scratch.ex_ref_patch_pixel_valid_sse.resize(ex_patch_rows_ * ex_patch_stride_sse_);
+    scratch.ref_patch_sse.resize(patch_rows_ * patch_stride_sse_);
+    scratch.ref_patch_pixel_valid_sse.resize(patch_rows_ * patch_stride_sse_);
+    scratch.all_dx_in_ref_patch_sse.resize(patch_rows_ * patch_stride_sse_);
+    scratch.all_dy_in_ref_patch_sse.resize(patch_rows_ * patch_stride_sse_);
+    scratch.cur_patch_sse.resize(patch_rows_ * patch_stride_sse_);
+    scratch.cur_patch_pixel_valid_sse.resize(patch_rows_ * patch_stride_sse_);
+
+    scratch.ref_pattern.resize(patch_pattern_.size());
+    scratch.ref_pattern_valid.resize(patch_pattern_.size());
+    scratch.all_dx_in_ref_pattern.resize(patch_pattern_.size());
+    scratch.all_dy_in_ref_pattern.resize(patch_pattern_.size());
+    scratch.cur_pattern.resize(patch_pattern_.size());
+    scratch.cur_pattern_valid.resize(patch_pattern_.size());
+
+    scratch.ex_ref_patch_fixed_point.resize(ex_patch_size_);
+    scratch.ex_ref_patch_pixel_valid_fixed_point.resize(ex_patch_size_);
+    scratch.all_dx_in_ref_patch_fixed_point.resize(patch_size_);
+    scratch.all_dy_in_ref_patch_fixed_point.resize(patch_size_);
+}
+
+void OpticalFlow::SetPredictHomography(const Mat3 &H_cr) {
+    predict_H_cr_ = H_cr;
+    use_predict_homography_ = true;
+}
+
+void OpticalFlow::SetPredictRotation(const Mat3 &R_cr, const Vec4 &intrinsics) {
+    Mat3 K = Mat3::Identity();
+    K(0, 0) = intrinsics(0);
+    K(1, 1) = intrinsics(1);
+    K(0, 2) = intrinsics(2);
+    K(1, 2) = intrinsics(3);
+    Mat3 K_inv = Mat3::Identity();
+    K_inv(0, 0) = 1.0f / intrinsics(0);
+    K_inv(1, 1) = 1.0f / intrinsics(1);
+    K_inv(0, 2) = - intrinsics(2) / intrinsics(0);
+    K_inv(1, 2) = - intrinsics(3) / intrinsics(1);
+    SetPredictHomography(K * R_cr * K_inv);
+}
+
+void OpticalFlow::ClearPrediction() {
+    use_predict_homography_ = false;
+    predict_affine_of_features_.clear();
+}
+
+void OpticalFlow::PredictFeatures(const std::vector<Vec2> &ref_pixel_uv, std::vector<Vec2> &cur_pixel_uv) {
+    if (!use_predict_homography_) {
+        predict_affine_of_features_.clear();
+        return;
+    }
+
+    const uint32_t max_feature_id = ref_pixel_uv.size() < options_.kMaxTrackPointsNumber ? ref_pixel_uv.size() : options_.kMaxTrackPointsNumber;
+    predict_affine_of_features_.resize(max_feature_id);
+    for (uint32_t feature_id = 0; feature_id < max_feature_id; ++feature_id) {
+        PredictFeature(ref_pixel_uv[feature_id], cur_pixel_uv[feature_id], predict_affine_of_features_[feature_id]);
+    }
+}
 
-    all_dx_in_ref_patch_.reserve(patch_size_);
-    all_dy_in_ref_patch_.reserve(patch_size_);
-    all_dx_in_cur_patch_.reserve(patch_size_);
-    all_dy_in_cur_patch_.reserve(patch_size_);
+bool OpticalFlow::PredictFeature(const Vec2 &ref_pixel_uv, Vec2 &cur_pixel_uv, Mat2 &affine) const {
+    RETURN_FALSE_IF(!use_predict_homography_);
+    const Vec3 cur_uvw = predict_H_cr_ * Vec3(ref_pixel_uv.x(), ref_pixel_uv.y(), 1.0f);
 
+    // If feature is projected to infinity, keep the prediction given by user.
+    if (cur_uvw.z() < kZerofloat) {
+        affine.setIdentity();
+        return true;
+    }
+
+    // Local affine transform is jacobian of homography at reference pixel.
+    const float inv_w = 1.0f / cur_uvw.z();
+    const Vec2 cur_uv = cur_uvw.head<2>() * inv_w;
+    affine = (predict_H_cr_.topLeftCorner<2, 2>() - cur_uv * predict_H_cr_.block<1, 2>(2, 0)) * inv_w;
+    cur_pixel_uv = cur_uv;
+    return true;
+}
+
+bool OpticalFlow::GetPredictAffine(uint32_t feature_id, Mat2 &affine) const {
+    RETURN_FALSE_IF(feature_id >= predict_affine_of_features_.size());
+    // Homography maps current frame to reference frame in backward pass.
+    affine = is_backward_pass_ ? Mat2(predict_affine_of_features_[feature_id].inverse()) : predict_affine_of_features_[feature_id];
+    return true;
+}
+
+bool OpticalFlow::GetPredictRotation(uint32_t feature_id, Mat2 &rotation) const {
+    Mat2 affine;
+    RETURN_FALSE_IF(!GetPredictAffine(feature_id, affine));
+    rotation = ClosestRotation(affine);
     return true;
 }
 
+Mat2 OpticalFlow::ClosestRotation(const Mat2 &affine) {
+    const float angle = std::atan2(affine(1, 0) - affine(0, 1), affine(0, 0) + affine(1, 1));
+    Mat2 rotation;
+    rotation << std::cos(angle), - std::sin(angle), std::sin(angle), std::cos(angle);
+    return rotation;
+}
+
+void OpticalFlow::SelectStartLevels(const std::vector<Vec2> &ref_pixel_uv,
+                                    const std::vector<Vec2> &cur_pixel_uv,
+                                    const std::vector<uint8_t> &status,
+                                    int32_t num_levels) {
+    const uint32_t max_feature_id = ref_pixel_uv.size() < options_.kMaxTrackPointsNumber ? ref_pixel_uv.size() : options_.kMaxTrackPointsNumber;
+    const int32_t top_level = num_levels - 1;
+    start_level_of_features_.resize(max_feature_id);
+    if (static_cast<int32_t>(level_hit_counts_.size()) < num_levels) {
+        level_hit_counts_.resize(num_levels, 0);
+    }
+
+    for (uint32_t feature_id = 0; feature_id < max_feature_id; ++feature_id) {
+        const int32_t start_level = SelectStartLevel(ref_pixel_uv[feature_id], cur_pixel_uv[feature_id], top_level);
+        start_level_of_features_[feature_id] = start_level;
+
+        // Features that has been tracking failed will not be tracked in any level. Only forward pass is counted.
+        CONTINUE_IF(is_backward_pass_ || status[feature_id] > static_cast<uint8_t>(TrackStatus::kTracked));
+        for (int32_t level_idx = 0; level_idx <= start_level; ++level_idx) {
+            ++level_hit_counts_[level_idx];
+        }
+    }
+}
+
+int32_t OpticalFlow::SelectStartLevel(const Vec2 &ref_pixel_uv, const Vec2 &cur_pixel_uv, int32_t top_level) const {
+    // Tracking in one level converges if motion in it is not larger than patch half size. So a feature needs
+    // the coarsest level in which its predicted motion is scaled down to patch half size. A feature whose current
+    // position is still its reference position has no prediction, so its motion is unknown.
+    const bool has_prediction = use_predict_homography_ || cur_pixel_uv != ref_pixel_uv;
+    if (!options_.kUseAdaptivePyramidLevel || !has_prediction) {
+        return top_level;
+    }
+
+    const float max_motion_in_level = static_cast<float>(std::min(options_.kPatchRowHalfSize, options_.kPatchColHalfSize));
+    const float motion = (cur_pixel_uv - ref_pixel_uv).norm();
+    int32_t start_level = std::min(std::max(options_.kMinAdaptiveStartLevel, 0), top_level);
+    while (start_level < top_level && motion > max_motion_in_level * static_cast<float>(1 << start_level)) {
+        ++start_level;
+    }
+    return start_level;
+}
+
+void OpticalFlow::CheckForwardBackward(const std::vector<Vec2> &ref_pixel_uv, std::vector<uint8_t> &status) {
+    const float max_squared_error = options_.kMaxForwardBackwardError * options_.kMaxForwardBackwardError;
+    const uint32_t max_feature_id = ref_pixel_uv.size() < options_.kMaxTrackPointsNumber ? ref_pixel_uv.size() : options_.kMaxTrackPointsNumber;
+    for (uint32_t feature_id = 0; feature_id < max_feature_id; ++feature_id) {
+        CONTINUE_IF(status[feature_id] != static_cast<uint8_t>(TrackStatus::kTracked));
+        if (backward_status_[feature_id] != static_cast<uint8_t>(TrackStatus::kTracked) ||
+            (backward_pixel_uv_[feature_id] - ref_pixel_uv[feature_id]).squaredNorm() > max_squared_error) {
+            status[feature_id] = static_cast<uint8_t>(TrackStatus::kInconsistent);
+        }
+    }
+}
+
+void OpticalFlow::PrepareTelemetry(uint32_t max_feature_id) {
+    if constexpr (kEnableTelemetry) {
+        for (auto &scratch : scratches_) {
+            scratch.convergence = ConvergenceRecord();
+        }
+        if (telemetry_ != nullptr) {
+            telemetry_->assign(max_feature_id, TrackTelemetry());
+        }
+    }
+}
+
+void OpticalFlow::RecordTelemetry(uint32_t feature_id, int32_t level_idx, uint8_t status, TrackingScratch &scratch) const {
+    if constexpr (kEnableTelemetry) {
+        // Only forward pass is recorded.
+        if (telemetry_ != nullptr && !is_backward_pass_ && feature_id < telemetry_->size()) {
+            TrackTelemetry &telemetry = (*telemetry_)[feature_id];
+            const ConvergenceRecord &convergence = scratch.convergence;
+            if (level_idx < TrackTelemetry::kMaxLevel) {
+                telemetry.iterations_in_level[level_idx] = static_cast<uint8_t>(std::min(convergence.iterations, static_cast<uint32_t>(255)));
+            }
+            telemetry.residual = convergence.valid_pixel_num > 0 ? convergence.squared_residual / static_cast<float>(convergence.valid_pixel_num) : 0.0f;
+            telemetry.min_eigen_value = convergence.min_eigen_value;
+            telemetry.valid_pixel_num = convergence.valid_pixel_num;
+            if (telemetry.failed_level < 0 && status > static_cast<uint8_t>(TrackStatus::kTracked)) {
+                telemetry.failed_level = level_idx;
+            }
+        }
+        scratch.convergence = ConvergenceRecord();
+    }
+}
+
+void OpticalFlow::PrepareTimeBudget(uint32_t max_feature_id) {
+    use_time_budget_ = options_.kTimeBudgetInMillisecond > 0.0f;
+    max_iteration_.store(options_.kMaxIteration, std::memory_order_relaxed);
+    if (!use_time_budget_) {
+        return;
+    }
+
+    // Backward pass costs almost the same as forward pass, so forward pass should stop at half of budget.
+    time_budget_of_pass_ = options_.kCheckForwardBackward ? options_.kTimeBudgetInMillisecond * 0.5f : options_.kTimeBudgetInMillisecond;
+
+    // Features with larger priority are tracked first. If sizeof priority is not equal to features, keep their order.
+    track_order_.resize(max_feature_id);
+    for (uint32_t feature_id = 0; feature_id < max_feature_id; ++feature_id) {
+        track_order_[feature_id] = feature_id;
+    }
+    if (feature_priority_.size() >= max_feature_id) {
+        // Ties are broken by feature id, which keeps the order of stable sort without its temporary heap buffer.
+        std::sort(track_order_.begin(), track_order_.end(), [&] (uint32_t id_a, uint32_t id_b) {
+            return feature_priority_[id_a] > feature_priority_[id_b] ||
+                (feature_priority_[id_a] == feature_priority_[id_b] && id_a < id_b);
+        });
+    }
+    features_out_of_budget_.assign(max_feature_id, 0);
+}
+
+bool OpticalFlow::IsTimeBudgetUsedUp() {
+    const float used_time = std::chrono::duration<float, std::milli>(GetTimeBudgetClock() - start_time_).count();
+    const float used_ratio = used_time / time_budget_of_pass_;
+    if (used_ratio >= 1.0f) {
+        return true;
+    }
+
+    // Shrink max iteration linearly in the second half of budget.
+    if (used_ratio > 0.5f && options_.kMinIterationInBudget < options_.kMaxIteration) {
+        const float range = static_cast<float>(options_.kMaxIteration - options_.kMinIterationInBudget);
+        const uint32_t max_iteration = options_.kMinIterationInBudget + static_cast<uint32_t>(range * (1.0f - used_ratio) * 2.0f);
+        max_iteration_.store(max_iteration, std::memory_order_relaxed);
+    }
+    return false;
+}
+
+void OpticalFlow::RecordTimeBudget(uint8_t *status) {
+    time_cost_in_millisecond_ = std::chrono::duration<float, std::milli>(GetTimeBudgetClock() - start_time_).count();
+    if (!use_time_budget_) {
+        return;
+    }
+    time_budget_of_pass_ = options_.kTimeBudgetInMillisecond;
+    for (uint32_t feature_id = 0; feature_id < features_out_of_budget_.size(); ++feature_id) {
+        if (features_out_of_budget_[feature_id]) {
+            status[feature_id] = static_cast<uint8_t>(TrackStatus::kNotTracked);
+        }
+    }
+}
+
+std::chrono::steady_clock::time_point OpticalFlow::GetTimeBudgetClock() const {
+    return time_budget_clock_ ? time_budget_clock_() : std::chrono::steady_clock::now();
+}
+
+float OpticalFlow::used_time_budget() const {
+    return options_.kTimeBudgetInMillisecond > 0.0f ? time_cost_in_millisecond_ / options_.kTimeBudgetInMillisecond : 0.0f;
+}
+
+PyramidTraversal OpticalFlow::pyramid_traversal() const {
+    return use_time_budget_ ? PyramidTraversal::kFeatureMajor : options_.kPyramidTraversal;
+}
+
+void OpticalFlow::PrepareRefPatchCache(const ImagePyramid &ref_pyramid, uint32_t max_feature_id, const uint32_t *feature_ids) {
+    if (!options_.kUseRefPatchCache) {
+        ref_patch_caches_.clear();
+        return;
+    }
+
+    // Layout of cache is changed, so all patches are dropped.
+    const int32_t num_levels = static_cast<int32_t>(ref_pyramid.level());
+    const uint32_t num_caches = max_feature_id * num_levels;
+    bool drop_all = ref_patch_cache_generation_ != ref_frame_generation_;
+    if (ref_patch_cache_num_features_ != max_feature_id || ref_patch_cache_patch_size_ != patch_size_ ||
+        ref_patch_cache_use_fixed_patch_kernel_ != options_.kUseFixedPatchKernel || ref_patch_caches_.size() != num_caches) {
+        ref_patch_caches_.resize(num_caches);
+        ref_patch_cache_feature_ids_.resize(max_feature_id);
+        ref_patch_cache_num_features_ = max_feature_id;
+        ref_patch_cache_patch_size_ = patch_size_;
+        ref_patch_cache_use_fixed_patch_kernel_ = options_.kUseFixedPatchKernel;
+        drop_all = true;
+    }
+    ref_patch_cache_generation_ = ref_frame_generation_;
+
+    // Patches of one index belong to another feature, such as the last feature moved by removing from feature store.
+    for (uint32_t feature_id = 0; feature_id < max_feature_id; ++feature_id) {
+        const uint32_t id = feature_ids == nullptr ? feature_id : feature_ids[feature_id];
+        CONTINUE_IF(!drop_all && ref_patch_cache_feature_ids_[feature_id] == id);
+        ref_patch_cache_feature_ids_[feature_id] = id;
+        for (int32_t level_idx = 0; level_idx < num_levels; ++level_idx) {
+            ref_patch_caches_[level_idx * max_feature_id + feature_id].is_valid = false;
+        }
+    }
+}
+
+RefPatchCache *OpticalFlow::GetRefPatchCache(int32_t level_idx, uint32_t feature_id) {
+    // Reference of backward pass is current frame, which should not be cached.
+    if (ref_patch_caches_.empty() || is_backward_pass_) {
+        return nullptr;
+    }
+    return &ref_patch_caches_[level_idx * ref_patch_cache_num_features_ + feature_id];
+}
+
+void OpticalFlow::TrackEachFeature(uint32_t num_features, const FeatureTask &task) {
+    // Features are independent from each other, so each worker only touches its own scratch buffers and
+    // its own slots of output. Result is identical with serial tracking.
+    if (use_time_budget_) {
+        // Features are tracked in order of priority. All workers pull features from one shared cursor over this order,
+        // and budget is checked before pulling, so that features started before budget is used up are always a
+        // prefix of this order. Features which are skipped are also skipped in backward pass.
+        std::atomic<uint32_t> next_task_id { 0 };
+        const auto budget_loop = [&] (TrackingScratch &scratch) {
+            while (!IsTimeBudgetUsedUp()) {
+                const uint32_t task_id = next_task_id.fetch_add(1, std::memory_order_relaxed);
+                BREAK_IF(task_id >= num_features);
+                const uint32_t feature_id = track_order_[task_id];
+                CONTINUE_IF(features_out_of_budget_[feature_id]);
+                task(feature_id, scratch);
+            }
+        };
+        if (thread_pool_ == nullptr) {
+            budget_loop(scratches_.front());
+        } else {
+            // Each worker runs one pulling loop, which is only guaranteed by static schedule.
+            thread_pool_->ParallelFor(thread_pool_->num_threads(), [&] (uint32_t task_id, uint32_t worker_id) {
+                budget_loop(scratches_[worker_id]);
+            }, ThreadPoolSchedule::kStatic);
+        }
+
+        for (uint32_t task_id = std::min(next_task_id.load(std::memory_order_relaxed), num_features); task_id < num_features; ++task_id) {
+            features_out_of_budget_[track_order_[task_id]] = 1;
+        }
+        return;
+    }
+
+    if (thread_pool_ == nullptr) {
+        for (uint32_t feature_id = 0; feature_id < num_features; ++feature_id) {
+            task(feature_id, scratches_.front());
+        }
+        return;
+    }
+
+    thread_pool_->ParallelFor(num_features, [&] (uint32_t feature_id, uint32_t worker_id) {
+        task(feature_id, scratches_[worker_id]);
+    }, options_.kThreadSchedule, options_.kThreadChunkSize);
+}
+
+void OpticalFlow::SelectFeaturesToTrack(const std::vector<uint8_t> &status, uint32_t max_feature_id) {
+    // Do not repeatly track features that has been tracking failed. This is decided once before the first level,
+    // so that features which fail in a coarse level are still refined in finer levels, the same as feature-major.
+    features_to_track_.resize(max_feature_id);
+    for (uint32_t feature_id = 0; feature_id < max_feature_id; ++feature_id) {
+        features_to_track_[feature_id] = status[feature_id] <= static_cast<uint8_t>(TrackStatus::kTracked);
+    }
+}
+
 }
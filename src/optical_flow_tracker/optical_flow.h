@@ -6,15 +6,49 @@
 #include "datatype_image_pyramid.h"
 #include "slam_basic_math.h"
 #include "feature_tracker.h"
+#include "thread_pool.h"
+#include "gradient_pyramid.h"
+#include "padded_pyramid.h"
+#include "patch_pattern.h"
+#include "feature_store.h"
+#include "profiler.h"
+#include "optical_flow_fixed_patch.h"
+
+#include <memory>
+#include <functional>
+#include <variant>
+#include <atomic>
+#include <chrono>
+#include <array>
+#include <type_traits>
+
+// Record convergence telemetry of each feature in klt kernels. It is compiled out if disabled.
+#ifndef OPTICAL_FLOW_TELEMETRY
+#define OPTICAL_FLOW_TELEMETRY (0)
+#endif
 
 namespace FEATURE_TRACKER {
 
+constexpr bool kEnableTelemetry = OPTICAL_FLOW_TELEMETRY;
+
 enum class OpticalFlowMethod : uint8_t {
     kInverse = 0,
     kDirect = 1,
     kFast = 2,
-    kSse = 3,
+    kSse = 3,    // Packed 8 floats. Its kernels are compiled for each simd level, and the highest one supported by cpu is used.
     kNeon = 4,
+    kFixedPoint = 5,
+};
+
+enum class SimdLevel : uint8_t {
+    kScalar = 0,    // Scalar code, available on every platform.
+    kSse4 = 1,    // SSE4.1, two 128-bit registers. Only on x86.
+    kAvx2 = 2,    // AVX2 and FMA, one 256-bit register. Only on x86.
+};
+
+enum class PyramidTraversal : uint8_t {
+    kFeatureMajor = 0,    // Track each feature through all levels, then next feature.
+    kLevelMajor = 1,      // Track all features in one level, then propagate them to next level.
 };
 
 struct OpticalFlowOptions {
@@ -25,6 +59,118 @@ struct OpticalFlowOptions {
     int32_t kPatchColHalfSize = 6;
     float kMaxConvergeStep = 4e-2f;
     OpticalFlowMethod kMethod = OpticalFlowMethod::kFast;
+    PyramidTraversal kPyramidTraversal = PyramidTraversal::kFeatureMajor;
+    bool kUseAdaptivePyramidLevel = false;    // Start each feature from the coarsest level which its predicted motion needs, or top level without prediction.
+    int32_t kMinAdaptiveStartLevel = 1;    // Coarsest level of features with small predicted motion.
+    bool kUseFixedPatchKernel = false;    // Kernel with compile-time patch size for fast method. Its summation order differs, so results differ slightly.
+    // Sparse pattern is only used by fast method, without reference patch cache. Pattern with less than 3 points for each
+    // parameter fitted by tracker, which is 2 for basic klt, 3 for lssd klt and 6 for affine klt, falls back to full patch.
+    PatchPatternType kPatchPattern = PatchPatternType::kFull;
+    int32_t kPatchPatternStride = 3;    // Spacing of points in diamond and checkerboard pattern.
+    std::vector<PatchPatternPoint> kPatchPatternPoints;    // Offsets of points in custom pattern.
+    // Keep reference patches between calls. Only basic klt fast method uses it. Each patch is keyed by feature id, which
+    // is index in vectors or id in feature store, and generation of reference frame. Caller should call
+    // BumpRefFrameGeneration() whenever reference frame changes, otherwise patches of former frame are reused.
+    bool kUseRefPatchCache = false;
+    bool kCheckForwardBackward = false;
+    float kMaxForwardBackwardError = 0.5f;    // Max distance between reference and backward tracked pixel.
+    float kTimeBudgetInMillisecond = 0.0f;    // Features not started before budget is used up are not tracked. Zero means no budget.
+    uint32_t kMinIterationInBudget = 3;    // Max iteration is shrunk linearly to it in the second half of budget.
+    uint32_t kNumThreads = 1;
+    ThreadPoolSchedule kThreadSchedule = ThreadPoolSchedule::kWorkStealing;
+    uint32_t kThreadChunkSize = 8;
+    SimdLevel kMaxSimdLevel = SimdLevel::kAvx2;    // Sse method uses the lower one of it and the highest level supported by cpu.
+};
+
+/* Convergence telemetry of one feature. */
+struct TrackTelemetry {
+    static constexpr int32_t kMaxLevel = 8;
+    std::array<uint8_t, kMaxLevel> iterations_in_level = {};    // Iterations in each pyramid level.
+    float residual = 0.0f;    // Sum of squared residual divided by valid pixels, in the last iteration.
+    float min_eigen_value = 0.0f;    // Min eigen value of hessian matrix in the last level. Its scale depends on the parameters of each tracker.
+    uint32_t valid_pixel_num = 0;    // Valid pixels in the last iteration.
+    int32_t failed_level = -1;    // Pyramid level where tracking failed. It is -1 if not failed.
+};
+
+/* Convergence of one feature in one pyramid level, recorded by klt kernels. */
+struct ConvergenceRecord {
+    uint32_t iterations = 0;
+    float squared_residual = 0.0f;
+    uint32_t valid_pixel_num = 0;
+    float min_eigen_value = 0.0f;
+};
+
+/* Scratch buffers for tracking one feature. Each worker thread owns one of them. */
+struct TrackingScratch {
+    // Variables of reference patch supporting for fast method.
+    std::vector<float> ex_ref_patch;   // Extended patch with bound size 1.
+    std::vector<uint8_t> ex_ref_patch_pixel_valid;
+    std::vector<float> all_dx_in_ref_patch;
+    std::vector<float> all_dy_in_ref_patch;
+
+    // Variables of current patch supporting for fast method.
+    std::vector<float> cur_patch;
+    std::vector<uint8_t> cur_patch_pixel_valid;
+    std::vector<float> all_dx_in_cur_patch;
+    std::vector<float> all_dy_in_cur_patch;
+
+    // Variables of ref and cur patch supporting for sse method. Each row is padded to be multiple of 8 floats,
+    // and validity is stored as 1.0f/0.0f so that it can be multiplied in vector lanes.
+    std::vector<float> ex_ref_patch_sse;
+    std::vector<float> ex_ref_patch_pixel_valid_sse;
+    std::vector<float> ref_patch_sse;
+    std::vector<float> ref_patch_pixel_valid_sse;
+    std::vector<float> all_dx_in_ref_patch_sse;
+    std::vector<float> all_dy_in_ref_patch_sse;
+    std::vector<float> cur_patch_sse;
+    std::vector<float> cur_patch_pixel_valid_sse;
+
+    // Variables of ref patch supporting for fixed-point method. Pixel values are Q5 and gradients are Q3.
+    std::vector<int16_t> ex_ref_patch_fixed_point;
+    std::vector<uint8_t> ex_ref_patch_pixel_valid_fixed_point;
+    std::vector<int16_t> all_dx_in_ref_patch_fixed_point;
+    std::vector<int16_t> all_dy_in_ref_patch_fixed_point;
+
+    // Variables of ref and cur pattern supporting for sparse patch pattern. They have one element per pattern point.
+    std::vector<float> ref_pattern;
+    std::vector<uint8_t> ref_pattern_valid;
+    std::vector<float> all_dx_in_ref_pattern;
+    std::vector<float> all_dy_in_ref_pattern;
+    std::vector<float> cur_pattern;
+    std::vector<uint8_t> cur_pattern_valid;
+
+    // Convergence of feature in current level supporting for telemetry.
+    ConvergenceRecord convergence;
+};
+
+/* Reference patch of one feature in one pyramid level supporting for fast method. */
+// It is kept between calls, so that many current frames can be tracked against the same reference frame
+// without extracting reference patch and rebuilding hessian matrix again.
+struct RefPatchCache {
+    bool is_valid = false;
+    Vec2 ref_pixel_uv = Vec2::Zero();
+    uint32_t valid_pixel_num = 0;
+    std::vector<float> ex_ref_patch;
+    std::vector<uint8_t> ex_ref_patch_pixel_valid;
+    std::vector<float> all_dx_in_ref_patch;
+    std::vector<float> all_dy_in_ref_patch;
+    Eigen::LDLT<Mat2> hessian_ldlt;
+
+    // Reference patch of kernel with compile-time patch size.
+    std::variant<std::monostate, FixedPatch<3>, FixedPatch<4>, FixedPatch<5>, FixedPatch<6>, FixedPatch<7>> fixed_patch;
+};
+
+/* Inputs of one feature for tracking kernel through pyramid levels. */
+// Stateful tracking fills them with adaptive start level, prediction and reference patch cache. Reentrant tracking
+// starts each feature from the top level without any of them.
+struct FeatureTrackingContext {
+    uint32_t feature_id = 0;
+    int32_t start_level = 0;
+    bool has_predict_affine = false;
+    Mat2 predict_affine = Mat2::Identity();    // Local affine transform predicted by homography.
+    RefPatchCache *ref_patch_cache = nullptr;    // Cache of this feature in level 0, or nullptr if disabled.
+    uint32_t ref_patch_cache_stride = 0;    // Offset between caches of this feature in adjacent levels.
+    bool record_telemetry = false;
 };
 
 class OpticalFlow {
@@ -45,76 +191,389 @@ public:
                        std::vector<Vec2> &cur_pixel_uv,
                        std::vector<uint8_t> &status);
 
+    // Track features in store from reference frame to current frame. Each feature reads its pixel position and status
+    // from the store, and writes them back in place, so that no array of features is copied. Age of tracked features
+    // increases by one. All features in store are tracked, regardless of kMaxTrackPointsNumber, and each one is tracked
+    // through all its levels at once, regardless of kPyramidTraversal. Position in store is also the initial guess in
+    // current frame, and it may be seeded by prediction of homography. Return false if kCheckForwardBackward is
+    // enabled, since reference position is overwritten before backward pass.
+    bool TrackFeatures(const ImagePyramid &ref_pyramid,
+                       const ImagePyramid &cur_pyramid,
+                       FeatureStore &features);
+
+    bool TrackFeatures(const GrayImage &ref_image,
+                       const GrayImage &cur_image,
+                       FeatureStore &features);
+
+    // Reentrant tracking of features in [begin_id, end_id) through all pyramid levels. It only reads state of tracker,
+    // and all buffers come from scratch owned by caller, so that concurrent jobs can share one tracker by tracking
+    // disjoint ranges of features. Sizes of cur_pixel_uv and status should be the same as ref_pixel_uv already, and
+    // cur_pixel_uv is the initial guess of each feature. Features of any id are tracked, regardless of
+    // kMaxTrackPointsNumber. Limits compared with stateful tracking:
+    // - PrepareForReentrantTracking() should be called before, and again after options are changed or stateful
+    //   tracking is called. Return false if patch layout is not prepared for current options.
+    // - Every feature starts from the top level, one feature after another. kPyramidTraversal does not change result,
+    //   so it is ignored. Reference patch cache and telemetry are not used.
+    // - Return false if kCheckForwardBackward, kUseAdaptivePyramidLevel, time budget or prediction by homography is
+    //   enabled, since they need state of tracker across features.
+    // - Return false if kMethod is not supported by this tracker, the same as stateful tracking.
+    bool TrackFeatures(const ImagePyramid &ref_pyramid,
+                       const ImagePyramid &cur_pyramid,
+                       const std::vector<Vec2> &ref_pixel_uv,
+                       std::vector<Vec2> &cur_pixel_uv,
+                       std::vector<uint8_t> &status,
+                       uint32_t begin_id,
+                       uint32_t end_id,
+                       TrackingScratch &scratch) const;
+
+    // Prepare patch layout from options for reentrant tracking.
+    void PrepareForReentrantTracking();
+    // Allocate buffers of scratch for patch layout. Reentrant tracking also calls it, which does nothing if they are
+    // allocated already.
+    void PrepareScratch(TrackingScratch &scratch) const;
+
     // Support for all subclass's fast method.
     uint32_t ExtractExtendPatchInReferenceImage(const GrayImage &ref_image,
                                                 const Vec2 &ref_pixel_uv,
                                                 int32_t ex_ref_patch_rows,
                                                 int32_t ex_ref_patch_cols,
                                                 std::vector<float> &ex_ref_patch,
-                                                std::vector<bool> &ex_ref_patch_pixel_valid);
+                                                std::vector<uint8_t> &ex_ref_patch_pixel_valid) const;
+
+    // Support for all subclass's sse method. Kernels of each simd level are compiled in their own files.
+    template <SimdLevel kSimdLevel>
+    uint32_t ExtractExtendPatchInReferenceImageSse(const GrayImage &ref_image,
+                                                   const Vec2 &ref_pixel_uv,
+                                                   int32_t ex_ref_patch_rows,
+                                                   int32_t ex_ref_patch_cols,
+                                                   int32_t ex_ref_patch_stride,
+                                                   float *ex_ref_patch,
+                                                   float *ex_ref_patch_pixel_valid) const;
+
+    // Support for all subclass's fixed-point method.
+    uint32_t ExtractExtendPatchInReferenceImageFixedPoint(const GrayImage &ref_image,
+                                                          const Vec2 &ref_pixel_uv,
+                                                          int32_t ex_ref_patch_rows,
+                                                          int32_t ex_ref_patch_cols,
+                                                          int16_t *ex_ref_patch,
+                                                          uint8_t *ex_ref_patch_pixel_valid) const;
+
+    // Support for all subclass's fast method with gradient pyramid of reference image. Return false if gradient of
+    // this image is not given or patch touches border of image, then gradient should be computed from extended patch.
+    bool SampleGradientInReferencePatch(const GrayImage &ref_image,
+                                        const Vec2 &ref_pixel_uv,
+                                        std::vector<float> &all_dx_in_ref_patch,
+                                        std::vector<float> &all_dy_in_ref_patch) const;
+
+    // Support for all subclass's fast method with sparse patch pattern. Pixel value and gradient of reference image are
+    // only sampled at pattern points. Point is valid if its gradient can be computed.
+    uint32_t ExtractPatternInReferenceImage(const GrayImage &ref_image,
+                                            const Vec2 &ref_pixel_uv,
+                                            std::vector<float> &ref_pattern,
+                                            std::vector<uint8_t> &ref_pattern_valid,
+                                            std::vector<float> &all_dx_in_ref_pattern,
+                                            std::vector<float> &all_dy_in_ref_pattern) const;
+
+    // Support for all subclass's fast method with padded pyramids. Return nullptr if this image is not padded.
+    const PaddedImage *FindPaddedImage(const GrayImage &image) const;
+    // Pixels which patches are sampled from, read from padded copy of image if it is given.
+    PaddedImageView GetImageView(const GrayImage &image) const { return PaddedImageView(image, FindPaddedImage(image)); }
+
+    // Predict all features with homography from reference frame to current frame. Each tracking call then seeds
+    // cur_pixel_uv and the local affine/rotation of each feature with it, until prediction is cleared.
+    void SetPredictHomography(const Mat3 &H_cr);
+    // Predict with rotation from reference camera to current camera, such as integrated by gyro. Intrinsics are
+    // fx, fy, cx, cy of pinhole camera. It is the same as homography K * R_cr * K.inv.
+    void SetPredictRotation(const Mat3 &R_cr, const Vec4 &intrinsics);
+    void ClearPrediction();
+
+    // Output convergence telemetry of each feature in forward pass into telemetry, until it is set to nullptr.
+    // Nothing is recorded unless OPTICAL_FLOW_TELEMETRY is enabled at compile time.
+    void SetTelemetryOutput(std::vector<TrackTelemetry> *telemetry) { telemetry_ = telemetry; }
+
+    // Track features with larger priority first, such as track age or harris response. It is only used with time budget.
+    void SetFeaturePriority(const std::vector<float> &priority) { feature_priority_ = priority; }
+    void ClearFeaturePriority() { feature_priority_.clear(); }
+    // Replace clock of time budget, such as by a simulated clock in tests. Empty clock means steady clock.
+    void SetTimeBudgetClock(const std::function<std::chrono::steady_clock::time_point()> &clock) { time_budget_clock_ = clock; }
+    // Time cost of last tracking call, and its ratio to time budget.
+    float time_cost_in_millisecond() const { return time_cost_in_millisecond_; }
+    float used_time_budget() const;
+
+    // Number of features tracked in each pyramid level in forward pass, accumulated since last reset.
+    void ResetLevelHitCounts() { level_hit_counts_.clear(); }
+
+    // Highest simd level supported by cpu and compiled on this platform. It is detected once.
+    static SimdLevel DetectSimdLevel();
+    // Simd level used by sse method, selected when patch layout is prepared.
+    SimdLevel simd_level() const { return simd_level_; }
+    const std::vector<uint32_t> &level_hit_counts() const { return level_hit_counts_; }
+
+    // Start a new generation of reference frame, so that all cached reference patches are dropped in next call.
+    void BumpRefFrameGeneration() { ++ref_frame_generation_; }
+    uint32_t ref_frame_generation() const { return ref_frame_generation_; }
 
     // Reference for member variables.
     OpticalFlowOptions &options() { return options_; }
-    std::vector<float> &ex_ref_patch() { return ex_ref_patch_; }
-    std::vector<bool> &ex_ref_patch_pixel_valid() { return ex_ref_patch_pixel_valid_; }
-    std::vector<float> &all_dx_in_ref_patch() { return all_dx_in_ref_patch_; }
-    std::vector<float> &all_dy_in_ref_patch() { return all_dy_in_ref_patch_; }
-    std::vector<float> &cur_patch() { return cur_patch_; }
-    std::vector<bool> &cur_patch_pixel_valid() { return cur_patch_pixel_valid_; }
-    std::vector<float> &all_dx_in_cur_patch() { return all_dx_in_cur_patch_; }
-    std::vector<float> &all_dy_in_cur_patch() { return all_dy_in_cur_patch_; }
+    const GradientPyramid *&ref_gradient_pyramid() { return ref_gradient_pyramid_; }
+    const PaddedPyramid *&ref_padded_pyramid() { return ref_padded_pyramid_; }
+    const PaddedPyramid *&cur_padded_pyramid() { return cur_padded_pyramid_; }
     int32_t &patch_rows() { return patch_rows_; }
     int32_t &patch_cols() { return patch_cols_; }
     int32_t &patch_size() { return patch_size_; }
     int32_t &ex_ref_patch_rows() { return ex_patch_rows_; }
     int32_t &ex_ref_patch_cols() { return ex_patch_cols_; }
     int32_t &ex_patch_size() { return ex_patch_size_; }
+    std::vector<float> &patch_col_valid_sse() { return patch_col_valid_sse_; }
+    int32_t &patch_stride_sse() { return patch_stride_sse_; }
+    int32_t &ex_patch_stride_sse() { return ex_patch_stride_sse_; }
 
     // Const reference for member variables.
     const OpticalFlowOptions &options() const { return options_; }
-    const std::vector<float> &ex_ref_patch() const { return ex_ref_patch_; }
-    const std::vector<bool> &ex_ref_patch_pixel_valid() const { return ex_ref_patch_pixel_valid_; }
-    const std::vector<float> &all_dx_in_ref_patch() const { return all_dx_in_ref_patch_; }
-    const std::vector<float> &all_dy_in_ref_patch() const { return all_dy_in_ref_patch_; }
-    const std::vector<float> &cur_patch() const { return cur_patch_; }
-    const std::vector<bool> &cur_patch_pixel_valid() const { return cur_patch_pixel_valid_; }
-    const std::vector<float> &all_dx_in_cur_patch() const { return all_dx_in_cur_patch_; }
-    const std::vector<float> &all_dy_in_cur_patch() const { return all_dy_in_cur_patch_; }
+    const GradientPyramid *ref_gradient_pyramid() const { return ref_gradient_pyramid_; }
+    const PaddedPyramid *ref_padded_pyramid() const { return ref_padded_pyramid_; }
+    const PaddedPyramid *cur_padded_pyramid() const { return cur_padded_pyramid_; }
     const int32_t &patch_rows() const { return patch_rows_; }
     const int32_t &patch_cols() const { return patch_cols_; }
     const int32_t &patch_size() const { return patch_size_; }
     const int32_t &ex_ref_patch_rows() const { return ex_patch_rows_; }
     const int32_t &ex_ref_patch_cols() const { return ex_patch_cols_; }
     const int32_t &ex_patch_size() const { return ex_patch_size_; }
+    const std::vector<float> &patch_col_valid_sse() const { return patch_col_valid_sse_; }
+    const int32_t &patch_stride_sse() const { return patch_stride_sse_; }
+    const int32_t &ex_patch_stride_sse() const { return ex_patch_stride_sse_; }
+    const PatchPattern &patch_pattern() const { return patch_pattern_; }
+
+protected:
+    // Run task for each feature. Features are split across worker threads if kNumThreads > 1.
+    using FeatureTask = std::function<void(uint32_t feature_id, TrackingScratch &scratch)>;
+    void TrackEachFeature(uint32_t num_features, const FeatureTask &task);
+    // Same as above, but the task is wrapped by reference, so that steady state tracking does not allocate heap.
+    template <typename TaskType>
+    void TrackEachFeature(uint32_t num_features, const TaskType &task) { TrackEachFeature(num_features, FeatureTask(std::cref(task))); }
+
+    // Run kernel of sse method for the selected simd level, which is given to kernel as std::integral_constant.
+    // Kernels of x86 simd levels are only compiled on x86.
+    template <typename KernelType>
+    void DispatchSimd(const KernelType &kernel) const {
+#if defined(OPTICAL_FLOW_SIMD_X86)
+        if (simd_level_ == SimdLevel::kAvx2) {
+            kernel(std::integral_constant<SimdLevel, SimdLevel::kAvx2>());
+            return;
+        }
+        if (simd_level_ == SimdLevel::kSse4) {
+            kernel(std::integral_constant<SimdLevel, SimdLevel::kSse4>());
+            return;
+        }
+#endif
+        kernel(std::integral_constant<SimdLevel, SimdLevel::kScalar>());
+    }
+
+    // Check if cached reference patches belong to generation of reference frame and feature ids, and drop them if not.
+    // Feature id is index of feature if feature_ids is nullptr.
+    void PrepareRefPatchCache(const ImagePyramid &ref_pyramid, uint32_t max_feature_id, const uint32_t *feature_ids = nullptr);
+    // Get cached reference patch of feature in pyramid level. Return nullptr if cache is disabled.
+    RefPatchCache *GetRefPatchCache(int32_t level_idx, uint32_t feature_id);
+
+    // Get local affine transform or rotation of feature predicted by homography. Return false if it is not predicted.
+    bool GetPredictAffine(uint32_t feature_id, Mat2 &affine) const;
+    bool GetPredictRotation(uint32_t feature_id, Mat2 &rotation) const;
+    // Rotation which is closest to affine transform.
+    static Mat2 ClosestRotation(const Mat2 &affine);
+
+    // Track features through pyramid levels one by one, each from its own start level. All subclasses share it.
+    bool TrackMultipleLevelFeatureMajor(const ImagePyramid &ref_pyramid,
+                                        const ImagePyramid &cur_pyramid,
+                                        const std::vector<Vec2> &ref_pixel_uv,
+                                        std::vector<Vec2> &cur_pixel_uv,
+                                        std::vector<uint8_t> &status);
+    // Track all features in one pyramid level before the next level. All subclasses share it, and keep state of each
+    // feature between levels through hooks of level-major traversal.
+    bool TrackMultipleLevelLevelMajor(const ImagePyramid &ref_pyramid,
+                                      const ImagePyramid &cur_pyramid,
+                                      const std::vector<Vec2> &ref_pixel_uv,
+                                      std::vector<Vec2> &cur_pixel_uv,
+                                      std::vector<uint8_t> &status);
+    // Collect inputs of feature from state of tracker for stateful tracking.
+    FeatureTrackingContext GetFeatureTrackingContext(uint32_t feature_id);
+    // Mark feature outside of image.
+    static void CheckFeatureOutside(const GrayImage &cur_image, const Vec2 &cur_pixel_uv, uint8_t &status);
+
+    // Backward pass tracks features from current frame to reference frame. Prediction should be inversed in it.
+    bool is_backward_pass() const { return is_backward_pass_; }
+
+    // Max iteration of each feature. It is shrunk as time budget drains.
+    uint32_t max_iteration() const { return use_time_budget_ ? max_iteration_.load(std::memory_order_relaxed) : options_.kMaxIteration; }
+    // Time budget is checked before each feature, so that all levels of one feature are tracked in one task.
+    PyramidTraversal pyramid_traversal() const;
+
+    // Solve incremental function hessian * v = bias.
+    template <typename HessianType, typename BiasType>
+    static BiasType SolveIncrementalFunction(const HessianType &hessian, const BiasType &bias) {
+        PROFILE_ZONE(kSolve);
+        return hessian.ldlt().solve(bias);
+    }
+    template <typename HessianType, typename BiasType>
+    static BiasType SolveIncrementalFunction(const Eigen::LDLT<HessianType> &hessian_ldlt, const BiasType &bias) {
+        PROFILE_ZONE(kSolve);
+        return hessian_ldlt.solve(bias);
+    }
+
+    // Record convergence in klt kernels. They do nothing if telemetry is compiled out.
+    static void RecordIteration(TrackingScratch &scratch) {
+        if constexpr (kEnableTelemetry) {
+            ++scratch.convergence.iterations;
+        }
+    }
+    static void RecordResidual(ConvergenceRecord &convergence, float squared_residual, uint32_t valid_pixel_num) {
+        if constexpr (kEnableTelemetry) {
+            convergence.squared_residual = squared_residual;
+            convergence.valid_pixel_num = valid_pixel_num;
+        }
+    }
+    template <typename HessianType>
+    static void RecordHessian(TrackingScratch &scratch, const HessianType &hessian) {
+        if constexpr (kEnableTelemetry) {
+            Eigen::SelfAdjointEigenSolver<HessianType> solver(hessian, Eigen::EigenvaluesOnly);
+            scratch.convergence.min_eigen_value = solver.eigenvalues()(0);
+        }
+    }
+    template <typename HessianType>
+    static void RecordHessian(TrackingScratch &scratch, const Eigen::LDLT<HessianType> &hessian_ldlt) {
+        if constexpr (kEnableTelemetry) {
+            RecordHessian(scratch, HessianType(hessian_ldlt.reconstructedMatrix()));
+        }
+    }
+    // Move convergence of feature in this level into telemetry output, and reset it for next level.
+    void RecordTelemetry(uint32_t feature_id, int32_t level_idx, uint8_t status, TrackingScratch &scratch) const;
+
+    // Coarsest pyramid level to start tracking feature from.
+    int32_t start_level_of_feature(uint32_t feature_id) const { return start_level_of_features_[feature_id]; }
+
+    // Record features which should be tracked through all levels in level-major traversal.
+    void SelectFeaturesToTrack(const std::vector<uint8_t> &status, uint32_t max_feature_id);
+    const std::vector<uint8_t> &features_to_track() const { return features_to_track_; }
 
 private:
+    // Track one feature from its start level to level 0. It must only read state of tracker, so that it is reentrant.
+    virtual void TrackOneFeatureInMultipleLevel(const ImagePyramid &ref_pyramid,
+                                                const ImagePyramid &cur_pyramid,
+                                                const Vec2 &ref_pixel_uv,
+                                                Vec2 &cur_pixel_uv,
+                                                uint8_t &status,
+                                                const FeatureTrackingContext &context,
+                                                TrackingScratch &scratch) const = 0;
+    // Track features in multiple level with traversal selected by options.
     virtual bool TrackMultipleLevel(const ImagePyramid &ref_pyramid,
                                     const ImagePyramid &cur_pyramid,
                                     const std::vector<Vec2> &ref_pixel_uv,
                                     std::vector<Vec2> &cur_pixel_uv,
-                                    std::vector<uint8_t> &status) = 0;
-    virtual bool TrackSingleLevel(const GrayImage &ref_image,
-                                  const GrayImage &cur_image,
-                                  const std::vector<Vec2> &ref_pixel_uv,
-                                  std::vector<Vec2> &cur_pixel_uv,
-                                  std::vector<uint8_t> &status) = 0;
+                                    std::vector<uint8_t> &status);
+    // Hooks of level-major traversal. State of each feature, such as affine transform, is prepared for all features and
+    // initialized in start level of each feature to track. Pixel uv are scaled to the level, and scaled_cur_pixel_uv is
+    // the result in this level after tracking.
+    virtual void PrepareLevelMajorStates(uint32_t num_features) {}
+    virtual void InitializeLevelMajorState(uint32_t feature_id, const Vec2 &scaled_ref_pixel_uv, const Vec2 &scaled_cur_pixel_uv) {}
+    virtual void TrackOneFeatureInLevelMajor(const GrayImage &ref_image,
+                                             const GrayImage &cur_image,
+                                             uint32_t feature_id,
+                                             int32_t level_idx,
+                                             const Vec2 &scaled_ref_pixel_uv,
+                                             Vec2 &scaled_cur_pixel_uv,
+                                             uint8_t &status,
+                                             TrackingScratch &scratch) = 0;
+    // Track one feature in one image without pyramid. It must only read state of tracker, so that it is reentrant.
+    virtual void TrackOneFeatureInSingleLevel(const GrayImage &ref_image,
+                                              const GrayImage &cur_image,
+                                              const Vec2 &ref_pixel_uv,
+                                              Vec2 &cur_pixel_uv,
+                                              uint8_t &status,
+                                              const FeatureTrackingContext &context,
+                                              TrackingScratch &scratch) const = 0;
+    bool TrackSingleLevel(const GrayImage &ref_image,
+                          const GrayImage &cur_image,
+                          const std::vector<Vec2> &ref_pixel_uv,
+                          std::vector<Vec2> &cur_pixel_uv,
+                          std::vector<uint8_t> &status);
     virtual bool PrepareForTracking();
+    // Check if this tracker has kernels of method. Fixed-point method is only implemented by basic klt.
+    virtual bool IsMethodSupported(OpticalFlowMethod method) const { return method != OpticalFlowMethod::kFixedPoint; }
+    // Number of parameters fitted for each feature, which are translation of basic klt. Sparse pattern should have at
+    // least kMinPatternPointsPerParameter points for each of them.
+    virtual uint32_t NumberOfFeatureParameters() const { return 2; }
+    static constexpr uint32_t kMinPatternPointsPerParameter = 3;
+    void PreparePatchLayout();
+    void PredictFeatures(const std::vector<Vec2> &ref_pixel_uv, std::vector<Vec2> &cur_pixel_uv);
+    bool PredictFeature(const Vec2 &ref_pixel_uv, Vec2 &cur_pixel_uv, Mat2 &affine) const;
+    int32_t SelectStartLevel(const Vec2 &ref_pixel_uv, const Vec2 &cur_pixel_uv, int32_t top_level) const;
+    void SelectStartLevels(const std::vector<Vec2> &ref_pixel_uv,
+                           const std::vector<Vec2> &cur_pixel_uv,
+                           const std::vector<uint8_t> &status,
+                           int32_t num_levels);
+    void CheckForwardBackward(const std::vector<Vec2> &ref_pixel_uv, std::vector<uint8_t> &status);
+    void PrepareTelemetry(uint32_t max_feature_id);
+    void PrepareTimeBudget(uint32_t max_feature_id);
+    bool IsTimeBudgetUsedUp();
+    void RecordTimeBudget(uint8_t *status);
+    std::chrono::steady_clock::time_point GetTimeBudgetClock() const;
 
 private:
     // General options for optical flow trackers.
     OpticalFlowOptions options_;
 
-    // Variables of reference patch supporting for fast method.
-    std::vector<float> ex_ref_patch_;   // Extended patch with bound size 1.
-    std::vector<bool> ex_ref_patch_pixel_valid_;
-    std::vector<float> all_dx_in_ref_patch_;
-    std::vector<float> all_dy_in_ref_patch_;
+    // Scratch buffers for each worker thread.
+    std::vector<TrackingScratch> scratches_;
+    std::unique_ptr<ThreadPool> thread_pool_ = nullptr;
 
-    // Variables of current patch supporting for fast method.
-    std::vector<float> cur_patch_;
-    std::vector<bool> cur_patch_pixel_valid_;
-    std::vector<float> all_dx_in_cur_patch_;
-    std::vector<float> all_dy_in_cur_patch_;
+    // Gradient pyramid of reference image given by user. It is not owned by tracker.
+    const GradientPyramid *ref_gradient_pyramid_ = nullptr;
+
+    // Padded pyramids of reference and current image given by user. They are not owned by tracker. Both of them are
+    // searched for any image, so they also serve backward pass of forward-backward check. Images are matched by buffer,
+    // so they must be rebuilt by user whenever pixels of pyramids change.
+    const PaddedPyramid *ref_padded_pyramid_ = nullptr;
+    const PaddedPyramid *cur_padded_pyramid_ = nullptr;
+
+    // Prediction by homography, and local affine transform of each feature derived from it.
+    bool use_predict_homography_ = false;
+    Mat3 predict_H_cr_ = Mat3::Identity();
+    std::vector<Mat2> predict_affine_of_features_;
+
+    // Convergence telemetry output given by user. It is not owned by tracker.
+    std::vector<TrackTelemetry> *telemetry_ = nullptr;
+
+    // Time budget of tracking. Features are tracked in order of priority, and features skipped by budget are marked.
+    bool use_time_budget_ = false;
+    std::function<std::chrono::steady_clock::time_point()> time_budget_clock_;
+    std::chrono::steady_clock::time_point start_time_;
+    float time_cost_in_millisecond_ = 0.0f;
+    float time_budget_of_pass_ = 0.0f;
+    std::atomic<uint32_t> max_iteration_ { 15 };
+    std::vector<float> feature_priority_;
+    std::vector<uint32_t> track_order_;
+    std::vector<uint8_t> features_out_of_budget_;
+
+    // Start level of each feature in multiple level tracking, and number of features tracked in each level.
+    std::vector<int32_t> start_level_of_features_;
+    std::vector<uint32_t> level_hit_counts_;
+
+    // Result of backward pass in forward-backward check.
+    bool is_backward_pass_ = false;
+    std::vector<Vec2> backward_pixel_uv_;
+    std::vector<uint8_t> backward_status_;
+
+    // Cached reference patches indexed by level and index of feature, with id of feature in each index and generation
+    // of reference frame they belong to.
+    std::vector<RefPatchCache> ref_patch_caches_;
+    std::vector<uint32_t> ref_patch_cache_feature_ids_;
+    uint32_t ref_frame_generation_ = 0;
+    uint32_t ref_patch_cache_generation_ = 0;
+    uint32_t ref_patch_cache_num_features_ = 0;
+    int32_t ref_patch_cache_patch_size_ = 0;
+    bool ref_patch_cache_use_fixed_patch_kernel_ = false;
+
+    // Features which should be tracked in level-major traversal.
+    std::vector<uint8_t> features_to_track_;
 
     // Parameters of ref and cur patch.
     int32_t patch_rows_ = 0;
@@ -124,6 +583,15 @@ private:
     int32_t ex_patch_cols_ = 0;
     int32_t ex_patch_size_ = 0;
 
+    // Parameters of padded patch supporting for sse method.
+    std::vector<float> patch_col_valid_sse_;
+    int32_t patch_stride_sse_ = 0;
+    int32_t ex_patch_stride_sse_ = 0;
+    SimdLevel simd_level_ = SimdLevel::kScalar;
+
+    // Sampling points of patch, created from options.
+    PatchPattern patch_pattern_;
+
 };
 
 }
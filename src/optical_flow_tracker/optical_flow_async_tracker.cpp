@@ -0,0 +1,209 @@
+#include "optical_flow_async_tracker.h"
+#include "slam_memory.h"
+#include "slam_operations.h"
+#include "profiler.h"
+
+#include <cstring>
+
+namespace FEATURE_TRACKER {
+
+namespace {
+    float MillisecondsSince(const std::chrono::steady_clock::time_point &start_time) {
+        return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+    }
+}
+
+OpticalFlowAsyncTracker::OpticalFlowAsyncTracker(OpticalFlow *optical_flow, const OpticalFlowAsyncTrackerOptions &options) :
+    options_(options),
+    optical_flow_(optical_flow),
+    build_queue_(std::max(options.kMaxFramesInFlight, 1u) + 1),
+    track_queue_(std::max(options.kMaxFramesInFlight, 1u) + 1),
+    free_queue_(std::max(options.kMaxFramesInFlight, 1u) + 1) {
+    options_.kMaxFramesInFlight = std::max(options_.kMaxFramesInFlight, 1u);
+
+    // Frames in flight, and one more held by tracker as reference.
+    slots_.resize(options_.kMaxFramesInFlight + 1);
+    for (auto &slot : slots_) {
+        slot = std::make_unique<FrameSlot>();
+        FrameSlot *free_slot = slot.get();
+        free_queue_.TryPush(free_slot);
+    }
+
+    builder_ = std::thread(&OpticalFlowAsyncTracker::BuilderLoop, this);
+    tracker_ = std::thread(&OpticalFlowAsyncTracker::TrackerLoop, this);
+}
+
+OpticalFlowAsyncTracker::~OpticalFlowAsyncTracker() {
+    // Both stages drain their queues before exit, so that all submitted frames get their results.
+    stop_builder_.store(true, std::memory_order_release);
+    build_queue_.Notify();
+    builder_.join();
+    stop_tracker_.store(true, std::memory_order_release);
+    track_queue_.Notify();
+    tracker_.join();
+}
+
+std::future<AsyncFrameResult> OpticalFlowAsyncTracker::SubmitFrame(const GrayImage &image) {
+    auto promise = std::make_shared<std::promise<AsyncFrameResult>>();
+    std::future<AsyncFrameResult> future = promise->get_future();
+    SubmitFrame(image, nullptr, [promise] (AsyncFrameResult &result) { promise->set_value(std::move(result)); });
+    return future;
+}
+
+std::future<AsyncFrameResult> OpticalFlowAsyncTracker::SubmitFrame(const GrayImage &image, const std::vector<Vec2> &new_pixel_uv) {
+    auto promise = std::make_shared<std::promise<AsyncFrameResult>>();
+    std::future<AsyncFrameResult> future = promise->get_future();
+    SubmitFrame(image, &new_pixel_uv, [promise] (AsyncFrameResult &result) { promise->set_value(std::move(result)); });
+    return future;
+}
+
+bool OpticalFlowAsyncTracker::SubmitFrame(const GrayImage &image, const std::vector<Vec2> *new_pixel_uv, const Callback &callback) {
+    const uint32_t frame_id = num_submitted_frames_;
+    ++num_submitted_frames_;
+    const auto submit_time = std::chrono::steady_clock::now();
+
+    FrameSlot *slot = image.data() == nullptr || image.rows() <= 0 || image.cols() <= 0 ? nullptr : AcquireFreeSlot();
+    if (slot == nullptr) {
+        ++num_dropped_frames_;
+        AsyncFrameResult result;
+        result.frame_id = frame_id;
+        result.is_dropped = true;
+        if (callback != nullptr) {
+            callback(result);
+        }
+        return false;
+    }
+
+    // Buffers of slot are reallocated only when image size changes.
+    if (slot->pyramid == nullptr || slot->rows != image.rows() || slot->cols != image.cols()) {
+        slot->rows = image.rows();
+        slot->cols = image.cols();
+        slot->raw_image.resize(image.rows() * image.cols());
+        slot->pyramid = std::make_unique<ImagePyramid>();
+        slot->pyramid->SetPyramidBuff((uint8_t *)SlamMemory::Malloc(sizeof(uint8_t) * image.rows() * image.cols()), true);
+    }
+    std::memcpy(slot->raw_image.data(), image.data(), sizeof(uint8_t) * image.rows() * image.cols());
+
+    slot->frame_id = frame_id;
+    slot->has_new_features = new_pixel_uv != nullptr;
+    if (slot->has_new_features) {
+        slot->new_pixel_uv = *new_pixel_uv;
+    }
+    slot->callback = callback;
+    slot->submit_time = submit_time;
+
+    // Queue always has room, since number of slots limits frames in flight.
+    build_queue_.TryPush(slot);
+    return true;
+}
+
+void OpticalFlowAsyncTracker::Flush() {
+    const uint32_t num_accepted_frames = num_submitted_frames_ - num_dropped_frames_;
+    while (num_finished_frames_.load(std::memory_order_acquire) < num_accepted_frames) {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+OpticalFlowAsyncTracker::FrameSlot *OpticalFlowAsyncTracker::AcquireFreeSlot() {
+    FrameSlot *slot = nullptr;
+    if (free_queue_.TryPop(slot)) {
+        return slot;
+    }
+    if (options_.kBackpressure == AsyncBackpressure::kDrop) {
+        return nullptr;
+    }
+
+    // Block until tracker releases a frame.
+    while (!free_queue_.TryPop(slot)) {
+        free_queue_.WaitForItem(never_stop_);
+    }
+    return slot;
+}
+
+void OpticalFlowAsyncTracker::BuilderLoop() {
+    FrameSlot *slot = nullptr;
+    while (true) {
+        if (!build_queue_.TryPop(slot)) {
+            BREAK_IF(!build_queue_.WaitForItem(stop_builder_));
+            continue;
+        }
+
+        const auto start_time = std::chrono::steady_clock::now();
+        {
+            PROFILE_ZONE(kBuildPyramid);
+            slot->pyramid->SetRawImage(slot->raw_image.data(), slot->rows, slot->cols);
+            slot->pyramid->CreateImagePyramid(options_.kPyramidLevel);
+        }
+        slot->has_padded_pyramid = options_.kPaddedBorder > 0 && slot->padded_pyramid.CreatePaddedPyramid(*slot->pyramid, options_.kPaddedBorder);
+        slot->pyramid_time_ms = MillisecondsSince(start_time);
+
+        // Queue always has room, since number of slots limits frames in flight.
+        track_queue_.TryPush(slot);
+    }
+}
+
+void OpticalFlowAsyncTracker::TrackerLoop() {
+    FrameSlot *slot = nullptr;
+    while (true) {
+        if (!track_queue_.TryPop(slot)) {
+            BREAK_IF(!track_queue_.WaitForItem(stop_tracker_));
+            continue;
+        }
+        TrackFrame(slot);
+    }
+
+    // Release reference frame, so that all slots are free after exit.
+    if (ref_slot_ != nullptr) {
+        free_queue_.TryPush(ref_slot_);
+        ref_slot_ = nullptr;
+    }
+}
+
+void OpticalFlowAsyncTracker::TrackFrame(FrameSlot *slot) {
+    AsyncFrameResult result;
+    result.frame_id = slot->frame_id;
+    result.pyramid_time_ms = slot->pyramid_time_ms;
+
+    // Track features carried from reference frame.
+    const auto start_time = std::chrono::steady_clock::now();
+    if (optical_flow_ != nullptr && ref_slot_ != nullptr && !ref_pixel_uv_.empty() &&
+        ref_slot_->rows == slot->rows && ref_slot_->cols == slot->cols) {
+        result.ref_pixel_uv = ref_pixel_uv_;
+        result.status = ref_status_;
+        optical_flow_->ref_padded_pyramid() = ref_slot_->has_padded_pyramid ? &ref_slot_->padded_pyramid : nullptr;
+        optical_flow_->cur_padded_pyramid() = slot->has_padded_pyramid ? &slot->padded_pyramid : nullptr;
+        result.is_tracked = optical_flow_->TrackFeatures(*ref_slot_->pyramid, *slot->pyramid, result.ref_pixel_uv, result.cur_pixel_uv, result.status);
+    }
+    result.track_time_ms = MillisecondsSince(start_time);
+
+    // Carry features to next frame. Features lost in this frame keep their status, so they are skipped later.
+    if (slot->has_new_features) {
+        ref_pixel_uv_ = slot->new_pixel_uv;
+        ref_status_.clear();
+    } else if (result.is_tracked) {
+        ref_pixel_uv_ = result.cur_pixel_uv;
+        ref_status_ = result.status;
+    } else {
+        ref_pixel_uv_.clear();
+        ref_status_.clear();
+    }
+
+    // This frame becomes reference, and last reference is released. Cached reference patches belong to last one.
+    if (optical_flow_ != nullptr) {
+        optical_flow_->BumpRefFrameGeneration();
+    }
+    if (ref_slot_ != nullptr) {
+        free_queue_.TryPush(ref_slot_);
+    }
+    ref_slot_ = slot;
+
+    result.latency_ms = MillisecondsSince(slot->submit_time);
+    Callback callback = std::move(slot->callback);
+    slot->callback = nullptr;
+    if (callback != nullptr) {
+        callback(result);
+    }
+    num_finished_frames_.fetch_add(1, std::memory_order_release);
+}
+
+}
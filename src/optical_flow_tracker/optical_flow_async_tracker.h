@@ -0,0 +1,130 @@
+#ifndef _OPTICAL_FLOW_ASYNC_TRACKER_H_
+#define _OPTICAL_FLOW_ASYNC_TRACKER_H_
+
+#include "basic_type.h"
+#include "datatype_image.h"
+#include "datatype_image_pyramid.h"
+#include "optical_flow.h"
+#include "spsc_queue.h"
+
+#include <memory>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+namespace FEATURE_TRACKER {
+
+enum class AsyncBackpressure : uint8_t {
+    kBlock = 0,    // SubmitFrame waits until a frame leaves the pipeline.
+    kDrop = 1,     // SubmitFrame drops the new frame at once.
+};
+
+struct OpticalFlowAsyncTrackerOptions {
+    uint32_t kPyramidLevel = 4;
+    uint32_t kMaxFramesInFlight = 2;    // Frames submitted but not tracked yet.
+    AsyncBackpressure kBackpressure = AsyncBackpressure::kBlock;
+    int32_t kPaddedBorder = 0;    // Border of padded pyramid built with each frame. Zero means none. It only pays off with sse method.
+};
+
+/* Result of tracking one submitted frame. */
+struct AsyncFrameResult {
+    uint32_t frame_id = 0;
+    bool is_dropped = false;
+    bool is_tracked = false;    // False for first frame, dropped frame, or frame without features to track.
+    std::vector<Vec2> ref_pixel_uv;    // Features in last tracked frame.
+    std::vector<Vec2> cur_pixel_uv;    // Their positions in this frame.
+    std::vector<uint8_t> status;
+    float pyramid_time_ms = 0.0f;
+    float track_time_ms = 0.0f;
+    float latency_ms = 0.0f;    // From submitting to result.
+};
+
+/* Class Optical Flow Async Tracker Declaration. */
+// Pipelined front end for frame-to-frame tracking. Pyramid of frame N + 1 is built on builder thread, while features
+// of frame N are tracked on tracker thread, so that latency in steady state is max of them instead of their sum.
+// Stages are connected by lock-free single producer single consumer queues:
+//   caller --(build queue)--> builder --(track queue)--> tracker --(free queue)--> caller
+// Features tracked in each frame are carried to next frame, unless new features are submitted with the frame.
+// SubmitFrame() must always be called from the same thread. Optical flow is not owned, and it must not be used by
+// others while async tracker is alive. Its padded pyramids are replaced by the ones built with each frame.
+class OpticalFlowAsyncTracker {
+
+public:
+    using Callback = std::function<void(AsyncFrameResult &result)>;
+
+    explicit OpticalFlowAsyncTracker(OpticalFlow *optical_flow, const OpticalFlowAsyncTrackerOptions &options = OpticalFlowAsyncTrackerOptions());
+    virtual ~OpticalFlowAsyncTracker();
+    OpticalFlowAsyncTracker(const OpticalFlowAsyncTracker &tracker) = delete;
+    OpticalFlowAsyncTracker &operator=(const OpticalFlowAsyncTracker &tracker) = delete;
+
+    // Submit frame, and get result from future. Image is copied, so its buffer can be reused at once.
+    std::future<AsyncFrameResult> SubmitFrame(const GrayImage &image);
+    // Submit frame with new features detected in it. They replace carried features, and are tracked into next frame.
+    std::future<AsyncFrameResult> SubmitFrame(const GrayImage &image, const std::vector<Vec2> &new_pixel_uv);
+    // Submit frame, and get result in callback on tracker thread. Return false if frame is dropped, then callback is
+    // still called with dropped result.
+    bool SubmitFrame(const GrayImage &image, const std::vector<Vec2> *new_pixel_uv, const Callback &callback);
+
+    // Block until all submitted frames are tracked.
+    void Flush();
+
+    // Const reference for member variables.
+    const OpticalFlowAsyncTrackerOptions &options() const { return options_; }
+    uint32_t num_submitted_frames() const { return num_submitted_frames_; }
+    uint32_t num_dropped_frames() const { return num_dropped_frames_; }
+
+private:
+    // Frame travelling through pipeline. Its buffers are allocated once and reused.
+    struct FrameSlot {
+        std::vector<uint8_t> raw_image;
+        std::unique_ptr<ImagePyramid> pyramid;
+        PaddedPyramid padded_pyramid;
+        bool has_padded_pyramid = false;
+        int32_t rows = 0;
+        int32_t cols = 0;
+
+        uint32_t frame_id = 0;
+        bool has_new_features = false;
+        std::vector<Vec2> new_pixel_uv;
+        Callback callback;
+        std::chrono::steady_clock::time_point submit_time;
+        float pyramid_time_ms = 0.0f;
+    };
+
+    void BuilderLoop();
+    void TrackerLoop();
+    void TrackFrame(FrameSlot *slot);
+    FrameSlot *AcquireFreeSlot();
+
+private:
+    OpticalFlowAsyncTrackerOptions options_;
+    OpticalFlow *optical_flow_ = nullptr;
+
+    // All slots are owned here. Queues only pass pointers.
+    std::vector<std::unique_ptr<FrameSlot>> slots_;
+    SpscQueue<FrameSlot *> build_queue_;
+    SpscQueue<FrameSlot *> track_queue_;
+    SpscQueue<FrameSlot *> free_queue_;
+
+    // State of tracker thread. Reference frame is held until next frame is tracked.
+    FrameSlot *ref_slot_ = nullptr;
+    std::vector<Vec2> ref_pixel_uv_;
+    std::vector<uint8_t> ref_status_;
+
+    std::thread builder_;
+    std::thread tracker_;
+    std::atomic<bool> stop_builder_ { false };
+    std::atomic<bool> stop_tracker_ { false };
+    std::atomic<bool> never_stop_ { false };
+
+    uint32_t num_submitted_frames_ = 0;
+    uint32_t num_dropped_frames_ = 0;
+    std::atomic<uint32_t> num_finished_frames_ { 0 };
+
+};
+
+}
+
+#endif // end of _OPTICAL_FLOW_ASYNC_TRACKER_H_
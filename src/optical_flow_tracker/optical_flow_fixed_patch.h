@@ -0,0 +1,115 @@
+#ifndef _OPTICAL_FLOW_FIXED_PATCH_H_
+#define _OPTICAL_FLOW_FIXED_PATCH_H_
+
+#include "basic_type.h"
+#include "datatype_image.h"
+#include "padded_pyramid.h"
+#include "profiler.h"
+
+#include <array>
+#include <algorithm>
+#include <cmath>
+
+namespace FEATURE_TRACKER {
+
+/* Reference patch with compile-time size supporting for fast method. */
+// Pixel validity is kept as one bitmask per row, bit i for col i. So patch with half size up to 14 is supported.
+template <int32_t kHalfSize>
+struct FixedPatch {
+    static_assert(kHalfSize > 0 && (kHalfSize << 1) + 3 <= 32, "Half size of fixed patch is out of range.");
+
+    static constexpr int32_t kSize = (kHalfSize << 1) + 1;
+    static constexpr int32_t kExSize = kSize + 2;
+    static constexpr uint32_t kRowMask = (1u << kSize) - 1u;
+    static constexpr uint32_t kExRowMask = (1u << kExSize) - 1u;
+
+    // Extended patch with bound size 1.
+    alignas(32) std::array<float, kExSize * kExSize> ex_ref_patch;
+    std::array<uint32_t, kExSize> ex_ref_patch_valid_mask;
+
+    // Gradient of reference patch. Gradient of pixel whose neighbours are not all valid is zero.
+    alignas(32) std::array<float, kSize * kSize> all_dx_in_ref_patch;
+    alignas(32) std::array<float, kSize * kSize> all_dy_in_ref_patch;
+
+    // Extract extended patch from view of reference image, return number of valid pixels. Whole rows are sampled if
+    // they can be read from view, otherwise only valid pixels in each row.
+    uint32_t ExtractExtendPatchInReferenceImage(const PaddedImageView &image_view, const Vec2 &ref_pixel_uv);
+
+    // Compute gradient of each pixel in reference patch.
+    void PrecomputeJacobian();
+
+    // Validity of center pixels in row of reference patch.
+    uint32_t ref_patch_valid_mask(int32_t row) const { return (ex_ref_patch_valid_mask[row + 1] >> 1) & kRowMask; }
+};
+
+template <int32_t kHalfSize>
+uint32_t FixedPatch<kHalfSize>::ExtractExtendPatchInReferenceImage(const PaddedImageView &image_view, const Vec2 &ref_pixel_uv) {
+    PROFILE_ZONE(kExtractRefPatch);
+    // Compute the weight for linear interpolar.
+    const float int_pixel_row = std::floor(ref_pixel_uv.y());
+    const float int_pixel_col = std::floor(ref_pixel_uv.x());
+    const float dec_pixel_row = ref_pixel_uv.y() - int_pixel_row;
+    const float dec_pixel_col = ref_pixel_uv.x() - int_pixel_col;
+    const float w_top_left = (1.0f - dec_pixel_row) * (1.0f - dec_pixel_col);
+    const float w_top_right = (1.0f - dec_pixel_row) * dec_pixel_col;
+    const float w_bottom_left = dec_pixel_row * (1.0f - dec_pixel_col);
+    const float w_bottom_right = dec_pixel_row * dec_pixel_col;
+
+    // Extract patch from reference image.
+    const int32_t min_ref_pixel_row = static_cast<int32_t>(int_pixel_row) - kExSize / 2;
+    const int32_t min_ref_pixel_col = static_cast<int32_t>(int_pixel_col) - kExSize / 2;
+    const int32_t max_ref_pixel_row = min_ref_pixel_row + kExSize;
+    const int32_t max_ref_pixel_col = min_ref_pixel_col + kExSize;
+
+    const bool is_readable = image_view.IsInside(min_ref_pixel_row, min_ref_pixel_col, max_ref_pixel_row, max_ref_pixel_col);
+    if (min_ref_pixel_row < 0 || max_ref_pixel_row > image_view.rows() - 2 ||
+        min_ref_pixel_col < 0 || max_ref_pixel_col > image_view.cols() - 2) {
+        PROFILE_COUNT(kPaddedBorderFastPath, is_readable ? 1 : 0);
+        PROFILE_COUNT(kOutsideImageFallback, is_readable ? 0 : 1);
+    }
+
+    uint32_t valid_pixel_cnt = 0;
+    for (int32_t row = 0; row < kExSize; ++row) {
+        int32_t valid_begin = 0;
+        int32_t valid_end = 0;
+        image_view.GetValidRangeInRow(row + min_ref_pixel_row, min_ref_pixel_col, kExSize, valid_begin, valid_end);
+        const int32_t read_begin = is_readable ? 0 : valid_begin;
+        const int32_t read_end = is_readable ? kExSize : valid_end;
+        float *patch_row = ex_ref_patch.data() + row * kExSize;
+        if (read_begin < read_end) {
+            const uint8_t *top = image_view.GetPixelPtr(row + min_ref_pixel_row, min_ref_pixel_col);
+            const uint8_t *bottom = top + image_view.stride();
+            for (int32_t col = read_begin; col < read_end; ++col) {
+                patch_row[col] = w_top_left * static_cast<float>(top[col]) +
+                                 w_top_right * static_cast<float>(top[col + 1]) +
+                                 w_bottom_left * static_cast<float>(bottom[col]) +
+                                 w_bottom_right * static_cast<float>(bottom[col + 1]);
+            }
+        }
+        std::fill(patch_row, patch_row + valid_begin, 0.0f);
+        std::fill(patch_row + valid_end, patch_row + kExSize, 0.0f);
+        ex_ref_patch_valid_mask[row] = image_view.GetValidMaskInRow(row + min_ref_pixel_row, min_ref_pixel_col, kExSize);
+        valid_pixel_cnt += valid_end - valid_begin;
+    }
+    return valid_pixel_cnt;
+}
+
+template <int32_t kHalfSize>
+void FixedPatch<kHalfSize>::PrecomputeJacobian() {
+    for (int32_t row = 0; row < kSize; ++row) {
+        // Gradient is valid only if left, right, top and bottom neighbours are all valid.
+        const uint32_t grad_valid_mask = ex_ref_patch_valid_mask[row + 1] & (ex_ref_patch_valid_mask[row + 1] >> 2) &
+                                         (ex_ref_patch_valid_mask[row] >> 1) & (ex_ref_patch_valid_mask[row + 2] >> 1);
+        const float *center = ex_ref_patch.data() + (row + 1) * kExSize + 1;
+        for (int32_t col = 0; col < kSize; ++col) {
+            const bool valid = (grad_valid_mask >> col) & 1u;
+            const int32_t index = row * kSize + col;
+            all_dx_in_ref_patch[index] = valid ? center[col + 1] - center[col - 1] : 0.0f;
+            all_dy_in_ref_patch[index] = valid ? center[col + kExSize] - center[col - kExSize] : 0.0f;
+        }
+    }
+}
+
+}
+
+#endif // end of _OPTICAL_FLOW_FIXED_PATCH_H_
@@ -0,0 +1,67 @@
+#ifndef _OPTICAL_FLOW_FIXED_POINT_H_
+#define _OPTICAL_FLOW_FIXED_POINT_H_
+
+#include "basic_type.h"
+
+#include <array>
+#include <cmath>
+
+namespace FEATURE_TRACKER {
+
+/* Fixed-point format supporting for fixed-point method. */
+// Bilinear weights are Q14, so four of them sum to 1 << 14 exactly.
+// Interpolated pixel values are Q5 in int16, which keeps 5 bits of sub-pixel luminance.
+// Gradients are Q3 in int16. The largest product of gradient and gradient or residual is below 2^24, so one row of
+// patch with up to 64 pixels is accumulated in int32 without overflow. Rows are summed in int64.
+constexpr int32_t kFixedPointWeightBits = 14;
+constexpr int32_t kFixedPointPixelBits = 5;
+constexpr int32_t kFixedPointGradientBits = 3;
+constexpr int32_t kFixedPointMaxRowSize = 64;
+
+// Rounding of pixels to Q5 and gradients to Q3 moves tracked result slightly, and more in small patches. Compared with
+// fast method, features tracked by both differ by less than the tolerance of patch half size below in this quantile of
+// them, and status of at most this ratio of features differs. Tolerances are a small margin over p99 measured on the
+// procedural texture of equivalence check, which is 0.0044 px at half size 2, 0.0023 px at 3, 0.0015 px at 4, 0.0011 px
+// at 5 and below 0.0009 px at larger sizes. They are not a bound of every feature. On example images of optical flow the
+// p99 is ten to thirty times larger, and a few weakly textured features converge to another minimum pixels away.
+constexpr float kFixedPointPixelDifferenceQuantile = 0.99f;
+constexpr float kFixedPointMaxStatusDifferRatio = 0.01f;
+inline float GetFixedPointMaxPixelDifference(int32_t patch_half_size) {
+    if (patch_half_size <= 2) {
+        return 0.006f;
+    } else if (patch_half_size == 3) {
+        return 0.0035f;
+    } else if (patch_half_size == 4) {
+        return 0.0025f;
+    }
+    return 0.0015f;
+}
+
+// Hessian is Q6 and bias is Q8, these scales recover them into float.
+constexpr float kFixedPointHessianScale = 1.0f / static_cast<float>(1 << (kFixedPointGradientBits * 2));
+constexpr float kFixedPointBiasScale = 1.0f / static_cast<float>(1 << (kFixedPointGradientBits + kFixedPointPixelBits));
+
+// Compute Q14 bilinear weights { top_left, top_right, bottom_left, bottom_right } of sub-pixel position.
+inline std::array<int32_t, 4> ComputeFixedPointBilinearWeights(const Vec2 &pixel_uv) {
+    const float dec_pixel_row = pixel_uv.y() - std::floor(pixel_uv.y());
+    const float dec_pixel_col = pixel_uv.x() - std::floor(pixel_uv.x());
+    const float one = static_cast<float>(1 << kFixedPointWeightBits);
+    std::array<int32_t, 4> weights;
+    weights[0] = static_cast<int32_t>(std::round((1.0f - dec_pixel_row) * (1.0f - dec_pixel_col) * one));
+    weights[1] = static_cast<int32_t>(std::round((1.0f - dec_pixel_row) * dec_pixel_col * one));
+    weights[2] = static_cast<int32_t>(std::round(dec_pixel_row * (1.0f - dec_pixel_col) * one));
+    weights[3] = (1 << kFixedPointWeightBits) - weights[0] - weights[1] - weights[2];
+    return weights;
+}
+
+// Interpolate pixel value in Q5 with Q14 weights, and round it.
+inline int16_t InterpolateFixedPoint(const std::array<int32_t, 4> &weights,
+                                     int32_t top_left, int32_t top_right, int32_t bottom_left, int32_t bottom_right) {
+    constexpr int32_t kShift = kFixedPointWeightBits - kFixedPointPixelBits;
+    return static_cast<int16_t>((weights[0] * top_left + weights[1] * top_right + weights[2] * bottom_left +
+        weights[3] * bottom_right + (1 << (kShift - 1))) >> kShift);
+}
+
+}
+
+#endif // end of _OPTICAL_FLOW_FIXED_POINT_H_
@@ -0,0 +1,109 @@
+#include "optical_flow_sequence_tracker.h"
+#include "slam_memory.h"
+#include "slam_operations.h"
+
+#include <cstring>
+
+namespace FEATURE_TRACKER {
+
+bool OpticalFlowSequenceTracker::PushFrame(const GrayImage &image) {
+    RETURN_FALSE_IF(image.data() == nullptr || image.rows() <= 0 || image.cols() <= 0);
+
+    // Current frame becomes reference, unless reference is kept. New frame takes the other slot.
+    const int32_t new_ref_slot_idx = keep_reference_ && ref_slot_idx_ >= 0 ? ref_slot_idx_ : cur_slot_idx_;
+    const int32_t new_cur_slot_idx = new_ref_slot_idx < 0 ? 0 : (new_ref_slot_idx + 1) % kNumSlots;
+
+    // Cached reference patches belong to reference frame, which is going to be replaced.
+    if (new_ref_slot_idx != ref_slot_idx_ && optical_flow_ != nullptr) {
+        optical_flow_->BumpRefFrameGeneration();
+    }
+
+    std::unique_ptr<PyramidSlot> &slot = slots_[new_cur_slot_idx];
+    if (slot == nullptr || slot->rows != image.rows() || slot->cols != image.cols()) {
+        slot = std::make_unique<PyramidSlot>();
+        PrepareSlot(*slot, image.rows(), image.cols());
+    }
+
+    if (options_.kCopyRawImage) {
+        slot->raw_image.resize(image.rows() * image.cols());
+        std::memcpy(slot->raw_image.data(), image.data(), sizeof(uint8_t) * image.rows() * image.cols());
+        slot->pyramid.SetRawImage(slot->raw_image.data(), image.rows(), image.cols());
+    } else {
+        slot->pyramid.SetRawImage(image.data(), image.rows(), image.cols());
+    }
+    slot->pyramid.CreateImagePyramid(options_.kPyramidLevel);
+    slot->has_padded_pyramid = options_.kPaddedBorder > 0 && slot->padded_pyramid.CreatePaddedPyramid(slot->pyramid, options_.kPaddedBorder);
+    slot->frame_id = num_pushed_frames_;
+
+    ref_slot_idx_ = new_ref_slot_idx;
+    cur_slot_idx_ = new_cur_slot_idx;
+    ++num_pushed_frames_;
+    return true;
+}
+
+bool OpticalFlowSequenceTracker::TrackFeatures(const std::vector<Vec2> &ref_pixel_uv,
+                                               std::vector<Vec2> &cur_pixel_uv,
+                                               std::vector<uint8_t> &status) {
+    RETURN_FALSE_IF(optical_flow_ == nullptr);
+    const ImagePyramid *ref = ref_pyramid();
+    const ImagePyramid *cur = cur_pyramid();
+    RETURN_FALSE_IF(ref == nullptr || cur == nullptr);
+    RETURN_FALSE_IF(slots_[ref_slot_idx_]->rows != slots_[cur_slot_idx_]->rows || slots_[ref_slot_idx_]->cols != slots_[cur_slot_idx_]->cols);
+
+    AttachSlotPyramids();
+    return optical_flow_->TrackFeatures(*ref, *cur, ref_pixel_uv, cur_pixel_uv, status);
+}
+
+bool OpticalFlowSequenceTracker::TrackFeatures(FeatureStore &features) {
+    RETURN_FALSE_IF(optical_flow_ == nullptr);
+    const ImagePyramid *ref = ref_pyramid();
+    const ImagePyramid *cur = cur_pyramid();
+    RETURN_FALSE_IF(ref == nullptr || cur == nullptr);
+    RETURN_FALSE_IF(slots_[ref_slot_idx_]->rows != slots_[cur_slot_idx_]->rows || slots_[ref_slot_idx_]->cols != slots_[cur_slot_idx_]->cols);
+
+    AttachSlotPyramids();
+    return optical_flow_->TrackFeatures(*ref, *cur, features);
+}
+
+bool OpticalFlowSequenceTracker::PushFrameAndTrackFeatures(const GrayImage &image,
+                                                           const std::vector<Vec2> &ref_pixel_uv,
+                                                           std::vector<Vec2> &cur_pixel_uv,
+                                                           std::vector<uint8_t> &status) {
+    RETURN_FALSE_IF_FALSE(PushFrame(image));
+    return TrackFeatures(ref_pixel_uv, cur_pixel_uv, status);
+}
+
+void OpticalFlowSequenceTracker::Reset() {
+    if (optical_flow_ != nullptr) {
+        optical_flow_->BumpRefFrameGeneration();
+    }
+    ref_slot_idx_ = -1;
+    cur_slot_idx_ = -1;
+    num_pushed_frames_ = 0;
+}
+
+const ImagePyramid *OpticalFlowSequenceTracker::ref_pyramid() const {
+    return ref_slot_idx_ < 0 ? nullptr : &slots_[ref_slot_idx_]->pyramid;
+}
+
+const ImagePyramid *OpticalFlowSequenceTracker::cur_pyramid() const {
+    return cur_slot_idx_ < 0 ? nullptr : &slots_[cur_slot_idx_]->pyramid;
+}
+
+void OpticalFlowSequenceTracker::PrepareSlot(PyramidSlot &slot, int32_t rows, int32_t cols) {
+    // Buffer of raw image size is enough for all levels above raw image.
+    slot.rows = rows;
+    slot.cols = cols;
+    slot.pyramid.SetPyramidBuff((uint8_t *)SlamMemory::Malloc(sizeof(uint8_t) * rows * cols), true);
+    ++num_allocations_;
+}
+
+void OpticalFlowSequenceTracker::AttachSlotPyramids() {
+    // Padded pyramids given by user may be copied from a slot before it was reused, so they are always replaced.
+    const PyramidSlot &ref_slot = *slots_[ref_slot_idx_];
+    const PyramidSlot &cur_slot = *slots_[cur_slot_idx_];
+    optical_flow_->ref_padded_pyramid() = ref_slot.has_padded_pyramid ? &ref_slot.padded_pyramid : nullptr;
+    optical_flow_->cur_padded_pyramid() = cur_slot.has_padded_pyramid ? &cur_slot.padded_pyramid : nullptr;
+}
+
+}
@@ -0,0 +1,106 @@
+#ifndef _OPTICAL_FLOW_SEQUENCE_TRACKER_H_
+#define _OPTICAL_FLOW_SEQUENCE_TRACKER_H_
+
+#include "basic_type.h"
+#include "datatype_image.h"
+#include "datatype_image_pyramid.h"
+#include "optical_flow.h"
+
+#include <array>
+#include <memory>
+
+namespace FEATURE_TRACKER {
+
+struct OpticalFlowSequenceTrackerOptions {
+    uint32_t kPyramidLevel = 4;
+    // Copy each pushed image into the ring. If disabled, image buffer given by caller must stay unchanged until
+    // this frame leaves the ring, which is two pushes later, or later if it is kept as reference.
+    bool kCopyRawImage = true;
+    // Border of padded pyramid built with each frame for klt kernels. Zero means no padded pyramid. It is copied for
+    // each frame, and only pays off with sse method. See PaddedPyramid for kernels which read it.
+    int32_t kPaddedBorder = 0;
+};
+
+/* Image pyramid of one frame in ring, with buffers allocated once. */
+struct PyramidSlot {
+    std::vector<uint8_t> raw_image;
+    ImagePyramid pyramid;
+    PaddedPyramid padded_pyramid;
+    bool has_padded_pyramid = false;
+    int32_t rows = 0;
+    int32_t cols = 0;
+    uint32_t frame_id = 0;
+};
+
+/* Class Optical Flow Sequence Tracker Declaration. */
+// Front end for frame-to-frame tracking. It owns a ring of preallocated pyramids, so that pyramid of current frame
+// becomes reference of next frame without being rebuilt. Only one pyramid is created for each pushed frame.
+// Padded pyramids of each slot are rebuilt together with its pyramid, and they replace padded pyramids of optical flow
+// before each tracking call, since buffers of slots are reused for new frames.
+class OpticalFlowSequenceTracker {
+
+public:
+    static constexpr uint32_t kNumSlots = 2;
+
+    // Optical flow is not owned by sequence tracker.
+    explicit OpticalFlowSequenceTracker(OpticalFlow *optical_flow) : optical_flow_(optical_flow) {}
+    virtual ~OpticalFlowSequenceTracker() = default;
+    OpticalFlowSequenceTracker(const OpticalFlowSequenceTracker &tracker) = delete;
+    OpticalFlowSequenceTracker &operator=(const OpticalFlowSequenceTracker &tracker) = delete;
+
+    // Build pyramid of new frame into the free slot of ring. Current frame becomes reference, unless reference is kept.
+    bool PushFrame(const GrayImage &image);
+
+    // Track features from reference frame to current frame. Return false if less than two frames are pushed.
+    bool TrackFeatures(const std::vector<Vec2> &ref_pixel_uv,
+                       std::vector<Vec2> &cur_pixel_uv,
+                       std::vector<uint8_t> &status);
+    bool TrackFeatures(FeatureStore &features);
+
+    // Push new frame, then track features from last frame into it.
+    bool PushFrameAndTrackFeatures(const GrayImage &image,
+                                   const std::vector<Vec2> &ref_pixel_uv,
+                                   std::vector<Vec2> &cur_pixel_uv,
+                                   std::vector<uint8_t> &status);
+
+    // Keep reference frame for following frames, such as a keyframe. Cached reference patches stay valid meanwhile.
+    void KeepReference(bool keep_reference) { keep_reference_ = keep_reference; }
+    // Drop all frames in ring. Buffers are kept.
+    void Reset();
+
+    // Pyramids of reference and current frame. Return nullptr if it is not pushed yet.
+    const ImagePyramid *ref_pyramid() const;
+    const ImagePyramid *cur_pyramid() const;
+    // Number of frames pushed since last reset.
+    uint32_t num_pushed_frames() const { return num_pushed_frames_; }
+    // Number of times pyramid buffers are allocated, which only happens on first frame or when image size changes.
+    uint32_t num_allocations() const { return num_allocations_; }
+
+    // Reference for member variables.
+    OpticalFlowSequenceTrackerOptions &options() { return options_; }
+    OpticalFlow *optical_flow() { return optical_flow_; }
+
+    // Const reference for member variables.
+    const OpticalFlowSequenceTrackerOptions &options() const { return options_; }
+    const OpticalFlow *optical_flow() const { return optical_flow_; }
+
+private:
+    void PrepareSlot(PyramidSlot &slot, int32_t rows, int32_t cols);
+    void AttachSlotPyramids();
+
+private:
+    OpticalFlowSequenceTrackerOptions options_;
+    OpticalFlow *optical_flow_ = nullptr;
+
+    std::array<std::unique_ptr<PyramidSlot>, kNumSlots> slots_;
+    int32_t ref_slot_idx_ = -1;
+    int32_t cur_slot_idx_ = -1;
+    bool keep_reference_ = false;
+    uint32_t num_pushed_frames_ = 0;
+    uint32_t num_allocations_ = 0;
+
+};
+
+}
+
+#endif // end of _OPTICAL_FLOW_SEQUENCE_TRACKER_H_
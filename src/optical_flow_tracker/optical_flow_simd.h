@@ -0,0 +1,238 @@
+#ifndef _OPTICAL_FLOW_SIMD_H_
+#define _OPTICAL_FLOW_SIMD_H_
+
+#include "basic_type.h"
+#include "optical_flow.h"
+
+#include <array>
+#include <algorithm>
+#include <cmath>
+
+// Kernels of sse method are compiled once for each instruction set, and cmake defines OPTICAL_FLOW_SIMD_LEVEL as the
+// value of SimdLevel for each of them. Only Float8 of that instruction set is defined in one file.
+#ifndef OPTICAL_FLOW_SIMD_LEVEL
+#define OPTICAL_FLOW_SIMD_LEVEL (0)
+#endif
+
+#if OPTICAL_FLOW_SIMD_LEVEL == 2
+#include <immintrin.h>
+#elif OPTICAL_FLOW_SIMD_LEVEL == 1
+#include <smmintrin.h>
+#endif
+
+// Instructions of simd level are enabled only for code between OPTICAL_FLOW_SIMD_BEGIN and OPTICAL_FLOW_SIMD_END, not
+// by compiler flags of the whole file. Inline functions of other headers, such as Eigen, are then compiled for any cpu,
+// so the linker can not pick a copy of them from these files which uses instructions unsupported by cpu.
+#if OPTICAL_FLOW_SIMD_LEVEL == 2 && defined(__clang__)
+#define OPTICAL_FLOW_SIMD_BEGIN _Pragma("clang attribute push (__attribute__((target(\"avx2,fma\"))), apply_to = function)")
+#define OPTICAL_FLOW_SIMD_END _Pragma("clang attribute pop")
+#elif OPTICAL_FLOW_SIMD_LEVEL == 2
+#define OPTICAL_FLOW_SIMD_BEGIN _Pragma("GCC push_options") _Pragma("GCC target(\"avx2,fma\")")
+#define OPTICAL_FLOW_SIMD_END _Pragma("GCC pop_options")
+#elif OPTICAL_FLOW_SIMD_LEVEL == 1 && defined(__clang__)
+#define OPTICAL_FLOW_SIMD_BEGIN _Pragma("clang attribute push (__attribute__((target(\"sse4.1\"))), apply_to = function)")
+#define OPTICAL_FLOW_SIMD_END _Pragma("clang attribute pop")
+#elif OPTICAL_FLOW_SIMD_LEVEL == 1
+#define OPTICAL_FLOW_SIMD_BEGIN _Pragma("GCC push_options") _Pragma("GCC target(\"sse4.1\")")
+#define OPTICAL_FLOW_SIMD_END _Pragma("GCC pop_options")
+#else
+#define OPTICAL_FLOW_SIMD_BEGIN
+#define OPTICAL_FLOW_SIMD_END
+#endif
+
+namespace FEATURE_TRACKER {
+
+// Instruction set which this file is compiled with.
+constexpr SimdLevel kCompiledSimdLevel = static_cast<SimdLevel>(OPTICAL_FLOW_SIMD_LEVEL);
+
+/* Layout of 8 floats shared by all instruction sets. */
+struct Float8Layout {
+    static constexpr int32_t kSize = 8;
+
+    // Round up size to be multiple of Float8.
+    static constexpr int32_t AlignedSize(int32_t size) { return (size + kSize - 1) / kSize * kSize; }
+};
+
+OPTICAL_FLOW_SIMD_BEGIN
+
+// Bilinear interpolate 8 uint8 pixels at (x, y) lane by lane, for instruction sets without gather.
+template <typename Float8>
+Float8 SampleBilinearByLane(const uint8_t *data, int32_t cols, const Float8 &x, const Float8 &y) {
+    std::array<float, 8> lanes_x;
+    std::array<float, 8> lanes_y;
+    std::array<float, 8> values;
+    x.Store(lanes_x.data());
+    y.Store(lanes_y.data());
+    for (int32_t i = 0; i < 8; ++i) {
+        const float int_x = std::floor(lanes_x[i]);
+        const float int_y = std::floor(lanes_y[i]);
+        const float dec_x = lanes_x[i] - int_x;
+        const float dec_y = lanes_y[i] - int_y;
+        const uint8_t *top = data + static_cast<int32_t>(int_y) * cols + static_cast<int32_t>(int_x);
+        const uint8_t *bottom = top + cols;
+        const float top_value = static_cast<float>(top[0]) + dec_x * static_cast<float>(top[1] - top[0]);
+        const float bottom_value = static_cast<float>(bottom[0]) + dec_x * static_cast<float>(bottom[1] - bottom[0]);
+        values[i] = top_value + dec_y * (bottom_value - top_value);
+    }
+    return Float8::Load(values.data());
+}
+
+template <SimdLevel kSimdLevel> struct SimdFloat8;
+
+#if OPTICAL_FLOW_SIMD_LEVEL == 2
+
+/* Pack of 8 floats supporting for sse method, in one 256-bit register. */
+template <>
+struct SimdFloat8<SimdLevel::kAvx2> {
+    static constexpr int32_t kSize = Float8Layout::kSize;
+
+    __m256 v;
+
+    static SimdFloat8 Zero() { return SimdFloat8{_mm256_setzero_ps()}; }
+    static SimdFloat8 Set(float value) { return SimdFloat8{_mm256_set1_ps(value)}; }
+    static SimdFloat8 Load(const float *ptr) { return SimdFloat8{_mm256_loadu_ps(ptr)}; }
+    void Store(float *ptr) const { _mm256_storeu_ps(ptr, v); }
+
+    // Load 8 continuous uint8 pixels and convert them into float.
+    static SimdFloat8 LoadUint8(const uint8_t *ptr) {
+        const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(ptr));
+        return SimdFloat8{_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes))};
+    }
+
+    // Return { start, start + 1, ..., start + 7 }.
+    static SimdFloat8 Sequence(float start) { return SimdFloat8{_mm256_add_ps(_mm256_set1_ps(start), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7))}; }
+
+    // Bilinear interpolate 8 uint8 pixels at (x, y). Caller should make sure that pixels at [row, row + 1] x [col, col + 3] are inside.
+    static SimdFloat8 SampleBilinear(const uint8_t *data, int32_t cols, const SimdFloat8 &x, const SimdFloat8 &y) {
+        const __m256 int_x = _mm256_floor_ps(x.v);
+        const __m256 int_y = _mm256_floor_ps(y.v);
+        const __m256 dec_x = _mm256_sub_ps(x.v, int_x);
+        const __m256 dec_y = _mm256_sub_ps(y.v, int_y);
+        const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(int_y), _mm256_set1_epi32(cols)), _mm256_cvttps_epi32(int_x));
+
+        // Each gather loads 4 bytes, the lowest two are the left and right pixels.
+        const __m256i byte_mask = _mm256_set1_epi32(0xff);
+        const __m256i top = _mm256_i32gather_epi32(reinterpret_cast<const int *>(data), index, 1);
+        const __m256i bottom = _mm256_i32gather_epi32(reinterpret_cast<const int *>(data + cols), index, 1);
+        const __m256 top_left = _mm256_cvtepi32_ps(_mm256_and_si256(top, byte_mask));
+        const __m256 top_right = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(top, 8), byte_mask));
+        const __m256 bottom_left = _mm256_cvtepi32_ps(_mm256_and_si256(bottom, byte_mask));
+        const __m256 bottom_right = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(bottom, 8), byte_mask));
+
+        const SimdFloat8 top_value = MulAdd(SimdFloat8{dec_x}, SimdFloat8{_mm256_sub_ps(top_right, top_left)}, SimdFloat8{top_left});
+        const SimdFloat8 bottom_value = MulAdd(SimdFloat8{dec_x}, SimdFloat8{_mm256_sub_ps(bottom_right, bottom_left)}, SimdFloat8{bottom_left});
+        return MulAdd(SimdFloat8{dec_y}, bottom_value - top_value, top_value);
+    }
+
+    SimdFloat8 operator+(const SimdFloat8 &b) const { return SimdFloat8{_mm256_add_ps(v, b.v)}; }
+    SimdFloat8 operator-(const SimdFloat8 &b) const { return SimdFloat8{_mm256_sub_ps(v, b.v)}; }
+    SimdFloat8 operator*(const SimdFloat8 &b) const { return SimdFloat8{_mm256_mul_ps(v, b.v)}; }
+
+    // Return a * b + c.
+    static SimdFloat8 MulAdd(const SimdFloat8 &a, const SimdFloat8 &b, const SimdFloat8 &c) { return SimdFloat8{_mm256_fmadd_ps(a.v, b.v, c.v)}; }
+
+    float Sum() const {
+        const __m128 sum_4 = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        const __m128 sum_2 = _mm_add_ps(sum_4, _mm_movehl_ps(sum_4, sum_4));
+        const __m128 sum_1 = _mm_add_ss(sum_2, _mm_shuffle_ps(sum_2, sum_2, 0x55));
+        return _mm_cvtss_f32(sum_1);
+    }
+
+};
+
+#elif OPTICAL_FLOW_SIMD_LEVEL == 1
+
+/* Pack of 8 floats supporting for sse method, in two 128-bit registers. */
+template <>
+struct SimdFloat8<SimdLevel::kSse4> {
+    static constexpr int32_t kSize = Float8Layout::kSize;
+
+    __m128 lo;
+    __m128 hi;
+
+    static SimdFloat8 Zero() { return SimdFloat8{_mm_setzero_ps(), _mm_setzero_ps()}; }
+    static SimdFloat8 Set(float value) { return SimdFloat8{_mm_set1_ps(value), _mm_set1_ps(value)}; }
+    static SimdFloat8 Load(const float *ptr) { return SimdFloat8{_mm_loadu_ps(ptr), _mm_loadu_ps(ptr + 4)}; }
+    void Store(float *ptr) const { _mm_storeu_ps(ptr, lo); _mm_storeu_ps(ptr + 4, hi); }
+
+    // Load 8 continuous uint8 pixels and convert them into float.
+    static SimdFloat8 LoadUint8(const uint8_t *ptr) {
+        const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(ptr));
+        return SimdFloat8{_mm_cvtepi32_ps(_mm_cvtepu8_epi32(bytes)), _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4)))};
+    }
+
+    // Return { start, start + 1, ..., start + 7 }.
+    static SimdFloat8 Sequence(float start) { return SimdFloat8{_mm_add_ps(_mm_set1_ps(start), _mm_setr_ps(0, 1, 2, 3)), _mm_add_ps(_mm_set1_ps(start), _mm_setr_ps(4, 5, 6, 7))}; }
+
+    SimdFloat8 operator+(const SimdFloat8 &b) const { return SimdFloat8{_mm_add_ps(lo, b.lo), _mm_add_ps(hi, b.hi)}; }
+    SimdFloat8 operator-(const SimdFloat8 &b) const { return SimdFloat8{_mm_sub_ps(lo, b.lo), _mm_sub_ps(hi, b.hi)}; }
+    SimdFloat8 operator*(const SimdFloat8 &b) const { return SimdFloat8{_mm_mul_ps(lo, b.lo), _mm_mul_ps(hi, b.hi)}; }
+
+    // Return a * b + c.
+    static SimdFloat8 MulAdd(const SimdFloat8 &a, const SimdFloat8 &b, const SimdFloat8 &c) { return a * b + c; }
+
+    float Sum() const {
+        const __m128 sum_4 = _mm_add_ps(lo, hi);
+        const __m128 sum_2 = _mm_add_ps(sum_4, _mm_movehl_ps(sum_4, sum_4));
+        const __m128 sum_1 = _mm_add_ss(sum_2, _mm_shuffle_ps(sum_2, sum_2, 0x55));
+        return _mm_cvtss_f32(sum_1);
+    }
+
+    // Bilinear interpolate 8 uint8 pixels at (x, y). Caller should make sure that pixels at [row, row + 1] x [col, col + 3] are inside.
+    static SimdFloat8 SampleBilinear(const uint8_t *data, int32_t cols, const SimdFloat8 &x, const SimdFloat8 &y) { return SampleBilinearByLane(data, cols, x, y); }
+
+};
+
+#else
+
+/* Pack of 8 floats supporting for sse method, in scalar code. It keeps sse method usable on every platform. */
+template <>
+struct SimdFloat8<SimdLevel::kScalar> {
+    static constexpr int32_t kSize = Float8Layout::kSize;
+
+    std::array<float, 8> v;
+
+    static SimdFloat8 Zero() { return Set(0.0f); }
+    static SimdFloat8 Set(float value) { SimdFloat8 res; res.v.fill(value); return res; }
+    static SimdFloat8 Load(const float *ptr) { SimdFloat8 res; std::copy(ptr, ptr + 8, res.v.begin()); return res; }
+    void Store(float *ptr) const { std::copy(v.begin(), v.end(), ptr); }
+
+    // Load 8 continuous uint8 pixels and convert them into float.
+    static SimdFloat8 LoadUint8(const uint8_t *ptr) {
+        SimdFloat8 res;
+        for (int32_t i = 0; i < 8; ++i) {
+            res.v[i] = static_cast<float>(ptr[i]);
+        }
+        return res;
+    }
+
+    // Return { start, start + 1, ..., start + 7 }.
+    static SimdFloat8 Sequence(float start) { SimdFloat8 res; for (int32_t i = 0; i < 8; ++i) { res.v[i] = start + static_cast<float>(i); } return res; }
+
+    SimdFloat8 operator+(const SimdFloat8 &b) const { SimdFloat8 res; for (int32_t i = 0; i < 8; ++i) { res.v[i] = v[i] + b.v[i]; } return res; }
+    SimdFloat8 operator-(const SimdFloat8 &b) const { SimdFloat8 res; for (int32_t i = 0; i < 8; ++i) { res.v[i] = v[i] - b.v[i]; } return res; }
+    SimdFloat8 operator*(const SimdFloat8 &b) const { SimdFloat8 res; for (int32_t i = 0; i < 8; ++i) { res.v[i] = v[i] * b.v[i]; } return res; }
+
+    // Return a * b + c.
+    static SimdFloat8 MulAdd(const SimdFloat8 &a, const SimdFloat8 &b, const SimdFloat8 &c) { return a * b + c; }
+
+    float Sum() const {
+        float sum = 0.0f;
+        for (const float &value : v) {
+            sum += value;
+        }
+        return sum;
+    }
+
+    // Bilinear interpolate 8 uint8 pixels at (x, y). Caller should make sure that pixels at [row, row + 1] x [col, col + 3] are inside.
+    static SimdFloat8 SampleBilinear(const uint8_t *data, int32_t cols, const SimdFloat8 &x, const SimdFloat8 &y) { return SampleBilinearByLane(data, cols, x, y); }
+
+};
+
+#endif
+
+OPTICAL_FLOW_SIMD_END
+
+}
+
+#endif // end of _OPTICAL_FLOW_SIMD_H_
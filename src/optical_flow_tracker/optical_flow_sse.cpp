@@ -0,0 +1,98 @@
+#include "optical_flow.h"
+#include "slam_operations.h"
+#include "optical_flow_simd.h"
+
+namespace FEATURE_TRACKER {
+
+OPTICAL_FLOW_SIMD_BEGIN
+
+template <SimdLevel kSimdLevel>
+uint32_t OpticalFlow::ExtractExtendPatchInReferenceImageSse(const GrayImage &ref_image,
+                                                            const Vec2 &ref_pixel_uv,
+                                                            int32_t ex_ref_patch_rows,
+                                                            int32_t ex_ref_patch_cols,
+                                                            int32_t ex_ref_patch_stride,
+                                                            float *ex_ref_patch,
+                                                            float *ex_ref_patch_pixel_valid) const {
+    using Float8 = SimdFloat8<kSimdLevel>;
+    PROFILE_ZONE(kExtractRefPatch);
+    // Compute the weight for linear interpolar.
+    const float int_pixel_row = std::floor(ref_pixel_uv.y());
+    const float int_pixel_col = std::floor(ref_pixel_uv.x());
+    const float dec_pixel_row = ref_pixel_uv.y() - int_pixel_row;
+    const float dec_pixel_col = ref_pixel_uv.x() - int_pixel_col;
+    const float w_top_left = (1.0f - dec_pixel_row) * (1.0f - dec_pixel_col);
+    const float w_top_right = (1.0f - dec_pixel_row) * dec_pixel_col;
+    const float w_bottom_left = dec_pixel_row * (1.0f - dec_pixel_col);
+    const float w_bottom_right = dec_pixel_row * dec_pixel_col;
+
+    // Extract patch from reference image.
+    const int32_t min_ref_pixel_row = static_cast<int32_t>(int_pixel_row) - ex_ref_patch_rows / 2;
+    const int32_t min_ref_pixel_col = static_cast<int32_t>(int_pixel_col) - ex_ref_patch_cols / 2;
+    const int32_t max_ref_pixel_row = min_ref_pixel_row + ex_ref_patch_rows;
+    const int32_t max_ref_pixel_col = min_ref_pixel_col + ex_ref_patch_cols;
+
+    // Vector lanes read the whole padded row and one more column on its right side. If they can not be read, only
+    // valid pixels in each row are sampled.
+    const PaddedImageView image_view = GetImageView(ref_image);
+    const bool is_readable = image_view.IsInside(min_ref_pixel_row, min_ref_pixel_col, max_ref_pixel_row, min_ref_pixel_col + ex_ref_patch_stride);
+    if (min_ref_pixel_row < 0 || max_ref_pixel_row > ref_image.rows() - 2 ||
+        min_ref_pixel_col < 0 || max_ref_pixel_col > ref_image.cols() - 2) {
+        PROFILE_COUNT(kPaddedBorderFastPath, is_readable ? 1 : 0);
+        PROFILE_COUNT(kOutsideImageFallback, is_readable ? 0 : 1);
+    }
+
+    const Float8 w_tl = Float8::Set(w_top_left);
+    const Float8 w_tr = Float8::Set(w_top_right);
+    const Float8 w_bl = Float8::Set(w_bottom_left);
+    const Float8 w_br = Float8::Set(w_bottom_right);
+    uint32_t valid_pixel_cnt = 0;
+    for (int32_t row = 0; row < ex_ref_patch_rows; ++row) {
+        int32_t valid_begin = 0;
+        int32_t valid_end = 0;
+        image_view.GetValidRangeInRow(row + min_ref_pixel_row, min_ref_pixel_col, ex_ref_patch_cols, valid_begin, valid_end);
+        float *patch_row = ex_ref_patch + row * ex_ref_patch_stride;
+        float *valid_row = ex_ref_patch_pixel_valid + row * ex_ref_patch_stride;
+
+        if (is_readable) {
+            const uint8_t *top = image_view.GetPixelPtr(row + min_ref_pixel_row, min_ref_pixel_col);
+            const uint8_t *bottom = top + image_view.stride();
+            for (int32_t col = 0; col < ex_ref_patch_stride; col += Float8::kSize) {
+                const Float8 value = Float8::MulAdd(w_tl, Float8::LoadUint8(top + col),
+                                     Float8::MulAdd(w_tr, Float8::LoadUint8(top + col + 1),
+                                     Float8::MulAdd(w_bl, Float8::LoadUint8(bottom + col),
+                                     w_br * Float8::LoadUint8(bottom + col + 1))));
+                value.Store(patch_row + col);
+            }
+        } else if (valid_begin < valid_end) {
+            const uint8_t *top = image_view.GetPixelPtr(row + min_ref_pixel_row, min_ref_pixel_col);
+            const uint8_t *bottom = top + image_view.stride();
+            for (int32_t col = valid_begin; col < valid_end; ++col) {
+                patch_row[col] = w_top_left * static_cast<float>(top[col]) + w_top_right * static_cast<float>(top[col + 1]) +
+                                 w_bottom_left * static_cast<float>(bottom[col]) + w_bottom_right * static_cast<float>(bottom[col + 1]);
+            }
+        }
+
+        // Invalid pixels and padded lanes are not part of this patch.
+        std::fill(patch_row, patch_row + valid_begin, 0.0f);
+        std::fill(patch_row + valid_end, patch_row + ex_ref_patch_stride, 0.0f);
+        std::fill(valid_row, valid_row + ex_ref_patch_stride, 0.0f);
+        std::fill(valid_row + valid_begin, valid_row + valid_end, 1.0f);
+        valid_pixel_cnt += valid_end - valid_begin;
+    }
+
+    return valid_pixel_cnt;
+}
+
+// Kernels for the simd level which this file is compiled with.
+template uint32_t OpticalFlow::ExtractExtendPatchInReferenceImageSse<kCompiledSimdLevel>(const GrayImage &ref_image,
+                                                                                        const Vec2 &ref_pixel_uv,
+                                                                                        int32_t ex_ref_patch_rows,
+                                                                                        int32_t ex_ref_patch_cols,
+                                                                                        int32_t ex_ref_patch_stride,
+                                                                                        float *ex_ref_patch,
+                                                                                        float *ex_ref_patch_pixel_valid) const;
+
+OPTICAL_FLOW_SIMD_END
+
+}
@@ -0,0 +1,88 @@
+#include "padded_pyramid.h"
+#include "slam_operations.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace FEATURE_TRACKER {
+
+void PaddedImage::CreatePaddedImage(const GrayImage &image,
+                                    int32_t border,
+                                    PaddedBorderType border_type,
+                                    uint8_t border_value,
+                                    ThreadPool *thread_pool) {
+    source_data_ = image.data();
+    rows_ = image.rows();
+    cols_ = image.cols();
+    border_ = std::max(border, 0);
+    stride_ = cols_ + 2 * border_;
+    border_type_ = border_type;
+    border_value_ = border_value;
+    padded_data_.resize(stride_ * (rows_ + 2 * border_));
+
+    const int32_t padded_rows = rows_ + 2 * border_;
+    if (thread_pool == nullptr) {
+        for (int32_t padded_row = 0; padded_row < padded_rows; ++padded_row) {
+            CopyRow(source_data_, padded_row);
+        }
+    } else {
+        thread_pool->ParallelFor(padded_rows, [&] (uint32_t padded_row, uint32_t worker_id) {
+            CopyRow(source_data_, padded_row);
+        });
+    }
+}
+
+void PaddedImage::CopyRow(const uint8_t *image_data, int32_t padded_row) {
+    uint8_t *padded_row_data = padded_data_.data() + padded_row * stride_;
+    const int32_t row = padded_row - border_;
+
+    // Rows in top and bottom border.
+    if (row < 0 || row >= rows_) {
+        if (border_type_ == PaddedBorderType::kConstant || rows_ == 0) {
+            std::fill_n(padded_row_data, stride_, border_value_);
+            return;
+        }
+        image_data += (row < 0 ? 0 : rows_ - 1) * cols_;
+    } else {
+        image_data += row * cols_;
+    }
+
+    // Left border, source row and right border.
+    const uint8_t left_value = border_type_ == PaddedBorderType::kConstant || cols_ == 0 ? border_value_ : image_data[0];
+    const uint8_t right_value = border_type_ == PaddedBorderType::kConstant || cols_ == 0 ? border_value_ : image_data[cols_ - 1];
+    std::fill_n(padded_row_data, border_, left_value);
+    std::memcpy(padded_row_data + border_, image_data, cols_);
+    std::fill_n(padded_row_data + border_ + cols_, border_, right_value);
+}
+
+bool PaddedPyramid::CreatePaddedPyramid(const ImagePyramid &image_pyramid,
+                                        int32_t border,
+                                        PaddedBorderType border_type,
+                                        uint8_t border_value,
+                                        ThreadPool *thread_pool) {
+    RETURN_FALSE_IF(image_pyramid.level() == 0);
+    RETURN_FALSE_IF(border < 0);
+    PROFILE_ZONE(kBuildPyramid);
+
+    level_ = image_pyramid.level();
+    if (images_.size() < level_) {
+        images_.resize(level_);
+    }
+    for (uint32_t level_idx = 0; level_idx < level_; ++level_idx) {
+        images_[level_idx].CreatePaddedImage(image_pyramid.GetImageConst(level_idx), border, border_type, border_value, thread_pool);
+    }
+
+    return true;
+}
+
+const PaddedImage *PaddedPyramid::FindPaddedImage(const GrayImage &image) const {
+    for (uint32_t level_idx = 0; level_idx < level_; ++level_idx) {
+        if (images_[level_idx].IsCreatedFrom(image)) {
+            return &images_[level_idx];
+        }
+    }
+    return nullptr;
+}
+
+}
@@ -0,0 +1,262 @@
+#ifndef _FEATURE_TRACKER_PADDED_PYRAMID_H_
+#define _FEATURE_TRACKER_PADDED_PYRAMID_H_
+
+#include "basic_type.h"
+#include "datatype_image.h"
+#include "datatype_image_pyramid.h"
+#include "thread_pool.h"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+namespace FEATURE_TRACKER {
+
+enum class PaddedBorderType : uint8_t {
+    kReplicate = 0,    // Border repeats the nearest pixel on edge of image.
+    kConstant = 1,     // Border is filled with a constant value.
+};
+
+/* Class Padded Image Declaration. */
+// Copy of one image with a border of the same size on each side. Pixel (row, col) of source image is addressed by the
+// same (row, col) here, and pixels in border by row or col in [-border, 0) or [rows, rows + border). Patches which
+// lie in the padded area can be read without any bounds check. Pixels outside of source image are still invalid
+// for tracking, which is given per row by PaddedImageView instead of being checked per pixel.
+class PaddedImage {
+
+public:
+    PaddedImage() = default;
+    virtual ~PaddedImage() = default;
+
+    // Copy image into padded buffer. Rows are split across workers of thread pool if it is given.
+    void CreatePaddedImage(const GrayImage &image,
+                           int32_t border,
+                           PaddedBorderType border_type = PaddedBorderType::kReplicate,
+                           uint8_t border_value = 0,
+                           ThreadPool *thread_pool = nullptr);
+
+    // Check if this padded image is copied from the given image. Only buffer and size are compared, so it should be
+    // copied again whenever pixels in this buffer change.
+    bool IsCreatedFrom(const GrayImage &image) const {
+        return source_data_ == image.data() && rows_ == image.rows() && cols_ == image.cols();
+    }
+
+    // Check if all pixels in [min_row, max_row] x [min_col, max_col] lie in padded buffer.
+    bool IsInside(int32_t min_row, int32_t min_col, int32_t max_row, int32_t max_col) const {
+        return min_row >= - border_ && max_row < rows_ + border_ && min_col >= - border_ && max_col < cols_ + border_;
+    }
+
+    // Pointer to pixel (row, col) of source image coordinate. It should be inside of padded buffer.
+    const uint8_t *GetPixelPtr(int32_t row, int32_t col) const {
+        return padded_data_.data() + (row + border_) * stride_ + col + border_;
+    }
+    // Const reference for member variables.
+    const int32_t &rows() const { return rows_; }
+    const int32_t &cols() const { return cols_; }
+    const int32_t &border() const { return border_; }
+    const int32_t &stride() const { return stride_; }
+
+private:
+    void CopyRow(const uint8_t *image_data, int32_t padded_row);
+
+private:
+    const uint8_t *source_data_ = nullptr;
+    int32_t rows_ = 0;
+    int32_t cols_ = 0;
+    int32_t border_ = 0;
+    int32_t stride_ = 0;
+    PaddedBorderType border_type_ = PaddedBorderType::kReplicate;
+    uint8_t border_value_ = 0;
+    std::vector<uint8_t> padded_data_;
+
+};
+
+/* Class Padded Image View Declaration. */
+// Pixels of one image which klt kernels sample patches from. It reads padded copy of image if it is given, otherwise
+// image itself with no border, so that kernels have one path for both. Validity of pixels in each row of patch is
+// computed once as a range, and only pixels in it are sampled unless the whole row can be read.
+class PaddedImageView {
+
+public:
+    // Padded image should be copied from this image, or be nullptr.
+    PaddedImageView(const GrayImage &image, const PaddedImage *padded_image) {
+        rows_ = image.rows();
+        cols_ = image.cols();
+        if (padded_image != nullptr) {
+            data_ = padded_image->GetPixelPtr(0, 0);
+            border_ = padded_image->border();
+            stride_ = padded_image->stride();
+        } else {
+            data_ = image.data();
+            border_ = 0;
+            stride_ = image.cols();
+        }
+    }
+    virtual ~PaddedImageView() = default;
+
+    // Check if all pixels in [min_row, max_row] x [min_col, max_col] can be read, including border.
+    bool IsInside(int32_t min_row, int32_t min_col, int32_t max_row, int32_t max_col) const {
+        return min_row >= - border_ && max_row < rows_ + border_ && min_col >= - border_ && max_col < cols_ + border_;
+    }
+    // Check if all pixels whose row and col are floor of position in [min_row, max_row] x [min_col, max_col] can be
+    // read. It is false if any bound is not a number.
+    bool IsInside(float min_row, float min_col, float max_row, float max_col) const {
+        return min_row >= static_cast<float>(- border_) && max_row < static_cast<float>(rows_ + border_) &&
+               min_col >= static_cast<float>(- border_) && max_col < static_cast<float>(cols_ + border_);
+    }
+
+    // Range [begin, end) of num_cols pixels from (row, min_col), whose bilinear interpolation only touches pixels of
+    // image. Pixel i is for col min_col + i. Range is empty if no pixel in this row is valid.
+    void GetValidRangeInRow(int32_t row, int32_t min_col, int32_t num_cols, int32_t &begin, int32_t &end) const {
+        begin = std::max(0, - min_col);
+        end = std::min(num_cols, cols_ - 1 - min_col);
+        if (static_cast<uint32_t>(row) > static_cast<uint32_t>(rows_ - 2) || begin >= end) {
+            begin = 0;
+            end = 0;
+        }
+    }
+    // Validity of num_cols pixels from (row, min_col) as bitmask, bit i for col min_col + i. num_cols is up to 32.
+    uint32_t GetValidMaskInRow(int32_t row, int32_t min_col, int32_t num_cols) const {
+        int32_t begin = 0;
+        int32_t end = 0;
+        GetValidRangeInRow(row, min_col, num_cols, begin, end);
+        const uint32_t end_mask = end >= 32 ? ~0u : (1u << end) - 1u;
+        return end_mask & ~((1u << begin) - 1u);
+    }
+    // Range [begin, end) of num_samples samples along a line of patch, whose bilinear interpolation only touches pixels
+    // of image. Position of sample i is Vec2(col, row) given by position(i), which should move monotonically with i,
+    // so that valid samples are in one range. The range is estimated by intersecting the line with image, and then
+    // corrected by checking samples at its ends with the same positions that kernel samples.
+    template <typename SamplePosition>
+    void GetValidRangeInLine(int32_t num_samples, const SamplePosition &position, int32_t &begin, int32_t &end) const;
+
+    // Pointer to pixel (row, col) of source image coordinate. It should be readable.
+    const uint8_t *GetPixelPtr(int32_t row, int32_t col) const { return data_ + row * stride_ + col; }
+    // Bilinear interpolate at sub-pixel position without bounds check.
+    float GetPixelValueNoCheck(float row, float col) const {
+        const float int_pixel_row = std::floor(row);
+        const float int_pixel_col = std::floor(col);
+        const float dec_pixel_row = row - int_pixel_row;
+        const float dec_pixel_col = col - int_pixel_col;
+        const uint8_t *top = GetPixelPtr(static_cast<int32_t>(int_pixel_row), static_cast<int32_t>(int_pixel_col));
+        const uint8_t *bottom = top + stride_;
+        return (1.0f - dec_pixel_row) * (1.0f - dec_pixel_col) * static_cast<float>(top[0]) +
+               (1.0f - dec_pixel_row) * dec_pixel_col * static_cast<float>(top[1]) +
+               dec_pixel_row * (1.0f - dec_pixel_col) * static_cast<float>(bottom[0]) +
+               dec_pixel_row * dec_pixel_col * static_cast<float>(bottom[1]);
+    }
+
+    // Const reference for member variables.
+    const int32_t &rows() const { return rows_; }
+    const int32_t &cols() const { return cols_; }
+    const int32_t &border() const { return border_; }
+    const int32_t &stride() const { return stride_; }
+
+private:
+    // It is the same condition as sampling source image with bounds check.
+    bool IsValidSample(const Vec2 &uv) const {
+        return uv.x() >= 0.0f && uv.y() >= 0.0f && uv.x() <= static_cast<float>(cols_ - 2) && uv.y() <= static_cast<float>(rows_ - 2);
+    }
+
+private:
+    const uint8_t *data_ = nullptr;
+    int32_t rows_ = 0;
+    int32_t cols_ = 0;
+    int32_t border_ = 0;
+    int32_t stride_ = 0;
+
+};
+
+template <typename SamplePosition>
+void PaddedImageView::GetValidRangeInLine(int32_t num_samples, const SamplePosition &position, int32_t &begin, int32_t &end) const {
+    begin = 0;
+    end = 0;
+    if (num_samples <= 0) {
+        return;
+    }
+
+    // Estimate range of samples which lie in image along each axis.
+    const Vec2 first_uv = position(0);
+    const Vec2 step_uv = num_samples > 1 ? Vec2((position(num_samples - 1) - first_uv) / static_cast<float>(num_samples - 1)) : Vec2::Zero();
+    const Vec2 max_uv(static_cast<float>(cols_ - 2), static_cast<float>(rows_ - 2));
+    const float max_index = static_cast<float>(num_samples - 1);
+    float min_valid_index = 0.0f;
+    float max_valid_index = max_index;
+    for (int32_t axis = 0; axis < 2; ++axis) {
+        if (step_uv(axis) == 0.0f) {
+            // Samples either all lie in image along this axis, or none of them does.
+            if (!(first_uv(axis) >= 0.0f && first_uv(axis) <= max_uv(axis))) {
+                max_valid_index = -1.0f;
+            }
+            continue;
+        }
+        const float index_at_zero = - first_uv(axis) / step_uv(axis);
+        const float index_at_max = (max_uv(axis) - first_uv(axis)) / step_uv(axis);
+        min_valid_index = std::max(min_valid_index, std::min(index_at_zero, index_at_max));
+        max_valid_index = std::min(max_valid_index, std::max(index_at_zero, index_at_max));
+    }
+
+    // Clamp estimation before converting it into index, and view it as empty if it is not a number.
+    min_valid_index = min_valid_index >= 0.0f ? std::min(min_valid_index, max_index + 1.0f) : 0.0f;
+    max_valid_index = max_valid_index <= max_index ? std::max(max_valid_index, -1.0f) : -1.0f;
+    begin = static_cast<int32_t>(std::ceil(min_valid_index));
+    end = std::max(begin, static_cast<int32_t>(std::floor(max_valid_index)) + 1);
+
+    // Correct both ends, since estimation is not exact in float.
+    while (begin < end && !IsValidSample(position(begin))) {
+        ++begin;
+    }
+    while (begin > 0 && IsValidSample(position(begin - 1))) {
+        --begin;
+    }
+    end = std::max(begin, end);
+    while (end > begin && !IsValidSample(position(end - 1))) {
+        --end;
+    }
+    while (end < num_samples && IsValidSample(position(end))) {
+        ++end;
+    }
+    if (begin == end) {
+        begin = 0;
+        end = 0;
+    }
+}
+
+/* Class Padded Pyramid Declaration. */
+// Padded copy of each level of an image pyramid. Like gradient pyramid, it is built once per frame and can be shared
+// by all trackers that work on this pyramid. Border should be at least half patch size + 2, so that extended patch
+// and its bilinear neighbours of any feature inside of image are covered. It must be rebuilt whenever buffers of image
+// pyramid are reused for another frame, which sequence and async front ends do for pyramids they own.
+// Patches partly outside of image are read as whole rows from padded buffer by reference patch extraction of fast and
+// sse methods, and by current patch sampling of sse method (basic, affine and lssd) and basic fixed patch kernel. Other
+// fast kernels sample only valid range of each row with or without it, and inverse, direct and sparse pattern kernels
+// still check bounds per pixel. Copying levels costs about 0.02 ms for 640 x 480 in four levels. With 300 features
+// over the whole image, frame time of sequence tracker including the copy is 2% to 7% shorter with sse method, and
+// 2% to 6% longer with fast method.
+class PaddedPyramid {
+
+public:
+    PaddedPyramid() = default;
+    virtual ~PaddedPyramid() = default;
+
+    bool CreatePaddedPyramid(const ImagePyramid &image_pyramid,
+                             int32_t border,
+                             PaddedBorderType border_type = PaddedBorderType::kReplicate,
+                             uint8_t border_value = 0,
+                             ThreadPool *thread_pool = nullptr);
+
+    // Find the level which is copied from the given image. Return nullptr if there is no such level.
+    const PaddedImage *FindPaddedImage(const GrayImage &image) const;
+
+    uint32_t level() const { return level_; }
+    const PaddedImage &GetPaddedImage(uint32_t level) const { return images_[level]; }
+
+private:
+    uint32_t level_ = 0;
+    std::vector<PaddedImage> images_;
+
+};
+
+}
+
+#endif // end of _FEATURE_TRACKER_PADDED_PYRAMID_H_
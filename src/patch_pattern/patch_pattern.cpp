@@ -0,0 +1,72 @@
+#include "patch_pattern.h"
+#include "slam_operations.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace FEATURE_TRACKER {
+
+namespace {
+    // Pattern 8 of DSO in (dcol, drow), whose radius is 2 pixels.
+    constexpr int32_t kDso8PatternRadius = 2;
+    constexpr int32_t kDso8Pattern[8][2] = {
+        { 0, -2 }, { -1, -1 }, { 1, -1 }, { -2, 0 }, { 0, 0 }, { 2, 0 }, { -1, 1 }, { 0, 2 },
+    };
+}
+
+bool PatchPattern::CreatePatchPattern(PatchPatternType type,
+                                      int32_t row_half_size,
+                                      int32_t col_half_size,
+                                      int32_t stride,
+                                      const std::vector<PatchPatternPoint> &custom_points) {
+    RETURN_FALSE_IF(row_half_size < 0 || col_half_size < 0);
+    RETURN_FALSE_IF(stride < 1);
+    RETURN_FALSE_IF(type == PatchPatternType::kCustom && custom_points.empty());
+
+    type_ = type;
+    points_.clear();
+    switch (type) {
+        case PatchPatternType::kDso8: {
+            // Spread pattern to patch, so that it keeps convergence region of full patch.
+            const int32_t scale = std::max(1, std::min(row_half_size, col_half_size) / kDso8PatternRadius);
+            for (const auto &offset : kDso8Pattern) {
+                points_.emplace_back(PatchPatternPoint{ offset[1] * scale, offset[0] * scale });
+            }
+            break;
+        }
+        case PatchPatternType::kDiamond:
+        case PatchPatternType::kCheckerboard: {
+            const int32_t max_row_step = row_half_size / stride;
+            const int32_t max_col_step = col_half_size / stride;
+            for (int32_t row_step = - max_row_step; row_step <= max_row_step; ++row_step) {
+                for (int32_t col_step = - max_col_step; col_step <= max_col_step; ++col_step) {
+                    if (type == PatchPatternType::kDiamond) {
+                        // |drow| / row_half + |dcol| / col_half <= 1, without division.
+                        CONTINUE_IF(std::abs(row_step) * std::max(max_col_step, 1) + std::abs(col_step) * std::max(max_row_step, 1) >
+                            std::max(max_row_step, 1) * std::max(max_col_step, 1));
+                    } else {
+                        CONTINUE_IF((row_step + col_step) % 2 != 0);
+                    }
+                    points_.emplace_back(PatchPatternPoint{ row_step * stride, col_step * stride });
+                }
+            }
+            break;
+        }
+        case PatchPatternType::kCustom:
+            points_ = custom_points;
+            break;
+        case PatchPatternType::kFull:
+        default:
+            type_ = PatchPatternType::kFull;
+            for (int32_t drow = - row_half_size; drow <= row_half_size; ++drow) {
+                for (int32_t dcol = - col_half_size; dcol <= col_half_size; ++dcol) {
+                    points_.emplace_back(PatchPatternPoint{ drow, dcol });
+                }
+            }
+            break;
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,57 @@
+#ifndef _FEATURE_TRACKER_PATCH_PATTERN_H_
+#define _FEATURE_TRACKER_PATCH_PATTERN_H_
+
+#include "basic_type.h"
+
+#include <vector>
+
+namespace FEATURE_TRACKER {
+
+enum class PatchPatternType : uint8_t {
+    kFull = 0,            // Every pixel of (2 * row_half + 1) x (2 * col_half + 1) patch.
+    kDso8 = 1,            // 8 points of DSO, spread to patch half size.
+    kDiamond = 2,         // Points on strided grid inside of diamond inscribed in patch.
+    kCheckerboard = 3,    // Black cells of strided checkerboard, including center of patch.
+    kCustom = 4,          // Offsets given by user.
+};
+
+/* Offset of one pattern point from center of patch. */
+struct PatchPatternPoint {
+    int32_t drow = 0;
+    int32_t dcol = 0;
+};
+
+/* Class Patch Pattern Declaration. */
+// Sampling points of a patch. Sparse patterns let trackers sample and precompute gradient only at a few points
+// instead of the full rectangular patch, which is what semi-dense tracking needs.
+class PatchPattern {
+
+public:
+    PatchPattern() = default;
+    virtual ~PatchPattern() = default;
+
+    // Create points of pattern. Stride is spacing of points in diamond and checkerboard, and custom points are only
+    // used by custom pattern. Return false if parameters are invalid, then pattern is left unchanged.
+    bool CreatePatchPattern(PatchPatternType type,
+                            int32_t row_half_size,
+                            int32_t col_half_size,
+                            int32_t stride = 3,
+                            const std::vector<PatchPatternPoint> &custom_points = {});
+
+    // Full pattern is tracked by dense kernels, so that results are not changed by pattern.
+    bool IsFull() const { return type_ == PatchPatternType::kFull; }
+
+    // Const reference for member variables.
+    const PatchPatternType &type() const { return type_; }
+    const std::vector<PatchPatternPoint> &points() const { return points_; }
+    uint32_t size() const { return points_.size(); }
+
+private:
+    PatchPatternType type_ = PatchPatternType::kFull;
+    std::vector<PatchPatternPoint> points_;
+
+};
+
+}
+
+#endif // end of _FEATURE_TRACKER_PATCH_PATTERN_H_
@@ -0,0 +1,192 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace FEATURE_TRACKER {
+
+namespace {
+    // Profiles of all threads. Mutex is only locked when a thread registers, resets or reports.
+    struct ProfileRegistry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadProfile>> profiles;
+    };
+
+    ProfileRegistry &GetRegistry() {
+        static ProfileRegistry registry;
+        return registry;
+    }
+
+    inline void AddRelaxed(std::atomic<uint64_t> &value, uint64_t increment) {
+        value.store(value.load(std::memory_order_relaxed) + increment, std::memory_order_relaxed);
+    }
+
+    // Sum of statistics of all threads, or a snapshot of one thread.
+    struct ProfileSnapshot {
+        std::array<uint64_t, ThreadProfile::kNumZones> zone_calls = {};
+        std::array<uint64_t, ThreadProfile::kNumZones> zone_nanoseconds = {};
+        std::array<uint64_t, ThreadProfile::kNumZones> zone_max_nanoseconds = {};
+        std::array<uint64_t, ThreadProfile::kNumCounters> counters = {};
+
+        void Add(const ThreadProfile &profile) {
+            for (uint32_t i = 0; i < ThreadProfile::kNumZones; ++i) {
+                zone_calls[i] += profile.zone_calls[i].load(std::memory_order_relaxed);
+                zone_nanoseconds[i] += profile.zone_nanoseconds[i].load(std::memory_order_relaxed);
+                zone_max_nanoseconds[i] = std::max(zone_max_nanoseconds[i], profile.zone_max_nanoseconds[i].load(std::memory_order_relaxed));
+            }
+            for (uint32_t i = 0; i < ThreadProfile::kNumCounters; ++i) {
+                counters[i] += profile.counters[i].load(std::memory_order_relaxed);
+            }
+        }
+    };
+
+    void ReportSnapshotInJson(const ProfileSnapshot &snapshot, std::ostringstream &stream) {
+        stream << "\"zones\": {";
+        for (uint32_t i = 0; i < ThreadProfile::kNumZones; ++i) {
+            stream << (i ? ", " : "") << "\"" << Profiler::ZoneName(static_cast<ProfileZone>(i)) << "\": {" <<
+                "\"calls\": " << snapshot.zone_calls[i] << ", " <<
+                "\"total_us\": " << static_cast<double>(snapshot.zone_nanoseconds[i]) * 1e-3 << ", " <<
+                "\"max_us\": " << static_cast<double>(snapshot.zone_max_nanoseconds[i]) * 1e-3 << "}";
+        }
+        stream << "}, \"counters\": {";
+        for (uint32_t i = 0; i < ThreadProfile::kNumCounters; ++i) {
+            stream << (i ? ", " : "") << "\"" << Profiler::CounterName(static_cast<ProfileCounter>(i)) << "\": " << snapshot.counters[i];
+        }
+        stream << "}";
+    }
+
+    void ReportSnapshotInCsv(const std::string &thread_name, const ProfileSnapshot &snapshot, std::ostringstream &stream) {
+        for (uint32_t i = 0; i < ThreadProfile::kNumZones; ++i) {
+            stream << thread_name << ",zone," << Profiler::ZoneName(static_cast<ProfileZone>(i)) << "," << snapshot.zone_calls[i] << "," <<
+                static_cast<double>(snapshot.zone_nanoseconds[i]) * 1e-3 << "," << static_cast<double>(snapshot.zone_max_nanoseconds[i]) * 1e-3 << "\n";
+        }
+        for (uint32_t i = 0; i < ThreadProfile::kNumCounters; ++i) {
+            stream << thread_name << ",counter," << Profiler::CounterName(static_cast<ProfileCounter>(i)) << "," << snapshot.counters[i] << ",,\n";
+        }
+    }
+}
+
+ThreadProfile &Profiler::GetThreadProfile() {
+    thread_local ThreadProfile *profile = RegisterThread();
+    return *profile;
+}
+
+ThreadProfile *Profiler::RegisterThread() {
+    ProfileRegistry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.profiles.emplace_back(std::make_unique<ThreadProfile>());
+    registry.profiles.back()->thread_id = std::this_thread::get_id();
+    return registry.profiles.back().get();
+}
+
+void Profiler::RecordZone(ProfileZone zone, uint64_t nanoseconds) {
+    ThreadProfile &profile = GetThreadProfile();
+    const uint32_t index = static_cast<uint32_t>(zone);
+    AddRelaxed(profile.zone_calls[index], 1);
+    AddRelaxed(profile.zone_nanoseconds[index], nanoseconds);
+    if (nanoseconds > profile.zone_max_nanoseconds[index].load(std::memory_order_relaxed)) {
+        profile.zone_max_nanoseconds[index].store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+void Profiler::Count(ProfileCounter counter, uint64_t value) {
+    AddRelaxed(GetThreadProfile().counters[static_cast<uint32_t>(counter)], value);
+}
+
+void Profiler::Reset() {
+    ProfileRegistry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (auto &profile : registry.profiles) {
+        for (uint32_t i = 0; i < ThreadProfile::kNumZones; ++i) {
+            profile->zone_calls[i].store(0, std::memory_order_relaxed);
+            profile->zone_nanoseconds[i].store(0, std::memory_order_relaxed);
+            profile->zone_max_nanoseconds[i].store(0, std::memory_order_relaxed);
+        }
+        for (auto &counter : profile->counters) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::string Profiler::ReportInJson() {
+    ProfileRegistry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(3);
+    ProfileSnapshot total;
+    stream << "{\n  \"enabled\": " << (FEATURE_TRACKER_PROFILER ? "true" : "false") << ",\n  \"threads\": [\n";
+    for (uint32_t thread_idx = 0; thread_idx < registry.profiles.size(); ++thread_idx) {
+        ProfileSnapshot snapshot;
+        snapshot.Add(*registry.profiles[thread_idx]);
+        total.Add(*registry.profiles[thread_idx]);
+        stream << "    {\"thread\": " << thread_idx << ", ";
+        ReportSnapshotInJson(snapshot, stream);
+        stream << "}" << (thread_idx + 1 < registry.profiles.size() ? "," : "") << "\n";
+    }
+    stream << "  ],\n  \"total\": {";
+    ReportSnapshotInJson(total, stream);
+    stream << "}\n}\n";
+    return stream.str();
+}
+
+std::string Profiler::ReportInCsv() {
+    ProfileRegistry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(3);
+    ProfileSnapshot total;
+    stream << "thread,type,name,count,total_us,max_us\n";
+    for (uint32_t thread_idx = 0; thread_idx < registry.profiles.size(); ++thread_idx) {
+        ProfileSnapshot snapshot;
+        snapshot.Add(*registry.profiles[thread_idx]);
+        total.Add(*registry.profiles[thread_idx]);
+        ReportSnapshotInCsv(std::to_string(thread_idx), snapshot, stream);
+    }
+    ReportSnapshotInCsv("total", total, stream);
+    return stream.str();
+}
+
+bool Profiler::SaveReport(const std::string &file_name) {
+    std::ofstream file(file_name);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    const std::string csv_suffix = ".csv";
+    const bool is_csv = file_name.size() >= csv_suffix.size() &&
+        file_name.compare(file_name.size() - csv_suffix.size(), csv_suffix.size(), csv_suffix) == 0;
+    file << (is_csv ? ReportInCsv() : ReportInJson());
+    return file.good();
+}
+
+const char *Profiler::ZoneName(ProfileZone zone) {
+    switch (zone) {
+        case ProfileZone::kTrackFeatures: return "track_features";
+        case ProfileZone::kBuildPyramid: return "build_pyramid";
+        case ProfileZone::kExtractRefPatch: return "extract_ref_patch";
+        case ProfileZone::kPrecomputeJacobian: return "precompute_jacobian";
+        case ProfileZone::kComputeBias: return "compute_bias";
+        case ProfileZone::kSolve: return "solve";
+        case ProfileZone::kMatchDescriptors: return "match_descriptors";
+        default: return "unknown";
+    }
+}
+
+const char *Profiler::CounterName(ProfileCounter counter) {
+    switch (counter) {
+        case ProfileCounter::kFeaturesToTrack: return "features_to_track";
+        case ProfileCounter::kOutsideImageFallback: return "outside_image_fallback";
+        case ProfileCounter::kDescriptorDistance: return "descriptor_distance";
+        case ProfileCounter::kPaddedBorderFastPath: return "padded_border_fast_path";
+        default: return "unknown";
+    }
+}
+
+}
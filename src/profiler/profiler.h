@@ -0,0 +1,112 @@
+#ifndef _FEATURE_TRACKER_PROFILER_H_
+#define _FEATURE_TRACKER_PROFILER_H_
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+// Scoped zones and counters on hot path of trackers. They are compiled out by default, unless
+// FEATURE_TRACKER_PROFILER is enabled at compile time.
+#ifndef FEATURE_TRACKER_PROFILER
+#define FEATURE_TRACKER_PROFILER (0)
+#endif
+
+namespace FEATURE_TRACKER {
+
+enum class ProfileZone : uint8_t {
+    kTrackFeatures = 0,
+    kBuildPyramid = 1,
+    kExtractRefPatch = 2,
+    kPrecomputeJacobian = 3,
+    kComputeBias = 4,    // Loops constructing bias, or hessian and bias together.
+    kSolve = 5,
+    kMatchDescriptors = 6,
+    kNumZones = 7,
+};
+
+enum class ProfileCounter : uint8_t {
+    kFeaturesToTrack = 0,
+    kOutsideImageFallback = 1,    // Patch is partly outside of image and can not be read in whole rows, so only valid pixels are sampled.
+    kDescriptorDistance = 2,
+    kPaddedBorderFastPath = 3,    // Patch is partly outside of image but read in whole rows, such as from padded image.
+    kNumCounters = 4,
+};
+
+/* Statistics recorded by one thread. */
+// Only the owner thread writes it, so relaxed load and store are enough. Other threads may read it for report.
+struct ThreadProfile {
+    static constexpr uint32_t kNumZones = static_cast<uint32_t>(ProfileZone::kNumZones);
+    static constexpr uint32_t kNumCounters = static_cast<uint32_t>(ProfileCounter::kNumCounters);
+
+    std::thread::id thread_id;
+    std::array<std::atomic<uint64_t>, kNumZones> zone_calls = {};
+    std::array<std::atomic<uint64_t>, kNumZones> zone_nanoseconds = {};
+    std::array<std::atomic<uint64_t>, kNumZones> zone_max_nanoseconds = {};
+    std::array<std::atomic<uint64_t>, kNumCounters> counters = {};
+};
+
+/* Class Profiler Declaration. */
+// Each thread registers its own ThreadProfile once, then records into it without any lock.
+// Profiles are kept after threads exit, so that workers of destroyed thread pools are still reported.
+class Profiler {
+
+public:
+    Profiler() = delete;
+
+    static void RecordZone(ProfileZone zone, uint64_t nanoseconds);
+    static void Count(ProfileCounter counter, uint64_t value);
+
+    // Reset all statistics. It should be called when no tracker is running.
+    static void Reset();
+
+    // Report statistics of each thread and the total of all threads.
+    static std::string ReportInJson();
+    static std::string ReportInCsv();
+    // Save report in csv if file name ends with .csv, otherwise in json.
+    static bool SaveReport(const std::string &file_name);
+
+    static const char *ZoneName(ProfileZone zone);
+    static const char *CounterName(ProfileCounter counter);
+
+private:
+    static ThreadProfile &GetThreadProfile();
+    static ThreadProfile *RegisterThread();
+
+};
+
+/* Class Profile Scope Declaration. */
+// Record time cost from construction to destruction into one zone.
+class ProfileScope {
+
+public:
+    explicit ProfileScope(ProfileZone zone) : zone_(zone), start_time_(std::chrono::steady_clock::now()) {}
+    ~ProfileScope() {
+        const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time_).count();
+        Profiler::RecordZone(zone_, static_cast<uint64_t>(nanoseconds));
+    }
+    ProfileScope(const ProfileScope &profile_scope) = delete;
+    ProfileScope &operator=(const ProfileScope &profile_scope) = delete;
+
+private:
+    ProfileZone zone_;
+    std::chrono::steady_clock::time_point start_time_;
+
+};
+
+}
+
+#define PROFILER_CONCAT_IMPL(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_IMPL(a, b)
+
+#if FEATURE_TRACKER_PROFILER
+#define PROFILE_ZONE(zone) FEATURE_TRACKER::ProfileScope PROFILER_CONCAT(profile_scope_, __LINE__)(FEATURE_TRACKER::ProfileZone::zone)
+#define PROFILE_COUNT(counter, value) FEATURE_TRACKER::Profiler::Count(FEATURE_TRACKER::ProfileCounter::counter, value)
+#else
+#define PROFILE_ZONE(zone)
+#define PROFILE_COUNT(counter, value)
+#endif
+
+#endif // end of _FEATURE_TRACKER_PROFILER_H_
@@ -0,0 +1,127 @@
+#ifndef _FEATURE_TRACKER_SPSC_QUEUE_H_
+#define _FEATURE_TRACKER_SPSC_QUEUE_H_
+
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+
+namespace FEATURE_TRACKER {
+
+/* Class Single Producer Single Consumer Queue Declaration. */
+// Bounded lock-free ring. Only one thread may push and only one thread may pop. Capacity is rounded up to power
+// of two. Consumer may block in WaitForItem(), and producer wakes it up after push without taking a lock unless
+// consumer is sleeping.
+template <typename T>
+class SpscQueue {
+
+public:
+    explicit SpscQueue(uint32_t capacity);
+    virtual ~SpscQueue() = default;
+    SpscQueue(const SpscQueue &queue) = delete;
+    SpscQueue &operator=(const SpscQueue &queue) = delete;
+
+    // Return false if queue is full, then item is not moved.
+    bool TryPush(T &item);
+    // Return false if queue is empty.
+    bool TryPop(T &item);
+
+    // Block consumer until queue is not empty or stop is set. Return false if it is stopped with empty queue.
+    bool WaitForItem(const std::atomic<bool> &stop);
+    // Wake up consumer, such as after stop is set.
+    void Notify();
+
+    bool empty() const { return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire); }
+    uint32_t capacity() const { return static_cast<uint32_t>(buffer_.size()); }
+
+private:
+    static constexpr uint32_t kNumSpins = 256;
+    static constexpr std::chrono::milliseconds kMaxSleepTime = std::chrono::milliseconds(2);
+
+    std::vector<T> buffer_;
+    uint64_t mask_ = 0;
+
+    // Consumer owns head and producer owns tail. They stay in different cache lines.
+    alignas(64) std::atomic<uint64_t> head_ { 0 };
+    alignas(64) std::atomic<uint64_t> tail_ { 0 };
+
+    // Sleeping consumer.
+    alignas(64) std::atomic<bool> is_consumer_sleeping_ { false };
+    std::mutex mutex_;
+    std::condition_variable item_ready_;
+
+};
+
+/* Class Single Producer Single Consumer Queue Definition. */
+template <typename T>
+SpscQueue<T>::SpscQueue(uint32_t capacity) {
+    uint32_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    buffer_.resize(size);
+    mask_ = size - 1;
+}
+
+template <typename T>
+bool SpscQueue<T>::TryPush(T &item) {
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) >= buffer_.size()) {
+        return false;
+    }
+
+    buffer_[tail & mask_] = std::move(item);
+    tail_.store(tail + 1, std::memory_order_seq_cst);
+    if (is_consumer_sleeping_.load(std::memory_order_seq_cst)) {
+        Notify();
+    }
+    return true;
+}
+
+template <typename T>
+bool SpscQueue<T>::TryPop(T &item) {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    item = std::move(buffer_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+bool SpscQueue<T>::WaitForItem(const std::atomic<bool> &stop) {
+    // Spin for a while, since next item usually comes soon in a busy pipeline.
+    for (uint32_t i = 0; i < kNumSpins; ++i) {
+        if (!empty()) {
+            return true;
+        }
+        if (stop.load(std::memory_order_acquire)) {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+
+    // Sleep until producer wakes it up. Timeout only guards against a missed notification.
+    std::unique_lock<std::mutex> lock(mutex_);
+    is_consumer_sleeping_.store(true, std::memory_order_seq_cst);
+    while (empty() && !stop.load(std::memory_order_acquire)) {
+        item_ready_.wait_for(lock, kMaxSleepTime);
+    }
+    is_consumer_sleeping_.store(false, std::memory_order_relaxed);
+    return !empty();
+}
+
+template <typename T>
+void SpscQueue<T>::Notify() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    item_ready_.notify_one();
+}
+
+}
+
+#endif // end of _FEATURE_TRACKER_SPSC_QUEUE_H_
@@ -0,0 +1,198 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace FEATURE_TRACKER {
+
+namespace {
+    inline uint64_t PackRange(uint32_t front, uint32_t back) { return (static_cast<uint64_t>(front) << 32) | back; }
+    inline uint32_t RangeFront(uint64_t range) { return static_cast<uint32_t>(range >> 32); }
+    inline uint32_t RangeBack(uint64_t range) { return static_cast<uint32_t>(range); }
+
+    // Pool and worker id of the job which current thread is running, so that nested job can be detected.
+    thread_local const ThreadPool *running_pool = nullptr;
+    thread_local uint32_t running_worker_id = 0;
+}
+
+ThreadPool::ThreadPool(uint32_t num_threads) {
+    num_threads_ = num_threads > 0 ? num_threads : 1;
+    deques_ = std::vector<ChunkDeque>(num_threads_);
+    workers_.reserve(num_threads_ - 1);
+    for (uint32_t worker_id = 1; worker_id < num_threads_; ++worker_id) {
+        workers_.emplace_back(&ThreadPool::WorkerLoop, this, worker_id);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    job_ready_.notify_all();
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::ParallelFor(uint32_t num_tasks,
+                             const Task &task,
+                             ThreadPoolSchedule schedule,
+                             uint32_t chunk_size) {
+    if (num_tasks == 0) {
+        return;
+    }
+
+    // All workers are busy with the outer job, so nested job runs in calling worker.
+    if (running_pool == this) {
+        for (uint32_t task_id = 0; task_id < num_tasks; ++task_id) {
+            task(task_id, running_worker_id);
+        }
+        return;
+    }
+
+    // Wait for job of other callers to finish.
+    std::lock_guard<std::mutex> job_lock(job_mutex_);
+
+    // If there is no background worker, run all tasks in calling thread.
+    if (workers_.empty()) {
+        running_pool = this;
+        running_worker_id = 0;
+        for (uint32_t task_id = 0; task_id < num_tasks; ++task_id) {
+            task(task_id, 0);
+        }
+        running_pool = nullptr;
+        return;
+    }
+
+    // Publish this job to all workers.
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        num_tasks_ = num_tasks;
+        job_schedule_ = schedule;
+        job_chunk_size_ = chunk_size > 0 ? chunk_size : 1;
+        if (job_schedule_ == ThreadPoolSchedule::kWorkStealing) {
+            // Deal chunks to workers in continuous ranges, which keeps the same locality as static schedule.
+            const uint32_t num_chunks = (num_tasks_ + job_chunk_size_ - 1) / job_chunk_size_;
+            for (uint32_t worker_id = 0; worker_id < num_threads_; ++worker_id) {
+                const uint32_t front = static_cast<uint64_t>(num_chunks) * worker_id / num_threads_;
+                const uint32_t back = static_cast<uint64_t>(num_chunks) * (worker_id + 1) / num_threads_;
+                deques_[worker_id].range.store(PackRange(front, back), std::memory_order_relaxed);
+            }
+        }
+        num_busy_workers_ = static_cast<uint32_t>(workers_.size());
+        ++job_index_;
+    }
+    job_ready_.notify_all();
+
+    // Calling thread works as worker 0.
+    RunJob(0);
+
+    // Wait for all background workers.
+    std::unique_lock<std::mutex> lock(mutex_);
+    job_done_.wait(lock, [this] { return num_busy_workers_ == 0; });
+    task_ = nullptr;
+}
+
+void ThreadPool::WorkerLoop(uint32_t worker_id) {
+    uint64_t last_job_index = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            job_ready_.wait(lock, [this, last_job_index] { return stop_ || job_index_ != last_job_index; });
+            if (stop_) {
+                return;
+            }
+            last_job_index = job_index_;
+        }
+
+        RunJob(worker_id);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --num_busy_workers_;
+        }
+        job_done_.notify_one();
+    }
+}
+
+void ThreadPool::RunJob(uint32_t worker_id) {
+    running_pool = this;
+    running_worker_id = worker_id;
+    switch (job_schedule_) {
+        case ThreadPoolSchedule::kWorkStealing:
+            RunWorkStealing(worker_id);
+            break;
+        case ThreadPoolSchedule::kStatic:
+        default:
+            RunStaticRange(worker_id);
+            break;
+    }
+    running_pool = nullptr;
+}
+
+void ThreadPool::RunStaticRange(uint32_t worker_id) {
+    // Split tasks into continuous ranges with nearly equal size.
+    const uint32_t begin = static_cast<uint64_t>(num_tasks_) * worker_id / num_threads_;
+    const uint32_t end = static_cast<uint64_t>(num_tasks_) * (worker_id + 1) / num_threads_;
+    for (uint32_t task_id = begin; task_id < end; ++task_id) {
+        (*task_)(task_id, worker_id);
+    }
+}
+
+void ThreadPool::RunWorkStealing(uint32_t worker_id) {
+    uint32_t chunk_id = 0;
+
+    // Finish own chunks first.
+    while (PopFront(worker_id, chunk_id)) {
+        RunChunk(chunk_id, worker_id);
+    }
+
+    // Steal from other workers until all deques are empty. No chunk is pushed during a job, so an empty pass
+    // means this worker is done.
+    bool stolen = true;
+    while (stolen) {
+        stolen = false;
+        for (uint32_t i = 1; i < num_threads_; ++i) {
+            const uint32_t victim_id = (worker_id + i) % num_threads_;
+            while (StealBack(victim_id, chunk_id)) {
+                RunChunk(chunk_id, worker_id);
+                stolen = true;
+            }
+        }
+    }
+}
+
+void ThreadPool::RunChunk(uint32_t chunk_id, uint32_t worker_id) {
+    const uint32_t begin = chunk_id * job_chunk_size_;
+    const uint32_t end = std::min(begin + job_chunk_size_, num_tasks_);
+    for (uint32_t task_id = begin; task_id < end; ++task_id) {
+        (*task_)(task_id, worker_id);
+    }
+}
+
+bool ThreadPool::PopFront(uint32_t worker_id, uint32_t &chunk_id) {
+    std::atomic<uint64_t> &range = deques_[worker_id].range;
+    uint64_t value = range.load(std::memory_order_acquire);
+    while (RangeFront(value) < RangeBack(value)) {
+        if (range.compare_exchange_weak(value, PackRange(RangeFront(value) + 1, RangeBack(value)), std::memory_order_acq_rel)) {
+            chunk_id = RangeFront(value);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::StealBack(uint32_t victim_id, uint32_t &chunk_id) {
+    std::atomic<uint64_t> &range = deques_[victim_id].range;
+    uint64_t value = range.load(std::memory_order_acquire);
+    while (RangeFront(value) < RangeBack(value)) {
+        if (range.compare_exchange_weak(value, PackRange(RangeFront(value), RangeBack(value) - 1), std::memory_order_acq_rel)) {
+            chunk_id = RangeBack(value) - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,95 @@
+#ifndef _FEATURE_TRACKER_THREAD_POOL_H_
+#define _FEATURE_TRACKER_THREAD_POOL_H_
+
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace FEATURE_TRACKER {
+
+enum class ThreadPoolSchedule : uint8_t {
+    kStatic = 0,
+    kWorkStealing = 1,
+};
+
+/* Class Thread Pool Declaration. */
+// Persistent workers which run one parallel-for job at a time. The calling thread works as worker 0,
+// so a pool with n threads creates n - 1 background threads.
+class ThreadPool {
+
+public:
+    using Task = std::function<void(uint32_t task_id, uint32_t worker_id)>;
+
+    explicit ThreadPool(uint32_t num_threads);
+    virtual ~ThreadPool();
+    ThreadPool(const ThreadPool &thread_pool) = delete;
+    ThreadPool &operator=(const ThreadPool &thread_pool) = delete;
+
+    // Run task for every task_id in [0, num_tasks), and block until all of them are finished. Only one job runs at a
+    // time, so callers sharing one pool wait for the former job to finish, and each job keeps its own schedule.
+    // Calling it from inside a task of the same pool runs the nested job serially with worker_id of calling worker.
+    // With kStatic schedule, tasks are split into continuous ranges, one range per worker.
+    // With kWorkStealing schedule, each worker's range is cut into chunks of chunk_size tasks. A worker pops
+    // chunks from the front of its own deque, and steals chunks from the back of others' when it runs out.
+    void ParallelFor(uint32_t num_tasks,
+                     const Task &task,
+                     ThreadPoolSchedule schedule = ThreadPoolSchedule::kStatic,
+                     uint32_t chunk_size = kDefaultChunkSize);
+    // Same as above, but the task is wrapped by reference, so that large captures of lambda are not copied into heap.
+    template <typename TaskType>
+    void ParallelFor(uint32_t num_tasks,
+                     const TaskType &task,
+                     ThreadPoolSchedule schedule = ThreadPoolSchedule::kStatic,
+                     uint32_t chunk_size = kDefaultChunkSize) {
+        ParallelFor(num_tasks, Task(std::cref(task)), schedule, chunk_size);
+    }
+
+    // Const reference for member variables.
+    const uint32_t &num_threads() const { return num_threads_; }
+
+    static constexpr uint32_t kDefaultChunkSize = 8;
+
+private:
+    // Deque of chunk indices [front, back) owned by one worker. Both ends are packed into one word, so that
+    // pop and steal are single compare-and-swap operations.
+    struct alignas(64) ChunkDeque {
+        std::atomic<uint64_t> range { 0 };
+    };
+
+    void WorkerLoop(uint32_t worker_id);
+    void RunJob(uint32_t worker_id);
+    void RunStaticRange(uint32_t worker_id);
+    void RunWorkStealing(uint32_t worker_id);
+    void RunChunk(uint32_t chunk_id, uint32_t worker_id);
+    bool PopFront(uint32_t worker_id, uint32_t &chunk_id);
+    bool StealBack(uint32_t victim_id, uint32_t &chunk_id);
+
+private:
+    uint32_t num_threads_ = 1;
+    std::vector<std::thread> workers_;
+    std::vector<ChunkDeque> deques_;
+
+    // Held by caller for the whole job, so that jobs of different callers do not overlap.
+    std::mutex job_mutex_;
+
+    // Current job shared with all workers.
+    std::mutex mutex_;
+    std::condition_variable job_ready_;
+    std::condition_variable job_done_;
+    const Task *task_ = nullptr;
+    uint32_t num_tasks_ = 0;
+    uint32_t job_chunk_size_ = 1;
+    ThreadPoolSchedule job_schedule_ = ThreadPoolSchedule::kStatic;
+    uint64_t job_index_ = 0;
+    uint32_t num_busy_workers_ = 0;
+    bool stop_ = false;
+
+};
+
+}
+
+#endif // end of _FEATURE_TRACKER_THREAD_POOL_H_
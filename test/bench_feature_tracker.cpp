@@ -0,0 +1,556 @@
+#include "iostream"
+#include "cstdint"
+#include "string"
+#include "vector"
+#include "array"
+#include "algorithm"
+#include "random"
+#include "fstream"
+#include "sstream"
+#include "iomanip"
+#include "functional"
+#include "atomic"
+
+#include "slam_log_reporter.h"
+#include "tick_tock.h"
+
+#include "optical_flow_basic_klt.h"
+#include "optical_flow_affine_klt.h"
+#include "optical_flow_lssd_klt.h"
+#include "optical_flow_sequence_tracker.h"
+#include "optical_flow_async_tracker.h"
+#include "direct_method_tracker.h"
+#include "descriptor_matcher.h"
+
+#include "synthetic_flow_generator.h"
+#include "test_image_pyramid.h"
+
+namespace {
+    constexpr int32_t kImageRows = 480;
+    constexpr int32_t kImageCols = 640;
+    constexpr int32_t kImageBorder = 32;
+    constexpr float kShiftX = 2.6f;
+    constexpr float kShiftY = -1.7f;
+    constexpr uint32_t kDefaultNumberOfWarmUp = 3;
+    constexpr uint32_t kDefaultNumberOfRepeat = 30;
+    constexpr uint32_t kDefaultNumThreads = 1;
+
+    const std::vector<int32_t> kHalfPatchSizes = {3, 5, 7};
+    const std::vector<uint32_t> kPyramidLevels = {1, 3, 4};
+    const std::vector<uint32_t> kNumbersOfFeatures = {100, 300, 1000};
+    const std::vector<uint32_t> kNumbersOfDescriptors = {100, 300, 1000};
+
+    // Camera intrinsics and depth of all points for direct method.
+    constexpr float kFx = 500.0f;
+    constexpr float kFy = 500.0f;
+    constexpr float kCx = 320.0f;
+    constexpr float kCy = 240.0f;
+    constexpr float kDepth = 5.0f;
+}
+
+void GenerateFeatures(uint32_t num_features, std::vector<Vec2> &pixel_uv, float border = kImageBorder) {
+    std::mt19937 generator(0);
+    std::uniform_real_distribution<float> distribution_u(border, kImageCols - border);
+    std::uniform_real_distribution<float> distribution_v(border, kImageRows - border);
+    pixel_uv.clear();
+    pixel_uv.reserve(num_features);
+    for (uint32_t i = 0; i < num_features; ++i) {
+        pixel_uv.emplace_back(Vec2(distribution_u(generator), distribution_v(generator)));
+    }
+}
+
+/* Benchmark case and its statistics. */
+struct BenchmarkResult {
+    std::string tracker;
+    std::string method;
+    int32_t half_patch_size = 0;
+    uint32_t pyramid_level = 0;
+    uint32_t num_features = 0;
+    uint32_t num_repeat = 0;
+    float mean_ms = 0.0f;
+    float median_ms = 0.0f;
+    float p99_ms = 0.0f;
+    float min_ms = 0.0f;
+    float max_ms = 0.0f;
+    float features_per_second = 0.0f;
+    float tracked_ratio = 0.0f;
+};
+
+struct BenchmarkOptions {
+    uint32_t kNumberOfWarmUp = kDefaultNumberOfWarmUp;
+    uint32_t kNumberOfRepeat = kDefaultNumberOfRepeat;
+    uint32_t kNumThreads = kDefaultNumThreads;
+};
+
+// Run one case with warm-up and repeats. Each run returns the number of tracked features.
+void Measure(const BenchmarkOptions &options, const std::function<uint32_t()> &run, BenchmarkResult &result) {
+    for (uint32_t i = 0; i < options.kNumberOfWarmUp; ++i) {
+        run();
+    }
+
+    std::vector<float> cost_times;
+    cost_times.reserve(options.kNumberOfRepeat);
+    uint32_t num_tracked = 0;
+    for (uint32_t i = 0; i < options.kNumberOfRepeat; ++i) {
+        TickTock timer;
+        num_tracked = run();
+        cost_times.emplace_back(timer.TockTickInMillisecond());
+    }
+
+    std::sort(cost_times.begin(), cost_times.end());
+    float sum = 0.0f;
+    for (const float &cost_time : cost_times) {
+        sum += cost_time;
+    }
+    const auto percentile = [&] (float ratio) {
+        return cost_times[static_cast<uint32_t>(ratio * static_cast<float>(cost_times.size() - 1))];
+    };
+
+    result.num_repeat = options.kNumberOfRepeat;
+    result.mean_ms = sum / static_cast<float>(cost_times.size());
+    result.median_ms = percentile(0.5f);
+    result.p99_ms = percentile(0.99f);
+    result.min_ms = cost_times.front();
+    result.max_ms = cost_times.back();
+    result.features_per_second = result.median_ms > 0.0f ? static_cast<float>(result.num_features) * 1000.0f / result.median_ms : 0.0f;
+    result.tracked_ratio = result.num_features > 0 ? static_cast<float>(num_tracked) / static_cast<float>(result.num_features) : 0.0f;
+
+    ReportInfo(result.tracker << " " << result.method << " patch " << result.half_patch_size << " level " << result.pyramid_level <<
+        " features " << result.num_features << " : median " << result.median_ms << " ms, p99 " << result.p99_ms <<
+        " ms, " << result.features_per_second << " features/s, tracked " << result.tracked_ratio * 100.0f << "%.");
+}
+
+uint32_t CountTracked(const std::vector<uint8_t> &status) {
+    return std::count(status.begin(), status.end(), static_cast<uint8_t>(FEATURE_TRACKER::TrackStatus::kTracked));
+}
+
+/* Optical flow trackers. */
+template <typename KltType>
+void BenchmarkOpticalFlow(const std::string &name,
+                          const SyntheticFlowGenerator &generator,
+                          const BenchmarkOptions &options,
+                          std::vector<BenchmarkResult> &results) {
+    const std::vector<std::pair<FEATURE_TRACKER::OpticalFlowMethod, std::string>> methods = {
+        {FEATURE_TRACKER::OpticalFlowMethod::kInverse, "inverse"},
+        {FEATURE_TRACKER::OpticalFlowMethod::kDirect, "direct"},
+        {FEATURE_TRACKER::OpticalFlowMethod::kFast, "fast"},
+        {FEATURE_TRACKER::OpticalFlowMethod::kSse, "sse"},
+    };
+
+    for (const uint32_t pyramid_level : kPyramidLevels) {
+        TestImagePyramid ref_pyramid(generator.ref_image(), pyramid_level);
+        TestImagePyramid cur_pyramid(generator.cur_image(), pyramid_level);
+
+        for (const uint32_t num_features : kNumbersOfFeatures) {
+            std::vector<Vec2> ref_pixel_uv;
+            GenerateFeatures(num_features, ref_pixel_uv);
+
+            for (const auto &method : methods) {
+                for (const int32_t half_patch_size : kHalfPatchSizes) {
+                    KltType klt;
+                    klt.options().kPatchRowHalfSize = half_patch_size;
+                    klt.options().kPatchColHalfSize = half_patch_size;
+                    klt.options().kMethod = method.first;
+                    klt.options().kMaxTrackPointsNumber = num_features;
+                    klt.options().kNumThreads = options.kNumThreads;
+
+                    std::vector<Vec2> cur_pixel_uv;
+                    std::vector<uint8_t> status;
+                    BenchmarkResult result;
+                    result.tracker = name;
+                    result.method = method.second;
+                    result.half_patch_size = half_patch_size;
+                    result.pyramid_level = pyramid_level;
+                    result.num_features = num_features;
+                    Measure(options, [&] () {
+                        cur_pixel_uv.clear();
+                        status.clear();
+                        klt.TrackFeatures(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+                        return CountTracked(status);
+                    }, result);
+                    results.emplace_back(result);
+                }
+            }
+        }
+    }
+}
+
+/* Frame-to-frame tracking, which rebuilds both pyramids or reuses them in ring. */
+void BenchmarkSequence(const SyntheticFlowGenerator &generator,
+                       const BenchmarkOptions &options,
+                       std::vector<BenchmarkResult> &results) {
+    constexpr uint32_t kPyramidLevel = 4;
+    constexpr uint32_t kNumFeatures = 300;
+    constexpr int32_t kHalfPatchSize = 5;
+
+    // Sequence alternates between two frames. Features of each frame are tracked into the other one.
+    const std::array<const GrayImage *, 2> images = {&generator.ref_image(), &generator.cur_image()};
+    std::array<std::vector<Vec2>, 2> pixel_uv;
+    GenerateFeatures(kNumFeatures, pixel_uv[0]);
+    pixel_uv[1] = pixel_uv[0];
+    for (Vec2 &uv : pixel_uv[1]) {
+        uv += Vec2(kShiftX, kShiftY);
+    }
+
+    FEATURE_TRACKER::OpticalFlowBasicKlt klt;
+    klt.options().kPatchRowHalfSize = kHalfPatchSize;
+    klt.options().kPatchColHalfSize = kHalfPatchSize;
+    klt.options().kMethod = FEATURE_TRACKER::OpticalFlowMethod::kFast;
+    klt.options().kMaxTrackPointsNumber = kNumFeatures;
+    klt.options().kNumThreads = options.kNumThreads;
+
+    std::vector<Vec2> cur_pixel_uv;
+    std::vector<uint8_t> status;
+    BenchmarkResult result;
+    result.tracker = "basic_klt_sequence";
+    result.half_patch_size = kHalfPatchSize;
+    result.pyramid_level = kPyramidLevel;
+    result.num_features = kNumFeatures;
+
+    // Allocate and build pyramids of both frames for each frame.
+    uint32_t frame_idx = 0;
+    result.method = "rebuild";
+    Measure(options, [&] () {
+        const uint32_t ref_idx = frame_idx % 2;
+        const uint32_t cur_idx = 1 - ref_idx;
+        ++frame_idx;
+        TestImagePyramid ref_pyramid(*images[ref_idx], kPyramidLevel);
+        TestImagePyramid cur_pyramid(*images[cur_idx], kPyramidLevel);
+        cur_pixel_uv.clear();
+        status.clear();
+        klt.TrackFeatures(ref_pyramid, cur_pyramid, pixel_uv[ref_idx], cur_pixel_uv, status);
+        return CountTracked(status);
+    }, result);
+    results.emplace_back(result);
+
+    // Build pyramid only for new frame, and reuse the last one as reference.
+    FEATURE_TRACKER::OpticalFlowSequenceTracker sequence_tracker(&klt);
+    sequence_tracker.options().kPyramidLevel = kPyramidLevel;
+    sequence_tracker.PushFrame(*images[0]);
+    frame_idx = 0;
+    result.method = "pyramid_ring";
+    Measure(options, [&] () {
+        const uint32_t ref_idx = frame_idx % 2;
+        const uint32_t cur_idx = 1 - ref_idx;
+        ++frame_idx;
+        cur_pixel_uv.clear();
+        status.clear();
+        sequence_tracker.PushFrameAndTrackFeatures(*images[cur_idx], pixel_uv[ref_idx], cur_pixel_uv, status);
+        return CountTracked(status);
+    }, result);
+    results.emplace_back(result);
+
+    // Features over the whole image, so that some of them are near edge. Padded pyramid is copied for each pushed
+    // frame, and its cost is included in frame time. Fast method only reads reference patches from padded buffer, while
+    // sse method also reads current patches from it.
+    std::array<std::vector<Vec2>, 2> whole_image_pixel_uv;
+    GenerateFeatures(kNumFeatures, whole_image_pixel_uv[0], 0.0f);
+    whole_image_pixel_uv[1] = whole_image_pixel_uv[0];
+    for (Vec2 &uv : whole_image_pixel_uv[1]) {
+        uv += Vec2(kShiftX, kShiftY);
+    }
+    const std::vector<std::pair<FEATURE_TRACKER::OpticalFlowMethod, std::string>> methods = {
+        {FEATURE_TRACKER::OpticalFlowMethod::kFast, "fast"},
+        {FEATURE_TRACKER::OpticalFlowMethod::kSse, "sse"},
+    };
+    for (const auto &method : methods) {
+        for (const int32_t padded_border : {0, kHalfPatchSize + 2}) {
+            klt.options().kMethod = method.first;
+            FEATURE_TRACKER::OpticalFlowSequenceTracker whole_image_tracker(&klt);
+            whole_image_tracker.options().kPyramidLevel = kPyramidLevel;
+            whole_image_tracker.options().kPaddedBorder = padded_border;
+            whole_image_tracker.PushFrame(*images[0]);
+            frame_idx = 0;
+            result.method = "whole_image_" + method.second + (padded_border > 0 ? "_padded" : "");
+            Measure(options, [&] () {
+                const uint32_t ref_idx = frame_idx % 2;
+                const uint32_t cur_idx = 1 - ref_idx;
+                ++frame_idx;
+                cur_pixel_uv.clear();
+                status.clear();
+                whole_image_tracker.PushFrameAndTrackFeatures(*images[cur_idx], whole_image_pixel_uv[ref_idx], cur_pixel_uv, status);
+                return CountTracked(status);
+            }, result);
+            results.emplace_back(result);
+        }
+    }
+}
+
+/* Batch of frames tracked by sequence tracker on caller thread, or by async tracker in pipeline. */
+void BenchmarkPipeline(const SyntheticFlowGenerator &generator,
+                       const BenchmarkOptions &options,
+                       std::vector<BenchmarkResult> &results) {
+    constexpr uint32_t kPyramidLevel = 4;
+    constexpr uint32_t kNumFeatures = 300;
+    constexpr int32_t kHalfPatchSize = 5;
+    constexpr uint32_t kNumFramesInBatch = 16;
+
+    const std::array<const GrayImage *, 2> images = {&generator.ref_image(), &generator.cur_image()};
+    std::array<std::vector<Vec2>, 2> pixel_uv;
+    GenerateFeatures(kNumFeatures, pixel_uv[0]);
+    pixel_uv[1] = pixel_uv[0];
+    for (Vec2 &uv : pixel_uv[1]) {
+        uv += Vec2(kShiftX, kShiftY);
+    }
+
+    FEATURE_TRACKER::OpticalFlowBasicKlt klt;
+    klt.options().kPatchRowHalfSize = kHalfPatchSize;
+    klt.options().kPatchColHalfSize = kHalfPatchSize;
+    klt.options().kMethod = FEATURE_TRACKER::OpticalFlowMethod::kFast;
+    klt.options().kMaxTrackPointsNumber = kNumFeatures;
+    klt.options().kNumThreads = options.kNumThreads;
+
+    BenchmarkResult result;
+    result.tracker = "basic_klt_batch_" + std::to_string(kNumFramesInBatch);
+    result.half_patch_size = kHalfPatchSize;
+    result.pyramid_level = kPyramidLevel;
+    result.num_features = kNumFeatures * kNumFramesInBatch;
+
+    // Build pyramid and track features one after another.
+    std::vector<Vec2> cur_pixel_uv;
+    std::vector<uint8_t> status;
+    FEATURE_TRACKER::OpticalFlowSequenceTracker sequence_tracker(&klt);
+    sequence_tracker.options().kPyramidLevel = kPyramidLevel;
+    sequence_tracker.PushFrame(*images[0]);
+    uint32_t frame_idx = 0;
+    result.method = "sequence";
+    Measure(options, [&] () {
+        uint32_t num_tracked = 0;
+        for (uint32_t i = 0; i < kNumFramesInBatch; ++i) {
+            const uint32_t ref_idx = frame_idx % 2;
+            ++frame_idx;
+            cur_pixel_uv.clear();
+            status.clear();
+            sequence_tracker.PushFrameAndTrackFeatures(*images[1 - ref_idx], pixel_uv[ref_idx], cur_pixel_uv, status);
+            num_tracked += CountTracked(status);
+        }
+        return num_tracked;
+    }, result);
+    results.emplace_back(result);
+
+    // Build pyramid of next frame while tracking features of this frame.
+    FEATURE_TRACKER::OpticalFlowAsyncTrackerOptions async_options;
+    async_options.kPyramidLevel = kPyramidLevel;
+    FEATURE_TRACKER::OpticalFlowAsyncTracker async_tracker(&klt, async_options);
+    std::atomic<uint32_t> num_tracked { 0 };
+    float sum_latency_ms = 0.0f;
+    const FEATURE_TRACKER::OpticalFlowAsyncTracker::Callback callback = [&] (FEATURE_TRACKER::AsyncFrameResult &frame_result) {
+        num_tracked += CountTracked(frame_result.status);
+        sum_latency_ms += frame_result.latency_ms;
+    };
+    frame_idx = 0;
+    async_tracker.SubmitFrame(*images[0], &pixel_uv[0], callback);
+    async_tracker.Flush();
+    result.method = "async_pipeline";
+    Measure(options, [&] () {
+        num_tracked = 0;
+        for (uint32_t i = 0; i < kNumFramesInBatch; ++i) {
+            ++frame_idx;
+            const uint32_t cur_idx = frame_idx % 2;
+            async_tracker.SubmitFrame(*images[cur_idx], &pixel_uv[cur_idx], callback);
+        }
+        async_tracker.Flush();
+        return num_tracked.load();
+    }, result);
+    results.emplace_back(result);
+    ReportInfo("async_pipeline : mean latency " << sum_latency_ms / static_cast<float>(async_tracker.num_submitted_frames()) << " ms.");
+}
+
+/* Direct method tracker. */
+void BenchmarkDirectMethod(const SyntheticFlowGenerator &generator,
+                           const BenchmarkOptions &options,
+                           std::vector<BenchmarkResult> &results) {
+    // Inverse and fast methods of direct method tracker are not implemented yet.
+    const std::vector<std::pair<FEATURE_TRACKER::DirectMethodMethod, std::string>> methods = {
+        {FEATURE_TRACKER::DirectMethodMethod::kDirect, "direct"},
+    };
+    const std::array<float, 4> K = {kFx, kFy, kCx, kCy};
+
+    for (const uint32_t pyramid_level : kPyramidLevels) {
+        TestImagePyramid ref_pyramid(generator.ref_image(), pyramid_level);
+        TestImagePyramid cur_pyramid(generator.cur_image(), pyramid_level);
+
+        for (const uint32_t num_features : kNumbersOfFeatures) {
+            // All points lie on a fronto-parallel plane, so that image shift is caused by translation of camera.
+            std::vector<Vec2> ref_pixel_uv;
+            GenerateFeatures(num_features, ref_pixel_uv);
+            std::vector<Vec3> p_w;
+            p_w.reserve(ref_pixel_uv.size());
+            for (const Vec2 &pixel_uv : ref_pixel_uv) {
+                p_w.emplace_back(Vec3((pixel_uv.x() - kCx) / kFx, (pixel_uv.y() - kCy) / kFy, 1.0f) * kDepth);
+            }
+
+            for (const auto &method : methods) {
+                for (const int32_t half_patch_size : kHalfPatchSizes) {
+                    FEATURE_TRACKER::DirectMethod solver;
+                    solver.options().kPatchRowHalfSize = half_patch_size;
+                    solver.options().kPatchColHalfSize = half_patch_size;
+                    solver.options().kMethod = method.first;
+                    solver.options().kMaxTrackPointsNumber = num_features;
+                    solver.options().kNumThreads = options.kNumThreads;
+
+                    std::vector<Vec2> cur_pixel_uv;
+                    std::vector<uint8_t> status;
+                    BenchmarkResult result;
+                    result.tracker = "direct_method";
+                    result.method = method.second;
+                    result.half_patch_size = half_patch_size;
+                    result.pyramid_level = pyramid_level;
+                    result.num_features = num_features;
+                    Measure(options, [&] () {
+                        Quat q_cur = Quat::Identity();
+                        Vec3 p_cur = Vec3::Zero();
+                        cur_pixel_uv.clear();
+                        status.clear();
+                        solver.TrackFeatures(ref_pyramid, cur_pyramid, K, Quat::Identity(), Vec3::Zero(), p_w, ref_pixel_uv,
+                            cur_pixel_uv, q_cur, p_cur, status);
+                        return CountTracked(status);
+                    }, result);
+                    results.emplace_back(result);
+                }
+            }
+        }
+    }
+}
+
+/* Descriptor matcher. */
+using BinaryDescriptor = std::array<uint64_t, 4>;
+
+class BinaryMatcher : public FEATURE_TRACKER::DescriptorMatcher<BinaryDescriptor> {
+
+public:
+    BinaryMatcher() : FEATURE_TRACKER::DescriptorMatcher<BinaryDescriptor>() {}
+    virtual ~BinaryMatcher() = default;
+
+    virtual float ComputeDistance(const BinaryDescriptor &descriptor_ref,
+                                  const BinaryDescriptor &descriptor_cur) override {
+        int32_t distance = 0;
+        for (uint32_t i = 0; i < descriptor_ref.size(); ++i) {
+            distance += __builtin_popcountll(descriptor_ref[i] ^ descriptor_cur[i]);
+        }
+        return static_cast<float>(distance);
+    }
+};
+
+void BenchmarkDescriptorMatcher(const BenchmarkOptions &options,
+                                std::vector<BenchmarkResult> &results) {
+    std::mt19937_64 generator(0);
+    for (const uint32_t num_descriptors : kNumbersOfDescriptors) {
+        // Descriptors in current frame are noisy copies of reference, observed at shifted positions.
+        std::vector<BinaryDescriptor> descriptors_ref(num_descriptors);
+        std::vector<BinaryDescriptor> descriptors_cur(num_descriptors);
+        for (uint32_t i = 0; i < num_descriptors; ++i) {
+            for (uint32_t j = 0; j < descriptors_ref[i].size(); ++j) {
+                descriptors_ref[i][j] = generator();
+                descriptors_cur[i][j] = descriptors_ref[i][j] ^ (generator() & generator() & generator() & generator());
+            }
+        }
+        std::vector<Vec2> pixel_uv_pred_in_cur;
+        GenerateFeatures(num_descriptors, pixel_uv_pred_in_cur);
+        std::vector<Vec2> pixel_uv_cur = pixel_uv_pred_in_cur;
+        for (Vec2 &pixel_uv : pixel_uv_cur) {
+            pixel_uv += Vec2(kShiftX, kShiftY);
+        }
+
+        BinaryMatcher matcher;
+        matcher.options().kMaxValidDescriptorDistance = 64.0f;
+
+        std::vector<Vec2> matched_pixel_uv_cur;
+        std::vector<uint8_t> status;
+        BenchmarkResult result;
+        result.tracker = "descriptor_matcher";
+        result.num_features = num_descriptors;
+
+        result.method = "force";
+        Measure(options, [&] () {
+            matched_pixel_uv_cur.clear();
+            status.clear();
+            matcher.ForceMatch(descriptors_ref, descriptors_cur, pixel_uv_cur, matched_pixel_uv_cur, status);
+            return CountTracked(status);
+        }, result);
+        results.emplace_back(result);
+
+        result.method = "nearby";
+        Measure(options, [&] () {
+            matched_pixel_uv_cur.clear();
+            status.clear();
+            matcher.NearbyMatch(descriptors_ref, descriptors_cur, pixel_uv_pred_in_cur, pixel_uv_cur, matched_pixel_uv_cur, status);
+            return CountTracked(status);
+        }, result);
+        results.emplace_back(result);
+    }
+}
+
+/* Machine-readable report. */
+std::string ReportInJson(const std::vector<BenchmarkResult> &results) {
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(4) << "{\n  \"image_size\": [" << kImageCols << ", " << kImageRows << "],\n  \"results\": [\n";
+    for (uint32_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult &result = results[i];
+        stream << "    {\"tracker\": \"" << result.tracker << "\", \"method\": \"" << result.method << "\", " <<
+            "\"half_patch_size\": " << result.half_patch_size << ", \"pyramid_level\": " << result.pyramid_level << ", " <<
+            "\"features\": " << result.num_features << ", \"repeat\": " << result.num_repeat << ", " <<
+            "\"mean_ms\": " << result.mean_ms << ", \"median_ms\": " << result.median_ms << ", \"p99_ms\": " << result.p99_ms << ", " <<
+            "\"min_ms\": " << result.min_ms << ", \"max_ms\": " << result.max_ms << ", " <<
+            "\"features_per_second\": " << result.features_per_second << ", \"tracked_ratio\": " << result.tracked_ratio << "}" <<
+            (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    stream << "  ]\n}\n";
+    return stream.str();
+}
+
+std::string ReportInCsv(const std::vector<BenchmarkResult> &results) {
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(4);
+    stream << "tracker,method,half_patch_size,pyramid_level,features,repeat,mean_ms,median_ms,p99_ms,min_ms,max_ms,features_per_second,tracked_ratio\n";
+    for (const BenchmarkResult &result : results) {
+        stream << result.tracker << "," << result.method << "," << result.half_patch_size << "," << result.pyramid_level << "," <<
+            result.num_features << "," << result.num_repeat << "," << result.mean_ms << "," << result.median_ms << "," <<
+            result.p99_ms << "," << result.min_ms << "," << result.max_ms << "," << result.features_per_second << "," <<
+            result.tracked_ratio << "\n";
+    }
+    return stream.str();
+}
+
+// Usage : bench_feature_tracker [output file, .json or .csv] [number of repeat] [number of threads]
+int main(int argc, char **argv) {
+    const std::string output_file_name = argc > 1 ? argv[1] : "bench_feature_tracker.json";
+    BenchmarkOptions options;
+    options.kNumberOfRepeat = argc > 2 ? static_cast<uint32_t>(std::max(1, std::stoi(argv[2]))) : kDefaultNumberOfRepeat;
+    options.kNumThreads = argc > 3 ? static_cast<uint32_t>(std::max(1, std::stoi(argv[3]))) : kDefaultNumThreads;
+    ReportInfo(YELLOW ">> Benchmark feature trackers with " << options.kNumberOfRepeat << " repeats and " <<
+        options.kNumThreads << " threads." RESET_COLOR);
+    const std::vector<std::string> simd_level_names = { "scalar", "sse4", "avx2" };
+    ReportInfo("Sse method runs with simd level " << simd_level_names[static_cast<uint32_t>(FEATURE_TRACKER::OpticalFlow::DetectSimdLevel())] << ".");
+
+    // Render frames from procedural texture with a known shift, so that benchmark needs neither image files nor display.
+    SyntheticFlowGenerator generator;
+    SyntheticWarp warp;
+    warp.name = "translation";
+    warp.translation = Vec2(kShiftX, kShiftY);
+    generator.SetProceduralSource(kImageRows, kImageCols);
+    generator.Generate(warp);
+
+    std::vector<BenchmarkResult> results;
+    BenchmarkOpticalFlow<FEATURE_TRACKER::OpticalFlowBasicKlt>("basic_klt", generator, options, results);
+    BenchmarkOpticalFlow<FEATURE_TRACKER::OpticalFlowAffineKlt>("affine_klt", generator, options, results);
+    BenchmarkOpticalFlow<FEATURE_TRACKER::OpticalFlowLssdKlt>("lssd_klt", generator, options, results);
+    BenchmarkSequence(generator, options, results);
+    BenchmarkPipeline(generator, options, results);
+    BenchmarkDirectMethod(generator, options, results);
+    BenchmarkDescriptorMatcher(options, results);
+
+    // Save report in csv if file name ends with .csv, otherwise in json.
+    const std::string csv_suffix = ".csv";
+    const bool is_csv = output_file_name.size() >= csv_suffix.size() &&
+        output_file_name.compare(output_file_name.size() - csv_suffix.size(), csv_suffix.size(), csv_suffix) == 0;
+    std::ofstream file(output_file_name);
+    if (!file.is_open()) {
+        ReportError("Failed to open " << output_file_name << ".");
+        return -1;
+    }
+    file << (is_csv ? ReportInCsv(results) : ReportInJson(results));
+    ReportInfo("Saved " << results.size() << " results to " << output_file_name << ".");
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include "iostream"
+#include "cstdint"
+#include "string"
+#include "vector"
+#include "algorithm"
+#include "thread"
+
+#include "slam_log_reporter.h"
+#include "tick_tock.h"
+#include "visualizor_2d.h"
+
+#include "feature_point_detector.h"
+#include "feature_harris.h"
+
+#include "optical_flow_basic_klt.h"
+#include "optical_flow_affine_klt.h"
+#include "optical_flow_lssd_klt.h"
+
+#include "test_image_pyramid.h"
+
+using namespace SLAM_VISUALIZOR;
+
+namespace {
+    constexpr int32_t kMaxNumberOfFeaturesToTrack = 500;
+    constexpr int32_t kHalfPatchSize = 6;
+    constexpr int32_t kMaxPyramidLevel = 4;
+    constexpr int32_t kNumberOfRepeat = 200;
+    constexpr uint32_t kDefaultNumThreads = 4;
+}
+
+std::string test_ref_image_file_name = "../example/optical_flow/ref_image.png";
+std::string test_cur_image_file_name = "../example/optical_flow/cur_image.png";
+
+void DetectFeatures(const GrayImage &image, std::vector<Vec2> &pixel_uv) {
+    FEATURE_DETECTOR::FeaturePointDetector<FEATURE_DETECTOR::HarrisFeature> detector;
+    detector.options().kMinFeatureDistance = 15;
+    detector.feature().options().kHalfPatchSize = 1;
+    detector.feature().options().kMinValidResponse = 40.0f;
+    detector.DetectGoodFeatures(image, kMaxNumberOfFeaturesToTrack, pixel_uv);
+}
+
+void ReportLatency(const std::string &name, std::vector<float> &cost_times) {
+    std::sort(cost_times.begin(), cost_times.end());
+    float sum = 0.0f;
+    for (const float &cost_time : cost_times) {
+        sum += cost_time;
+    }
+    const auto percentile = [&] (float ratio) {
+        return cost_times[static_cast<uint32_t>(ratio * static_cast<float>(cost_times.size() - 1))];
+    };
+    ReportInfo(name << " : mean " << sum / static_cast<float>(cost_times.size()) << " ms, p50 " << percentile(0.5f) <<
+        " ms, p90 " << percentile(0.9f) << " ms, p99 " << percentile(0.99f) << " ms, max " << cost_times.back() << " ms.");
+}
+
+template <typename KltType>
+void BenchmarkOpticalFlow(const std::string &name,
+                          const ImagePyramid &ref_pyramid,
+                          const ImagePyramid &cur_pyramid,
+                          const std::vector<Vec2> &ref_pixel_uv,
+                          uint32_t num_threads) {
+    for (const auto schedule : {FEATURE_TRACKER::ThreadPoolSchedule::kStatic, FEATURE_TRACKER::ThreadPoolSchedule::kWorkStealing}) {
+        KltType klt;
+        klt.options().kPatchRowHalfSize = kHalfPatchSize;
+        klt.options().kPatchColHalfSize = kHalfPatchSize;
+        klt.options().kMethod = FEATURE_TRACKER::OpticalFlowMethod::kFast;
+        klt.options().kMaxTrackPointsNumber = kMaxNumberOfFeaturesToTrack;
+        klt.options().kNumThreads = num_threads;
+        klt.options().kThreadSchedule = schedule;
+
+        std::vector<Vec2> cur_pixel_uv;
+        std::vector<uint8_t> status;
+        std::vector<float> cost_times;
+        cost_times.reserve(kNumberOfRepeat);
+        for (int32_t i = 0; i < kNumberOfRepeat; ++i) {
+            cur_pixel_uv.clear();
+            status.clear();
+            TickTock timer;
+            klt.TrackFeatures(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+            cost_times.emplace_back(timer.TockTickInMillisecond());
+        }
+
+        ReportLatency(name + (schedule == FEATURE_TRACKER::ThreadPoolSchedule::kStatic ? " static       " : " work stealing"), cost_times);
+    }
+}
+
+int main(int argc, char **argv) {
+    const uint32_t num_threads = argc > 1 ? static_cast<uint32_t>(std::stoi(argv[1])) : kDefaultNumThreads;
+    ReportInfo(YELLOW ">> Benchmark thread schedule of optical flow with " << num_threads << " threads." RESET_COLOR);
+
+    // Load images.
+    GrayImage ref_image;
+    GrayImage cur_image;
+    Visualizor2D::LoadImage(test_ref_image_file_name, ref_image);
+    Visualizor2D::LoadImage(test_cur_image_file_name, cur_image);
+
+    // Generate image pyramids.
+    TestImagePyramid ref_pyramid(ref_image, kMaxPyramidLevel);
+    TestImagePyramid cur_pyramid(cur_image, kMaxPyramidLevel);
+
+    // Detect features.
+    std::vector<Vec2> ref_pixel_uv;
+    DetectFeatures(ref_image, ref_pixel_uv);
+    ReportInfo("Detected " << ref_pixel_uv.size() << " features.");
+
+    BenchmarkOpticalFlow<FEATURE_TRACKER::OpticalFlowBasicKlt>("Basic klt ", ref_pyramid, cur_pyramid, ref_pixel_uv, num_threads);
+    BenchmarkOpticalFlow<FEATURE_TRACKER::OpticalFlowAffineKlt>("Affine klt", ref_pyramid, cur_pyramid, ref_pixel_uv, num_threads);
+    BenchmarkOpticalFlow<FEATURE_TRACKER::OpticalFlowLssdKlt>("Lssd klt  ", ref_pyramid, cur_pyramid, ref_pixel_uv, num_threads);
+
+    return 0;
+}
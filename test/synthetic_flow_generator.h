@@ -0,0 +1,204 @@
+#ifndef _SYNTHETIC_FLOW_GENERATOR_H_
+#define _SYNTHETIC_FLOW_GENERATOR_H_
+
+#include "basic_type.h"
+#include "datatype_image.h"
+
+#include "cmath"
+#include "string"
+#include "vector"
+#include "random"
+#include "algorithm"
+
+/* Known warp from reference frame to current frame. */
+// Pixel moves as cur = linear * (ref - center) + center + translation, and its intensity changes as
+// cur = gain * ref + bias + noise.
+struct SyntheticWarp {
+    std::string name;
+    Mat2 linear = Mat2::Identity();
+    Vec2 translation = Vec2::Zero();
+    float brightness_gain = 1.0f;
+    float brightness_bias = 0.0f;
+    float noise_sigma = 0.0f;
+
+    Vec2 Apply(const Vec2 &ref_pixel_uv, const Vec2 &center) const {
+        return linear * (ref_pixel_uv - center) + center + translation;
+    }
+};
+
+/* Class Synthetic Flow Generator Declaration. */
+// Render a pair of frames with ground truth flow, from a procedural texture or a given image.
+class SyntheticFlowGenerator {
+
+public:
+    SyntheticFlowGenerator() = default;
+    virtual ~SyntheticFlowGenerator() = default;
+    SyntheticFlowGenerator(const SyntheticFlowGenerator &generator) = delete;
+    SyntheticFlowGenerator &operator=(const SyntheticFlowGenerator &generator) = delete;
+
+    // Use smooth procedural texture as source, so that warped frame is sampled exactly.
+    void SetProceduralSource(int32_t rows, int32_t cols);
+    // Use a copy of given image as source. Warped frame is sampled with bilinear interpolation.
+    void SetImageSource(const GrayImage &image);
+
+    // Render reference frame from source, and current frame by warping it.
+    void Generate(const SyntheticWarp &warp, uint32_t seed = 0);
+
+    // Select features with strong texture in reference frame, whose ground truth is still inside current frame.
+    void SelectFeatures(uint32_t max_number, int32_t border, std::vector<Vec2> &ref_pixel_uv, std::vector<Vec2> &gt_cur_pixel_uv) const;
+
+    // Const reference for member variables.
+    const GrayImage &ref_image() const { return ref_image_; }
+    const GrayImage &cur_image() const { return cur_image_; }
+    const SyntheticWarp &warp() const { return warp_; }
+    Vec2 center() const { return Vec2(static_cast<float>(cols_ - 1) * 0.5f, static_cast<float>(rows_ - 1) * 0.5f); }
+
+private:
+    static float SampleTexture(float x, float y);
+    float SampleSource(float x, float y) const;
+
+private:
+    int32_t rows_ = 0;
+    int32_t cols_ = 0;
+    bool is_procedural_ = true;
+    std::vector<uint8_t> source_data_;
+    SyntheticWarp warp_;
+
+    std::vector<uint8_t> ref_data_;
+    std::vector<uint8_t> cur_data_;
+    GrayImage ref_image_;
+    GrayImage cur_image_;
+
+};
+
+/* Class Synthetic Flow Generator Definition. */
+inline void SyntheticFlowGenerator::SetProceduralSource(int32_t rows, int32_t cols) {
+    rows_ = rows;
+    cols_ = cols;
+    is_procedural_ = true;
+    source_data_.clear();
+}
+
+inline void SyntheticFlowGenerator::SetImageSource(const GrayImage &image) {
+    rows_ = image.rows();
+    cols_ = image.cols();
+    is_procedural_ = false;
+    source_data_.assign(image.data(), image.data() + rows_ * cols_);
+}
+
+inline void SyntheticFlowGenerator::Generate(const SyntheticWarp &warp, uint32_t seed) {
+    warp_ = warp;
+    ref_data_.resize(rows_ * cols_);
+    cur_data_.resize(rows_ * cols_);
+
+    std::mt19937 generator(seed);
+    std::normal_distribution<float> noise(0.0f, std::max(warp.noise_sigma, 1e-6f));
+    const Mat2 inv_linear = warp.linear.inverse();
+    const Vec2 image_center = center();
+
+    for (int32_t row = 0; row < rows_; ++row) {
+        for (int32_t col = 0; col < cols_; ++col) {
+            const float ref_value = SampleSource(static_cast<float>(col), static_cast<float>(row));
+            ref_data_[row * cols_ + col] = static_cast<uint8_t>(std::max(0.0f, std::min(255.0f, std::round(ref_value))));
+
+            // Find where this pixel of current frame comes from in reference frame.
+            const Vec2 cur_pixel_uv = Vec2(static_cast<float>(col), static_cast<float>(row));
+            const Vec2 ref_pixel_uv = inv_linear * (cur_pixel_uv - image_center - warp.translation) + image_center;
+            float cur_value = warp.brightness_gain * SampleSource(ref_pixel_uv.x(), ref_pixel_uv.y()) + warp.brightness_bias;
+            if (warp.noise_sigma > 0.0f) {
+                cur_value += noise(generator);
+            }
+            cur_data_[row * cols_ + col] = static_cast<uint8_t>(std::max(0.0f, std::min(255.0f, std::round(cur_value))));
+        }
+    }
+
+    ref_image_.SetImage(ref_data_.data(), rows_, cols_);
+    cur_image_.SetImage(cur_data_.data(), rows_, cols_);
+}
+
+inline void SyntheticFlowGenerator::SelectFeatures(uint32_t max_number,
+                                                   int32_t border,
+                                                   std::vector<Vec2> &ref_pixel_uv,
+                                                   std::vector<Vec2> &gt_cur_pixel_uv) const {
+    constexpr int32_t kStep = 4;
+    constexpr int32_t kHalfWindow = 3;
+    constexpr float kMinFeatureDistance = 8.0f;
+
+    // Score candidates on a grid by min eigen value of structure tensor.
+    std::vector<std::pair<float, Vec2>> candidates;
+    const Vec2 image_center = center();
+    const auto pixel = [&] (int32_t row, int32_t col) {
+        return static_cast<float>(ref_data_[row * cols_ + col]);
+    };
+    for (int32_t row = border; row < rows_ - border; row += kStep) {
+        for (int32_t col = border; col < cols_ - border; col += kStep) {
+            const Vec2 gt = warp_.Apply(Vec2(col, row), image_center);
+            if (gt.x() < border || gt.x() > cols_ - 1 - border || gt.y() < border || gt.y() > rows_ - 1 - border) {
+                continue;
+            }
+
+            float gxx = 0.0f;
+            float gxy = 0.0f;
+            float gyy = 0.0f;
+            for (int32_t drow = - kHalfWindow; drow <= kHalfWindow; ++drow) {
+                for (int32_t dcol = - kHalfWindow; dcol <= kHalfWindow; ++dcol) {
+                    const float gx = pixel(row + drow, col + dcol + 1) - pixel(row + drow, col + dcol - 1);
+                    const float gy = pixel(row + drow + 1, col + dcol) - pixel(row + drow - 1, col + dcol);
+                    gxx += gx * gx;
+                    gxy += gx * gy;
+                    gyy += gy * gy;
+                }
+            }
+            const float min_eigen_value = 0.5f * (gxx + gyy - std::sqrt((gxx - gyy) * (gxx - gyy) + 4.0f * gxy * gxy));
+            candidates.emplace_back(min_eigen_value, Vec2(col, row));
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [] (const auto &a, const auto &b) { return a.first > b.first; });
+
+    // Keep the strongest candidates which are far enough from each other.
+    ref_pixel_uv.clear();
+    gt_cur_pixel_uv.clear();
+    for (const auto &candidate : candidates) {
+        if (ref_pixel_uv.size() >= max_number || candidate.first <= 0.0f) {
+            break;
+        }
+        bool is_too_close = false;
+        for (const Vec2 &selected : ref_pixel_uv) {
+            if ((selected - candidate.second).squaredNorm() < kMinFeatureDistance * kMinFeatureDistance) {
+                is_too_close = true;
+                break;
+            }
+        }
+        if (!is_too_close) {
+            ref_pixel_uv.emplace_back(candidate.second);
+            gt_cur_pixel_uv.emplace_back(warp_.Apply(candidate.second, image_center));
+        }
+    }
+}
+
+inline float SyntheticFlowGenerator::SampleTexture(float x, float y) {
+    return 128.0f +
+        40.0f * std::sin(x * 0.11f) * std::cos(y * 0.07f) +
+        30.0f * std::sin(x * 0.05f + y * 0.13f) +
+        25.0f * std::cos(x * 0.23f - y * 0.04f) * std::sin(y * 0.19f) +
+        15.0f * std::sin(x * 0.31f + 1.3f) * std::sin(y * 0.29f + 0.7f);
+}
+
+inline float SyntheticFlowGenerator::SampleSource(float x, float y) const {
+    if (is_procedural_) {
+        return SampleTexture(x, y);
+    }
+
+    // Clamp to border of source image, then sample it with bilinear interpolation.
+    x = std::max(0.0f, std::min(static_cast<float>(cols_ - 1), x));
+    y = std::max(0.0f, std::min(static_cast<float>(rows_ - 1), y));
+    const int32_t col = std::min(static_cast<int32_t>(x), cols_ - 2);
+    const int32_t row = std::min(static_cast<int32_t>(y), rows_ - 2);
+    const float sub_col = x - static_cast<float>(col);
+    const float sub_row = y - static_cast<float>(row);
+    const uint8_t *data = source_data_.data() + row * cols_ + col;
+    return (1.0f - sub_row) * ((1.0f - sub_col) * data[0] + sub_col * data[1]) +
+        sub_row * ((1.0f - sub_col) * data[cols_] + sub_col * data[cols_ + 1]);
+}
+
+#endif // end of _SYNTHETIC_FLOW_GENERATOR_H_
@@ -0,0 +1,339 @@
+#include "iostream"
+#include "cstdint"
+#include "string"
+#include "vector"
+#include "algorithm"
+#include "fstream"
+#include "sstream"
+#include "iomanip"
+
+#include "slam_operations.h"
+#include "slam_log_reporter.h"
+#include "tick_tock.h"
+#include "visualizor_2d.h"
+
+#include "optical_flow_basic_klt.h"
+#include "optical_flow_affine_klt.h"
+#include "optical_flow_lssd_klt.h"
+
+#include "synthetic_flow_generator.h"
+#include "test_image_pyramid.h"
+
+using namespace SLAM_VISUALIZOR;
+
+namespace {
+    constexpr int32_t kProceduralImageRows = 480;
+    constexpr int32_t kProceduralImageCols = 640;
+    constexpr int32_t kFeatureBorder = 24;
+    constexpr uint32_t kMaxNumberOfFeaturesToTrack = 300;
+    constexpr int32_t kHalfPatchSize = 6;
+    constexpr int32_t kMaxPyramidLevel = 4;
+    constexpr uint32_t kNumberOfRepeat = 10;
+}
+
+/* Accuracy and throughput of one method on one warp. */
+struct AccuracyResult {
+    std::string warp;
+    std::string tracker;
+    std::string method;
+    uint32_t num_features = 0;
+    float survival_rate = 0.0f;
+    float mean_endpoint_error = 0.0f;
+    float median_endpoint_error = 0.0f;
+    float p90_endpoint_error = 0.0f;
+    float median_ms = 0.0f;
+    float features_per_second = 0.0f;
+    bool is_sparse_pattern = false;
+    bool is_gated = false;
+    bool is_gate_passed = true;
+};
+
+/* Margin of accuracy gate over baseline. Errors may grow by ratio plus offset, and survival may drop by offset. */
+struct AccuracyGateMargin {
+    float max_survival_rate_drop = 0.02f;
+    float max_endpoint_error_ratio = 1.2f;
+    float max_median_endpoint_error_offset = 0.01f;
+    float max_p90_endpoint_error_offset = 0.02f;
+};
+
+// Each result is gated against result of the same warp, tracker and method in baseline, which is flow_accuracy.csv
+// saved by a former run of this test. Results depend on bilinear sampling of GrayImage, so no absolute threshold is
+// kept here, and baseline should be recorded again when the image library changes.
+bool LoadBaseline(const std::string &file_name, std::vector<AccuracyResult> &baseline) {
+    std::ifstream file(file_name);
+    RETURN_FALSE_IF(!file.is_open());
+
+    std::string line;
+    std::getline(file, line);
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        std::vector<std::string> items;
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            items.emplace_back(item);
+        }
+        CONTINUE_IF(items.size() < 8);
+        AccuracyResult result;
+        result.warp = items[0];
+        result.tracker = items[1];
+        result.method = items[2];
+        result.survival_rate = std::stof(items[4]);
+        result.median_endpoint_error = std::stof(items[6]);
+        result.p90_endpoint_error = std::stof(items[7]);
+        baseline.emplace_back(result);
+    }
+    return !baseline.empty();
+}
+
+const AccuracyResult *FindBaseline(const std::vector<AccuracyResult> &baseline, const AccuracyResult &result) {
+    for (const AccuracyResult &item : baseline) {
+        if (item.warp == result.warp && item.tracker == result.tracker && item.method == result.method) {
+            return &item;
+        }
+    }
+    return nullptr;
+}
+
+void GateResult(const AccuracyResult &baseline, const AccuracyGateMargin &margin, AccuracyResult &result) {
+    result.is_gated = true;
+    // Result which has no tracked feature in baseline can only be checked on survival rate.
+    const bool is_error_passed = baseline.median_endpoint_error < 0.0f || (result.median_endpoint_error >= 0.0f &&
+        result.median_endpoint_error <= baseline.median_endpoint_error * margin.max_endpoint_error_ratio + margin.max_median_endpoint_error_offset &&
+        result.p90_endpoint_error <= baseline.p90_endpoint_error * margin.max_endpoint_error_ratio + margin.max_p90_endpoint_error_offset);
+    result.is_gate_passed = is_error_passed && result.survival_rate >= baseline.survival_rate - margin.max_survival_rate_drop;
+}
+
+// Lssd klt averages patch luminance in inverse and direct method, so fast and sse method do the same.
+void ConfigureTracker(FEATURE_TRACKER::OpticalFlow &klt) {}
+void ConfigureTracker(FEATURE_TRACKER::OpticalFlowLssdKlt &klt) {
+    klt.consider_patch_luminance() = true;
+}
+
+std::vector<SyntheticWarp> CreateWarps() {
+    const auto rotation = [] (float degree) {
+        const float radian = degree * 3.14159265f / 180.0f;
+        Mat2 linear;
+        linear << std::cos(radian), - std::sin(radian), std::sin(radian), std::cos(radian);
+        return linear;
+    };
+
+    std::vector<SyntheticWarp> warps(7);
+    warps[0].name = "translation_small";
+    warps[0].translation = Vec2(1.3f, -0.8f);
+    warps[1].name = "translation_large";
+    warps[1].translation = Vec2(9.4f, 6.2f);
+    warps[2].name = "rotation";
+    warps[2].linear = rotation(4.0f);
+    warps[2].translation = Vec2(1.5f, 1.0f);
+    warps[3].name = "affine";
+    warps[3].linear << 1.04f, 0.03f, -0.02f, 0.97f;
+    warps[3].translation = Vec2(-2.1f, 1.4f);
+    warps[4].name = "brightness";
+    warps[4].translation = Vec2(2.2f, 1.1f);
+    warps[4].brightness_gain = 1.2f;
+    warps[4].brightness_bias = -15.0f;
+    warps[5].name = "noise";
+    warps[5].translation = Vec2(2.2f, 1.1f);
+    warps[5].noise_sigma = 4.0f;
+    warps[6].name = "combined";
+    warps[6].linear = rotation(2.0f) * 1.02f;
+    warps[6].translation = Vec2(4.3f, -3.2f);
+    warps[6].brightness_gain = 0.9f;
+    warps[6].brightness_bias = 10.0f;
+    warps[6].noise_sigma = 2.0f;
+    return warps;
+}
+
+void EvaluateTracking(const std::vector<Vec2> &gt_cur_pixel_uv,
+                      const std::vector<Vec2> &cur_pixel_uv,
+                      const std::vector<uint8_t> &status,
+                      AccuracyResult &result) {
+    std::vector<float> endpoint_errors;
+    endpoint_errors.reserve(gt_cur_pixel_uv.size());
+    for (uint32_t i = 0; i < gt_cur_pixel_uv.size(); ++i) {
+        if (i < status.size() && status[i] == static_cast<uint8_t>(FEATURE_TRACKER::TrackStatus::kTracked)) {
+            endpoint_errors.emplace_back((cur_pixel_uv[i] - gt_cur_pixel_uv[i]).norm());
+        }
+    }
+
+    result.num_features = gt_cur_pixel_uv.size();
+    result.survival_rate = gt_cur_pixel_uv.empty() ? 0.0f : static_cast<float>(endpoint_errors.size()) / static_cast<float>(gt_cur_pixel_uv.size());
+    if (endpoint_errors.empty()) {
+        result.mean_endpoint_error = result.median_endpoint_error = result.p90_endpoint_error = -1.0f;
+        return;
+    }
+
+    std::sort(endpoint_errors.begin(), endpoint_errors.end());
+    float sum = 0.0f;
+    for (const float &error : endpoint_errors) {
+        sum += error;
+    }
+    result.mean_endpoint_error = sum / static_cast<float>(endpoint_errors.size());
+    result.median_endpoint_error = endpoint_errors[(endpoint_errors.size() - 1) / 2];
+    result.p90_endpoint_error = endpoint_errors[static_cast<uint32_t>(0.9f * static_cast<float>(endpoint_errors.size() - 1))];
+}
+
+template <typename KltType>
+void EvaluateOpticalFlow(const std::string &name,
+                         const std::vector<FEATURE_TRACKER::OpticalFlowMethod> &methods,
+                         const SyntheticFlowGenerator &generator,
+                         const ImagePyramid &ref_pyramid,
+                         const ImagePyramid &cur_pyramid,
+                         const std::vector<Vec2> &ref_pixel_uv,
+                         const std::vector<Vec2> &gt_cur_pixel_uv,
+                         const std::vector<AccuracyResult> &baseline,
+                         std::vector<AccuracyResult> &results) {
+    const std::vector<std::string> method_names = {"inverse", "direct", "fast", "sse", "neon", "fixed_point"};
+
+    const uint32_t first_result_idx = results.size();
+    const auto evaluate = [&] (FEATURE_TRACKER::OpticalFlowMethod method, FEATURE_TRACKER::PatchPatternType pattern, const std::string &method_name) {
+        KltType klt;
+        klt.options().kPatchRowHalfSize = kHalfPatchSize;
+        klt.options().kPatchColHalfSize = kHalfPatchSize;
+        klt.options().kMethod = method;
+        klt.options().kPatchPattern = pattern;
+        klt.options().kMaxTrackPointsNumber = ref_pixel_uv.size();
+        ConfigureTracker(klt);
+
+        // Track repeatedly for throughput. All repeats give the same result.
+        std::vector<Vec2> cur_pixel_uv;
+        std::vector<uint8_t> status;
+        std::vector<float> cost_times;
+        for (uint32_t i = 0; i < kNumberOfRepeat; ++i) {
+            cur_pixel_uv.clear();
+            status.clear();
+            TickTock timer;
+            klt.TrackFeatures(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+            cost_times.emplace_back(timer.TockTickInMillisecond());
+        }
+        std::sort(cost_times.begin(), cost_times.end());
+        // Sparse pattern with too few points for this tracker falls back to full patch, which is already reported.
+        if (klt.patch_pattern().type() != pattern) {
+            return;
+        }
+
+        AccuracyResult result;
+        result.warp = generator.warp().name;
+        result.tracker = name;
+        result.method = method_name;
+        result.is_sparse_pattern = pattern != FEATURE_TRACKER::PatchPatternType::kFull;
+        EvaluateTracking(gt_cur_pixel_uv, cur_pixel_uv, status, result);
+        result.median_ms = cost_times[(cost_times.size() - 1) / 2];
+        result.features_per_second = result.median_ms > 0.0f ? static_cast<float>(result.num_features) * 1000.0f / result.median_ms : 0.0f;
+        results.emplace_back(result);
+    };
+    for (const auto &method : methods) {
+        evaluate(method, FEATURE_TRACKER::PatchPatternType::kFull, method_names[static_cast<uint32_t>(method)]);
+    }
+
+    // Sparse patterns are only supported by fast method, and each tracker keeps only those with enough points.
+    const std::vector<std::pair<FEATURE_TRACKER::PatchPatternType, std::string>> patterns = {
+        { FEATURE_TRACKER::PatchPatternType::kDso8, "fast_dso8" },
+        { FEATURE_TRACKER::PatchPatternType::kDiamond, "fast_diamond" },
+        { FEATURE_TRACKER::PatchPatternType::kCheckerboard, "fast_checkerboard" },
+    };
+    for (const auto &pattern : patterns) {
+        evaluate(FEATURE_TRACKER::OpticalFlowMethod::kFast, pattern.first, pattern.second);
+    }
+
+    // Gate each method on its own error against ground truth, compared with baseline. Sparse patterns trade accuracy
+    // for fewer samples, so they are only reported for comparison. Result missing in baseline fails, so that baseline
+    // is recorded again when a method is added.
+    for (uint32_t i = first_result_idx; i < results.size(); ++i) {
+        AccuracyResult &result = results[i];
+        CONTINUE_IF(result.is_sparse_pattern);
+        const AccuracyResult *baseline_result = FindBaseline(baseline, result);
+        if (baseline_result == nullptr) {
+            result.is_gated = true;
+            result.is_gate_passed = false;
+            ReportError(result.warp << " " << result.tracker << " " << result.method << " is missing in baseline.");
+            continue;
+        }
+        GateResult(*baseline_result, AccuracyGateMargin(), result);
+    }
+
+    for (uint32_t i = first_result_idx; i < results.size(); ++i) {
+        const AccuracyResult &result = results[i];
+        ReportInfo(result.warp << " " << result.tracker << " " << result.method << " : survival " << result.survival_rate * 100.0f <<
+            "%, epe mean " << result.mean_endpoint_error << " median " << result.median_endpoint_error << " p90 " <<
+            result.p90_endpoint_error << " px, " << result.features_per_second << " features/s" << (!result.is_gated ? "." : (result.is_gate_passed ? ", passed." : ", FAILED.")));
+    }
+}
+
+std::string ReportInCsv(const std::vector<AccuracyResult> &results) {
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(4);
+    stream << "warp,tracker,method,features,survival_rate,mean_epe,median_epe,p90_epe,median_ms,features_per_second,gate\n";
+    for (const AccuracyResult &result : results) {
+        stream << result.warp << "," << result.tracker << "," << result.method << "," << result.num_features << "," <<
+            result.survival_rate << "," << result.mean_endpoint_error << "," << result.median_endpoint_error << "," <<
+            result.p90_endpoint_error << "," << result.median_ms << "," << result.features_per_second << "," <<
+            (!result.is_gated ? "none" : (result.is_gate_passed ? "pass" : "fail")) << "\n";
+    }
+    return stream.str();
+}
+
+// Usage : test_flow_accuracy [output csv file] [baseline csv file] [source image, procedural texture if not given]
+// Baseline is the output csv file of a former run on the same source. The one of procedural texture is committed as
+// test/flow_accuracy_baseline.csv, and it is loaded by default. Return non-zero if baseline can not be loaded, or if
+// any method fails the accuracy gate against it.
+int main(int argc, char **argv) {
+    const std::string output_file_name = argc > 1 ? argv[1] : "flow_accuracy.csv";
+    const std::string baseline_file_name = argc > 2 ? argv[2] : "../test/flow_accuracy_baseline.csv";
+    std::vector<AccuracyResult> baseline;
+    if (!LoadBaseline(baseline_file_name, baseline)) {
+        ReportError("Failed to load baseline " << baseline_file_name << ".");
+        return -1;
+    }
+
+    SyntheticFlowGenerator generator;
+    if (argc > 3) {
+        GrayImage source_image;
+        Visualizor2D::LoadImage(argv[3], source_image);
+        if (source_image.rows() < 2 * kFeatureBorder || source_image.cols() < 2 * kFeatureBorder) {
+            ReportError("Failed to load source image " << argv[3] << ".");
+            return -1;
+        }
+        generator.SetImageSource(source_image);
+        ReportInfo(YELLOW ">> Evaluate optical flow accuracy on warps of " << argv[3] << "." RESET_COLOR);
+    } else {
+        generator.SetProceduralSource(kProceduralImageRows, kProceduralImageCols);
+        ReportInfo(YELLOW ">> Evaluate optical flow accuracy on warps of procedural texture." RESET_COLOR);
+    }
+
+    const std::vector<FEATURE_TRACKER::OpticalFlowMethod> methods = {
+        FEATURE_TRACKER::OpticalFlowMethod::kInverse,
+        FEATURE_TRACKER::OpticalFlowMethod::kDirect,
+        FEATURE_TRACKER::OpticalFlowMethod::kFast,
+        FEATURE_TRACKER::OpticalFlowMethod::kSse,
+    };
+    std::vector<FEATURE_TRACKER::OpticalFlowMethod> basic_klt_methods = methods;
+    basic_klt_methods.emplace_back(FEATURE_TRACKER::OpticalFlowMethod::kFixedPoint);
+
+    std::vector<AccuracyResult> results;
+    uint32_t seed = 0;
+    for (const SyntheticWarp &warp : CreateWarps()) {
+        generator.Generate(warp, seed++);
+        std::vector<Vec2> ref_pixel_uv, gt_cur_pixel_uv;
+        generator.SelectFeatures(kMaxNumberOfFeaturesToTrack, kFeatureBorder, ref_pixel_uv, gt_cur_pixel_uv);
+
+        TestImagePyramid ref_pyramid(generator.ref_image(), kMaxPyramidLevel);
+        TestImagePyramid cur_pyramid(generator.cur_image(), kMaxPyramidLevel);
+
+        EvaluateOpticalFlow<FEATURE_TRACKER::OpticalFlowBasicKlt>("basic_klt", basic_klt_methods, generator, ref_pyramid, cur_pyramid, ref_pixel_uv, gt_cur_pixel_uv, baseline, results);
+        EvaluateOpticalFlow<FEATURE_TRACKER::OpticalFlowAffineKlt>("affine_klt", methods, generator, ref_pyramid, cur_pyramid, ref_pixel_uv, gt_cur_pixel_uv, baseline, results);
+        EvaluateOpticalFlow<FEATURE_TRACKER::OpticalFlowLssdKlt>("lssd_klt", methods, generator, ref_pyramid, cur_pyramid, ref_pixel_uv, gt_cur_pixel_uv, baseline, results);
+    }
+
+    std::ofstream file(output_file_name);
+    if (file.is_open()) {
+        file << ReportInCsv(results);
+        ReportInfo("Saved " << results.size() << " results to " << output_file_name << ".");
+    }
+
+    const uint32_t num_gated = std::count_if(results.begin(), results.end(), [] (const AccuracyResult &result) { return result.is_gated; });
+    const uint32_t num_failed = std::count_if(results.begin(), results.end(), [] (const AccuracyResult &result) { return !result.is_gate_passed; });
+    ReportInfo("Accuracy gate : " << num_gated - num_failed << " passed, " << num_failed << " failed, " <<
+        results.size() - num_gated << " not gated.");
+    return num_failed > 0 ? 1 : 0;
+}
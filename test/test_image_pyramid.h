@@ -0,0 +1,32 @@
+#ifndef _TEST_IMAGE_PYRAMID_H_
+#define _TEST_IMAGE_PYRAMID_H_
+
+#include "datatype_image.h"
+#include "datatype_image_pyramid.h"
+
+#include "cstdint"
+#include "vector"
+
+/* Class Test Image Pyramid Declaration. */
+// Image pyramid which owns buffer of its levels, so that tests and benchmarks do not leak it. Raw image is not
+// copied, so it should outlive this pyramid.
+class TestImagePyramid : public ImagePyramid {
+
+public:
+    TestImagePyramid() = default;
+    TestImagePyramid(const GrayImage &image, uint32_t level) { Create(image, level); }
+    TestImagePyramid(const TestImagePyramid &) = delete;
+    TestImagePyramid &operator=(const TestImagePyramid &) = delete;
+
+    void Create(const GrayImage &image, uint32_t level) {
+        buff_.resize(image.rows() * image.cols());
+        SetPyramidBuff(buff_.data());
+        SetRawImage(image.data(), image.rows(), image.cols());
+        CreateImagePyramid(level);
+    }
+
+private:
+    std::vector<uint8_t> buff_;
+};
+
+#endif // end of _TEST_IMAGE_PYRAMID_H_
@@ -16,6 +16,7 @@
 #include "optical_flow_basic_klt.h"
 #include "optical_flow_affine_klt.h"
 #include "optical_flow_lssd_klt.h"
+#include "profiler.h"
 
 using namespace SLAM_VISUALIZOR;
 
@@ -67,9 +68,14 @@ float TestOpticalFlowBasicKlt(int32_t pyramid_level, int32_t patch_size, uint8_t
     klt.options().kPatchColHalfSize = patch_size;
     klt.options().kMethod = static_cast<FEATURE_TRACKER::OpticalFlowMethod>(method);
 
+    {
+        PROFILE_ZONE(kBuildPyramid);
+        ref_pyramid.CreateImagePyramid(pyramid_level);
+        cur_pyramid.CreateImagePyramid(pyramid_level);
+    }
+
+    // Only tracking is timed.
     TickTock timer;
-    ref_pyramid.CreateImagePyramid(pyramid_level);
-    cur_pyramid.CreateImagePyramid(pyramid_level);
     klt.TrackFeatures(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
     const float cost_time = timer.TockTickInMillisecond();
 
@@ -109,9 +115,14 @@ float TestOpticalFlowAffineKlt(int32_t pyramid_level, int32_t patch_size, uint8_
     klt.options().kPatchColHalfSize = patch_size;
     klt.options().kMethod = static_cast<FEATURE_TRACKER::OpticalFlowMethod>(method);
 
+    {
+        PROFILE_ZONE(kBuildPyramid);
+        ref_pyramid.CreateImagePyramid(pyramid_level);
+        cur_pyramid.CreateImagePyramid(pyramid_level);
+    }
+
+    // Only tracking is timed.
     TickTock timer;
-    ref_pyramid.CreateImagePyramid(pyramid_level);
-    cur_pyramid.CreateImagePyramid(pyramid_level);
     klt.TrackFeatures(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
     const float cost_time = timer.TockTickInMillisecond();
 
@@ -152,9 +163,14 @@ float TestOpticalFlowLssdKlt(int32_t pyramid_level, int32_t patch_size, uint8_t
     klt.options().kMethod = static_cast<FEATURE_TRACKER::OpticalFlowMethod>(method);
     klt.consider_patch_luminance() = false;
 
+    {
+        PROFILE_ZONE(kBuildPyramid);
+        ref_pyramid.CreateImagePyramid(pyramid_level);
+        cur_pyramid.CreateImagePyramid(pyramid_level);
+    }
+
+    // Only tracking is timed.
     TickTock timer;
-    ref_pyramid.CreateImagePyramid(pyramid_level);
-    cur_pyramid.CreateImagePyramid(pyramid_level);
     klt.TrackFeatures(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
     const float cost_time = timer.TockTickInMillisecond();
 
@@ -177,6 +193,11 @@ int main(int argc, char **argv) {
     cost_time = TestOpticalFlowLssdKlt(kMaxPyramidLevel, kHalfPatchSize, static_cast<uint8_t>(kDefaultMethod));
     ReportInfo("Lssd klt cost time " << cost_time << " ms.");
 
+    // Zones and counters are recorded only when profiler is enabled.
+#if FEATURE_TRACKER_PROFILER
+    FEATURE_TRACKER::Profiler::SaveReport("profile_optical_flow.json");
+#endif // end of FEATURE_TRACKER_PROFILER
+
 #if DRAW_TRACKING_RESULT
     Visualizor2D::WaitKey(0);
 #endif // end of DRAW_TRACKING_RESULT
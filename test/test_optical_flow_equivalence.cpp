@@ -0,0 +1,765 @@
+#include "iostream"
+#include "cstdint"
+#include "cmath"
+#include "string"
+#include "vector"
+#include "algorithm"
+#include "thread"
+#include "atomic"
+#include "chrono"
+
+#include "slam_log_reporter.h"
+
+#include "optical_flow_basic_klt.h"
+#include "optical_flow_affine_klt.h"
+#include "optical_flow_lssd_klt.h"
+#include "optical_flow_sequence_tracker.h"
+#include "optical_flow_fixed_point.h"
+
+#include "synthetic_flow_generator.h"
+#include "test_image_pyramid.h"
+
+namespace {
+    constexpr int32_t kProceduralImageRows = 240;
+    constexpr int32_t kProceduralImageCols = 320;
+    constexpr uint32_t kMaxNumberOfFeaturesToTrack = 1000;
+    constexpr int32_t kHalfPatchSize = 6;
+    constexpr int32_t kPaddedBorder = kHalfPatchSize + 4;
+    constexpr int32_t kMaxPyramidLevel = 4;
+    constexpr float kMaxPixelDifference = 1e-4f;
+    constexpr float kBrightnessGain = 1.3f;
+    constexpr float kMaxLuminancePixelDifference = 0.25f;
+    constexpr float kMinLuminanceAgreedRatio = 0.9f;
+    constexpr float kMaxSimdPixelDifference = 1e-2f;    // Simd levels differ in rounding, such as fused multiply-add.
+    constexpr uint32_t kNumReentrantJobs = 4;
+}
+
+// Keep features whose patch is close to border of image, so that tracking of them reads pixels outside of image.
+void SelectFeaturesNearBorder(const SyntheticFlowGenerator &generator, std::vector<Vec2> &ref_pixel_uv) {
+    std::vector<Vec2> all_ref_pixel_uv, gt_cur_pixel_uv;
+    generator.SelectFeatures(kMaxNumberOfFeaturesToTrack, 2, all_ref_pixel_uv, gt_cur_pixel_uv);
+
+    const float max_distance = static_cast<float>(kHalfPatchSize + 4);
+    ref_pixel_uv.clear();
+    for (const Vec2 &pixel_uv : all_ref_pixel_uv) {
+        const float distance = std::min(std::min(pixel_uv.x(), pixel_uv.y()),
+            std::min(generator.ref_image().cols() - 1 - pixel_uv.x(), generator.ref_image().rows() - 1 - pixel_uv.y()));
+        if (distance < max_distance) {
+            ref_pixel_uv.emplace_back(pixel_uv);
+        }
+    }
+}
+
+// Results are equivalent if status of all features are the same, and tracked features are at the same position.
+bool CompareResults(const std::string &name,
+                    const std::vector<Vec2> &expected_cur_pixel_uv,
+                    const std::vector<uint8_t> &expected_status,
+                    const std::vector<Vec2> &cur_pixel_uv,
+                    const std::vector<uint8_t> &status,
+                    float max_pixel_difference) {
+    if (cur_pixel_uv.size() != expected_cur_pixel_uv.size() || status.size() != expected_status.size()) {
+        ReportError(name << " : size of results differs.");
+        return false;
+    }
+
+    uint32_t num_tracked = 0;
+    uint32_t num_status_differs = 0;
+    float max_difference = 0.0f;
+    for (uint32_t i = 0; i < status.size(); ++i) {
+        if (status[i] != expected_status[i]) {
+            ++num_status_differs;
+            continue;
+        }
+        if (status[i] == static_cast<uint8_t>(FEATURE_TRACKER::TrackStatus::kTracked)) {
+            ++num_tracked;
+            max_difference = std::max(max_difference, (cur_pixel_uv[i] - expected_cur_pixel_uv[i]).norm());
+        }
+    }
+
+    const bool is_equivalent = num_status_differs == 0 && max_difference <= max_pixel_difference;
+    if (is_equivalent) {
+        ReportInfo(name << " : " << num_tracked << "/" << status.size() << " tracked, max difference " << max_difference << " px.");
+    } else {
+        ReportError(name << " : " << num_status_differs << " status differ, max difference " << max_difference << " px.");
+    }
+    return is_equivalent;
+}
+
+// Results are close if status of almost all features are the same, and most tracked features are nearby. Difference of
+// tracked features is checked in quantile, so that a few features converging elsewhere are allowed.
+bool CompareResultsInQuantile(const std::string &name,
+                              const std::vector<Vec2> &expected_cur_pixel_uv,
+                              const std::vector<uint8_t> &expected_status,
+                              const std::vector<Vec2> &cur_pixel_uv,
+                              const std::vector<uint8_t> &status,
+                              float quantile,
+                              float max_pixel_difference,
+                              float max_status_differ_ratio) {
+    if (cur_pixel_uv.size() != expected_cur_pixel_uv.size() || status.size() != expected_status.size() || status.empty()) {
+        ReportError(name << " : size of results differs.");
+        return false;
+    }
+
+    uint32_t num_status_differs = 0;
+    std::vector<float> differences;
+    for (uint32_t i = 0; i < status.size(); ++i) {
+        if (status[i] != expected_status[i]) {
+            ++num_status_differs;
+            continue;
+        }
+        if (status[i] == static_cast<uint8_t>(FEATURE_TRACKER::TrackStatus::kTracked)) {
+            differences.emplace_back((cur_pixel_uv[i] - expected_cur_pixel_uv[i]).norm());
+        }
+    }
+    std::sort(differences.begin(), differences.end());
+    const float difference = differences.empty() ? 0.0f :
+        differences[static_cast<uint32_t>(quantile * static_cast<float>(differences.size() - 1))];
+
+    const bool is_close = static_cast<float>(num_status_differs) <= max_status_differ_ratio * static_cast<float>(status.size()) &&
+        difference <= max_pixel_difference;
+    if (is_close) {
+        ReportInfo(name << " : " << differences.size() << "/" << status.size() << " tracked, " << num_status_differs <<
+            " status differ, difference " << difference << " px in quantile " << quantile << ".");
+    } else {
+        ReportError(name << " : " << num_status_differs << " status differ, difference " << difference << " px in quantile " <<
+            quantile << ", tolerance " << max_pixel_difference << " px.");
+    }
+    return is_close;
+}
+
+template <typename OpticalFlowType>
+void TrackFeatures(OpticalFlowType &optical_flow,
+                   const ImagePyramid &ref_pyramid,
+                   const ImagePyramid &cur_pyramid,
+                   const std::vector<Vec2> &ref_pixel_uv,
+                   std::vector<Vec2> &cur_pixel_uv,
+                   std::vector<uint8_t> &status) {
+    cur_pixel_uv.clear();
+    status.clear();
+    optical_flow.TrackFeatures(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+}
+
+// Padded pyramids only let patches near border be read in whole rows, so features near border should be tracked the
+// same as without them by each kernel.
+template <typename OpticalFlowType>
+uint32_t CheckPaddedPyramid(const std::string &tracker_name,
+                            const std::vector<FEATURE_TRACKER::OpticalFlowMethod> &methods,
+                            bool has_fixed_patch_kernel,
+                            const ImagePyramid &ref_pyramid,
+                            const ImagePyramid &cur_pyramid,
+                            const std::vector<Vec2> &ref_pixel_uv) {
+    const std::vector<std::string> method_names = { "inverse", "direct", "fast", "sse", "neon", "fixed point" };
+    FEATURE_TRACKER::PaddedPyramid ref_padded_pyramid, cur_padded_pyramid;
+    ref_padded_pyramid.CreatePaddedPyramid(ref_pyramid, kPaddedBorder);
+    cur_padded_pyramid.CreatePaddedPyramid(cur_pyramid, kPaddedBorder);
+
+    uint32_t num_failed = 0;
+    for (const auto &method : methods) {
+        for (const bool use_fixed_patch_kernel : { false, true }) {
+            if (use_fixed_patch_kernel && (!has_fixed_patch_kernel || method != FEATURE_TRACKER::OpticalFlowMethod::kFast)) {
+                continue;
+            }
+            OpticalFlowType optical_flow;
+            optical_flow.options().kMaxTrackPointsNumber = ref_pixel_uv.size();
+            optical_flow.options().kMethod = method;
+            optical_flow.options().kUseFixedPatchKernel = use_fixed_patch_kernel;
+            std::vector<Vec2> expected_cur_pixel_uv, cur_pixel_uv;
+            std::vector<uint8_t> expected_status, status;
+            TrackFeatures(optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, expected_cur_pixel_uv, expected_status);
+
+            optical_flow.ref_padded_pyramid() = &ref_padded_pyramid;
+            optical_flow.cur_padded_pyramid() = &cur_padded_pyramid;
+            TrackFeatures(optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+
+            // Whole rows of sse method are sampled by vector lanes, which differ in rounding from scalar fallback.
+            const std::string name = "padded pyramid " + tracker_name + " " + method_names[static_cast<uint32_t>(method)] +
+                (use_fixed_patch_kernel ? " fixed patch kernel" : "");
+            const float max_pixel_difference = method == FEATURE_TRACKER::OpticalFlowMethod::kSse ? kMaxSimdPixelDifference : kMaxPixelDifference;
+            num_failed += !CompareResults(name, expected_cur_pixel_uv, expected_status, cur_pixel_uv, status, max_pixel_difference);
+        }
+    }
+    return num_failed;
+}
+
+// Sequence tracker reuses buffers of the oldest frame for new frame. Pyramids built with each frame should never be
+// stale, so tracking in ring should be the same as tracking on pyramids built from scratch.
+uint32_t CheckSequenceTracker(const GrayImage &old_image,
+                              const GrayImage &ref_image,
+                              const GrayImage &cur_image,
+                              const ImagePyramid &ref_pyramid,
+                              const ImagePyramid &cur_pyramid,
+                              const std::vector<Vec2> &ref_pixel_uv) {
+    FEATURE_TRACKER::OpticalFlowBasicKlt expected_optical_flow;
+    std::vector<Vec2> expected_cur_pixel_uv, cur_pixel_uv;
+    std::vector<uint8_t> expected_status, status;
+    TrackFeatures(expected_optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, expected_cur_pixel_uv, expected_status);
+
+    FEATURE_TRACKER::OpticalFlowBasicKlt optical_flow;
+    FEATURE_TRACKER::OpticalFlowSequenceTracker sequence_tracker(&optical_flow);
+    sequence_tracker.options().kPyramidLevel = kMaxPyramidLevel;
+    sequence_tracker.options().kPaddedBorder = kPaddedBorder;
+    sequence_tracker.PushFrame(old_image);
+    sequence_tracker.PushFrame(ref_image);
+    sequence_tracker.TrackFeatures(ref_pixel_uv, cur_pixel_uv, status);
+    sequence_tracker.PushFrame(cur_image);
+    cur_pixel_uv.clear();
+    status.clear();
+    sequence_tracker.TrackFeatures(ref_pixel_uv, cur_pixel_uv, status);
+
+    return !CompareResults("sequence tracker", expected_cur_pixel_uv, expected_status, cur_pixel_uv, status, kMaxPixelDifference);
+}
+
+// Level-major traversal keeps state of each feature between levels, and scaling by power of 2 is exact, so it should
+// track the same as feature-major traversal. Prediction, adaptive start level and backward pass change the state.
+template <typename OpticalFlowType>
+uint32_t CheckLevelMajor(const std::string &tracker_name,
+                         const ImagePyramid &ref_pyramid,
+                         const ImagePyramid &cur_pyramid,
+                         const std::vector<Vec2> &ref_pixel_uv) {
+    Mat3 H_cr = Mat3::Identity();
+    H_cr << 0.999f, -0.02f, 1.5f, 0.02f, 0.999f, -0.8f, 0.0f, 0.0f, 1.0f;
+
+    uint32_t num_failed = 0;
+    for (const bool has_prediction : { false, true }) {
+        std::vector<Vec2> expected_cur_pixel_uv, cur_pixel_uv;
+        std::vector<uint8_t> expected_status, status;
+        for (const auto traversal : { FEATURE_TRACKER::PyramidTraversal::kFeatureMajor, FEATURE_TRACKER::PyramidTraversal::kLevelMajor }) {
+            OpticalFlowType optical_flow;
+            optical_flow.options().kMaxTrackPointsNumber = ref_pixel_uv.size();
+            optical_flow.options().kPyramidTraversal = traversal;
+            optical_flow.options().kUseAdaptivePyramidLevel = has_prediction;
+            optical_flow.options().kCheckForwardBackward = true;
+            if (has_prediction) {
+                optical_flow.SetPredictHomography(H_cr);
+            }
+            const bool is_level_major = traversal == FEATURE_TRACKER::PyramidTraversal::kLevelMajor;
+            TrackFeatures(optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, is_level_major ? cur_pixel_uv : expected_cur_pixel_uv,
+                is_level_major ? status : expected_status);
+        }
+
+        const std::string name = "level major " + tracker_name + (has_prediction ? " with prediction" : "");
+        num_failed += !CompareResults(name, expected_cur_pixel_uv, expected_status, cur_pixel_uv, status, kMaxPixelDifference);
+    }
+    return num_failed;
+}
+
+// Tracking features in store reads and writes them in place, so it should be the same as tracking a copy of them in
+// vectors. All features in store are tracked, even if they are more than max number of features to track.
+template <typename OpticalFlowType>
+uint32_t CheckFeatureStore(const std::string &tracker_name,
+                           const ImagePyramid &ref_pyramid,
+                           const ImagePyramid &cur_pyramid,
+                           const std::vector<Vec2> &ref_pixel_uv) {
+    OpticalFlowType expected_optical_flow;
+    expected_optical_flow.options().kMaxTrackPointsNumber = ref_pixel_uv.size();
+    std::vector<Vec2> expected_cur_pixel_uv, cur_pixel_uv;
+    std::vector<uint8_t> expected_status, status;
+    TrackFeatures(expected_optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, expected_cur_pixel_uv, expected_status);
+
+    OpticalFlowType optical_flow;
+    optical_flow.options().kMaxTrackPointsNumber = ref_pixel_uv.size() / 2;
+    FEATURE_TRACKER::FeatureStore features;
+    features.Append(ref_pixel_uv);
+    optical_flow.TrackFeatures(ref_pyramid, cur_pyramid, features);
+
+    uint32_t num_age_differs = 0;
+    for (uint32_t i = 0; i < features.size(); ++i) {
+        cur_pixel_uv.emplace_back(features.pixel_uv(i));
+        status.emplace_back(features.status()[i]);
+        const bool is_tracked = features.status()[i] == static_cast<uint8_t>(FEATURE_TRACKER::TrackStatus::kTracked);
+        num_age_differs += features.age()[i] != static_cast<uint32_t>(is_tracked);
+    }
+
+    const std::string name = "feature store " + tracker_name;
+    uint32_t num_failed = !CompareResults(name, expected_cur_pixel_uv, expected_status, cur_pixel_uv, status, kMaxPixelDifference);
+    if (num_age_differs) {
+        ReportError(name << " : age of " << num_age_differs << " features differ.");
+        ++num_failed;
+    }
+
+    // Only features failed to be tracked are removed. New appended ones are not tracked yet, and should be kept.
+    if (!features.empty()) {
+        features.status()[0] = static_cast<uint8_t>(FEATURE_TRACKER::TrackStatus::kOutside);
+    }
+    features.Append(ref_pixel_uv);
+    const uint32_t num_lost = std::count_if(features.status().begin(), features.status().end(), [] (uint8_t value) {
+        return value > static_cast<uint8_t>(FEATURE_TRACKER::TrackStatus::kTracked);
+    });
+    const uint32_t num_kept = features.size() - num_lost;
+    const uint32_t num_removed = features.RemoveLostFeatures();
+    if (num_removed != num_lost || features.size() != num_kept) {
+        ReportError(name << " : removed " << num_removed << " features, expected " << num_lost << ".");
+        ++num_failed;
+    }
+    return num_failed;
+}
+
+// Cached reference patches belong to generation of reference frame, so that reusing image buffer of reference frame
+// for another frame should track the same as without cache once generation is bumped.
+uint32_t CheckRefPatchCache(const GrayImage &old_image,
+                            const GrayImage &ref_image,
+                            const ImagePyramid &cur_pyramid,
+                            const std::vector<Vec2> &ref_pixel_uv) {
+    const int32_t rows = ref_image.rows();
+    const int32_t cols = ref_image.cols();
+    std::vector<uint8_t> image_data(rows * cols);
+    std::vector<uint8_t> pyramid_buff(rows * cols);
+    ImagePyramid ref_pyramid;
+    ref_pyramid.SetPyramidBuff(pyramid_buff.data());
+
+    FEATURE_TRACKER::OpticalFlowBasicKlt expected_optical_flow;
+    expected_optical_flow.options().kMaxTrackPointsNumber = ref_pixel_uv.size();
+    FEATURE_TRACKER::OpticalFlowBasicKlt optical_flow;
+    optical_flow.options().kMaxTrackPointsNumber = ref_pixel_uv.size();
+    optical_flow.options().kUseRefPatchCache = true;
+
+    uint32_t num_failed = 0;
+    for (const GrayImage *image : { &old_image, &ref_image }) {
+        std::copy_n(image->data(), rows * cols, image_data.data());
+        ref_pyramid.SetRawImage(image_data.data(), rows, cols);
+        ref_pyramid.CreateImagePyramid(kMaxPyramidLevel);
+        optical_flow.BumpRefFrameGeneration();
+
+        std::vector<Vec2> expected_cur_pixel_uv, cur_pixel_uv;
+        std::vector<uint8_t> expected_status, status;
+        TrackFeatures(expected_optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, expected_cur_pixel_uv, expected_status);
+        // The second call reads patches cached by the first one.
+        for (uint32_t i = 0; i < 2; ++i) {
+            TrackFeatures(optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+            const std::string name = "ref patch cache generation " + std::to_string(optical_flow.ref_frame_generation()) + " call " + std::to_string(i);
+            num_failed += !CompareResults(name, expected_cur_pixel_uv, expected_status, cur_pixel_uv, status, kMaxPixelDifference);
+        }
+    }
+    return num_failed;
+}
+
+// Features started before time budget is used up should be exactly the ones with top priorities, even if they are
+// tracked by multiple threads. They should be tracked the same as without budget. Clock is simulated, which moves one
+// tick each time it is read, so that budget of (n + 0.5) ticks starts exactly n features.
+uint32_t CheckTimeBudget(const ImagePyramid &ref_pyramid,
+                         const ImagePyramid &cur_pyramid,
+                         const std::vector<Vec2> &ref_pixel_uv) {
+    const uint32_t num_features = ref_pixel_uv.size();
+    FEATURE_TRACKER::OpticalFlowBasicKlt expected_optical_flow;
+    expected_optical_flow.options().kMaxTrackPointsNumber = num_features;
+    std::vector<Vec2> expected_cur_pixel_uv;
+    std::vector<uint8_t> expected_status;
+    TrackFeatures(expected_optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, expected_cur_pixel_uv, expected_status);
+
+    // Priority is not in order of features, so that features with top priorities spread over all ranges of workers.
+    std::vector<float> priority(num_features);
+    std::vector<uint32_t> order(num_features);
+    for (uint32_t i = 0; i < num_features; ++i) {
+        priority[i] = static_cast<float>(i % 13);
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&] (uint32_t id_a, uint32_t id_b) {
+        return priority[id_a] > priority[id_b] || (priority[id_a] == priority[id_b] && id_a < id_b);
+    });
+
+    constexpr int64_t kClockTickInMicrosecond = 10;
+    uint32_t num_failed = 0;
+    for (const uint32_t num_expected_started : { 1u, 37u, num_features / 2, num_features + 10 }) {
+        std::atomic<int64_t> num_ticks { 0 };
+        FEATURE_TRACKER::OpticalFlowBasicKlt optical_flow;
+        optical_flow.options().kMaxTrackPointsNumber = num_features;
+        optical_flow.options().kNumThreads = 4;
+        optical_flow.options().kTimeBudgetInMillisecond = (static_cast<float>(num_expected_started) + 0.5f) * kClockTickInMicrosecond * 1e-3f;
+        // Max iteration is not shrunk, so that started features are tracked the same as without budget.
+        optical_flow.options().kMinIterationInBudget = optical_flow.options().kMaxIteration;
+        optical_flow.SetFeaturePriority(priority);
+        optical_flow.SetTimeBudgetClock([&num_ticks] () {
+            return std::chrono::steady_clock::time_point(std::chrono::microseconds(num_ticks.fetch_add(1) * kClockTickInMicrosecond));
+        });
+        std::vector<Vec2> cur_pixel_uv;
+        std::vector<uint8_t> status;
+        TrackFeatures(optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+
+        // Tracking always changes status of started features, so they are the leading features in order of priority.
+        uint32_t num_started = 0;
+        while (num_started < num_features && status[order[num_started]] != static_cast<uint8_t>(FEATURE_TRACKER::TrackStatus::kNotTracked)) {
+            ++num_started;
+        }
+        uint32_t num_started_out_of_order = 0;
+        std::vector<Vec2> expected_started_pixel_uv, started_pixel_uv;
+        std::vector<uint8_t> expected_started_status, started_status;
+        for (uint32_t i = 0; i < num_features; ++i) {
+            const uint32_t feature_id = order[i];
+            if (i < num_started) {
+                expected_started_pixel_uv.emplace_back(expected_cur_pixel_uv[feature_id]);
+                expected_started_status.emplace_back(expected_status[feature_id]);
+                started_pixel_uv.emplace_back(cur_pixel_uv[feature_id]);
+                started_status.emplace_back(status[feature_id]);
+            } else {
+                num_started_out_of_order += status[feature_id] != static_cast<uint8_t>(FEATURE_TRACKER::TrackStatus::kNotTracked);
+            }
+        }
+
+        const std::string name = "time budget of " + std::to_string(num_expected_started) + " ticks, top " + std::to_string(num_started) + " priorities";
+        if (num_started != std::min(num_expected_started, num_features)) {
+            ReportError(name << " : " << std::min(num_expected_started, num_features) << " features should be started.");
+            ++num_failed;
+        }
+        if (num_started_out_of_order > 0) {
+            ReportError(name << " : " << num_started_out_of_order << " features are started out of order of priority.");
+            ++num_failed;
+        }
+        num_failed += !CompareResults(name, expected_started_pixel_uv, expected_started_status, started_pixel_uv, started_status, kMaxPixelDifference);
+    }
+
+    return num_failed;
+}
+
+// Features are independent from each other, so concurrent jobs sharing one const tracker on disjoint ranges of features
+// should track them the same as stateful tracking.
+template <typename OpticalFlowType>
+uint32_t CheckReentrantTracking(const std::string &tracker_name,
+                                const std::vector<FEATURE_TRACKER::OpticalFlowMethod> &methods,
+                                const ImagePyramid &ref_pyramid,
+                                const ImagePyramid &cur_pyramid,
+                                const std::vector<Vec2> &ref_pixel_uv) {
+    const std::vector<std::string> method_names = { "inverse", "direct", "fast", "sse", "neon", "fixed_point" };
+    const uint32_t num_features = ref_pixel_uv.size();
+
+    uint32_t num_failed = 0;
+    for (const auto &method : methods) {
+        OpticalFlowType optical_flow;
+        optical_flow.options().kMaxTrackPointsNumber = num_features;
+        optical_flow.options().kMethod = method;
+        std::vector<Vec2> expected_cur_pixel_uv;
+        std::vector<uint8_t> expected_status;
+        TrackFeatures(optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, expected_cur_pixel_uv, expected_status);
+
+        // Each job owns its scratch, and tracks its own range of features.
+        optical_flow.PrepareForReentrantTracking();
+        const OpticalFlowType &const_optical_flow = optical_flow;
+        std::vector<Vec2> cur_pixel_uv = ref_pixel_uv;
+        std::vector<uint8_t> status(num_features, static_cast<uint8_t>(FEATURE_TRACKER::TrackStatus::kNotTracked));
+        std::vector<FEATURE_TRACKER::TrackingScratch> scratches(kNumReentrantJobs);
+        std::vector<uint8_t> results(kNumReentrantJobs, 0);
+        std::vector<std::thread> jobs;
+        for (uint32_t job_id = 0; job_id < kNumReentrantJobs; ++job_id) {
+            jobs.emplace_back([&, job_id] () {
+                const uint32_t begin_id = num_features * job_id / kNumReentrantJobs;
+                const uint32_t end_id = num_features * (job_id + 1) / kNumReentrantJobs;
+                results[job_id] = const_optical_flow.TrackFeatures(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status,
+                    begin_id, end_id, scratches[job_id]);
+            });
+        }
+        for (auto &job : jobs) {
+            job.join();
+        }
+
+        const std::string name = "reentrant " + tracker_name + " " + method_names[static_cast<uint32_t>(method)];
+        if (std::count(results.begin(), results.end(), 0) > 0) {
+            ReportError(name << " : tracking is rejected.");
+            ++num_failed;
+            continue;
+        }
+        num_failed += !CompareResults(name, expected_cur_pixel_uv, expected_status, cur_pixel_uv, status, kMaxPixelDifference);
+    }
+
+    // Forward-backward check needs state of tracker across features, so it should be rejected.
+    OpticalFlowType optical_flow;
+    optical_flow.options().kCheckForwardBackward = true;
+    optical_flow.PrepareForReentrantTracking();
+    std::vector<Vec2> cur_pixel_uv = ref_pixel_uv;
+    std::vector<uint8_t> status(num_features, static_cast<uint8_t>(FEATURE_TRACKER::TrackStatus::kNotTracked));
+    FEATURE_TRACKER::TrackingScratch scratch;
+    if (optical_flow.TrackFeatures(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status, 0, num_features, scratch)) {
+        ReportError("reentrant " << tracker_name << " : forward-backward check is not rejected.");
+        ++num_failed;
+    }
+    return num_failed;
+}
+
+// Jobs of callers sharing one pool run one after another, so every task of each caller should run exactly once with
+// its own schedule. Nested job inside a task runs serially in calling worker.
+uint32_t CheckSharedThreadPool() {
+    constexpr uint32_t kNumThreads = 4;
+    constexpr uint32_t kNumJobsPerCaller = 20;
+    constexpr uint32_t kNumTasks = 257;
+    constexpr uint32_t kNumNestedTasks = 8;
+    FEATURE_TRACKER::ThreadPool thread_pool(kNumThreads);
+    std::vector<std::vector<std::atomic<uint32_t>>> counts(kNumReentrantJobs);
+    std::vector<std::atomic<uint32_t>> nested_counts(kNumReentrantJobs);
+    std::atomic<uint32_t> num_bad_worker_ids { 0 };
+    std::vector<std::thread> callers;
+    for (uint32_t caller_id = 0; caller_id < kNumReentrantJobs; ++caller_id) {
+        counts[caller_id] = std::vector<std::atomic<uint32_t>>(kNumTasks);
+        nested_counts[caller_id] = 0;
+        callers.emplace_back([&, caller_id] () {
+            for (uint32_t job_id = 0; job_id < kNumJobsPerCaller; ++job_id) {
+                const auto schedule = (caller_id + job_id) % 2 ? FEATURE_TRACKER::ThreadPoolSchedule::kWorkStealing :
+                    FEATURE_TRACKER::ThreadPoolSchedule::kStatic;
+                thread_pool.ParallelFor(kNumTasks, [&] (uint32_t task_id, uint32_t worker_id) {
+                    ++counts[caller_id][task_id];
+                    num_bad_worker_ids += worker_id >= kNumThreads;
+                    if (task_id == job_id) {
+                        thread_pool.ParallelFor(kNumNestedTasks, [&] (uint32_t nested_task_id, uint32_t nested_worker_id) {
+                            ++nested_counts[caller_id];
+                            num_bad_worker_ids += nested_worker_id != worker_id;
+                        });
+                    }
+                }, schedule, 3);
+            }
+        });
+    }
+    for (auto &caller : callers) {
+        caller.join();
+    }
+
+    uint32_t num_wrong_counts = 0;
+    for (uint32_t caller_id = 0; caller_id < kNumReentrantJobs; ++caller_id) {
+        for (const auto &count : counts[caller_id]) {
+            num_wrong_counts += count != kNumJobsPerCaller;
+        }
+        num_wrong_counts += nested_counts[caller_id] != kNumJobsPerCaller * kNumNestedTasks;
+    }
+    if (num_wrong_counts > 0 || num_bad_worker_ids > 0) {
+        ReportError("shared thread pool : " << num_wrong_counts << " wrong counts, " << num_bad_worker_ids << " wrong worker ids.");
+        return 1;
+    }
+    ReportInfo("shared thread pool : " << kNumReentrantJobs << " callers run all tasks once.");
+    return 0;
+}
+
+// Lssd klt normalizes luminance of patches, so inverse, fast and sse method should agree under brightness gain. They
+// solve different linearizations, so most features tracked by one method should be tracked nearby by another. Within
+// 0.25 px, 96% of features agree if means of patches match, and less than 5% agree if they do not.
+uint32_t CheckLssdLuminance() {
+    SyntheticFlowGenerator generator;
+    generator.SetProceduralSource(kProceduralImageRows, kProceduralImageCols);
+    SyntheticWarp warp;
+    warp.translation = Vec2(2.2f, 1.1f);
+    warp.brightness_gain = kBrightnessGain;
+    generator.Generate(warp);
+    std::vector<Vec2> ref_pixel_uv, gt_cur_pixel_uv;
+    generator.SelectFeatures(kMaxNumberOfFeaturesToTrack, kHalfPatchSize, ref_pixel_uv, gt_cur_pixel_uv);
+
+    TestImagePyramid ref_pyramid(generator.ref_image(), kMaxPyramidLevel);
+    TestImagePyramid cur_pyramid(generator.cur_image(), kMaxPyramidLevel);
+
+    FEATURE_TRACKER::OpticalFlowLssdKlt optical_flow;
+    optical_flow.options().kMaxTrackPointsNumber = ref_pixel_uv.size();
+    optical_flow.consider_patch_luminance() = true;
+    const std::vector<std::string> method_names = { "inverse", "direct", "fast", "sse" };
+    std::vector<std::vector<Vec2>> cur_pixel_uv(method_names.size());
+    std::vector<std::vector<uint8_t>> status(method_names.size());
+    for (const auto &method : { FEATURE_TRACKER::OpticalFlowMethod::kInverse, FEATURE_TRACKER::OpticalFlowMethod::kFast,
+        FEATURE_TRACKER::OpticalFlowMethod::kSse }) {
+        optical_flow.options().kMethod = method;
+        const uint32_t method_id = static_cast<uint32_t>(method);
+        TrackFeatures(optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv[method_id], status[method_id]);
+    }
+
+    uint32_t num_failed = 0;
+    const uint32_t inverse_id = static_cast<uint32_t>(FEATURE_TRACKER::OpticalFlowMethod::kInverse);
+    const uint32_t fast_id = static_cast<uint32_t>(FEATURE_TRACKER::OpticalFlowMethod::kFast);
+    const uint32_t sse_id = static_cast<uint32_t>(FEATURE_TRACKER::OpticalFlowMethod::kSse);
+    const uint8_t tracked = static_cast<uint8_t>(FEATURE_TRACKER::TrackStatus::kTracked);
+    const std::vector<std::pair<uint32_t, uint32_t>> pairs = { {inverse_id, fast_id}, {inverse_id, sse_id}, {fast_id, sse_id} };
+    for (const auto &pair : pairs) {
+        const uint32_t expected_id = pair.first;
+        const uint32_t method_id = pair.second;
+        uint32_t num_expected_tracked = 0;
+        uint32_t num_agreed = 0;
+        for (uint32_t i = 0; i < ref_pixel_uv.size(); ++i) {
+            if (status[expected_id][i] != tracked) {
+                continue;
+            }
+            ++num_expected_tracked;
+            num_agreed += status[method_id][i] == tracked &&
+                (cur_pixel_uv[method_id][i] - cur_pixel_uv[expected_id][i]).norm() <= kMaxLuminancePixelDifference;
+        }
+
+        const std::string name = "lssd luminance " + method_names[method_id] + " against " + method_names[expected_id];
+        const float agreed_ratio = static_cast<float>(num_agreed) / static_cast<float>(std::max(num_expected_tracked, 1u));
+        if (num_expected_tracked > 0 && agreed_ratio >= kMinLuminanceAgreedRatio) {
+            ReportInfo(name << " : " << num_agreed << "/" << num_expected_tracked << " tracked features agree.");
+        } else {
+            ReportError(name << " : only " << num_agreed << "/" << num_expected_tracked << " tracked features agree.");
+            ++num_failed;
+        }
+    }
+    return num_failed;
+}
+
+// Sparse pattern with too few points to fit parameters of tracker should fall back to full patch, and track features
+// the same as it. Patterns with enough points are kept.
+template <typename OpticalFlowType>
+uint32_t CheckPatchPatternPoints(const std::string &tracker_name,
+                                 FEATURE_TRACKER::PatchPatternType pattern,
+                                 int32_t stride,
+                                 bool is_pattern_kept,
+                                 const ImagePyramid &ref_pyramid,
+                                 const ImagePyramid &cur_pyramid,
+                                 const std::vector<Vec2> &ref_pixel_uv) {
+    OpticalFlowType optical_flow;
+    optical_flow.options().kMaxTrackPointsNumber = ref_pixel_uv.size();
+    std::vector<Vec2> expected_cur_pixel_uv, cur_pixel_uv;
+    std::vector<uint8_t> expected_status, status;
+    TrackFeatures(optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, expected_cur_pixel_uv, expected_status);
+
+    optical_flow.options().kPatchPattern = pattern;
+    optical_flow.options().kPatchPatternStride = stride;
+    TrackFeatures(optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+    const std::vector<std::string> pattern_names = { "full", "dso8", "diamond", "checkerboard", "custom" };
+    const std::string name = "patch pattern " + tracker_name + " " + pattern_names[static_cast<uint32_t>(pattern)] +
+        " stride " + std::to_string(stride);
+    const FEATURE_TRACKER::PatchPatternType expected_pattern = is_pattern_kept ? pattern : FEATURE_TRACKER::PatchPatternType::kFull;
+    if (optical_flow.patch_pattern().type() != expected_pattern) {
+        ReportError(name << " : " << optical_flow.patch_pattern().size() << " points are " <<
+            (is_pattern_kept ? "rejected." : "not rejected."));
+        return 1;
+    }
+    if (is_pattern_kept) {
+        ReportInfo(name << " : " << optical_flow.patch_pattern().size() << " points are kept.");
+        return 0;
+    }
+    return !CompareResults(name, expected_cur_pixel_uv, expected_status, cur_pixel_uv, status, 0.0f);
+}
+
+// Fixed-point method should track features like fast method within the tolerance of its fixed-point format, which
+// depends on patch half size. Other trackers do not implement it, so they should reject it.
+uint32_t CheckFixedPoint(const ImagePyramid &ref_pyramid,
+                         const ImagePyramid &cur_pyramid,
+                         const std::vector<Vec2> &ref_pixel_uv,
+                         int32_t half_patch_size) {
+    FEATURE_TRACKER::OpticalFlowBasicKlt optical_flow;
+    optical_flow.options().kMaxTrackPointsNumber = ref_pixel_uv.size();
+    optical_flow.options().kPatchRowHalfSize = half_patch_size;
+    optical_flow.options().kPatchColHalfSize = half_patch_size;
+    optical_flow.options().kMethod = FEATURE_TRACKER::OpticalFlowMethod::kFast;
+    std::vector<Vec2> expected_cur_pixel_uv, cur_pixel_uv;
+    std::vector<uint8_t> expected_status, status;
+    TrackFeatures(optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, expected_cur_pixel_uv, expected_status);
+    optical_flow.options().kMethod = FEATURE_TRACKER::OpticalFlowMethod::kFixedPoint;
+    TrackFeatures(optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+    const std::string name = "fixed point half size " + std::to_string(half_patch_size);
+    uint32_t num_failed = !CompareResultsInQuantile(name, expected_cur_pixel_uv, expected_status, cur_pixel_uv, status,
+        FEATURE_TRACKER::kFixedPointPixelDifferenceQuantile, FEATURE_TRACKER::GetFixedPointMaxPixelDifference(half_patch_size),
+        FEATURE_TRACKER::kFixedPointMaxStatusDifferRatio);
+
+    FEATURE_TRACKER::OpticalFlowAffineKlt affine_optical_flow;
+    affine_optical_flow.options().kMethod = FEATURE_TRACKER::OpticalFlowMethod::kFixedPoint;
+    FEATURE_TRACKER::OpticalFlowLssdKlt lssd_optical_flow;
+    lssd_optical_flow.options().kMethod = FEATURE_TRACKER::OpticalFlowMethod::kFixedPoint;
+    if (affine_optical_flow.TrackFeatures(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status) ||
+        lssd_optical_flow.TrackFeatures(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status)) {
+        ReportError("fixed point : it is not rejected by affine or lssd klt.");
+        ++num_failed;
+    }
+    return num_failed;
+}
+
+// Kernels of sse method for each simd level supported by cpu should track features the same as scalar kernels.
+template <typename OpticalFlowType>
+uint32_t CheckSimdLevels(const std::string &tracker_name,
+                         const ImagePyramid &ref_pyramid,
+                         const ImagePyramid &cur_pyramid,
+                         const std::vector<Vec2> &ref_pixel_uv) {
+    const std::vector<std::string> simd_level_names = { "scalar", "sse4", "avx2" };
+    OpticalFlowType optical_flow;
+    optical_flow.options().kMaxTrackPointsNumber = ref_pixel_uv.size();
+    optical_flow.options().kMethod = FEATURE_TRACKER::OpticalFlowMethod::kSse;
+    optical_flow.options().kMaxSimdLevel = FEATURE_TRACKER::SimdLevel::kScalar;
+    std::vector<Vec2> expected_cur_pixel_uv, cur_pixel_uv;
+    std::vector<uint8_t> expected_status, status;
+    TrackFeatures(optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, expected_cur_pixel_uv, expected_status);
+
+    uint32_t num_failed = 0;
+    for (const auto &simd_level : { FEATURE_TRACKER::SimdLevel::kSse4, FEATURE_TRACKER::SimdLevel::kAvx2 }) {
+        if (simd_level > FEATURE_TRACKER::OpticalFlow::DetectSimdLevel()) {
+            continue;
+        }
+        optical_flow.options().kMaxSimdLevel = simd_level;
+        TrackFeatures(optical_flow, ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+        const std::string name = "simd " + tracker_name + " " + simd_level_names[static_cast<uint32_t>(simd_level)];
+        num_failed += !CompareResults(name, expected_cur_pixel_uv, expected_status, cur_pixel_uv, status, kMaxSimdPixelDifference);
+    }
+    return num_failed;
+}
+
+// Usage : test_optical_flow_equivalence
+// Return non-zero if any optional path of optical flow tracks features differently from the plain path.
+int main(int argc, char **argv) {
+    ReportInfo(YELLOW ">> Check equivalence of optional paths of optical flow." RESET_COLOR);
+
+    // Oldest frame in ring comes from a different warp, so that stale pyramids of its slot give different results.
+    SyntheticFlowGenerator generator;
+    generator.SetProceduralSource(kProceduralImageRows, kProceduralImageCols);
+    SyntheticWarp old_warp;
+    old_warp.translation = Vec2(-7.5f, 4.2f);
+    generator.Generate(old_warp);
+    std::vector<uint8_t> old_image_data(generator.cur_image().data(),
+        generator.cur_image().data() + kProceduralImageRows * kProceduralImageCols);
+    GrayImage old_image;
+    old_image.SetImage(old_image_data.data(), kProceduralImageRows, kProceduralImageCols);
+
+    SyntheticWarp warp;
+    warp.translation = Vec2(1.3f, -0.7f);
+    generator.Generate(warp);
+    std::vector<Vec2> ref_pixel_uv;
+    SelectFeaturesNearBorder(generator, ref_pixel_uv);
+    ReportInfo("Select " << ref_pixel_uv.size() << " features near border of image.");
+
+    TestImagePyramid ref_pyramid(generator.ref_image(), kMaxPyramidLevel);
+    TestImagePyramid cur_pyramid(generator.cur_image(), kMaxPyramidLevel);
+
+    std::vector<Vec2> all_ref_pixel_uv, gt_cur_pixel_uv;
+    generator.SelectFeatures(kMaxNumberOfFeaturesToTrack, kHalfPatchSize, all_ref_pixel_uv, gt_cur_pixel_uv);
+
+    uint32_t num_failed = ref_pixel_uv.empty();
+    const std::vector<FEATURE_TRACKER::OpticalFlowMethod> padded_methods = {
+        FEATURE_TRACKER::OpticalFlowMethod::kFast,
+        FEATURE_TRACKER::OpticalFlowMethod::kSse,
+    };
+    std::vector<FEATURE_TRACKER::OpticalFlowMethod> padded_basic_klt_methods = padded_methods;
+    padded_basic_klt_methods.emplace_back(FEATURE_TRACKER::OpticalFlowMethod::kFixedPoint);
+    num_failed += CheckPaddedPyramid<FEATURE_TRACKER::OpticalFlowBasicKlt>("basic klt", padded_basic_klt_methods, true, ref_pyramid, cur_pyramid, ref_pixel_uv);
+    num_failed += CheckPaddedPyramid<FEATURE_TRACKER::OpticalFlowAffineKlt>("affine klt", padded_methods, false, ref_pyramid, cur_pyramid, ref_pixel_uv);
+    num_failed += CheckPaddedPyramid<FEATURE_TRACKER::OpticalFlowLssdKlt>("lssd klt", padded_methods, false, ref_pyramid, cur_pyramid, ref_pixel_uv);
+    num_failed += CheckSequenceTracker(old_image, generator.ref_image(), generator.cur_image(), ref_pyramid, cur_pyramid, ref_pixel_uv);
+    num_failed += CheckRefPatchCache(old_image, generator.ref_image(), cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckTimeBudget(ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckLevelMajor<FEATURE_TRACKER::OpticalFlowBasicKlt>("basic klt", ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckLevelMajor<FEATURE_TRACKER::OpticalFlowAffineKlt>("affine klt", ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckLevelMajor<FEATURE_TRACKER::OpticalFlowLssdKlt>("lssd klt", ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckFeatureStore<FEATURE_TRACKER::OpticalFlowBasicKlt>("basic klt", ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckFeatureStore<FEATURE_TRACKER::OpticalFlowAffineKlt>("affine klt", ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckFeatureStore<FEATURE_TRACKER::OpticalFlowLssdKlt>("lssd klt", ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckLssdLuminance();
+    num_failed += CheckPatchPatternPoints<FEATURE_TRACKER::OpticalFlowBasicKlt>("basic klt", FEATURE_TRACKER::PatchPatternType::kDso8, 3, true, ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckPatchPatternPoints<FEATURE_TRACKER::OpticalFlowLssdKlt>("lssd klt", FEATURE_TRACKER::PatchPatternType::kDso8, 3, false, ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckPatchPatternPoints<FEATURE_TRACKER::OpticalFlowLssdKlt>("lssd klt", FEATURE_TRACKER::PatchPatternType::kCheckerboard, 3, true, ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckPatchPatternPoints<FEATURE_TRACKER::OpticalFlowAffineKlt>("affine klt", FEATURE_TRACKER::PatchPatternType::kDso8, 3, false, ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckPatchPatternPoints<FEATURE_TRACKER::OpticalFlowAffineKlt>("affine klt", FEATURE_TRACKER::PatchPatternType::kCheckerboard, 3, false, ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckPatchPatternPoints<FEATURE_TRACKER::OpticalFlowAffineKlt>("affine klt", FEATURE_TRACKER::PatchPatternType::kCheckerboard, 2, true, ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    for (const int32_t half_patch_size : { 2, 3, 4, 5, 6, 7, 8 }) {
+        num_failed += CheckFixedPoint(ref_pyramid, cur_pyramid, all_ref_pixel_uv, half_patch_size);
+        num_failed += CheckFixedPoint(ref_pyramid, cur_pyramid, ref_pixel_uv, half_patch_size);
+    }
+
+    const std::vector<FEATURE_TRACKER::OpticalFlowMethod> methods = {
+        FEATURE_TRACKER::OpticalFlowMethod::kInverse,
+        FEATURE_TRACKER::OpticalFlowMethod::kDirect,
+        FEATURE_TRACKER::OpticalFlowMethod::kFast,
+        FEATURE_TRACKER::OpticalFlowMethod::kSse,
+    };
+    std::vector<FEATURE_TRACKER::OpticalFlowMethod> basic_klt_methods = methods;
+    basic_klt_methods.emplace_back(FEATURE_TRACKER::OpticalFlowMethod::kFixedPoint);
+    num_failed += CheckReentrantTracking<FEATURE_TRACKER::OpticalFlowBasicKlt>("basic_klt", basic_klt_methods, ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckReentrantTracking<FEATURE_TRACKER::OpticalFlowAffineKlt>("affine_klt", methods, ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckReentrantTracking<FEATURE_TRACKER::OpticalFlowLssdKlt>("lssd_klt", methods, ref_pyramid, cur_pyramid, all_ref_pixel_uv);
+    num_failed += CheckSharedThreadPool();
+
+    std::vector<Vec2> simd_ref_pixel_uv = all_ref_pixel_uv;
+    simd_ref_pixel_uv.insert(simd_ref_pixel_uv.end(), ref_pixel_uv.begin(), ref_pixel_uv.end());
+    num_failed += CheckSimdLevels<FEATURE_TRACKER::OpticalFlowBasicKlt>("basic_klt", ref_pyramid, cur_pyramid, simd_ref_pixel_uv);
+    num_failed += CheckSimdLevels<FEATURE_TRACKER::OpticalFlowAffineKlt>("affine_klt", ref_pyramid, cur_pyramid, simd_ref_pixel_uv);
+    num_failed += CheckSimdLevels<FEATURE_TRACKER::OpticalFlowLssdKlt>("lssd_klt", ref_pyramid, cur_pyramid, simd_ref_pixel_uv);
+
+    ReportInfo("Equivalence check : " << num_failed << " failed.");
+    return num_failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,277 @@
+#include "iostream"
+#include "cstdint"
+#include "cstdlib"
+#include "string"
+#include "vector"
+#include "atomic"
+#include "new"
+#include "algorithm"
+
+#include "slam_log_reporter.h"
+
+#include "optical_flow_basic_klt.h"
+#include "optical_flow_affine_klt.h"
+#include "optical_flow_lssd_klt.h"
+#include "direct_method_tracker.h"
+#include "descriptor_matcher.h"
+
+#include "synthetic_flow_generator.h"
+#include "test_image_pyramid.h"
+
+namespace {
+    constexpr int32_t kProceduralImageRows = 240;
+    constexpr int32_t kProceduralImageCols = 320;
+    constexpr int32_t kFeatureBorder = 16;
+    constexpr uint32_t kMaxNumberOfFeaturesToTrack = 200;
+    constexpr int32_t kMaxPyramidLevel = 4;
+    constexpr uint32_t kNumberOfSteadyFrames = 5;
+
+    // Heap allocations are only counted while this hook is enabled.
+    std::atomic<bool> is_allocation_counted { false };
+    std::atomic<uint64_t> num_allocations { 0 };
+}
+
+// Count every heap allocation of this process, so that steady state of trackers can be checked.
+void *CountedMalloc(size_t size) {
+    if (is_allocation_counted.load(std::memory_order_relaxed)) {
+        num_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    return std::malloc(size > 0 ? size : 1);
+}
+// Over-aligned types, such as fixed size Eigen matrices in containers, are allocated through align_val_t overloads.
+void *CountedAlignedMalloc(size_t size, std::align_val_t alignment) {
+    if (is_allocation_counted.load(std::memory_order_relaxed)) {
+        num_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Size of aligned_alloc should be a multiple of alignment.
+    const size_t align = static_cast<size_t>(alignment);
+    return std::aligned_alloc(align, (std::max(size, static_cast<size_t>(1)) + align - 1) / align * align);
+}
+// Release out of line. If free() is inlined into a caller of operator delete, GCC pairs it with operator new there,
+// and reports a mismatched deallocation.
+__attribute__((noinline)) void CountedFree(void *ptr) {
+    std::free(ptr);
+}
+void *operator new(size_t size) {
+    void *ptr = CountedMalloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return CountedMalloc(size); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return CountedMalloc(size); }
+// Every replaced operator delete forwards to this one, so that each allocation is released by its paired operator.
+void operator delete(void *ptr) noexcept { CountedFree(ptr); }
+void operator delete[](void *ptr) noexcept { operator delete(ptr); }
+void operator delete(void *ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept { operator delete(ptr); }
+void *operator new(size_t size, std::align_val_t alignment) {
+    void *ptr = CountedAlignedMalloc(size, alignment);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+void *operator new[](size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept { return CountedAlignedMalloc(size, alignment); }
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept { return CountedAlignedMalloc(size, alignment); }
+void operator delete(void *ptr, std::align_val_t) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { operator delete(ptr); }
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept { operator delete(ptr); }
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept { operator delete(ptr); }
+
+/* Descriptor matcher on 64 bits binary descriptors. */
+class HammingMatcher : public FEATURE_TRACKER::DescriptorMatcher<uint64_t> {
+private:
+    float ComputeDistance(const uint64_t &descriptor_ref, const uint64_t &descriptor_cur) override {
+        return static_cast<float>(__builtin_popcountll(descriptor_ref ^ descriptor_cur));
+    }
+};
+
+// The first frame prepares all buffers. Every following frame should not allocate heap at all.
+template <typename TrackFrame>
+bool CheckZeroAllocation(const std::string &name, const TrackFrame &track_frame) {
+    track_frame();
+
+    num_allocations.store(0);
+    is_allocation_counted.store(true);
+    for (uint32_t i = 0; i < kNumberOfSteadyFrames; ++i) {
+        track_frame();
+    }
+    is_allocation_counted.store(false);
+
+    const uint64_t allocations = num_allocations.load();
+    if (allocations > 0) {
+        ReportError(name << " : " << allocations << " heap allocations in " << kNumberOfSteadyFrames << " steady frames.");
+        return false;
+    }
+    ReportInfo(name << " : zero heap allocation in steady frames.");
+    return true;
+}
+
+// Hook should count both plain and over-aligned allocations, otherwise zero allocation of trackers proves nothing.
+uint32_t CheckAllocationHook() {
+    num_allocations.store(0);
+    is_allocation_counted.store(true);
+    std::vector<float> plain_vector(8);
+    const uint64_t plain_allocations = num_allocations.exchange(0);
+    FEATURE_TRACKER::AlignedVector<float> aligned_vector(8);
+    const uint64_t aligned_allocations = num_allocations.exchange(0);
+    is_allocation_counted.store(false);
+
+    if (plain_allocations == 0 || aligned_allocations == 0) {
+        ReportError("allocation hook : plain " << plain_allocations << ", aligned " << aligned_allocations << " allocations counted.");
+        return 1;
+    }
+    return 0;
+}
+
+template <typename OpticalFlowType>
+uint32_t CheckOpticalFlow(const std::string &tracker_name,
+                          const std::vector<FEATURE_TRACKER::OpticalFlowMethod> &methods,
+                          const ImagePyramid &ref_pyramid,
+                          const ImagePyramid &cur_pyramid,
+                          const std::vector<Vec2> &ref_pixel_uv) {
+    const std::vector<std::string> method_names = { "inverse", "direct", "fast", "sse", "neon", "fixed_point" };
+    std::vector<Vec2> cur_pixel_uv;
+    std::vector<uint8_t> status;
+    std::vector<float> priority(ref_pixel_uv.size());
+    for (uint32_t i = 0; i < priority.size(); ++i) {
+        priority[i] = static_cast<float>(i % 7);
+    }
+
+    uint32_t num_failed = 0;
+    for (const auto &method : methods) {
+        for (const uint32_t num_threads : { 1, 2 }) {
+            OpticalFlowType optical_flow;
+            optical_flow.options().kMethod = method;
+            optical_flow.options().kNumThreads = num_threads;
+            const std::string name = tracker_name + " " + method_names[static_cast<uint32_t>(method)] + " threads " + std::to_string(num_threads);
+
+            num_failed += !CheckZeroAllocation(name, [&] () {
+                cur_pixel_uv.clear();
+                status.clear();
+                optical_flow.TrackFeatures(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+            });
+        }
+    }
+
+    // Optional stages of tracking share the same steady state.
+    OpticalFlowType optical_flow;
+    optical_flow.options().kUseRefPatchCache = true;
+    optical_flow.options().kCheckForwardBackward = true;
+    optical_flow.options().kTimeBudgetInMillisecond = 1000.0f;
+    optical_flow.SetPredictHomography(Mat3::Identity());
+    optical_flow.SetFeaturePriority(priority);
+    num_failed += !CheckZeroAllocation(tracker_name + " cache, forward-backward, budget and prediction", [&] () {
+        cur_pixel_uv.clear();
+        status.clear();
+        optical_flow.TrackFeatures(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+    });
+
+    OpticalFlowType level_major_optical_flow;
+    level_major_optical_flow.options().kPyramidTraversal = FEATURE_TRACKER::PyramidTraversal::kLevelMajor;
+    num_failed += !CheckZeroAllocation(tracker_name + " level major", [&] () {
+        cur_pixel_uv.clear();
+        status.clear();
+        level_major_optical_flow.TrackFeatures(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+    });
+
+    OpticalFlowType pattern_optical_flow;
+    pattern_optical_flow.options().kPatchPattern = FEATURE_TRACKER::PatchPatternType::kDiamond;
+    num_failed += !CheckZeroAllocation(tracker_name + " sparse pattern", [&] () {
+        cur_pixel_uv.clear();
+        status.clear();
+        pattern_optical_flow.TrackFeatures(ref_pyramid, cur_pyramid, ref_pixel_uv, cur_pixel_uv, status);
+    });
+
+    return num_failed;
+}
+
+uint32_t CheckDirectMethod(const ImagePyramid &ref_pyramid,
+                           const ImagePyramid &cur_pyramid,
+                           const std::vector<Vec2> &ref_pixel_uv) {
+    const std::array<float, 4> K = { 300.0f, 300.0f, 0.5f * kProceduralImageCols, 0.5f * kProceduralImageRows };
+    const float depth = 5.0f;
+    std::vector<Vec3> p_w;
+    for (const Vec2 &pixel_uv : ref_pixel_uv) {
+        p_w.emplace_back(Vec3((pixel_uv.x() - K[2]) / K[0], (pixel_uv.y() - K[3]) / K[1], 1.0f) * depth);
+    }
+
+    FEATURE_TRACKER::DirectMethod direct_method;
+    std::vector<Vec2> cur_pixel_uv;
+    std::vector<uint8_t> status;
+    return !CheckZeroAllocation("direct method", [&] () {
+        Quat q_rc = Quat::Identity();
+        Vec3 p_rc = Vec3::Zero();
+        cur_pixel_uv.clear();
+        status.clear();
+        direct_method.TrackFeatures(ref_pyramid, cur_pyramid, K, p_w, ref_pixel_uv, cur_pixel_uv, q_rc, p_rc, status);
+    });
+}
+
+uint32_t CheckDescriptorMatcher(const std::vector<Vec2> &ref_pixel_uv) {
+    std::vector<uint64_t> descriptors_ref(ref_pixel_uv.size());
+    std::vector<uint64_t> descriptors_cur(ref_pixel_uv.size());
+    for (uint32_t i = 0; i < descriptors_ref.size(); ++i) {
+        descriptors_ref[i] = i * 0x9E3779B97F4A7C15ull;
+        descriptors_cur[i] = descriptors_ref[i] ^ 1ull;
+    }
+
+    HammingMatcher matcher;
+    matcher.options().kMaxValidDescriptorDistance = 8.0f;
+    std::vector<Vec2> matched_pixel_uv;
+    std::vector<uint8_t> status;
+    uint32_t num_failed = 0;
+    num_failed += !CheckZeroAllocation("descriptor matcher force", [&] () {
+        status.clear();
+        matcher.ForceMatch(descriptors_ref, descriptors_cur, ref_pixel_uv, matched_pixel_uv, status);
+    });
+    num_failed += !CheckZeroAllocation("descriptor matcher nearby", [&] () {
+        status.clear();
+        matcher.NearbyMatch(descriptors_ref, descriptors_cur, ref_pixel_uv, ref_pixel_uv, matched_pixel_uv, status);
+    });
+    return num_failed;
+}
+
+// Usage : test_zero_allocation
+// Return non-zero if any tracker allocates heap after the first frame.
+int main(int argc, char **argv) {
+    ReportInfo(YELLOW ">> Check heap allocations of trackers in steady state." RESET_COLOR);
+
+    SyntheticFlowGenerator generator;
+    generator.SetProceduralSource(kProceduralImageRows, kProceduralImageCols);
+    SyntheticWarp warp;
+    warp.translation = Vec2(3.3f, -2.1f);
+    generator.Generate(warp);
+    std::vector<Vec2> ref_pixel_uv, gt_cur_pixel_uv;
+    generator.SelectFeatures(kMaxNumberOfFeaturesToTrack, kFeatureBorder, ref_pixel_uv, gt_cur_pixel_uv);
+
+    TestImagePyramid ref_pyramid(generator.ref_image(), kMaxPyramidLevel);
+    TestImagePyramid cur_pyramid(generator.cur_image(), kMaxPyramidLevel);
+
+    const std::vector<FEATURE_TRACKER::OpticalFlowMethod> methods = {
+        FEATURE_TRACKER::OpticalFlowMethod::kInverse,
+        FEATURE_TRACKER::OpticalFlowMethod::kDirect,
+        FEATURE_TRACKER::OpticalFlowMethod::kFast,
+        FEATURE_TRACKER::OpticalFlowMethod::kSse,
+    };
+    std::vector<FEATURE_TRACKER::OpticalFlowMethod> basic_klt_methods = methods;
+    basic_klt_methods.emplace_back(FEATURE_TRACKER::OpticalFlowMethod::kFixedPoint);
+
+    uint32_t num_failed = CheckAllocationHook();
+    num_failed += CheckOpticalFlow<FEATURE_TRACKER::OpticalFlowBasicKlt>("basic_klt", basic_klt_methods, ref_pyramid, cur_pyramid, ref_pixel_uv);
+    num_failed += CheckOpticalFlow<FEATURE_TRACKER::OpticalFlowAffineKlt>("affine_klt", methods, ref_pyramid, cur_pyramid, ref_pixel_uv);
+    num_failed += CheckOpticalFlow<FEATURE_TRACKER::OpticalFlowLssdKlt>("lssd_klt", methods, ref_pyramid, cur_pyramid, ref_pixel_uv);
+    num_failed += CheckDirectMethod(ref_pyramid, cur_pyramid, ref_pixel_uv);
+    num_failed += CheckDescriptorMatcher(ref_pixel_uv);
+
+    ReportInfo("Zero allocation check : " << num_failed << " failed.");
+    return num_failed > 0 ? 1 : 0;
+}